@@ -47,6 +47,7 @@ public:
   void  SetDefaults() const;
   virtual void  Print (std::ostream& o, const char* sep= " ") const;
   virtual void  Print (const char* sep= " ") const { Print (std::cout, sep); }
+  void  PrintSet (std::ostream& o, const char* sep= " ") const;  // only arguments changed from their defaults, each after sep
   void  Usage (const char* prog) const;
   void  ArgHelp (std::ostream& o) const;
 };
@@ -0,0 +1,370 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Benchmarks the RooUnfold package: times response matrix filling, each
+//      unfolding algorithm, each error treatment, and single toys, for a range
+//      of 1D, 2D, and 3D binnings. The training and test samples are toy MC
+//      generated by the RooUnfoldTestHarness classes. Each measurement is
+//      written as one line of comma-separated values, eg.
+//
+//        RooUnfoldBenchmark bins1d=20,40,80 bins2d= bins3d= methods=1,2 output=bench.csv
+//
+//      Columns (header line first):
+//        bench    fill, fillN, fillParallel, train, unfold, errors, runtoy, or toy
+//        dim      number of dimensions
+//        bins     number of bins on each axis
+//        nbins    total number of truth bins
+//        method   unfolding algorithm (RooUnfold::Algorithm name), or "-"
+//        errors   error treatment (RooUnfold::ErrorTreatment name), or "-"
+//        ntoys    number of toys (used by kCovToy, runtoy, and toy)
+//        threads  number of threads requested (0 = all cores)
+//        calls    number of events filled, unfoldings, or toys timed
+//        real     total elapsed time (s)
+//        cpu      total CPU time (s)
+//        percall  elapsed time per call (s)
+//        rate     calls per second
+//
+//==============================================================================
+
+#if !defined(__CINT__) || defined(__MAKECINT__)
+#include <iostream>
+#include <fstream>
+#include <vector>
+
+#include "TH1.h"
+#include "TAxis.h"
+#include "TRandom3.h"
+#include "TStopwatch.h"
+#include "TString.h"
+#include "TObjArray.h"
+#include "TObjString.h"
+#include "TVectorD.h"
+#include "RooUnfold.h"
+#include "RooUnfoldResponse.h"
+#include "RooUnfoldResponseFiller.h"
+#endif
+
+#include "RooUnfoldTestHarness3D.h"
+
+#if !defined(__CINT__) || defined(__MAKECINT__)
+using std::cout;
+using std::cerr;
+using std::endl;
+#endif
+
+class RooUnfoldBenchmarkSuite {
+public:
+  // Parameters
+  Int_t    ntrain, ntest, nfill, ntoys, nthreads, reps, seed, verbose;
+  TString  bins1d, bins2d, bins3d, methods, errors, output;
+
+  // Data
+  Int_t              error;
+  std::ofstream*     file;
+  std::ostream*      out;
+  std::vector<Int_t> methodList, errorList;
+
+  // Constructors
+  RooUnfoldBenchmarkSuite (int argc, const char* const* argv, bool split= false);
+  ~RooUnfoldBenchmarkSuite();
+
+  // Methods and functions
+  void  Parms   (ArgVars& args);
+  Int_t Run();
+  Int_t RunDim  (Int_t dim, Int_t bins);
+  void  Fill    (const RooUnfoldResponse& res, Int_t dim, Int_t bins);
+  void  Unfold  (const RooUnfoldResponse& res, const TH1* meas, Int_t method, Int_t dim, Int_t bins);
+  RooUnfold* New (const RooUnfoldResponse& res, const TH1* meas, Int_t method) const;
+  void  Result  (const char* bench, Int_t dim, Int_t bins, Int_t nbins, Int_t method, Int_t err,
+                 Long64_t calls, TStopwatch& sw);
+  static void        List (const TString& s, std::vector<Int_t>& v);
+  static const char* MethodName (Int_t method);
+  static const char* ErrorName  (Int_t err);
+};
+
+//==============================================================================
+// Benchmark parameters
+//==============================================================================
+
+void RooUnfoldBenchmarkSuite::Parms (ArgVars& args)
+{
+  args.Add ("bins1d",  &bins1d,  "10,20,40,80", "comma-separated list of #bins for 1D tests (empty for none)");
+  args.Add ("bins2d",  &bins2d,  "5,10,20",     "comma-separated list of #bins on each axis for 2D tests");
+  args.Add ("bins3d",  &bins3d,  "3,5,8",       "comma-separated list of #bins on each axis for 3D tests");
+  args.Add ("methods", &methods, "1,2,3,4,5,7", "comma-separated list of unfolding methods (RooUnfold::Algorithm)");
+  args.Add ("errors",  &errors,  "1,2,3",       "comma-separated list of error treatments (1=errors, 2=covariance, 3=toy MC)");
+  args.Add ("ntrain",  &ntrain,  100000, "#events to use for training");
+  args.Add ("ntest",   &ntest,    10000, "#events to use for testing");
+  args.Add ("nfill",   &nfill,   100000, "#events to use for the response fill rate");
+  args.Add ("ntoys",   &ntoys,       50, "#toys for toy MC errors and the toy benchmarks");
+  args.Add ("nthreads",&nthreads,     1, "#threads for toys and parallel filling (0=all cores)");
+  args.Add ("reps",    &reps,         1, "#times to repeat each benchmark");
+  args.Add ("seed",    &seed,         1, "random number seed (use seed=0 for a different seed on each run)");
+  args.Add ("verbose", &verbose,      0, "RooUnfold debug level: -1=errors only, 0=warnings, 1=verbose");
+  args.Add ("output",  &output,      "", "CSV output file (default: standard output)", "");
+}
+
+//==============================================================================
+// Run benchmarks
+//==============================================================================
+
+Int_t RooUnfoldBenchmarkSuite::Run()
+{
+  if (error) return error;
+  List (methods, methodList);
+  List (errors,  errorList);
+  if (output.Length()>0) {
+    file= new std::ofstream (output.Data());
+    if (!*file) {
+      cerr << "could not write to " << output << endl;
+      return 2;
+    }
+    out= file;
+  } else
+    out= &cout;
+  *out << "bench,dim,bins,nbins,method,errors,ntoys,threads,calls,real,cpu,percall,rate" << endl;
+
+  // Histograms created by each test harness have the same names, so don't keep them in a directory
+  TH1::AddDirectory (kFALSE);
+
+  const TString* binLists[3]= { &bins1d, &bins2d, &bins3d };
+  for (Int_t dim= 1; dim<=3; dim++) {
+    std::vector<Int_t> binList;
+    List (*binLists[dim-1], binList);
+    for (size_t i= 0; i<binList.size(); i++) {
+      Int_t err= RunDim (dim, binList[i]);
+      if (err) error= err;
+    }
+  }
+  if (file) file->close();
+  return error;
+}
+
+Int_t RooUnfoldBenchmarkSuite::RunDim (Int_t dim, Int_t bins)
+{
+  // Train and test with the test harness for dimension dim, then run all the benchmarks on its response and measurement
+  TString name, args;
+  name.Form ("RooUnfoldBenchmark%dD", dim);
+  args.Form ("ntx=%d ntrain=%d ntest=%d seed=%d verbose=-1 draw=0", bins, ntrain, ntest, seed);
+  if (dim>=2) args += Form (" nty=%d", bins);
+  if (dim>=3) args += Form (" ntz=%d", bins);
+  RooUnfoldTestHarness* test;
+  if      (dim==3) test= new RooUnfoldTestHarness3D (name, args);
+  else if (dim==2) test= new RooUnfoldTestHarness2D (name, args);
+  else             test= new RooUnfoldTestHarness   (name, args);
+  if (!test->error) test->Init();
+  if (!test->error) test->CheckParms();
+  Int_t err= test->error;
+  if (err) {
+    cerr << name << ": bad parameters " << args << endl;
+    delete test;
+    return err;
+  }
+
+  TString title;
+  title.Form ("Benchmark %dD", dim);
+  test->response= new RooUnfoldResponse ("response", title);
+  TStopwatch sw;
+  sw.Start();
+  Int_t ok= test->Train();
+  sw.Stop();
+  if (!ok || !test->Test()) {
+    cerr << name << ": could not generate training or test samples" << endl;
+    delete test;
+    return 4;
+  }
+  Int_t nbins= test->response->GetNbinsTruth();
+  Result ("train", dim, bins, nbins, -1, -1, test->ntrain, sw);
+
+  Fill (*test->response, dim, bins);
+  for (size_t i= 0; i<methodList.size(); i++)
+    Unfold (*test->response, test->hMeas, methodList[i], dim, bins);
+
+  delete test;
+  return 0;
+}
+
+void RooUnfoldBenchmarkSuite::Fill (const RooUnfoldResponse& res, Int_t dim, Int_t bins)
+{
+  // Time filling nfill events into an empty response with the binning of res: event by event (fill),
+  // all at once (fillN), and with nthreads threads (fillParallel).
+  if (nfill<=0) return;
+  const TH1* htrue= res.Htruth();
+  const TAxis* axes[3]= { htrue->GetXaxis(), htrue->GetYaxis(), htrue->GetZaxis() };
+  std::vector<Double_t> reco (Long64_t(nfill)*dim), truth (Long64_t(nfill)*dim);
+  TRandom3 rnd (seed>0 ? seed+1 : 0);
+  for (Long64_t i= 0, k= 0; i<nfill; i++) {
+    for (Int_t d= 0; d<dim; d++, k++) {
+      Double_t lo= axes[d]->GetXmin(), hi= axes[d]->GetXmax();
+      truth[k]= rnd.Uniform (lo, hi);
+      reco[k]=  truth[k] + rnd.Gaus (0.0, (hi-lo)/axes[d]->GetNbins());
+    }
+  }
+
+  const char* bench[3]= { "fill", "fillN", "fillParallel" };
+  Int_t nbins= res.GetNbinsTruth();
+  for (Int_t mode= 0; mode<3; mode++) {
+    TStopwatch sw;
+    sw.Reset();
+    for (Int_t rep= 0; rep<reps; rep++) {
+      RooUnfoldResponse r (res.GetName(), res.GetTitle());
+      r.Setup (res.Hmeasured(), htrue);
+      const Double_t *x= &reco[0], *t= &truth[0];
+      sw.Start (kFALSE);
+      if (mode==0) {
+        if      (dim==1) for (Int_t i= 0; i<nfill; i++, x++,   t++)   r.Fill (x[0], t[0]);
+        else if (dim==2) for (Int_t i= 0; i<nfill; i++, x+=2, t+=2)  r.Fill (x[0], x[1], t[0], t[1]);
+        else             for (Int_t i= 0; i<nfill; i++, x+=3, t+=3)  r.Fill (x[0], x[1], x[2], t[0], t[1], t[2]);
+      } else if (mode==1)
+        r.FillN (nfill, x, t);
+      else
+        RooUnfoldResponseFiller::FillParallel (r, nfill, x, t, 0, 0, nthreads);
+      sw.Stop();
+    }
+    Result (bench[mode], dim, bins, nbins, -1, -1, Long64_t(nfill)*reps, sw);
+  }
+}
+
+RooUnfold* RooUnfoldBenchmarkSuite::New (const RooUnfoldResponse& res, const TH1* meas, Int_t method) const
+{
+  // New unfolding object with the benchmark settings, or 0 if the method is not available
+  RooUnfold* unfold= RooUnfold::New ((RooUnfold::Algorithm)method, &res, meas, -1e30, "unfold");
+  if (!unfold) return 0;
+  unfold->SetVerbose  (verbose);
+  unfold->SetNToys    (ntoys);
+  unfold->SetNThreads (nthreads);
+  if (seed>0) unfold->SetToySeed (seed);
+  return unfold;
+}
+
+void RooUnfoldBenchmarkSuite::Unfold (const RooUnfoldResponse& res, const TH1* meas, Int_t method, Int_t dim, Int_t bins)
+{
+  // Time the unfolding alone (unfold), each error treatment of an unfolded result (errors),
+  // smearing a toy (runtoy), and smearing and unfolding a toy (toy).
+  Int_t nbins= res.GetNbinsTruth();
+  TStopwatch sw;
+  sw.Reset();
+  for (Int_t rep= 0; rep<reps; rep++) {
+    RooUnfold* unfold= New (res, meas, method);
+    if (!unfold) return;
+    sw.Start (kFALSE);
+    unfold->Vreco();
+    sw.Stop();
+    delete unfold;
+  }
+  Result ("unfold", dim, bins, nbins, method, RooUnfold::kNoError, reps, sw);
+
+  for (size_t ie= 0; ie<errorList.size(); ie++) {
+    RooUnfold::ErrorTreatment err= (RooUnfold::ErrorTreatment)errorList[ie];
+    sw.Reset();
+    for (Int_t rep= 0; rep<reps; rep++) {
+      RooUnfold* unfold= New (res, meas, method);
+      unfold->Vreco();
+      sw.Start (kFALSE);
+      unfold->ErecoV (err);
+      sw.Stop();
+      delete unfold;
+    }
+    Result ("errors", dim, bins, nbins, method, err, reps, sw);
+  }
+
+  if (ntoys<=0) return;
+  RooUnfold* unfold= New (res, meas, method);
+  unfold->Vreco();
+  RooUnfold* toy= unfold->RunToy();
+  toy->Vreco();
+  for (Int_t mode= 0; mode<2; mode++) {
+    sw.Reset();
+    sw.Start (kFALSE);
+    for (Int_t k= 0; k<ntoys*reps; k++) {
+      unfold->RunToy (*toy);
+      if (mode==1) toy->Vreco();
+    }
+    sw.Stop();
+    Result (mode==0 ? "runtoy" : "toy", dim, bins, nbins, method, -1, Long64_t(ntoys)*reps, sw);
+  }
+  delete toy;
+  delete unfold;
+}
+
+void RooUnfoldBenchmarkSuite::Result (const char* bench, Int_t dim, Int_t bins, Int_t nbins, Int_t method, Int_t err,
+                                      Long64_t calls, TStopwatch& sw)
+{
+  // Write one line of results
+  Double_t real= sw.RealTime(), cpu= sw.CpuTime();
+  *out << bench << "," << dim << "," << bins << "," << nbins << ","
+       << MethodName(method) << "," << ErrorName(err) << ","
+       << ntoys << "," << nthreads << "," << calls << ","
+       << real << "," << cpu << ","
+       << (calls>0 ? real/calls : 0.0) << "," << (real>0.0 ? calls/real : 0.0) << endl;
+}
+
+//==============================================================================
+// Utility routines
+//==============================================================================
+
+RooUnfoldBenchmarkSuite::RooUnfoldBenchmarkSuite (int argc, const char* const* argv, bool split)
+  : error(0), file(0), out(&cout)
+{
+  ArgVars args;
+  Parms (args);
+  error= args.SetArgs (argc, argv, split);
+}
+
+RooUnfoldBenchmarkSuite::~RooUnfoldBenchmarkSuite()
+{
+  delete file; file= 0;
+}
+
+void RooUnfoldBenchmarkSuite::List (const TString& s, std::vector<Int_t>& v)
+{
+  // Parse comma-separated list of integers
+  v.clear();
+  TObjArray* tok= s.Tokenize (",");
+  for (Int_t i= 0; i<tok->GetEntriesFast(); i++) {
+    TString t= static_cast<TObjString*>(tok->At(i))->GetString();
+    if (t.IsDigit()) v.push_back (t.Atoi());
+    else cerr << "ignore bad list entry '" << t << "' in '" << s << "'" << endl;
+  }
+  delete tok;
+}
+
+const char* RooUnfoldBenchmarkSuite::MethodName (Int_t method)
+{
+  static const char* const names[]= { "None", "Bayes", "SVD", "BinByBin", "TUnfold", "Invert", "Dagostini", "IDS" };
+  if (method<0 || method>=Int_t(sizeof(names)/sizeof(names[0]))) return "-";
+  return names[method];
+}
+
+const char* RooUnfoldBenchmarkSuite::ErrorName (Int_t err)
+{
+  static const char* const names[]= { "NoError", "Errors", "Covariance", "CovToy" };
+  if (err<0 || err>=Int_t(sizeof(names)/sizeof(names[0]))) return "-";
+  return names[err];
+}
+
+//==============================================================================
+// Routine to run with parameters specified as a string
+//==============================================================================
+
+void RooUnfoldBenchmark (const char* args= "")
+{
+  const char* const argv[]= { "RooUnfoldBenchmark", args };
+  RooUnfoldBenchmarkSuite bench (2, argv, true);
+  bench.Run();
+}
+
+#ifndef __CINT__
+
+//==============================================================================
+// Main program when run stand-alone
+//==============================================================================
+
+int main (int argc, char** argv) {
+  RooUnfoldBenchmarkSuite bench (argc, argv);
+  return bench.Run();
+}
+
+#endif
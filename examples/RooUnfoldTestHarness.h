@@ -55,6 +55,7 @@ public:
   Int_t    method, stage, ftrainx, ftestx, ntx, ntest, ntrain, wpaper, hpaper, regmethod;
   Int_t    ntoyssvd, nmx, onepage, doerror, dim, overflow, addbias, nbPDF, verbose, dodraw, dosys;
   Int_t    ntoys, ploterrors, plotparms, doeff, addfakes, seed, dofit;
+  Int_t    nthreads, toyseed, fillmode, dolookup, sparse, nboot, bootseed, dobatch, incremental;
   Double_t xlo, xhi, mtrainx, wtrainx, btrainx, mtestx, wtestx, btestx, mscalex, bincorr;
   Double_t regparm, effxlo, effxhi, xbias, xsmear, fakexlo, fakexhi, minparm, maxparm, stepsize;
   TString  setname, rootfile;
@@ -82,6 +83,7 @@ public:
 
   // Methods and functions
   virtual void     Parms (ArgVars& args);
+  virtual void     TestParms (ArgVars& args);
   virtual Int_t    Run();
   virtual void     SetupCanvas();
   virtual Int_t    RunTests();
@@ -90,6 +92,8 @@ public:
   virtual Int_t    Test();
   virtual void     SetMeasuredCov();
   virtual Int_t    Unfold();
+  virtual Int_t    CheckBatch();
+  virtual Int_t    CheckLookup();
   virtual void     Fit();
   virtual void     Results();
   virtual void     PlotErrors();
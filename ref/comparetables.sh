@@ -0,0 +1,16 @@
+# Compare the results tables of two RooUnfoldTest outputs, $1 and $2: the bin number, unfolded output,
+# and error of each row must agree within $3 (default 0, ie. as printed).
+# Used by the test/*.sh scripts. Exits non-zero if they differ or either has no results table.
+tol=${3:-0}
+awk '$1 ~ /^[0-9]+$/ && NF>=8 {print $1, $6, $7}' $1 > $1.table
+awk '$1 ~ /^[0-9]+$/ && NF>=8 {print $1, $6, $7}' $2 > $2.table
+if [ ! -s $1.table ] || [ ! -s $2.table ]; then
+  echo "no results table in $1 or $2"
+  exit 1
+fi
+if [ $(wc -l < $1.table) -ne $(wc -l < $2.table) ]; then
+  echo "results tables in $1 and $2 have different numbers of rows"
+  exit 1
+fi
+paste -d' ' $1.table $2.table |
+  awk -v tol=$tol '{d=$2-$5; e=$3-$6; if ($1!=$4 || d>tol || d<-tol || e>tol || e<-tol) {print "bin " $1 ": " $2 " +- " $3 " vs " $5 " +- " $6; bad=1}} END {exit bad}'
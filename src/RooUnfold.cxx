@@ -68,6 +68,18 @@
 <li>For small statistics, this method does not produce useful results.
 <li>The inversion method is included largely to illustrate the necessity of a more effective method of unfolding</ul>
 </ul>
+<p>Thread safety: RooUnfold objects are independent of each other, so different objects (eg. Clone()s sharing the
+same RooUnfoldResponse) can be used in different threads at the same time, once ROOT::EnableThreadSafety() has been called.
+A single object must not be used by more than one thread at once. A shared RooUnfoldResponse is only read, but should
+have RooUnfoldResponse::FillCache() called first, so its cached matrices are not filled concurrently.
+Toys use the random number generator passed to RunToy(), the one set with SetRandom(), or gRandom, in that order,
+or their own streams if SetToySeed() is used; an object that should not share gRandom with other threads needs
+SetRandom() or SetToySeed(). The histograms the unfolding creates for its own use are never added to the current
+directory, and with ROOT 6 the global TH1::AddDirectory setting is not changed (see RooUnfoldNoDirectory).</p>
+<p>Timing: the time and matrix memory of Unfold(), the error calculations, the toys, and RunToy(), per call and in total,
+are available from GetTiming() (see RooUnfoldTiming), and the response matrix cache rebuilds from
+RooUnfoldResponse::GetTiming(). They are printed by Print() with verbose()>=2 or option "timing".
+Compile with -DNOTIMING to remove the instrumentation.
 */
 
 /////////////////////////////////////////////////////////////
@@ -80,6 +92,7 @@
 #include <cmath>
 #include <vector>
 
+#include "TROOT.h"
 #include "TClass.h"
 #include "TMatrixD.h"
 #include "TNamed.h"
@@ -91,10 +104,15 @@
 #include "TDecompSVD.h"
 #include "TDecompChol.h"
 #include "TRandom.h"
+#include "TRandom3.h"
 #include "TMath.h"
 
 #include "RooUnfoldResponse.h"
 #include "RooUnfoldErrors.h"
+#include "RooUnfoldToyEnsemble.h"
+#include "RooUnfoldMatrixFactor.h"
+#include "RooUnfoldNoDirectory.h"
+#include "RooUnfoldThreads.h"
 // Need subclasses just for RooUnfold::New()
 #include "RooUnfoldBayes.h"
 #include "RooUnfoldSvd.h"
@@ -103,9 +121,7 @@
 #ifndef NOTUNFOLD
 #include "RooUnfoldTUnfold.h"
 #endif
-#ifdef HAVE_DAGOSTINI
 #include "RooUnfoldDagostini.h"
-#endif
 #include "RooUnfoldIds.h"
 
 using std::vector;
@@ -168,13 +184,8 @@ RooUnfold* RooUnfold::New (Algorithm alg, const RooUnfoldResponse* res, const TH
       unfold = new RooUnfoldInvert  (res,meas);
       break;
     case kDagostini:
-#ifdef HAVE_DAGOSTINI
       unfold = new RooUnfoldDagostini (res,meas);
       break;
-#else
-      cerr << "RooUnfoldDagostini is not available" << endl;
-      return 0;
-#endif
     case kIDS:
       unfold= new RooUnfoldIds      (res, meas);
       break;
@@ -205,7 +216,10 @@ void RooUnfold::Destroy()
   delete _eMes;
   delete _covMes;
   delete _covL;
+  delete _wgtFactor[0];
+  delete _wgtFactor[1];
   delete _resmine;
+  delete _toys;
 }
 
 RooUnfold::RooUnfold (const RooUnfold& rhs)
@@ -229,6 +243,9 @@ void RooUnfold::CopyData (const RooUnfold& rhs)
   Setup (rhs.response(), rhs.Hmeasured());
   SetVerbose (rhs.verbose());
   SetNToys   (rhs.NToys());
+  SetNThreads(rhs.NThreads());
+  SetToySeed (rhs.ToySeed());
+  SetRandom  (rhs._rnd);
 }
 
 void RooUnfold::Reset()
@@ -242,13 +259,21 @@ void RooUnfold::Init()
   _res= _resmine= 0;
   _vMes= _eMes= 0;
   _covMes= _covL= 0;
+  _covLok= false;
+  _wgtFactor[0]= _wgtFactor[1]= 0;
+  _toys= 0;
   _meas= _measmine= 0;
   _nm= _nt= 0;
   _verbose= 1;
   _overflow= 0;
-  _dosys= _unfolded= _haveCov= _haveCovMes= _fail= _have_err_mat= _haveErrors= _haveWgt= false;
+  _dosys= _unfolded= _haveCov= _haveCovMes= _fail= _have_err_mat= _haveToys= _haveErrors= _haveWgt= false;
   _withError= kDefault;
   _NToys=50;
+  _NThreads= 1;
+  _toySeed= 0;
+  _incremental= false;
+  _rnd= 0;
+  _timing.Reset();
   GetSettings();
 }
 
@@ -266,16 +291,18 @@ void RooUnfold::SetMeasured (const TH1* meas)
   _meas= meas;
   delete _vMes; _vMes= 0;
   delete _eMes; _eMes= 0;
+  // Covariance matrix cached from the errors (not set with SetMeasuredCov)
+  if (!_haveCovMes) {
+    delete _covMes; _covMes= 0;
+  }
 }
 
 void RooUnfold::SetMeasured (const TVectorD& meas, const TVectorD& err)
 {
   //! Set measured distribution and errors. Should be called after setting response matrix.
   if (!_measmine) {
-    Bool_t oldstat= TH1::AddDirectoryStatus();
-    TH1::AddDirectory (kFALSE);
+    RooUnfoldNoDirectory nodir;
     _measmine= (TH1*) _res->Hmeasured()->Clone (GetName());
-    TH1::AddDirectory (oldstat);
     _measmine->Reset();
     _measmine->SetTitle (GetTitle());
   }
@@ -309,6 +336,39 @@ void RooUnfold::SetMeasuredCov (const TMatrixD& cov)
   _haveCovMes= true;
 }
 
+void RooUnfold::SetMeasured (Int_t n, const Double_t* meas, const Double_t* err)
+{
+  //! Set measured distribution and errors from arrays of n elements, which must be the number of measured bins
+  //! (GetNbinsMeasured() of the response, including under/overflows if IncludeOverflow() is set).
+  //! If err=0, the errors are sqrt(|meas|).
+  //! The arrays are only read during the call, so can be eg. NumPy float64 arrays passed from Python without copying.
+  //! Should be called after setting response matrix.
+  if (!_res || n!=_nm || !meas) {
+    cerr << "RooUnfold::SetMeasured: " << n << " measured bins given, but the response has " << _nm << endl;
+    return;
+  }
+  const TVectorD vmeas;
+  vmeas.Use (n, meas);
+  TVectorD verr (n);
+  if (err) verr.SetElements (err);
+  else     for (Int_t i= 0; i<n; i++) verr[i]= sqrt(fabs(meas[i]));
+  SetMeasured (vmeas, verr);
+}
+
+void RooUnfold::SetMeasuredCov (Int_t n, const Double_t* cov)
+{
+  //! Set covariance matrix on measured distribution from an n*n array (row-major, as TMatrixD and NumPy's default),
+  //! where n is the number of measured bins. The array is copied.
+  if (!_res || n!=_nm || !cov) {
+    cerr << "RooUnfold::SetMeasuredCov: " << n << "x" << n << " covariance matrix given, but the response has "
+         << _nm << " measured bins" << endl;
+    return;
+  }
+  const TMatrixD m;
+  m.Use (n, n, cov);
+  SetMeasuredCov (m);
+}
+
 const TMatrixD& RooUnfold::GetMeasuredCov() const
 {
   //! Get covariance matrix on measured distribution.
@@ -386,35 +446,217 @@ void RooUnfold::GetWgt()
 {
   //! Creates weight matrix
   //! This may be overridden if it can be computed directly without the need for inverting the matrix
+  //! The decomposition of _cov is cached (see RooUnfoldMatrixFactor), and also used by Chi2.
   if (!_haveCov) GetCov();
   if (!_haveCov) return;
-  if (!InvertMatrix (_cov, _wgt, "covariance matrix", _verbose)) return;
+  if (!_wgtFactor[0]) _wgtFactor[0]= new RooUnfoldMatrixFactor;
+  if (!_wgtFactor[0]->Has (_cov)) _wgtFactor[0]->Decompose (_cov, "covariance matrix", _verbose);
+  if (!_wgtFactor[0]->GetStatus()) return;
+  _wgt.ResizeTo (_nt, _nt);
+  _wgt= _wgtFactor[0]->GetInverse();
   _haveWgt= true;
 }
 
+const RooUnfoldMatrixFactor* RooUnfold::WgtFactor (ErrorTreatment withError)
+{
+  //! Returns the cached decomposition of the covariance matrix for withError=kCovariance or kCovToy,
+  //! decomposing it if it has changed. Returns 0 if the unfolding or the errors failed, or if
+  //! the weight matrix came from an override of GetWgt (eg. RooUnfoldSvd), which should then be used instead.
+  Int_t i;
+  if (withError==kCovariance) {
+    if (!UnfoldWithErrors (withError, true)) return 0;
+    if (_wgtFactor[0] && _wgtFactor[0]->Has (_cov)) return _wgtFactor[0];
+    return 0;
+  } else if (withError==kCovToy) {
+    if (!UnfoldWithErrors (withError)) return 0;
+    i= 1;
+  } else
+    return 0;
+  if (!_wgtFactor[i]) _wgtFactor[i]= new RooUnfoldMatrixFactor;
+  if (!_wgtFactor[i]->Has (_err_mat)) _wgtFactor[i]->Decompose (_err_mat, "covariance matrix from toys", _verbose);
+  return _wgtFactor[i];
+}
+
 void RooUnfold::GetErrMat()
 {
-  //! Get covariance matrix from the variation of the results in toy MC tests
+  //! Get covariance matrix from the variation of the results in toy MC tests.
+  //! The toys are taken from ToyEnsemble(), so they are shared with RooUnfoldErrors.
   if (_NToys<=1) return;
-  _err_mat.ResizeTo(_nt,_nt);
-  TVectorD xisum (_nt);
-  TMatrixD xijsum(_nt,_nt);
-  for (Int_t k=0; k<_NToys; k++){
-    RooUnfold* unfold= RunToy();
-    const TVectorD& x= unfold->Vreco();
-    for (Int_t i=0; i<_nt;i++){
-      Double_t xi= x[i];
-      xisum[i] += xi;
-      for (Int_t j=0; j<_nt; j++) xijsum(i,j) += xi * x[j];
-    }
-    delete unfold;
+  ToyEnsemble().GetCovariance (_err_mat);
+  _have_err_mat=true;
+}
+
+const RooUnfoldToyEnsemble& RooUnfold::ToyEnsemble (Int_t contents, const TH1* hTrue, ErrorTreatment chi2Error)
+{
+  //! Returns the results of NToys() toy MC unfoldings (see RunToy), which are kept so that the
+  //! kCovToy covariance matrix and the RooUnfoldErrors plots all come from one set of toys.
+  //! contents are RooUnfoldToyEnsemble::Contents flags, specifying what is kept for each toy in
+  //! addition to the running mean and covariance. The toys are only generated again if the
+  //! cached ensemble does not have these contents, or the number of toys, ToySeed(), or the
+  //! unfolding changed. With kChi2, each toy's chi^2 is calculated wrt hTrue using chi2Error.
+  //! The ensemble can also be generated elsewhere, see RunToys() and SetToyEnsemble().
+  //! With IncludeSystematics and bootstrap replicas of the response, each toy uses a different replica,
+  //! so no more toys are run than there are replicas.
+  if (!_toys) _toys= new RooUnfoldToyEnsemble (_nt);
+  Int_t ntoys= _NToys, nrep= (_dosys && _res) ? _res->GetNReplicas() : 0;
+  if (nrep>0 && ntoys>nrep) ntoys= nrep;
+  if (_haveToys && _toys->Has (ntoys, _toySeed, contents, hTrue, chi2Error)) return *_toys;
+  if (ntoys<_NToys)
+    cerr << "RooUnfold: only " << nrep << " bootstrap replicas of the response, so use "
+         << ntoys << " toys instead of " << _NToys << endl;
+  _toys->Setup (_nt, ntoys, _toySeed, contents, hTrue, chi2Error);
+  _haveToys= false;
+  if (ntoys<=0) return *_toys;
+  GenerateToys (0, ntoys, *_toys);
+  _haveToys= true;
+  return *_toys;
+}
+
+Bool_t RooUnfold::RunToys (Int_t first, Int_t last, RooUnfoldToyEnsemble& toys, Int_t contents, const TH1* hTrue, ErrorTreatment chi2Error)
+{
+  //! Run toys first..last-1 into toys, keeping contents (RooUnfoldToyEnsemble::Contents flags) for each toy.
+  //! This allows the toys to be split between jobs: each job writes its RooUnfoldToyEnsemble to a file,
+  //! the files are merged (eg. with hadd), and the result is used with SetToyEnsemble().
+  //! Requires SetToySeed(), so that each toy's random number stream only depends on the seed and
+  //! the toy number. The merged mean and covariance are bit-identical however the toys are split
+  //! (see RooUnfoldToyEnsemble). Ranges starting on multiples of RooUnfoldToyEnsemble::kBlockSize need the least memory.
+  if (!_toySeed) {
+    cerr << "RooUnfold::RunToys: SetToySeed() is required to run a range of toys" << endl;
+    return false;
   }
-  for (Int_t i=0; i<_nt; i++){
-    for (Int_t j=0; j<_nt; j++){
-      _err_mat(i,j)= (xijsum(i,j) - (xisum[i]*xisum[j])/_NToys) / (_NToys-1);
+  if (first<0 || last<first) {
+    cerr << "RooUnfold::RunToys: bad toy range " << first << "-" << last-1 << endl;
+    return false;
+  }
+  Int_t nrep= (_dosys && _res) ? _res->GetNReplicas() : 0;
+  if (nrep>0 && last>nrep) {
+    cerr << "RooUnfold::RunToys: toy range " << first << "-" << last-1 << " needs more than the "
+         << nrep << " bootstrap replicas of the response" << endl;
+    return false;
+  }
+  toys.Setup (_nt, last-first, _toySeed, contents, hTrue, chi2Error, first);
+  GenerateToys (first, last, toys);
+  return true;
+}
+
+Bool_t RooUnfold::SetToyEnsemble (const RooUnfoldToyEnsemble& toys, const TH1* hTrue)
+{
+  //! Use toys, eg. merged from the results of RunToys() in different jobs, as the ensemble of toys for
+  //! this unfolding. Sets NToys() and ToySeed() from toys. hTrue is the truth histogram used by RunToys
+  //! for the chi^2, which is not saved in files. The unfolding settings must be the same as those used for the toys.
+  if (toys.GetSize()!=_nt || toys.GetFirst()!=0 || toys.GetEntries()<=0 || toys.GetEntries()!=toys.GetNToys()) {
+    cerr << "RooUnfold::SetToyEnsemble: toys " << toys.GetFirst() << "-" << toys.GetFirst()+toys.GetEntries()-1
+         << " of " << toys.GetSize() << " bins are not a complete ensemble for " << _nt << " bins" << endl;
+    return false;
+  }
+  SetToySeed (toys.GetSeed());
+  SetNToys   (toys.GetEntries());
+  if (!_toys) _toys= new RooUnfoldToyEnsemble (_nt);
+  *_toys= toys;
+  if (toys.GetContents() & RooUnfoldToyEnsemble::kChi2) _toys->SetTruth (hTrue);
+  _have_err_mat= false;
+  _haveToys= true;
+  return true;
+}
+
+void RooUnfold::GenerateToys (Int_t first, Int_t last, RooUnfoldToyEnsemble& toys)
+{
+  //! Run toys first..last-1 into toys, which has been set up with the toy seed.
+  //! With SetNThreads(n>1) the toys are shared between n threads, each filling its own
+  //! ensemble, which are merged in order at the end. With more than one thread, or if SetToySeed()
+  //! was used, each toy gets its own random number stream (see RooUnfoldThreads::ToyStreamSeed), so the toys
+  //! are the same whatever the number of threads.
+  //! The time of the ensemble, and of each toy (summed over threads), are added to GetTiming().
+  ROOUNFOLD_TIMER (timer, _timing, kToys);
+  UInt_t seed= toys.GetSeed();
+#ifdef ROOUNFOLD_THREADS
+  Int_t nthreads= ToyThreads (last-first);
+  if (!seed && nthreads>1) seed= GetRandom()->Integer(kMaxUInt) + 1;
+  if (nthreads>1) {
+    // Fill lazily-cached quantities now, so the threads only read shared state.
+    Vmeasured();
+    Emeasured();
+    if (_haveCovMes) GetMeasuredCovL();
+    _res->FillCache();
+    RooUnfoldThreads::EnableThreadSafety();
+    vector<RooUnfoldToyEnsemble> parts (nthreads);
+    vector<std::thread> threads;
+    for (Int_t t= 0; t<nthreads; t++) {
+      Int_t tfirst= ToySplit (first, last, t,   nthreads);
+      Int_t tlast=  ToySplit (first, last, t+1, nthreads);
+      parts[t].Setup (toys.GetSize(), tlast-tfirst, toys.GetSeed(), toys.GetContents(), toys.GetTruth(), toys.GetChi2Error(), tfirst);
+      threads.push_back (std::thread (&RooUnfold::ToySums, this, tfirst, tlast, seed,
+                                      std::ref(parts[t])));
+    }
+    for (Int_t t= 0; t<nthreads; t++) {
+      threads[t].join();
+      toys.Merge (parts[t]);
+      parts[t].Clear();
     }
+  } else
+#endif
+  ToySums (first, last, seed, toys);
+  _timing.Merge (toys.GetTiming());
+  ROOUNFOLD_TIMER_BYTES (timer, toys.GetBytes());
+}
+
+void RooUnfold::ToySums (Int_t first, Int_t last, UInt_t seed, RooUnfoldToyEnsemble& toys) const
+{
+  //! Run toys first..last-1, adding the unfolded results (and with toys.GetContents() flags, their
+  //! errors and chi^2) to toys.
+  //! If seed is non-zero, each toy uses its own random number stream, otherwise GetRandom() is used.
+  //! The first toy's unfolding object is reused as the workspace for the others.
+  //! The time of each toy, and of its RunToy(), are added to toys.Timing().
+  const Int_t contents= toys.GetContents();
+  TRandom3 rnd;
+  RooUnfold* unfold= 0;
+  TVectorD err;
+  for (Int_t k=first; k<last; k++){
+    ROOUNFOLD_TIMER (timer, toys.Timing(), kToy);
+    if (seed) rnd.SetSeed (RooUnfoldThreads::ToyStreamSeed (seed, k));
+    {
+      ROOUNFOLD_TIMER (runTimer, toys.Timing(), kRunToy);
+      if (!unfold) unfold= RunToy (seed ? &rnd : 0, k);
+      else                 RunToy (*unfold, seed ? &rnd : 0, k);
+    }
+    Double_t chi2= 0.0;
+    if (contents & RooUnfoldToyEnsemble::kChi2)   chi2= unfold->Chi2 (toys.GetTruth(), ErrorTreatment(toys.GetChi2Error()));
+    if (contents & (RooUnfoldToyEnsemble::kErrors|RooUnfoldToyEnsemble::kErrorSums)) unfold->ErecoV (err);
+    toys.Add (unfold->Vreco(), &err, chi2);
+    ROOUNFOLD_TIMER_BYTES (timer, unfold->MatrixBytes());
   }
-  _have_err_mat=true;
+  delete unfold;
+}
+
+Int_t RooUnfold::ToySplit (Int_t first, Int_t last, Int_t t, Int_t nthreads)
+{
+  //! First toy for thread t of nthreads sharing toys first..last-1. The split is rounded to a multiple of
+  //! RooUnfoldToyEnsemble::kBlockSize where possible, so the threads' ensembles need not keep any unfolded vectors.
+  Int_t k= first + Int_t ((Long64_t(last-first)*t)/nthreads);
+  if (t<=0 || t>=nthreads) return k;
+  const Int_t bs= RooUnfoldToyEnsemble::kBlockSize;
+  Int_t kr= ((k+bs/2)/bs)*bs;
+  return (kr>first && kr<last) ? kr : k;
+}
+
+Int_t RooUnfold::ToyReplica (TRandom* rnd, Int_t replica) const
+{
+  //! Bootstrap replica of the response to use for toy number replica, or a random one if replica<0.
+  //! Toys beyond the number of replicas would reuse them, so ToyEnsemble() and RunToys() do not run those.
+  Int_t n= _res->GetNReplicas();
+  return replica>=0 ? replica%n : Int_t (rnd->Integer(n));
+}
+
+Int_t RooUnfold::ToyThreads (Int_t ntoys) const
+{
+  //! Number of threads to use for ntoys toys: limited by the number of toys,
+  //! and 1 if threads are not available or the method is not thread-safe.
+  Int_t nthreads= RooUnfoldThreads::NThreads (_NThreads, ntoys);
+  if (nthreads>1 && !ThreadSafe()) {
+    if (_verbose>=1) cout << ClassName() << " toys cannot run in parallel - use 1 thread" << endl;
+    nthreads= 1;
+  }
+  return nthreads;
 }
 
 Bool_t RooUnfold::UnfoldWithErrors (ErrorTreatment withError, bool getWeights)
@@ -434,7 +676,11 @@ Bool_t RooUnfold::UnfoldWithErrors (ErrorTreatment withError, bool getWeights)
       if (rmeas->GetDimension()>=3) cerr << "x" << rmeas->GetNbinsZ();
       cerr << "-bin measured histogram from RooUnfoldResponse" << endl;
     }
-    Unfold();
+    {
+      ROOUNFOLD_TIMER (timer, _timing, kUnfold);
+      Unfold();
+      ROOUNFOLD_TIMER_BYTES (timer, MatrixBytes());
+    }
     if (!_unfolded) {
       _fail= true;
       return false;
@@ -443,20 +689,20 @@ Bool_t RooUnfold::UnfoldWithErrors (ErrorTreatment withError, bool getWeights)
   Bool_t ok;
   _withError= withError;
   if (getWeights && (withError==kErrors || withError==kCovariance)) {
-      if   (!_haveWgt)      GetWgt();
+      if   (!_haveWgt)      {ROOUNFOLD_TIMER (timer, _timing, kWgt);    GetWgt();    ROOUNFOLD_TIMER_BYTES (timer, MatrixBytes());}
       ok= _haveWgt;
   } else {
     switch (withError) {
     case kErrors:
-      if   (!_haveErrors)   GetErrors();
+      if   (!_haveErrors)   {ROOUNFOLD_TIMER (timer, _timing, kErrors); GetErrors(); ROOUNFOLD_TIMER_BYTES (timer, MatrixBytes());}
       ok= _haveErrors;
       break;
     case kCovariance:
-      if   (!_haveCov)      GetCov();
+      if   (!_haveCov)      {ROOUNFOLD_TIMER (timer, _timing, kCov);    GetCov();    ROOUNFOLD_TIMER_BYTES (timer, MatrixBytes());}
       ok= _haveCov;
       break;
     case kCovToy:
-      if   (!_have_err_mat) GetErrMat();
+      if   (!_have_err_mat) {ROOUNFOLD_TIMER (timer, _timing, kErrMat); GetErrMat(); ROOUNFOLD_TIMER_BYTES (timer, MatrixBytes());}
       ok= _have_err_mat;
       break;
     default:
@@ -489,12 +735,10 @@ Double_t RooUnfold::Chi2(const TH1* hTrue,ErrorTreatment DoChi2)
 
     Double_t chi2= 0.0;
     if (DoChi2==kCovariance || DoChi2==kCovToy) {
-        TMatrixD wgt= Wreco(DoChi2);
+        const RooUnfoldMatrixFactor* wgt= WgtFactor(DoChi2);
         if (_fail) return -1.0;
-        TMatrixD resmat(1,_nt), chi2mat(1,1);
-        TMatrixDRow(resmat,0)= res;
-        ABAT (resmat, wgt, chi2mat);
-        chi2= chi2mat(0,0);
+        if (wgt) chi2= wgt->Chi2 (res);
+        else     chi2= ABAT (res, _wgt);
     } else {
         TVectorD ereco= ErecoV(DoChi2);
         if (_fail) return -1.0;
@@ -685,24 +929,31 @@ TH1* RooUnfold::Hreco (ErrorTreatment withError)
     3: Errors from the square root of the covariance matrix from the variation of the results in toy MC tests
     */
   TH1* reco= (TH1*) _res->Htruth()->Clone(GetName());
-  reco->Reset();
   reco->SetTitle (GetTitle());
+  Hreco (*reco, withError);
+  return reco;
+}
+
+Bool_t RooUnfold::Hreco (TH1& reco, ErrorTreatment withError)
+{
+  //! Fills reco (which must have the binning of the truth histogram) with the reconstructed distribution,
+  //! as Hreco(withError), without making a new histogram. Returns false, leaving reco empty, if unfolding failed.
+  reco.Reset();
   if (!UnfoldWithErrors (withError)) withError= kNoError;
-  if (!_unfolded) return reco;
+  if (!_unfolded) return false;
 
   for (Int_t i= 0; i < _nt; i++) {
-    Int_t j= RooUnfoldResponse::GetBin (reco, i, _overflow);
-    reco->SetBinContent (j,             _rec(i));
+    Int_t j= RooUnfoldResponse::GetBin (&reco, i, _overflow);
+    reco.SetBinContent (j,             _rec(i));
     if        (withError==kErrors){
-      reco->SetBinError (j, sqrt (fabs (_variances(i))));
+      reco.SetBinError (j, sqrt (fabs (_variances(i))));
     } else if (withError==kCovariance){
-      reco->SetBinError (j, sqrt (fabs (_cov(i,i))));
+      reco.SetBinError (j, sqrt (fabs (_cov(i,i))));
     } else if (withError==kCovToy){
-      reco->SetBinError (j, sqrt (fabs (_err_mat(i,i))));
+      reco.SetBinError (j, sqrt (fabs (_err_mat(i,i))));
     }
   }
-
-  return reco;
+  return true;
 }
 
 void RooUnfold::GetSettings()
@@ -738,32 +989,38 @@ Double_t RooUnfold::GetDefaultParm() const
     return _defaultparm;
 }
 
-RooUnfold* RooUnfold::RunToy() const
+TRandom* RooUnfold::GetRandom() const
+{
+  //! Random number generator used for toys: the one set with SetRandom, or gRandom
+  return _rnd ? _rnd : gRandom;
+}
+
+RooUnfold* RooUnfold::RunToy (TRandom* rnd, Int_t replica) const
 {
   //! Returns new RooUnfold object with smeared measurements and
   //! (if IncludeSystematics) response matrix for use as a toy.
   //! Use multiple toys to find spread of unfolding results.
+  //! The smearing uses the random number generator rnd, or GetRandom() if not specified.
+  //! If the response has bootstrap replicas (RooUnfoldResponse::SetBootstrap), IncludeSystematics
+  //! uses replica number replica (modulo the number of replicas; chosen with rnd if replica<0)
+  //! instead of smearing the response matrix.
+  if (!rnd) rnd= GetRandom();
   TString name= GetName();
   name += "_toy";
   RooUnfold* unfold = Clone(name);
 
   //! Make new smeared response matrix
-  if (_dosys) unfold->SetResponse (_res->RunToy(), kTRUE);
+  if (_dosys) {
+    if (_res->GetNReplicas()>0) unfold->SetResponse (_res->RunReplica (ToyReplica (rnd, replica)), kTRUE);
+    else                        unfold->SetResponse (_res->RunToy(rnd), kTRUE);
+  }
   if (_dosys==2) return unfold;
 
   if (_haveCovMes) {
 
-    //! _covL is a lower triangular matrix for which the covariance matrix, V = _covL * _covL^T.
-    if (!_covL) {
-      TDecompChol c(*_covMes);
-      c.Decompose();
-      TMatrixD U(c.GetU());
-      _covL= new TMatrixD (TMatrixD::kTransposed, U);
-      if (_verbose>=2) RooUnfoldResponse::PrintMatrix(*_covL,"decomposed measurement covariance matrix");
-    }
     TVectorD newmeas(_nm);
-    for (Int_t i= 0; i<_nm; i++) newmeas[i]= gRandom->Gaus(0.0,1.0);
-    newmeas *= *_covL;
+    for (Int_t i= 0; i<_nm; i++) newmeas[i]= rnd->Gaus(0.0,1.0);
+    newmeas *= GetMeasuredCovL();
     newmeas += Vmeasured();
     unfold->SetMeasured(newmeas,*_covMes);
 
@@ -773,7 +1030,7 @@ RooUnfold* RooUnfold::RunToy() const
     const TVectorD& err= Emeasured();
     for (Int_t i= 0; i<_nm; i++) {
       Double_t e= err[i];
-      if (e>0.0) newmeas[i] += gRandom->Gaus(0,e);
+      if (e>0.0) newmeas[i] += rnd->Gaus(0,e);
     }
     unfold->SetMeasured(newmeas,err);
 
@@ -781,8 +1038,179 @@ RooUnfold* RooUnfold::RunToy() const
   return unfold;
 }
 
-void RooUnfold::Print(Option_t* /*opt*/) const
+void RooUnfold::RunToy (RooUnfold& toy, TRandom* rnd, Int_t replica) const
+{
+  //! Re-use toy, a RooUnfold object previously returned by RunToy(), for a new toy.
+  //! The measurements (and, if IncludeSystematics, response matrix) are smeared again
+  //! in place, so the toy's histograms, vectors, and matrices are not reallocated.
+  //! Uses the same random numbers as RunToy(rnd,replica) would.
+  if (!rnd) rnd= GetRandom();
+  if (_dosys && _res->GetNReplicas()>0) {
+    Int_t r= ToyReplica (rnd, replica);
+    if (toy._resmine) _res->RunReplica (*toy._resmine, r);
+    else              toy.SetResponse (_res->RunReplica(r), kTRUE);
+  } else if (_dosys) {
+    if (toy._resmine) _res->RunToy (*toy._resmine, rnd);
+    else              toy.SetResponse (_res->RunToy(rnd), kTRUE);
+  }
+  toy.ClearUnfolding (_dosys);
+  if (_dosys==2) return;
+
+  if (!toy._measmine) {    // measured histogram not owned, so first time a measurement was smeared
+    toy.SetMeasured (Vmeasured(), Emeasured());
+    if (_haveCovMes) toy.SetMeasuredCov (*_covMes);
+  }
+  toy.Vmeasured();
+  TVectorD& newmeas= *toy._vMes;
+
+  if (_haveCovMes) {
+
+    for (Int_t i= 0; i<_nm; i++) newmeas[i]= rnd->Gaus(0.0,1.0);
+    newmeas *= GetMeasuredCovL();
+    newmeas += Vmeasured();
+
+  } else {
+
+    newmeas= Vmeasured();
+    const TVectorD& err= Emeasured();
+    for (Int_t i= 0; i<_nm; i++) {
+      Double_t e= err[i];
+      if (e>0.0) newmeas[i] += rnd->Gaus(0,e);
+    }
+
+  }
+  for (Int_t i= 0; i<_nm; i++)
+    toy._measmine->SetBinContent (RooUnfoldResponse::GetBin (toy._measmine, i, _overflow), newmeas[i]);
+}
+
+Bool_t RooUnfold::UnfoldBatch (const TMatrixD& meas, TMatrixD& reco, const TMatrixD* err, std::vector<TMatrixD>* cov)
+{
+  //! Unfold each column of meas (GetNbinsMeasured() rows, one column per measured distribution, eg. systematic
+  //! variations or data-taking periods) with this object's response and settings. The results are returned in the
+  //! columns of reco, which is resized to GetNbinsTruth() x meas.GetNcols(). If cov is specified, it is filled
+  //! with the covariance matrix of each result (as Ereco(kCovariance)).
+  //! err, if specified, gives the measurement errors in the same layout as meas. Otherwise the errors (or
+  //! covariance matrix) of this object's measured distribution are used for every column.
+  //! The work that depends only on the response is done once for the whole batch: RooUnfoldInvert and
+  //! RooUnfoldBinByBin unfold all the columns with a single matrix product, and RooUnfoldBayes does the iterations for all
+  //! the columns together. Other methods unfold the columns in turn with a single copy of this object, keeping its
+  //! response workspace, as for the toys. This object's own measured distribution and result are not changed.
+  //! In incremental mode (SetIncremental), the columns are unfolded in turn as successive updates, as with
+  //! UpdateMeasured(), so each starts from the result of the previous column, and the first from this object's result.
+  //! Returns false if any column could not be unfolded (its result is then left as zero).
+  if (!BatchSetup (meas, reco, err, cov, kTRUE)) return kFALSE;
+  TString name= GetName();
+  name += "_batch";
+  RooUnfold* unfold= Clone (name);
+  unfold->IncludeSystematics (_dosys);
+  unfold->SetIncremental (_incremental);
+  if (!err && _haveCovMes) unfold->SetMeasuredCov (*_covMes);
+  const TVectorD nominalErr= err ? TVectorD(_nm) : Emeasured();
+  TVectorD v(_nm), e(nominalErr);
+  Bool_t ok= kTRUE;
+  for (Int_t b= 0, nb= meas.GetNcols(); b<nb; b++) {
+    for (Int_t i= 0; i<_nm; i++) {
+      v[i]= meas(i,b);
+      if (err) e[i]= (*err)(i,b);
+    }
+    unfold->SetMeasured (v, e);
+    unfold->ClearUnfolding (kFALSE);
+    if (!unfold->UnfoldWithErrors (cov ? kCovariance : kNoError)) {
+      if (_verbose>=1) cerr << "Unfolding of measurement " << b << " failed" << endl;
+      ok= kFALSE;
+      continue;
+    }
+    for (Int_t i= 0; i<_nt; i++) reco(i,b)= unfold->_rec[i];
+    if (cov) (*cov)[b]= unfold->_cov;
+  }
+  delete unfold;
+  return ok;
+}
+
+Bool_t RooUnfold::BatchSetup (const TMatrixD& meas, TMatrixD& reco, const TMatrixD* err, std::vector<TMatrixD>* cov,
+                              Bool_t needErrors) const
+{
+  //! Check the arguments of UnfoldBatch and size the results. needErrors specifies whether the errors
+  //! are needed to unfold, so must be taken from the measured distribution if err is not specified.
+  if (!_res) {
+    cerr << ClassName() << "::UnfoldBatch: no response matrix" << endl;
+    return kFALSE;
+  }
+  if (meas.GetNrows() != _nm || (err && (err->GetNrows() != _nm || err->GetNcols() != meas.GetNcols()))) {
+    cerr << ClassName() << "::UnfoldBatch: measurements should have " << _nm << " rows, not " << meas.GetNrows() << endl;
+    return kFALSE;
+  }
+  if (needErrors && !err && !_meas) {
+    cerr << ClassName() << "::UnfoldBatch: no measurement errors given, and no measured distribution to take them from" << endl;
+    return kFALSE;
+  }
+  const Int_t nb= meas.GetNcols();
+  reco.ResizeTo (_nt, nb);
+  reco.Zero();
+  if (cov) cov->assign (nb, TMatrixD (_nt, _nt));
+  return kTRUE;
+}
+
+void RooUnfold::BatchVariance (const TMatrixD& err, Int_t b, TVectorD& var) const
+{
+  //! Measurement variances of column b of the UnfoldBatch errors
+  var.ResizeTo (_nm);
+  for (Int_t i= 0; i<_nm; i++) var[i]= err(i,b)*err(i,b);
+}
+
+void RooUnfold::ClearUnfolding (Bool_t)
 {
+  //! Forget the unfolded result and errors, ready to unfold again after the measured distribution
+  //! has been changed in place (eg. by RunToy(toy)). newResponse specifies whether the response matrix
+  //! contents were also changed. Subclasses should override this to drop any results that depend on
+  //! the measured values (or the response), but keep workspace that can be reused.
+  _unfolded= _haveCov= _haveWgt= _haveErrors= _have_err_mat= _haveToys= _fail= false;
+}
+
+void RooUnfold::UpdateMeasured (const TH1* meas)
+{
+  //! Use an updated measured distribution: meas, or the same histogram (meas=0) with new contents, eg. more entries.
+  //! Unlike SetMeasured(), this also forgets the previous result, so the next request unfolds again. Workspace that
+  //! only depends on the response is kept, and in incremental mode (see SetIncremental) the previous result may be used.
+  SetMeasured (meas ? meas : _meas);
+  ClearUnfolding (kFALSE);
+}
+
+void RooUnfold::UpdateResponse()
+{
+  //! Use the updated contents of the response matrix, eg. after RooUnfoldResponse::Add,
+  //! which must have the same binning. Forgets the previous result and everything calculated from the response.
+  ClearUnfolding (kTRUE);
+}
+
+const TMatrixD& RooUnfold::GetMeasuredCovL() const
+{
+  //! Lower triangular matrix, L, for which the measurement covariance matrix, V = L * L^T.
+  //! Cached in _covL for use in RunToy.
+  if (!_covL) {
+    TDecompChol c(*_covMes);
+    _covLok= c.Decompose();
+    if (!_covLok && _verbose>=1) cerr << "Warning: Cholesky decomposition of measurement covariance matrix failed" << endl;
+    TMatrixD U(c.GetU());
+    _covL= new TMatrixD (TMatrixD::kTransposed, U);
+    if (_verbose>=2) RooUnfoldResponse::PrintMatrix(*_covL,"decomposed measurement covariance matrix");
+  }
+  return *_covL;
+}
+
+Bool_t RooUnfold::MeasuredCovLValid() const
+{
+  //! True if a measurement covariance matrix was set (SetMeasuredCov) and GetMeasuredCovL() is its Cholesky factor.
+  //! False if the matrix is not positive definite, so the decomposition failed.
+  if (!_haveCovMes || !_covMes) return false;
+  GetMeasuredCovL();
+  return _covLok;
+}
+
+void RooUnfold::Print(Option_t* opt) const
+{
+  //! Print the unfolding settings. With verbose()>=2 or option "timing", also print the time and
+  //! matrix memory of each phase of this unfolding and of its response matrix cache (see GetTiming).
   cout << ClassName() << "::" << GetName() << " \"" << GetTitle()
        << "\", regularisation parameter=" << GetRegParm() << ", ";
   if (_haveCovMes) cout << "with measurement covariance, ";
@@ -808,6 +1236,25 @@ void RooUnfold::Print(Option_t* /*opt*/) const
   cout << " bins truth";
   if (_overflow) cout << " including overflows";
   cout << endl;
+  if (_verbose>=2 || TString(opt).Contains("timing")) {
+    _timing.Print (cout, Form("%s::%s", ClassName(), GetName()));
+    _res->GetTiming().Print (cout, Form("RooUnfoldResponse::%s", _res->GetName()));
+  }
+}
+
+Long64_t RooUnfold::MatrixBytes() const
+{
+  //! Memory held in the vectors and matrices of this unfolding, including the toy ensemble and
+  //! the cache of an owned response (eg. a toy's smeared response). Subclasses add their workspace.
+  Long64_t n= RooUnfoldTiming::Bytes (_rec) + RooUnfoldTiming::Bytes (_cov) + RooUnfoldTiming::Bytes (_wgt)
+            + RooUnfoldTiming::Bytes (_variances) + RooUnfoldTiming::Bytes (_err_mat);
+  if (_vMes)    n += RooUnfoldTiming::Bytes (*_vMes);
+  if (_eMes)    n += RooUnfoldTiming::Bytes (*_eMes);
+  if (_covMes)  n += RooUnfoldTiming::Bytes (*_covMes);
+  if (_covL)    n += RooUnfoldTiming::Bytes (*_covL);
+  if (_toys)    n += _toys->GetBytes();
+  if (_resmine) n += _resmine->CacheBytes();
+  return n;
 }
 
 TMatrixD RooUnfold::CutZeros(const TMatrixD& ereco)
@@ -851,15 +1298,28 @@ TMatrixD RooUnfold::Ereco(ErrorTreatment withError)
     3: Errors from the covariance matrix from the variation of the results in toy MC tests
     */
     TMatrixD Ereco_m(_nt,_nt);
-    if (!UnfoldWithErrors (withError)) return Ereco_m;
+    Ereco (Ereco_m, withError);
+    return Ereco_m;
+}
+
+Bool_t RooUnfold::Ereco(TMatrixD& Ereco_m, ErrorTreatment withError)
+{
+    //!Fills Ereco_m with the covariance matrix, as Ereco(withError). Returns false, leaving it zero, if unfolding failed.
+    Ereco_m.ResizeTo(_nt,_nt);
+    if (!UnfoldWithErrors (withError)) {
+      Ereco_m.Zero();
+      return false;
+    }
 
     switch(withError){
       case kNoError:
+        Ereco_m.Zero();
         for (int i=0; i<_nt; i++){
           Ereco_m(i,i)=_rec(i);
         }
         break;
       case kErrors:
+        Ereco_m.Zero();
         for (int i=0; i<_nt;i++){
           Ereco_m(i,i)=_variances(i);
         }
@@ -871,9 +1331,10 @@ TMatrixD RooUnfold::Ereco(ErrorTreatment withError)
         Ereco_m=_err_mat;
         break;
       default:
+        Ereco_m.Zero();
         cerr<<"Error, unrecognised error method= "<<withError<<endl;
     }
-    return Ereco_m;
+    return true;
 }
 
 TVectorD RooUnfold::ErecoV(ErrorTreatment withError)
@@ -885,7 +1346,18 @@ TVectorD RooUnfold::ErecoV(ErrorTreatment withError)
     3: Errors from the covariance matrix from the variation of the results in toy MC tests
     */
     TVectorD Ereco_v(_nt);
-    if (!UnfoldWithErrors (withError)) return Ereco_v;
+    ErecoV (Ereco_v, withError);
+    return Ereco_v;
+}
+
+Bool_t RooUnfold::ErecoV(TVectorD& Ereco_v, ErrorTreatment withError)
+{
+    //!Fills Ereco_v with the unfolding errors, as ErecoV(withError). Returns false, leaving it zero, if unfolding failed.
+    Ereco_v.ResizeTo(_nt);
+    if (!UnfoldWithErrors (withError)) {
+      Ereco_v.Zero();
+      return false;
+    }
 
     switch(withError){
       case kNoError:
@@ -909,23 +1381,37 @@ TVectorD RooUnfold::ErecoV(ErrorTreatment withError)
         }
         break;
       default:
+        Ereco_v.Zero();
         cerr<<"Error, unrecognised error method= "<<withError<<endl;
     }
-    return Ereco_v;
+    return true;
 }
 
 TMatrixD RooUnfold::Wreco(ErrorTreatment withError)
 {
     TMatrixD Wreco_m(_nt,_nt);
-    if (!UnfoldWithErrors (withError, true)) return Wreco_m;
+    Wreco (Wreco_m, withError);
+    return Wreco_m;
+}
+
+Bool_t RooUnfold::Wreco(TMatrixD& Wreco_m, ErrorTreatment withError)
+{
+    //!Fills Wreco_m with the weight matrix, as Wreco(withError). Returns false, leaving it zero, if unfolding failed.
+    Wreco_m.ResizeTo(_nt,_nt);
+    if (!UnfoldWithErrors (withError, true)) {
+      Wreco_m.Zero();
+      return false;
+    }
 
     switch(withError){
       case kNoError:
+        Wreco_m.Zero();
         for (int i=0; i<_nt; i++){
           if (_rec(i)!=0.0) Wreco_m(i,i)=1.0/_rec(i);
         }
         break;
       case kErrors:
+        Wreco_m.Zero();
         for (int i=0; i<_nt;i++){
           Wreco_m(i,i)=_wgt(i,i);
         }
@@ -934,12 +1420,34 @@ TMatrixD RooUnfold::Wreco(ErrorTreatment withError)
         Wreco_m=_wgt;
         break;
       case kCovToy:
-        InvertMatrix (_err_mat, Wreco_m, "covariance matrix from toys", _verbose);
+        Wreco_m= WgtFactor(withError)->GetInverse();
         break;
       default:
+        Wreco_m.Zero();
         cerr<<"Error, unrecognised error method= "<<withError<<endl;
     }
-    return Wreco_m;
+    return true;
+}
+
+const TMatrixD& RooUnfold::CovReco()
+{
+    //!Returns the covariance matrix given by the unfolding, calculating it if necessary, without copying
+    if (!UnfoldWithErrors (kCovariance)) _cov.ResizeTo(0,0);
+    return _cov;
+}
+
+const TMatrixD& RooUnfold::CovRecoToy()
+{
+    //!Returns the covariance matrix from the toy MC tests, calculating it if necessary, without copying
+    if (!UnfoldWithErrors (kCovToy)) _err_mat.ResizeTo(0,0);
+    return _err_mat;
+}
+
+const TMatrixD& RooUnfold::WgtReco()
+{
+    //!Returns the weight matrix given by the unfolding, calculating it if necessary, without copying
+    if (!UnfoldWithErrors (kCovariance, true)) _wgt.ResizeTo(0,0);
+    return _wgt;
 }
 
 TH1D* RooUnfold::HistNoOverflow (const TH1* h, Bool_t overflow)
@@ -1064,24 +1572,150 @@ TH1* RooUnfold::Resize (TH1* h, Int_t nx, Int_t ny, Int_t nz)
   return h;
 }
 
-TMatrixD& RooUnfold::ABAT (const TMatrixD& a, const TMatrixD& b, TMatrixD& c)
+static inline void ABATColumn (const Double_t* a, Int_t m, Int_t n, const Double_t* d, Int_t j, Double_t* c, Bool_t add)
 {
-  //! Fills \f$C\f$ such that \f$C = A * B * A^T\f$. Note that \f$C\f$ cannot be the same object as \f$A\f$.
-  TMatrixD d (b, TMatrixD::kMultTranspose, a);
-  c.Mult (a, d);
+  // Lower triangle of column j of C=A*D^T, where d is row j of D: c(i,j) = sum_k a(i,k)*d(k) for i>=j
+  for (Int_t i= j; i<m; i++) {
+    const Double_t* ai= a+i*n;
+    Double_t s= 0.0;
+    for (Int_t k= 0; k<n; k++) s += ai[k]*d[k];
+    if (add) c[i*m+j] += s;
+    else     c[i*m+j]  = s;
+  }
+}
+
+static inline void ABATMirror (Double_t* c, Int_t m)
+{
+  // Copy lower triangle of C into the upper triangle
+  for (Int_t i= 1; i<m; i++)
+    for (Int_t j= 0; j<i; j++)
+      c[j*m+i]= c[i*m+j];
+}
+
+TMatrixD& RooUnfold::ABAT (const TMatrixD& a, const TMatrixD& b, TMatrixD& c, Bool_t add, TVectorD* work)
+{
+  //! Fills \f$C\f$ such that \f$C = A * B * A^T\f$ (or adds it to \f$C\f$ if add is set).
+  //! \f$B\f$ must be symmetric (eg. a covariance matrix): only the lower triangle of \f$C\f$ is calculated and it is
+  //! then mirrored, so if add is set \f$C\f$ should be symmetric too.
+  //! Only one row of \f$B A^T\f$ is stored at a time, in work (resized if necessary), so no matrix temporaries
+  //! are needed, and repeated calls with the same work do not allocate.
+  //! Note that \f$C\f$ cannot be the same object as \f$A\f$ or \f$B\f$.
+  const Int_t m= a.GetNrows(), n= a.GetNcols();
+  if (b.GetNrows() != n || b.GetNcols() != n) {
+    cerr << "RooUnfold::ABAT: cannot multiply " << m << "x" << n << " matrix by " << b.GetNrows() << "x" << b.GetNcols() << " matrix" << endl;
+    return c;
+  }
+  if (!add || c.GetNrows() != m || c.GetNcols() != m) {
+    c.ResizeTo (m, m);
+    add= kFALSE;
+  }
+  const Double_t *ap= a.GetMatrixArray(), *bp= b.GetMatrixArray();
+  Double_t* cp= c.GetMatrixArray();
+  TVectorD dtmp;
+  TVectorD& dv= work ? *work : dtmp;
+  if (dv.GetNrows() < n) dv.ResizeTo (n);
+  Double_t* d= dv.GetMatrixArray();  // row j of B*A^T
+  for (Int_t j= 0; j<m; j++) {
+    const Double_t* aj= ap+j*n;
+    for (Int_t k= 0; k<n; k++) {
+      const Double_t* bk= bp+k*n;
+      Double_t s= 0.0;
+      for (Int_t l= 0; l<n; l++) s += bk[l]*aj[l];
+      d[k]= s;
+    }
+    ABATColumn (ap, m, n, d, j, cp, add);
+  }
+  ABATMirror (cp, m);
   return c;
 }
 
-TMatrixD& RooUnfold::ABAT (const TMatrixD& a, const TVectorD& b, TMatrixD& c)
+TMatrixD& RooUnfold::ABAT (const TMatrixD& a, const TVectorD& b, TMatrixD& c, Bool_t add, TVectorD* work)
 {
-  //! Fills \f$C\f$ such that \f$C = A * B * A^T\f$, where \f$B\f$ is a diagonal matrix specified by the vector.
+  //! Fills \f$C\f$ such that \f$C = A * B * A^T\f$ (or adds it to \f$C\f$ if add is set),
+  //! where \f$B\f$ is a diagonal matrix specified by the vector.
+  //! This is a symmetric rank-k update: only the lower triangle of \f$C\f$ is calculated and it is then mirrored,
+  //! so if add is set \f$C\f$ should be symmetric too. No matrix temporaries are needed, and a row of
+  //! \f$A B\f$ is kept in work (resized if necessary), so repeated calls with the same work do not allocate.
   //! Note that \f$C\f$ cannot be the same object as \f$A\f$.
-  TMatrixD d (TMatrixD::kTransposed, a);
-  d.NormByColumn (b, "M");
-  c.Mult (a, d);
+  const Int_t m= a.GetNrows(), n= a.GetNcols();
+  if (b.GetNrows() != n) {
+    cerr << "RooUnfold::ABAT: cannot multiply " << m << "x" << n << " matrix by diagonal matrix of size " << b.GetNrows() << endl;
+    return c;
+  }
+  if (!add || c.GetNrows() != m || c.GetNcols() != m) {
+    c.ResizeTo (m, m);
+    add= kFALSE;
+  }
+  const Double_t *ap= a.GetMatrixArray(), *bp= b.GetMatrixArray();
+  Double_t* cp= c.GetMatrixArray();
+  TVectorD dtmp;
+  TVectorD& dv= work ? *work : dtmp;
+  if (dv.GetNrows() < n) dv.ResizeTo (n);
+  Double_t* d= dv.GetMatrixArray();  // row j of A scaled by B
+  for (Int_t j= 0; j<m; j++) {
+    const Double_t* aj= ap+j*n;
+    for (Int_t k= 0; k<n; k++) d[k]= aj[k]*bp[k];
+    ABATColumn (ap, m, n, d, j, cp, add);
+  }
+  ABATMirror (cp, m);
+  return c;
+}
+
+TMatrixD& RooUnfold::ABATChol (const TMatrixD& a, const TMatrixD& l, TMatrixD& c, TMatrixD* work)
+{
+  //! Fills \f$C\f$ such that \f$C = A * B * A^T = (A L) (A L)^T\f$, where \f$B = L L^T\f$ is given by its lower-triangular
+  //! Cholesky factor \f$L\f$ (eg. from GetMeasuredCovL()). Only the lower triangle of \f$L\f$ is used.
+  //! The result is symmetric and positive semi-definite by construction. \f$G = A L\f$ is stored in work,
+  //! if specified, so repeated calls need not allocate. Note that \f$C\f$ cannot be the same object as \f$A\f$ or \f$L\f$.
+  const Int_t m= a.GetNrows(), n= a.GetNcols();
+  if (l.GetNrows() != n || l.GetNcols() != n) {
+    cerr << "RooUnfold::ABATChol: cannot multiply " << m << "x" << n << " matrix by " << l.GetNrows() << "x" << l.GetNcols() << " matrix" << endl;
+    return c;
+  }
+  TMatrixD gtmp;
+  TMatrixD& g= work ? *work : gtmp;
+  g.ResizeTo (m, n);
+  const Double_t *ap= a.GetMatrixArray(), *lp= l.GetMatrixArray();
+  Double_t* gp= g.GetMatrixArray();
+  for (Int_t i= 0; i<m; i++) {
+    const Double_t* ai= ap+i*n;
+    Double_t* gi= gp+i*n;
+    for (Int_t k= 0; k<n; k++) gi[k]= 0.0;
+    for (Int_t q= 0; q<n; q++) {        // g(i,k) += a(i,q)*L(q,k) for k<=q
+      const Double_t aiq= ai[q];
+      if (aiq==0.0) continue;
+      const Double_t* lq= lp+q*n;
+      for (Int_t k= 0; k<=q; k++) gi[k] += aiq*lq[k];
+    }
+  }
+  c.ResizeTo (m, m);
+  Double_t* cp= c.GetMatrixArray();
+  for (Int_t j= 0; j<m; j++)
+    ABATColumn (gp, m, n, gp+j*n, j, cp, kFALSE);
+  ABATMirror (cp, m);
   return c;
 }
 
+Double_t RooUnfold::ABAT (const TVectorD& a, const TMatrixD& b)
+{
+  //! Returns the quadratic form \f$a^T B a\f$, eg. a \f$\chi^2\f$ with \f$B\f$ the inverse covariance matrix.
+  //! This is ABAT with a single-row \f$A\f$, without needing the matrix temporaries.
+  const Int_t n= a.GetNrows();
+  if (b.GetNrows() != n || b.GetNcols() != n) {
+    cerr << "RooUnfold::ABAT: cannot multiply vector of size " << n << " by " << b.GetNrows() << "x" << b.GetNcols() << " matrix" << endl;
+    return 0.0;
+  }
+  const Double_t *ap= a.GetMatrixArray(), *bp= b.GetMatrixArray();
+  Double_t r= 0.0;
+  for (Int_t k= 0; k<n; k++) {
+    const Double_t* bk= bp+k*n;
+    Double_t s= 0.0;
+    for (Int_t l= 0; l<n; l++) s += bk[l]*ap[l];
+    r += ap[k]*s;
+  }
+  return r;
+}
+
 Int_t RooUnfold::InvertMatrix(const TMatrixD& mat, TMatrixD& inv, const char* name, Int_t verbose)
 {
   //! Invert a matrix using Single Value Decomposition: inv = mat^-1.
@@ -1137,12 +1771,11 @@ void RooUnfold::Streamer (TBuffer &R__b)
 {
   //! Stream an object of class RooUnfold.
   if (R__b.IsReading()) {
-    // Don't add our histograms to the currect directory.
-    // We own them and we don't want them to disappear when the file is closed.
-    Bool_t oldstat= TH1::AddDirectoryStatus();
-    TH1::AddDirectory (kFALSE);
     RooUnfold::Class()->ReadBuffer  (R__b, this);
-    TH1::AddDirectory (oldstat);
+    // Don't leave our histograms in the currect directory.
+    // We own them and we don't want them to disappear when the file is closed.
+    if (_measmine) _measmine->SetDirectory (0);
+    if (_meas && _meas!=_measmine) const_cast<TH1*>(_meas)->SetDirectory (0);
   } else {
     RooUnfold::Class()->WriteBuffer (R__b, this);
   }
@@ -16,9 +16,14 @@
 #include "TVectorD.h"
 #include "TMatrixD.h"
 #include "RooUnfoldResponse.h"
+#include "RooUnfoldTiming.h"
+#include <vector>
 
 class TH1;
 class TH1D;
+class TRandom;
+class RooUnfoldMatrixFactor;
+class RooUnfoldToyEnsemble;
 
 class RooUnfold : public TNamed {
 
@@ -67,6 +72,9 @@ public:
   virtual void SetMeasured (const TVectorD& meas, const TMatrixD& cov);
   virtual void SetMeasured (const TVectorD& meas, const TVectorD& err);
   virtual void SetMeasuredCov (const TMatrixD& cov);
+  // From contiguous arrays of GetNbinsMeasured() (x GetNbinsMeasured(), row-major) elements, eg. NumPy arrays from Python
+  virtual void SetMeasured (Int_t n, const Double_t* meas, const Double_t* err= 0);
+  virtual void SetMeasuredCov (Int_t n, const Double_t* cov);
   virtual void SetResponse (const RooUnfoldResponse* res);
   virtual void SetResponse (RooUnfoldResponse* res, Bool_t takeOwnership);
 
@@ -86,12 +94,50 @@ public:
   virtual TVectorD   ErecoV (ErrorTreatment witherror=kErrors);
   virtual TMatrixD   Wreco  (ErrorTreatment witherror=kCovariance);
 
+  // As above, filling existing objects, which are only resized if necessary. Return false if unfolding failed.
+  virtual Bool_t     Hreco  (TH1&      reco, ErrorTreatment witherror=kErrors);      // reco must have the truth binning
+  virtual Bool_t     Ereco  (TMatrixD& cov,  ErrorTreatment witherror=kCovariance);
+  virtual Bool_t     ErecoV (TVectorD& err,  ErrorTreatment witherror=kErrors);
+  virtual Bool_t     Wreco  (TMatrixD& wgt,  ErrorTreatment witherror=kCovariance);
+
+  // The cached matrices, without copying. Empty if the unfolding failed. Valid until the next unfolding.
+  const TMatrixD&    CovReco();     // covariance matrix from the unfolding (kCovariance)
+  const TMatrixD&    CovRecoToy();  // covariance matrix from toy MC tests (kCovToy)
+  const TMatrixD&    WgtReco();     // weight (inverse covariance) matrix from the unfolding (kCovariance)
+
+  // NToys() toy MC unfoldings, generated once and kept until the next unfolding. contents are RooUnfoldToyEnsemble::Contents flags.
+  const RooUnfoldToyEnsemble& ToyEnsemble (Int_t contents= 0, const TH1* hTrue= 0, ErrorTreatment chi2Error= kCovariance);
+  // Run a range of toys, eg. in separate jobs whose results are merged and then used with SetToyEnsemble. Requires SetToySeed.
+  Bool_t             RunToys (Int_t first, Int_t last, RooUnfoldToyEnsemble& toys, Int_t contents= 0,
+                              const TH1* hTrue= 0, ErrorTreatment chi2Error= kCovariance);
+  Bool_t             SetToyEnsemble (const RooUnfoldToyEnsemble& toys, const TH1* hTrue= 0);
+
+  // Unfold many measured distributions (columns of meas) with the same response and settings
+  virtual Bool_t     UnfoldBatch (const TMatrixD& meas, TMatrixD& reco, const TMatrixD* err= 0, std::vector<TMatrixD>* cov= 0);
+
+  // Re-unfold after the inputs changed, eg. for online monitoring of a growing measured distribution
+  virtual void       UpdateMeasured (const TH1* meas= 0);    // measured distribution changed (0 = same histogram, changed in place)
+  virtual void       UpdateResponse();                       // response contents changed, eg. with RooUnfoldResponse::Add
+  virtual void       SetIncremental (Bool_t incremental= true); // start each update from the previous unfolding
+  virtual Bool_t     GetIncremental() const;
+
+  // Time and matrix memory of each phase (RooUnfoldTiming::Phase), per call and in aggregate. Empty with -DNOTIMING.
+  const RooUnfoldTiming& GetTiming() const;
+  void               ResetTiming();
+  virtual Long64_t   MatrixBytes() const;   // memory held in this unfolding's vectors and matrices
+
   virtual Int_t      verbose() const;
   virtual void       SetVerbose (Int_t level);
   virtual void       IncludeSystematics (Int_t dosys= 1);
   virtual Int_t      SystematicsIncluded() const;
   virtual Int_t      NToys() const;         // Number of toys
   virtual void       SetNToys (Int_t toys); // Set number of toys
+  virtual Int_t      NThreads() const;      // Number of threads used for toys
+  virtual void       SetNThreads (Int_t nthreads); // Set number of threads used for toys (0 = all cores)
+  virtual UInt_t     ToySeed() const;       // Seed for toy random number streams
+  virtual void       SetToySeed (UInt_t seed); // Set seed for toy random number streams
+  virtual TRandom*   GetRandom() const;     // Random number generator for toys
+  virtual void       SetRandom (TRandom* rnd); // Set random number generator for toys (not owned, 0 = gRandom)
   virtual Int_t      Overflow() const;
   virtual void       PrintTable (std::ostream& o, const TH1* hTrue= 0, ErrorTreatment withError=kDefault);
   virtual void       SetRegParm (Double_t parm);
@@ -101,7 +147,8 @@ public:
   Double_t GetMaxParm() const;
   Double_t GetStepSizeParm() const;
   Double_t GetDefaultParm() const;
-  RooUnfold* RunToy() const;
+  RooUnfold* RunToy (TRandom* rnd= 0, Int_t replica= -1) const;
+  void       RunToy (RooUnfold& toy, TRandom* rnd= 0, Int_t replica= -1) const;
   void Print(Option_t* opt="") const;
 
   static void PrintTable (std::ostream& o, const TH1* hTrainTrue, const TH1* hTrain,
@@ -122,11 +169,26 @@ protected:
   virtual void GetWgt(); // Get weight matrix using errors on measured distribution
   virtual void GetSettings();
   virtual Bool_t UnfoldWithErrors (ErrorTreatment withError, bool getWeights=false);
+  virtual Bool_t ThreadSafe() const; // Can toys of this unfolding method run in parallel threads?
+  virtual void   ClearUnfolding (Bool_t newResponse= kTRUE); // Forget result, but keep workspace for the next unfolding
+  virtual void   ToySums (Int_t first, Int_t last, UInt_t seed, RooUnfoldToyEnsemble& toys) const;
+  void           GenerateToys (Int_t first, Int_t last, RooUnfoldToyEnsemble& toys);
+  const TMatrixD& GetMeasuredCovL() const;
+  Bool_t         MeasuredCovLValid() const;
+  Bool_t         BatchSetup (const TMatrixD& meas, TMatrixD& reco, const TMatrixD* err, std::vector<TMatrixD>* cov, Bool_t needErrors) const;
+  void           BatchVariance (const TMatrixD& err, Int_t b, TVectorD& var) const;
+  Int_t          ToyThreads (Int_t ntoys) const;
+  static Int_t   ToySplit (Int_t first, Int_t last, Int_t t, Int_t nthreads);
+  const RooUnfoldMatrixFactor* WgtFactor (ErrorTreatment witherror);
+  Int_t          ToyReplica (TRandom* rnd, Int_t replica) const;
 
   static TMatrixD CutZeros     (const TMatrixD& ereco);
   static TH1D*    HistNoOverflow (const TH1* h, Bool_t overflow);
-  static TMatrixD& ABAT (const TMatrixD& a, const TMatrixD& b, TMatrixD& c);
-  static TMatrixD& ABAT (const TMatrixD& a, const TVectorD& b, TMatrixD& c);
+  // A B A^T. B must be symmetric: a general B gives a wrong result. work (size A columns) avoids an allocation per call.
+  static TMatrixD& ABAT (const TMatrixD& a, const TMatrixD& b, TMatrixD& c, Bool_t add= kFALSE, TVectorD* work= 0);  // symmetric b
+  static TMatrixD& ABAT (const TMatrixD& a, const TVectorD& b, TMatrixD& c, Bool_t add= kFALSE, TVectorD* work= 0);  // diagonal b
+  static TMatrixD& ABATChol (const TMatrixD& a, const TMatrixD& l, TMatrixD& c, TMatrixD* work= 0);  // b = l l^T
+  static Double_t  ABAT (const TVectorD& a, const TMatrixD& b);                                     // a^T b a
   static TH1*     Resize (TH1* h, Int_t nx, Int_t ny=-1, Int_t nz=-1);
   static Int_t    InvertMatrix (const TMatrixD& mat, TMatrixD& inv, const char* name="matrix", Int_t verbose=1);
 
@@ -146,13 +208,18 @@ protected:
   Int_t    _nt;            // Total number of truth    bins (including under/overflows if _overflow set)
   Int_t    _overflow;      // Use histogram under/overflows if 1 (set from RooUnfoldResponse)
   Int_t    _NToys;         // Number of toys to be used
+  Int_t    _NThreads;      //! Number of threads to use for toys (0 = number of cores)
+  UInt_t   _toySeed;       //! Seed for per-toy random number streams (0 = use GetRandom())
+  TRandom* _rnd;           //! Random number generator for toys (not owned, 0 = gRandom)
   Bool_t   _unfolded;      // unfolding done
   Bool_t   _haveCov;       // have _cov
   Bool_t   _haveWgt;       // have _wgt
   Bool_t   _have_err_mat;  // have _err_mat
+  Bool_t   _haveToys;      //! have _toys
   Bool_t   _fail;          // unfolding failed
   Bool_t   _haveErrors;    // have _variances
   Bool_t   _haveCovMes;    // _covMes was set, not just cached
+  Bool_t   _incremental;   //! incremental mode (see SetIncremental)
   Int_t    _dosys;         // include systematic errors from response matrix? use _dosys=2 to exclude measurement errors
   const RooUnfoldResponse* _res;   // Response matrix (not owned)
   RooUnfoldResponse* _resmine;     // Owned response matrix
@@ -167,6 +234,13 @@ protected:
   mutable TVectorD* _eMes; //! Cached measured error
   mutable TMatrixD* _covMes;       // Measurement covariance matrix
   mutable TMatrixD* _covL; //! Cached lower triangular matrix for which _covMes = _covL * _covL^T.
+  mutable Bool_t    _covLok; //! The Cholesky decomposition for _covL succeeded
+  RooUnfoldMatrixFactor* _wgtFactor[2]; //! Cached decompositions of _cov and _err_mat.
+  RooUnfoldToyEnsemble*  _toys;         //! Cached toy ensemble, from which _err_mat is calculated
+  RooUnfoldTiming        _timing;       //! Time and memory of each phase (see GetTiming)
+
+  friend class RooUnfoldMatrixFactor;
+  friend class RooUnfoldParms;
   ErrorTreatment _withError; // type of error last calulcated
 
 public:
@@ -230,6 +304,27 @@ Int_t RooUnfold::NToys()     const
   return _NToys;
 }
 
+inline
+Int_t RooUnfold::NThreads()  const
+{
+  // Get number of threads used in kCovToy error calculation.
+  return _NThreads;
+}
+
+inline
+UInt_t RooUnfold::ToySeed()  const
+{
+  // Get seed used for the toy random number streams.
+  return _toySeed;
+}
+
+inline
+Bool_t RooUnfold::ThreadSafe() const
+{
+  // Toys can be run in parallel threads, unless overridden by a method that uses shared state.
+  return kTRUE;
+}
+
 inline
 Int_t RooUnfold::Overflow()  const
 {
@@ -297,6 +392,66 @@ void  RooUnfold::SetNToys (Int_t toys)
   _NToys= toys;
 }
 
+inline
+void  RooUnfold::SetNThreads (Int_t nthreads)
+{
+  // Set number of threads used in kCovToy error calculation.
+  // Use nthreads=0 to use all available cores.
+  _NThreads= nthreads;
+}
+
+inline
+void  RooUnfold::SetIncremental (Bool_t incremental)
+{
+  // In incremental mode, unfolding again after UpdateMeasured() or UpdateResponse() reuses what it can
+  // from the previous unfolding, eg. cached unfolding operators, or (for iterative methods) the previous
+  // result as the starting point. This setting is not copied to clones, so toys are independent.
+  _incremental= incremental;
+}
+
+inline
+Bool_t RooUnfold::GetIncremental() const
+{
+  // Return incremental mode setting
+  return _incremental;
+}
+
+inline
+const RooUnfoldTiming& RooUnfold::GetTiming() const
+{
+  // Return time and matrix memory of each phase of this unfolding and its toys.
+  // The response matrix cache rebuild is timed by RooUnfoldResponse::GetTiming().
+  return _timing;
+}
+
+inline
+void RooUnfold::ResetTiming()
+{
+  // Forget the timing of previous phases
+  _timing.Reset();
+}
+
+inline
+void  RooUnfold::SetToySeed (UInt_t seed)
+{
+  // Set seed for the toy random number streams used in kCovToy error calculation.
+  // Each toy gets its own stream, derived from this seed and the toy number, so the
+  // toys do not depend on the number of threads. seed=0 (the default) uses GetRandom(),
+  // or a seed taken from GetRandom() when running with more than one thread.
+  if (seed!=_toySeed) _have_err_mat= _haveToys= kFALSE;
+  _toySeed= seed;
+}
+
+inline
+void  RooUnfold::SetRandom (TRandom* rnd)
+{
+  // Set the random number generator used for toys when no generator is passed to RunToy
+  // and no ToySeed is set. It is not owned, and should not be shared with unfoldings in
+  // other threads. rnd=0 (the default) uses gRandom.
+  if (rnd!=_rnd) _have_err_mat= _haveToys= kFALSE;
+  _rnd= rnd;
+}
+
 inline
 void  RooUnfold::SetRegParm (Double_t)
 {
@@ -315,7 +470,7 @@ void RooUnfold::IncludeSystematics (Int_t dosys)
 {
   // Include systematic errors from response matrix?
   // Use dosys=2 to exclude measurement errors.
-  if (dosys!=_dosys) _haveWgt= _haveErrors= _haveCov= _have_err_mat= kFALSE;
+  if (dosys!=_dosys) _haveWgt= _haveErrors= _haveCov= _have_err_mat= _haveToys= kFALSE;
   _dosys= dosys;
 }
 
@@ -0,0 +1,142 @@
+# ==============================================================================
+#
+#  NumPy interface to RooUnfold: fill a RooUnfoldResponse and set the measured
+#  distribution from contiguous arrays, and view the unfolded result and its
+#  covariance as NumPy arrays sharing the TVectorD/TMatrixD storage.
+#
+#  Imported by the RooUnfold package (pip install), or directly from a CMake
+#  build directory (after source setup.sh) with "import RooUnfoldNumpy".
+#  The methods are added to the ROOT classes:
+#
+#    response.FillArrays (reco, truth, w=None, type=None, nthreads=None)
+#    unfold.SetMeasuredArrays (meas, err=None, cov=None)
+#    unfold.RecoArray()             # Vreco()
+#    unfold.CovArray (withError)    # CovReco() (kCovariance) or CovRecoToy() (kCovToy)
+#    unfold.WgtArray()              # WgtReco()
+#    response.MresponseArray()      # Mresponse()
+#
+#  The views are read-only (except RecoArray) and are only valid while the
+#  object exists and until the next unfolding or response change.
+#
+# ==============================================================================
+
+import numpy
+import ROOT
+
+_null = getattr(ROOT, "nullptr", 0)
+
+
+def _array(a, dtype=numpy.float64):
+    """Contiguous array of dtype, only copied if a is not already one."""
+    if a is None: return None
+    return numpy.ascontiguousarray(a, dtype=dtype)
+
+
+def _ptr(a):
+    return _null if a is None else a
+
+
+def _view(buf, shape, writeable=False):
+    """NumPy array of shape using the memory of buf, a Double_t* returned by GetMatrixArray()."""
+    n = int(numpy.prod(shape))
+    if n == 0: return numpy.zeros(shape)
+    if hasattr(buf, "reshape"):  # cppyy LowLevelView (ROOT 6.22 and later)
+        buf.reshape((n,))
+    else:                        # PyROOT buffer
+        buf.SetSize(n)
+    a = numpy.frombuffer(buf, dtype=numpy.float64, count=n).reshape(shape)
+    if not writeable: a.flags.writeable = False
+    return a
+
+
+def _vector_view(v, writeable=False):
+    return _view(v.GetMatrixArray(), (v.GetNrows(),), writeable)
+
+
+def _matrix_view(m, writeable=False):
+    return _view(m.GetMatrixArray(), (m.GetNrows(), m.GetNcols()), writeable)
+
+
+def _dims(res):
+    return res.Hmeasured().GetDimension(), res.Htruth().GetDimension()
+
+
+def _coordinates(a, dim, name):
+    """Events' coordinates as an (n,dim) or (n,) array, flattened."""
+    if a is None: return None, None
+    a = _array(a)
+    if a.ndim == 1 and dim == 1: return a, len(a)
+    if a.ndim == 2 and a.shape[1] == dim: return a.reshape(-1), a.shape[0]
+    raise ValueError("RooUnfoldResponse.FillArrays: %s must have shape (n,%d)" % (name, dim))
+
+
+def FillArrays(self, reco, truth, w=None, type=None, nthreads=None):
+    """Fill n events from arrays: reco (n,dimMeasured) and truth (n,dimTruth), or (n,) in 1D,
+    the weights w (n,), and the RooUnfoldResponse.FillType type (n,) for each event.
+    As RooUnfoldResponse::FillN (or, with nthreads, RooUnfoldResponseFiller::FillParallel),
+    so the arrays cross to C++ once, without a copy if they are already contiguous float64 (int32 for type)."""
+    dimm, dimt = _dims(self)
+    reco, nr = _coordinates(reco, dimm, "reco")
+    truth, nt = _coordinates(truth, dimt, "truth")
+    if nr is not None and nt is not None and nr != nt:
+        raise ValueError("RooUnfoldResponse.FillArrays: %d reco and %d truth events" % (nr, nt))
+    n = nr if nr is not None else nt
+    if n is None: raise ValueError("RooUnfoldResponse.FillArrays: no reco or truth given")
+    w = _array(w)
+    type = _array(type, numpy.int32)
+    for a, name in ((w, "w"), (type, "type")):
+        if a is not None and a.shape != (n,):
+            raise ValueError("RooUnfoldResponse.FillArrays: %s must have shape (%d,)" % (name, n))
+    if n == 0: return
+    if nthreads is None:
+        self.FillN(n, _ptr(reco), _ptr(truth), _ptr(w), _ptr(type))
+    else:
+        ROOT.RooUnfoldResponseFiller.FillParallel(self, n, _ptr(reco), _ptr(truth), _ptr(w), _ptr(type), nthreads)
+
+
+def MresponseArray(self):
+    """Response matrix (measured x truth) as a read-only view of Mresponse()."""
+    return _matrix_view(self.Mresponse())
+
+
+def SetMeasuredArrays(self, meas, err=None, cov=None):
+    """Set the measured distribution (GetNbinsMeasured(),) with errors err (default sqrt(|meas|)),
+    or covariance matrix cov (GetNbinsMeasured(),GetNbinsMeasured()). See RooUnfold::SetMeasured(n,meas,err)."""
+    meas = _array(meas).reshape(-1)
+    n = len(meas)
+    if cov is not None:
+        cov = _array(cov)
+        if cov.shape != (n, n):
+            raise ValueError("RooUnfold.SetMeasuredArrays: cov must have shape (%d,%d)" % (n, n))
+        self.SetMeasuredCov(n, cov)
+        err = numpy.sqrt(numpy.maximum(numpy.diagonal(cov), 0.0))
+    err = _array(err)
+    if err is not None and err.shape != (n,):
+        raise ValueError("RooUnfold.SetMeasuredArrays: err must have shape (%d,)" % n)
+    self.SetMeasured(n, meas, _ptr(err))
+
+
+def RecoArray(self):
+    """Unfolded distribution as a view of Vreco(), unfolding if necessary."""
+    return _vector_view(self.Vreco(), True)
+
+
+def CovArray(self, withError=ROOT.RooUnfold.kCovariance):
+    """Covariance matrix of the unfolded distribution as a read-only view of CovReco() (kCovariance)
+    or CovRecoToy() (kCovToy)."""
+    if withError == ROOT.RooUnfold.kCovToy: return _matrix_view(self.CovRecoToy())
+    if withError == ROOT.RooUnfold.kCovariance: return _matrix_view(self.CovReco())
+    raise ValueError("RooUnfold.CovArray: withError must be kCovariance or kCovToy")
+
+
+def WgtArray(self):
+    """Weight (inverse covariance) matrix of the unfolded distribution as a read-only view of WgtReco()."""
+    return _matrix_view(self.WgtReco())
+
+
+ROOT.RooUnfoldResponse.FillArrays = FillArrays
+ROOT.RooUnfoldResponse.MresponseArray = MresponseArray
+ROOT.RooUnfold.SetMeasuredArrays = SetMeasuredArrays
+ROOT.RooUnfold.RecoArray = RecoArray
+ROOT.RooUnfold.CovArray = CovArray
+ROOT.RooUnfold.WgtArray = WgtArray
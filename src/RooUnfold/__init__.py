@@ -20,5 +20,12 @@ except ImportError:
     raise
 
 from ROOT import RooUnfold
+# NumPy array methods (FillArrays, SetMeasuredArrays, RecoArray, CovArray, ...), if NumPy is available
+try:
+    import numpy
+except ImportError:
+    pass
+else:
+    from . import RooUnfoldNumpy
 # hide away this __init__.py
 sys.modules[__name__] = RooUnfold
@@ -18,6 +18,8 @@
 <p>Is able to account for bin migration and smearing
 <p>Can unfold if test and measured distributions have different binning.
 <p>Returns covariance matrices with conditions approximately that of the machine precision. This occasionally leads to very large chi squared values
+<p>In incremental mode (SetIncremental), each unfolding after RooUnfold::UpdateMeasured() starts from the previous result
+instead of the training truth, and the quantities that only depend on the response are kept
 */
 
 /////////////////////////////////////////////////////////////
@@ -77,6 +79,17 @@ void RooUnfoldBayes::Init()
 {
   _nc= _ne= 0;
   _nbartrue= _N0C= 0.0;
+  _lowmem= false;
+  _sparse= false;
+  _itSaved= 0;
+  _ckWithCov= false;
+  _ckUsed= -1;
+  _ckNoCov= false;
+  _convTol= 0.0;
+  _convRelative= false;
+  _niterUsed= 0;
+  _warmN0C= 0.0;
+  _warmP0C.ResizeTo(0);
   GetSettings();
 }
 
@@ -96,14 +109,25 @@ void RooUnfoldBayes::CopyData (const RooUnfoldBayes& rhs)
 {
   _niter=    rhs._niter;
   _smoothit= rhs._smoothit;
+  _lowmem=   rhs._lowmem;
+  _sparse=   rhs._sparse;
+  _checkpoints= rhs._checkpoints;
+  _ckWithCov=   rhs._ckWithCov;
+  _convTol=      rhs._convTol;
+  _convRelative= rhs._convRelative;
+  _warmP0C.ResizeTo (rhs._warmP0C.GetNrows());
+  _warmP0C=      rhs._warmP0C;   // only used if the copy is set to incremental mode, eg. by UnfoldBatch
+  _warmN0C=      rhs._warmN0C;
 }
 
 void RooUnfoldBayes::Unfold()
 {
+  _ckUsed= -1;
+  _ckNoCov= false;
   setup();
   if (verbose() >= 2) {
     Print();
-    RooUnfoldResponse::PrintMatrix(_Nji,"RooUnfoldBayes response matrix (Nji)");
+    if (!_sparse) RooUnfoldResponse::PrintMatrix(_Nji,"RooUnfoldBayes response matrix (Nji)");
   }
   if (verbose() >= 1) cout << "Now unfolding..." << endl;
   unfold();
@@ -113,10 +137,28 @@ void RooUnfoldBayes::Unfold()
   _rec.ResizeTo(_nt);  // drop fakes in final bin
   _unfolded= true;
   _haveCov=  false;
+  if (_incremental && _nbartrue>0.0) {   // start the next unfolding from this result
+    _warmP0C.ResizeTo(_nc);
+    _warmP0C= _nbarCi;
+    _warmP0C *= 1.0/_nbartrue;
+    _warmN0C= _nbartrue;
+  }
 }
 
 void RooUnfoldBayes::GetCov()
 {
+  if (_ckUsed>=0) {
+    // The iterations after the checkpoint have overwritten what is needed to calculate its covariance,
+    // so fail, with an empty matrix. Only report this once, as CovReco() etc. will call GetCov() again.
+    if (!_ckNoCov)
+      cerr << "RooUnfoldBayes checkpoint " << _ckUsed << " (" << _checkpoints[_ckUsed]
+           << " iterations) has no covariance matrix. Use SetCheckpoints(niters,true) without IncludeSystematics." << endl;
+    _ckNoCov= true;
+    _cov.ResizeTo (0, 0);
+    _haveCov= false;
+    _fail= true;
+    return;
+  }
   getCovariance();
   _cov.ResizeTo (_nt, _nt);  // drop fakes in final bin
   _haveCov= true;
@@ -145,17 +187,90 @@ TMatrixD& RooUnfoldBayes::H2M (const TH2* h, TMatrixD& m, Bool_t overflow)
 //-------------------------------------------------------------------------
 void RooUnfoldBayes::setup()
 {
-  _nc = _nt;
-  _ne = _nm;
+  // Response quantities are kept from previous unfolding if the response has not changed
+  if (!_ne || (_sparse ? _sPEjCi.GetNrows() : _PEjCi.GetNrows()) != _ne) setupResponse();
 
   _nEstj.ResizeTo(_ne);
   _nEstj= Vmeasured();
 
+  // Workspaces depending on _dosys, which can change (IncludeSystematics) when the response quantities are kept.
+  // Sparse mode does not propagate the errors in the iterations, so does not need them.
+  const Bool_t errs= !_sparse && _dosys!=2, syserrs= !_sparse && _dosys;
+#ifndef OLDERRS
+  _dnCidnEj.ResizeTo(errs ? _nc : 0, errs ? _ne : 0);
+#ifndef OLDMULT
+  _tmpEE   .ResizeTo(errs ? _ne : 0, errs ? _ne : 0);
+#endif
+#endif
+#ifndef OLDERRS2
+  _tmpCC   .ResizeTo(syserrs ? _nc : 0, syserrs ? _nc : 0);
+#endif
+
+  if (_sparse) {
+    // Only save each iteration's priors and estimates, from which getCovariance() propagates the errors
+    _dnCidPjk.ResizeTo(0,0);
+    _itT     .ResizeTo(0,0);
+    _itP0C   .ResizeTo(_niter,_nc);
+    _itNbarCi.ResizeTo(_niter,_nc);
+    _itUjInv .ResizeTo(_niter,_ne);
+    _itN0C   .ResizeTo(_niter);
+    _itSaved= 0;
+  } else if (_dosys) {
+#ifndef OLDERRS2
+    if (_lowmem) {
+      // Only save each iteration: nc x nc per iteration, instead of nc x ne*nc for _dnCidPjk
+      _dnCidPjk.ResizeTo(0,0);
+      _itT     .ResizeTo(_niter>1 ? (_niter-1)*_nc : 0, _nc);
+      _itP0C   .ResizeTo(_niter,_nc);
+      _itNbarCi.ResizeTo(_niter,_nc);
+      _itUjInv .ResizeTo(_niter,_ne);
+      _itSaved= 0;
+    } else {
+#endif
+      _dnCidPjk.ResizeTo(_nc,_ne*_nc);
+      _dnCidPjk.Zero();   // accumulated over iterations, so clear from any previous unfolding
+#ifndef OLDERRS2
+    }
+#endif
+  }
+
+  // Initial distribution: the training truth, or in incremental mode the result of the previous unfolding.
+  // The errors do not include the dependence of the previous result on the previous measurement.
+  if (_incremental && _warmN0C>0.0 && _warmP0C.GetNrows()==_nc) {
+    if (verbose()>=1) cout << "Start from previous result with " << _warmN0C << " events" << endl;
+    _N0C= _warmN0C;
+    _P0C= _warmP0C;
+    return;
+  }
+  _N0C= _nCi.Sum();
+  if (_N0C!=0.0) {
+    _P0C= _nCi;
+    _P0C *= 1.0/_N0C;
+  }
+}
+
+//-------------------------------------------------------------------------
+void RooUnfoldBayes::setupResponse()
+{
+  //! Set up the quantities that only depend on the response matrix.
+  _nc = _nt;
+  _ne = _nm;
+
   _nCi.ResizeTo(_nt);
   _nCi= _res->Vtruth();
 
-  _Nji.ResizeTo(_ne,_nt);
-  H2M (_res->Hresponse(), _Nji, _overflow);   // don't normalise, which is what _res->Mresponse() would give us
+  if (_sparse) {   // free the dense matrices from any previous unfolding
+    _Nji      .ResizeTo(0,0);
+    _Mij      .ResizeTo(0,0);
+    _PEjCi    .ResizeTo(0,0);
+    _PEjCiEffT.ResizeTo(0,0);
+  } else {
+    _sPEjCi    .ResizeTo(0,0);
+    _sPEjCiEffT.ResizeTo(0,0);
+    _sMij      .ResizeTo(0);
+    _Nji.ResizeTo(_ne,_nt);
+    H2M (_res->Hresponse(), _Nji, _overflow);   // don't normalise, which is what _res->Mresponse() would give us
+  }
 
   if (_res->FakeEntries()) {
     TVectorD fakes= _res->Vfakes();
@@ -164,50 +279,137 @@ void RooUnfoldBayes::setup()
     _nc++;
     _nCi.ResizeTo(_nc);
     _nCi[_nc-1]= nfakes;
-    _Nji.ResizeTo(_ne,_nc);
-    for (Int_t i= 0; i<_nm; i++) _Nji(i,_nc-1)= fakes[i];
+    if (!_sparse) {
+      _Nji.ResizeTo(_ne,_nc);
+      for (Int_t i= 0; i<_nm; i++) _Nji(i,_nc-1)= fakes[i];
+    }
   }
 
   _nbarCi.ResizeTo(_nc);
   _efficiencyCi.ResizeTo(_nc);
-  _Mij.ResizeTo(_nc,_ne);
+  if (!_sparse) _Mij.ResizeTo(_nc,_ne);
   _P0C.ResizeTo(_nc);
   _UjInv.ResizeTo(_ne);
-#ifndef OLDERRS
-  if (_dosys!=2) _dnCidnEj.ResizeTo(_nc,_ne);
-#endif
-  if (_dosys)    _dnCidPjk.ResizeTo(_nc,_ne*_nc);
 
-  // Initial distribution
-  _N0C= _nCi.Sum();
-  if (_N0C!=0.0) {
-    _P0C= _nCi;
-    _P0C *= 1.0/_N0C;
+  if (_sparse) {
+    setupResponseSparse();
+    return;
   }
-}
-
-//-------------------------------------------------------------------------
-void RooUnfoldBayes::unfold()
-{
-  //! Calculate the unfolding matrix.
-  //! _niter = number of iterations to perform (3 by default).
-  //! _smoothit = smooth the matrix in between iterations (default false).
 
-  TMatrixD PEjCi(_ne,_nc), PEjCiEff(_ne,_nc);
+  // Store PEjCiEff transposed, so the unfolding matrix loop in unfold() runs along rows
+  _PEjCi    .ResizeTo(_ne,_nc); _PEjCi    .Zero();
+  _PEjCiEffT.ResizeTo(_nc,_ne); _PEjCiEffT.Zero();
   for (Int_t i = 0 ; i < _nc ; i++) {
     if (_nCi[i] <= 0.0) { _efficiencyCi[i] = 0.0; continue; }
+    Double_t* PEffi= _PEjCiEffT.GetMatrixArray() + i*_ne;
     Double_t eff = 0.0;
     for (Int_t j = 0 ; j < _ne ; j++) {
       Double_t response = _Nji(j,i) / _nCi[i];
-      PEjCi(j,i) = PEjCiEff(j,i) = response;  // efficiency of detecting the cause Ci in Effect Ej
+      _PEjCi(j,i) = PEffi[j] = response;  // efficiency of detecting the cause Ci in Effect Ej
       eff += response;
     }
     _efficiencyCi[i] = eff;
     Double_t effinv = eff > 0.0 ? 1.0/eff : 0.0;   // reset PEjCiEff if eff=0
-    for (Int_t j = 0 ; j < _ne ; j++) PEjCiEff(j,i) *= effinv;
+    for (Int_t j = 0 ; j < _ne ; j++) PEffi[j] *= effinv;
+  }
+}
+
+//-------------------------------------------------------------------------
+void RooUnfoldBayes::setupResponseSparse()
+{
+  //! Sparse mode: set up _sPEjCi, _sPEjCiEffT, and _efficiencyCi from the non-zero elements of
+  //! the response matrix, without making a dense copy. The elements are the same as those of
+  //! _PEjCi and _PEjCiEffT in setupResponse(), and are summed in the same order.
+  TMatrixDSparse* Nji= RooUnfoldResponse::H2MSparse (_res->Hresponse(), _res->GetNbinsMeasured(),
+                                                     _res->GetNbinsTruth(), 0, _overflow);  // don't normalise
+  const Int_t*    Nrow= Nji->GetRowIndexArray();
+  const Int_t*    Ncol= Nji->GetColIndexArray();
+  const Double_t* Nval= Nji->GetMatrixArray();
+  TVectorD fakes;
+  if (_nc > _nt) {
+    fakes.ResizeTo(_ne);
+    fakes= _res->Vfakes();
+  }
+
+  // Count, then fill, the non-zero elements of each row (effect) of PEjCi. The fakes bin is the last column.
+  Bool_t fakesBin= (_nc > _nt && _nCi[_nc-1] > 0.0);
+  Int_t nnz= 0;
+  for (Int_t j = 0 ; j < _ne ; j++) {
+    for (Int_t n = Nrow[j] ; n < Nrow[j+1] ; n++)
+      if (_nCi[Ncol[n]] > 0.0) nnz++;
+    if (fakesBin && fakes[j] != 0.0) nnz++;
+  }
+  _sPEjCi.ResizeTo (_ne, _nc, nnz);
+  Int_t*    Prow= _sPEjCi.GetRowIndexArray();
+  Int_t*    Pcol= _sPEjCi.GetColIndexArray();
+  Double_t* Pval= _sPEjCi.GetMatrixArray();
+  _efficiencyCi.Zero();
+  Int_t m= 0;
+  for (Int_t j = 0 ; j < _ne ; j++) {
+    Prow[j]= m;
+    for (Int_t n = Nrow[j] ; n < Nrow[j+1] ; n++) {
+      Int_t i= Ncol[n];
+      if (_nCi[i] <= 0.0) continue;
+      Pcol[m]= i;
+      Pval[m]= Nval[n] / _nCi[i];  // efficiency of detecting the cause Ci in Effect Ej
+      _efficiencyCi[i] += Pval[m++];
+    }
+    if (fakesBin && fakes[j] != 0.0) {
+      Pcol[m]= _nc-1;
+      Pval[m]= fakes[j] / _nCi[_nc-1];
+      _efficiencyCi[_nc-1] += Pval[m++];
+    }
   }
+  Prow[_ne]= m;
+  delete Nji;
+
+  // Transpose, dividing by the efficiency: this keeps the effects in each row in order
+  _sPEjCiEffT.ResizeTo (_nc, _ne, m);
+  Int_t*    Erow= _sPEjCiEffT.GetRowIndexArray();
+  Int_t*    Ecol= _sPEjCiEffT.GetColIndexArray();
+  Double_t* Eval= _sPEjCiEffT.GetMatrixArray();
+  for (Int_t i = 0 ; i <= _nc ; i++) Erow[i]= 0;
+  for (Int_t n = 0 ; n < m ; n++) Erow[Pcol[n]+1]++;
+  for (Int_t i = 0 ; i < _nc ; i++) Erow[i+1] += Erow[i];
+  std::vector<Int_t> next (Erow, Erow+_nc);
+  for (Int_t j = 0 ; j < _ne ; j++) {
+    for (Int_t n = Prow[j] ; n < Prow[j+1] ; n++) {
+      Int_t i= Pcol[n];
+      Double_t eff= _efficiencyCi[i];
+      Double_t effinv = eff > 0.0 ? 1.0/eff : 0.0;   // reset PEjCiEff if eff=0
+      Int_t k= next[i]++;
+      Ecol[k]= j;
+      Eval[k]= Pval[n] * effinv;
+    }
+  }
+  _sMij.ResizeTo(m);
+}
+
+void RooUnfoldBayes::ClearUnfolding (Bool_t newResponse)
+{
+  //! Response matrix quantities are recalculated in the next setup() only if the response has changed
+  if (newResponse) _nc= _ne= 0;
+  RooUnfold::ClearUnfolding (newResponse);
+}
+
+//-------------------------------------------------------------------------
+void RooUnfoldBayes::unfold()
+{
+  //! Calculate the unfolding matrix.
+  //! _niter = number of iterations to perform (3 by default).
+  //! _smoothit = smooth the matrix in between iterations (default false).
+  //! If SetConvergence() was used, stop early when the change is below the tolerance.
 
   TVectorD PbarCi(_nc);
+  _niterUsed= 0;
+
+  // Checkpoints not reached in this unfolding stay empty
+  _ckReco.resize (_checkpoints.size());
+  _ckCov .resize (_checkpoints.size());
+  for (size_t ick= 0; ick<_checkpoints.size(); ick++) {
+    _ckReco[ick].ResizeTo (0);
+    _ckCov [ick].ResizeTo (0, 0);
+  }
 
   for (Int_t kiter = 0 ; kiter < _niter; kiter++) {
 
@@ -219,120 +421,752 @@ void RooUnfoldBayes::unfold()
       _N0C = _nbartrue;
     }
 
+    unfoldStep();
+
+    // new estimate of true distribution
+    PbarCi= _nbarCi;
+    if (_nbartrue!=0.0) PbarCi *= 1.0/_nbartrue;
+    _niterUsed= kiter+1;
+
+    // stop after this iteration? If nothing was unfolded, there is no new prior to iterate with.
+    Bool_t last= (kiter == _niter-1) || _nbartrue==0.0 || converged (PbarCi);
+
+    if (_sparse) {
+      saveIteration (kiter, PbarCi);   // the errors are propagated from the saved iterations in getCovariance()
+    } else {
+#ifndef OLDERRS
+      if (_dosys!=2) dnCidnEjUpdate (kiter);
+#endif
+      if (_dosys) {
+#ifndef OLDERRS2
+        if (_lowmem) saveIteration (kiter, PbarCi);  // _dnCidPjk is built one effect at a time in getCovariance()
+        else
+#endif
+        dnCidPjkUpdate (kiter, PbarCi, last);
+      }
+    }
+
+    for (size_t ick= 0; ick<_checkpoints.size(); ick++)
+      if (_checkpoints[ick]==kiter+1) saveCheckpoint (ick);
+
+    // no need to smooth the last iteraction
+    if (_smoothit && !last) smooth(PbarCi);
+
+    // Chi2 based on Poisson errors
+    Double_t chi2 = getChi2(PbarCi, _P0C, _nbartrue);
+    if (verbose()>=1) cout << "Chi^2 of change " << chi2 << endl;
+
+    if (last) {
+      if (kiter < _niter-1 && verbose()>=1) cout << "Converged after " << _niterUsed << " iterations" << endl;
+      break;
+    }
+
+    // and repeat
+  }
+}
+
+//-------------------------------------------------------------------------
+void RooUnfoldBayes::dnCidnEjUpdate (Int_t kiter)
+{
+  //! Update the measurement error propagation matrix, _dnCidnEj, for iteration kiter.
+  if (kiter <= 0) {
+    _dnCidnEj= _Mij;
+  } else {
+#ifndef OLDMULT
+    // _dnCidnEj = _Mij + diag(nr) _dnCidnEj + _Mij diag(_nEstj) _Mij^T diag(en) _dnCidnEj,
+    // with nr= _nbarCi/(_N0C*_P0C) and en= -_efficiencyCi/(_N0C*_P0C).
+    // The diagonal scalings are applied inside the products, which accumulate into
+    // the preallocated _tmpEE along contiguous rows, skipping zero elements.
+    const Double_t* Mij  = _Mij.GetMatrixArray();
+    const Double_t* nEstj= _nEstj.GetMatrixArray();
+    Double_t*       dn   = _dnCidnEj.GetMatrixArray();
+    Double_t*       M3   = _tmpEE.GetMatrixArray();
+    _tmpEE.Zero();
+    for (Int_t l = 0 ; l < _nc ; l++) {
+      if (_P0C[l]<=0.0) continue;
+      Double_t en= -_efficiencyCi[l]/(_N0C*_P0C[l]);
+      if (en==0.0) continue;
+      const Double_t* Ml = Mij + l*_ne;
+      const Double_t* dnl= dn  + l*_ne;
+      for (Int_t k = 0 ; k < _ne ; k++) {
+        Double_t a= Ml[k]*nEstj[k]*en;
+        if (a==0.0) continue;
+        Double_t* M3k= M3 + k*_ne;
+        for (Int_t j = 0 ; j < _ne ; j++) M3k[j] += a*dnl[j];
+      }
+    }
+    // M3 no longer depends on _dnCidnEj, so this can be updated in-place
+    for (Int_t i = 0 ; i < _nc ; i++) {
+      Double_t nr= _P0C[i]>0.0 ? _nbarCi[i]/(_N0C*_P0C[i]) : 0.0;
+      const Double_t* Mi = Mij + i*_ne;
+      Double_t*       dni= dn  + i*_ne;
+      for (Int_t j = 0 ; j < _ne ; j++) dni[j]= Mi[j] + nr*dni[j];
+      for (Int_t k = 0 ; k < _ne ; k++) {
+        Double_t a= Mi[k];
+        if (a==0.0) continue;
+        const Double_t* M3k= M3 + k*_ne;
+        for (Int_t j = 0 ; j < _ne ; j++) dni[j] += a*M3k[j];
+      }
+    }
+#else /* OLDMULT */
+    TVectorD ksum(_ne);
     for (Int_t j = 0 ; j < _ne ; j++) {
-      Double_t Uj = 0.0;
-      for (Int_t i = 0 ; i < _nc ; i++)
-        Uj += PEjCi(j,i) * _P0C[i];
-      _UjInv[j] = Uj > 0.0 ? 1.0/Uj : 0.0;
+      for (Int_t k = 0 ; k < _ne ; k++) {
+        Double_t sum = 0.0;
+        for (Int_t l = 0 ; l < _nc ; l++) {
+          if (_P0C[l]>0.0) sum += _efficiencyCi[l]*_Mij(l,k)*_dnCidnEj(l,j)/_P0C[l];
+        }
+        ksum[k]= sum;
+      }
+      for (Int_t i = 0 ; i < _nc ; i++) {
+        Double_t dsum = _P0C[i]>0 ? _dnCidnEj(i,j)*_nbarCi[i]/_P0C[i] : 0.0;
+        for (Int_t k = 0 ; k < _ne ; k++) {
+          dsum -= _Mij(i,k)*_nEstj[k]*ksum[k];
+        }
+        // update dnCidnEj. Note that we can do this in-place due to the ordering of the accesses.
+        _dnCidnEj(i,j) = _Mij(i,j) + dsum/_N0C;
+      }
+    }
+#endif
+  }
+}
+
+//-------------------------------------------------------------------------
+Bool_t RooUnfoldBayes::converged (const TVectorD& PbarCi) const
+{
+  //! Check whether the new estimate, PbarCi, is close enough to the prior, _P0C, to stop iterating.
+  return converged (PbarCi, _P0C, _nbartrue);
+}
+
+Bool_t RooUnfoldBayes::converged (const TVectorD& PbarCi, const TVectorD& P0C, Double_t nbartrue) const
+{
+  //! Check whether the new estimate, PbarCi, is close enough to the prior, P0C, to stop iterating.
+  //! Uses the chi^2 of change (as printed for each iteration), or the maximum relative change.
+  if (_convTol <= 0.0) return false;
+  if (!_convRelative) return getChi2 (PbarCi, P0C, nbartrue) < _convTol;
+  Double_t maxrel= 0.0;
+  for (Int_t i = 0 ; i < _nc ; i++) {
+    if (P0C[i] <= 0.0) continue;
+    Double_t rel= fabs (PbarCi[i] - P0C[i]) / P0C[i];
+    if (rel > maxrel) maxrel= rel;
+  }
+  return maxrel < _convTol;
+}
+
+//-------------------------------------------------------------------------
+Bool_t RooUnfoldBayes::UnfoldBatch (const TMatrixD& meas, TMatrixD& reco, const TMatrixD* err, std::vector<TMatrixD>* cov)
+{
+  //! Unfold all the columns of meas together (see RooUnfold::UnfoldBatch). The response quantities are set up
+  //! once, and each iteration folds and unfolds the priors of all the (not yet converged) columns with two
+  //! matrix products, the same calculation as unfoldStep(), up to rounding.
+  //! The covariance matrix propagation, sparse mode, checkpoints, and incremental mode (where each column
+  //! starts from the result of the previous one) are done one column at a time.
+  if (cov || _sparse || !_checkpoints.empty() || _niter<=0 || _incremental)
+    return RooUnfold::UnfoldBatch (meas, reco, err, cov);
+  if (!BatchSetup (meas, reco, err, cov, kFALSE)) return kFALSE;
+  if (!_ne || _PEjCi.GetNrows() != _ne) setupResponse();
+
+  const Int_t nb= meas.GetNcols();
+  TMatrixD P0 (_nc, nb), U (_ne, nb), nbar (_nc, nb);
+  TVectorD PbarCi (_nc), P0C (_nc);
+  Double_t N0= _nCi.Sum();
+  if (N0!=0.0)
+    for (Int_t i = 0 ; i < _nc ; i++)
+      for (Int_t b = 0 ; b < nb ; b++) P0(i,b)= _nCi[i]/N0;
+
+  std::vector<Bool_t> done (nb, false);
+  Int_t ndone= 0;
+  for (Int_t kiter = 0 ; kiter < _niter && ndone < nb ; kiter++) {
+    // Folded priors, U = PEjCi P0, then nEstj/U (UjInv * nEstj in unfoldStep)
+    U.Mult (_PEjCi, P0);
+    for (Int_t j = 0 ; j < _ne ; j++) {
+      const Double_t* nEstj= meas.GetMatrixArray() + j*nb;
+      Double_t*       Uj   = U.GetMatrixArray()    + j*nb;
+      for (Int_t b = 0 ; b < nb ; b++) Uj[b]= Uj[b] > 0.0 ? nEstj[b]/Uj[b] : 0.0;
+    }
+    // New estimates, nbarCi = P0Ci * sum_j PEjCiEff UjInv nEstj
+    nbar.Mult (_PEjCiEffT, U);
+    for (Int_t b = 0 ; b < nb ; b++) {
+      if (done[b]) continue;
+      Double_t nbartrue = 0.0;
+      for (Int_t i = 0 ; i < _nc ; i++) {
+        nbar(i,b) *= P0(i,b);
+        nbartrue += nbar(i,b);
+      }
+      for (Int_t i = 0 ; i < _nc ; i++) {
+        PbarCi[i]= nbartrue!=0.0 ? nbar(i,b)/nbartrue : 0.0;
+        P0C[i]= P0(i,b);
+      }
+      if (kiter == _niter-1 || nbartrue==0.0 || converged (PbarCi, P0C, nbartrue)) {   // as unfold()
+        for (Int_t i = 0 ; i < _nt ; i++) reco(i,b)= nbar(i,b);  // drop fakes in final bin
+        done[b]= true;
+        ndone++;
+        continue;
+      }
+      if (_smoothit) smooth(PbarCi);
+      for (Int_t i = 0 ; i < _nc ; i++) P0(i,b)= PbarCi[i];
     }
+  }
+  return kTRUE;
+}
 
-    // Unfolding matrix M
+//-------------------------------------------------------------------------
+void RooUnfoldBayes::unfoldStep()
+{
+  //! Calculate the unfolding matrix, _Mij, and new estimate, _nbarCi, from the prior, _P0C.
+  //! The loops run over contiguous rows of _PEjCi, _PEjCiEffT, and _Mij, so
+  //! they can be vectorised by the compiler.
+  //! In sparse mode, the loops run over the non-zero elements of the rows of _sPEjCi and _sPEjCiEffT.
+  if (_sparse) {
+    const Int_t*    Prow = _sPEjCi.GetRowIndexArray();
+    const Int_t*    Pcol = _sPEjCi.GetColIndexArray();
+    const Double_t* Pval = _sPEjCi.GetMatrixArray();
+    const Int_t*    Erow = _sPEjCiEffT.GetRowIndexArray();
+    const Int_t*    Ecol = _sPEjCiEffT.GetColIndexArray();
+    const Double_t* Eval = _sPEjCiEffT.GetMatrixArray();
+    const Double_t* P0C  = _P0C.GetMatrixArray();
+    const Double_t* nEstj= _nEstj.GetMatrixArray();
+    Double_t*       UjInv= _UjInv.GetMatrixArray();
+    Double_t*       Mij  = _sMij.GetMatrixArray();
+    for (Int_t j = 0 ; j < _ne ; j++) {
+      Double_t Uj = 0.0;
+      for (Int_t n = Prow[j] ; n < Prow[j+1] ; n++)
+        Uj += Pval[n] * P0C[Pcol[n]];
+      UjInv[j] = Uj > 0.0 ? 1.0/Uj : 0.0;
+    }
     _nbartrue = 0.0;
     for (Int_t i = 0 ; i < _nc ; i++) {
+      Double_t P0Ci= P0C[i];
       Double_t nbarC = 0.0;
-      for (Int_t j = 0 ; j < _ne ; j++) {
-        Double_t Mij = _UjInv[j] * PEjCiEff(j,i) * _P0C[i];
-        _Mij(i,j) = Mij;
-        nbarC += Mij * _nEstj[j];
+      for (Int_t n = Erow[i] ; n < Erow[i+1] ; n++) {
+        Int_t j= Ecol[n];
+        Double_t m = UjInv[j] * Eval[n] * P0Ci;
+        Mij[n] = m;
+        nbarC += m * nEstj[j];
       }
       _nbarCi[i] = nbarC;
-      _nbartrue += nbarC;  // best estimate of true number of events
+      _nbartrue += nbarC;
     }
+    return;
+  }
 
-    // new estimate of true distribution
-    PbarCi= _nbarCi;
-    PbarCi *= 1.0/_nbartrue;
+  const Double_t* PEjCi   = _PEjCi.GetMatrixArray();
+  const Double_t* PEjCiEff= _PEjCiEffT.GetMatrixArray();
+  const Double_t* P0C     = _P0C.GetMatrixArray();
+  const Double_t* nEstj   = _nEstj.GetMatrixArray();
+  Double_t*       UjInv   = _UjInv.GetMatrixArray();
+  Double_t*       Mij     = _Mij.GetMatrixArray();
 
-#ifndef OLDERRS
-    if (_dosys!=2) {
-      if (kiter <= 0) {
-        _dnCidnEj= _Mij;
-      } else {
-#ifndef OLDMULT
-        TVectorD en(_nc), nr(_nc);
-        for (Int_t i = 0 ; i < _nc ; i++) {
-          if (_P0C[i]<=0.0) continue;
-          Double_t ni= 1.0/(_N0C*_P0C[i]);
-          en[i]= -ni*_efficiencyCi[i];
-          nr[i]=  ni*_nbarCi[i];
+  for (Int_t j = 0 ; j < _ne ; j++) {
+    const Double_t* PEj= PEjCi + j*_nc;
+    Double_t Uj = 0.0;
+    for (Int_t i = 0 ; i < _nc ; i++)
+      Uj += PEj[i] * P0C[i];
+    UjInv[j] = Uj > 0.0 ? 1.0/Uj : 0.0;
+  }
+
+  // Unfolding matrix M, fused with folding the measurements
+  _nbartrue = 0.0;
+  for (Int_t i = 0 ; i < _nc ; i++) {
+    const Double_t* PEffi= PEjCiEff + i*_ne;
+    Double_t*       Mi   = Mij      + i*_ne;
+    Double_t P0Ci= P0C[i];
+    Double_t nbarC = 0.0;
+    for (Int_t j = 0 ; j < _ne ; j++) {
+      Double_t m = UjInv[j] * PEffi[j] * P0Ci;
+      Mi[j] = m;
+      nbarC += m * nEstj[j];
+    }
+    _nbarCi[i] = nbarC;
+    _nbartrue += nbarC;  // best estimate of true number of events
+  }
+}
+
+//-------------------------------------------------------------------------
+void RooUnfoldBayes::dnCidPjkUpdate (Int_t kiter, const TVectorD& PbarCi, Bool_t last)
+{
+  //! Update the response error propagation matrix, _dnCidPjk, for iteration kiter.
+  //! last specifies whether this is the final iteration.
+#ifndef OLDERRS2
+  if (kiter > 0) {
+    // _dnCidPjk = diag(PbarCi/_P0C) _dnCidPjk - B _dnCidPjk, with B= _Mij diag(_UjInv*_nEstj/_N0C) PEjCi.
+    // B is accumulated into the preallocated _tmpCC. Only the rows are mixed, so the columns (j,k) are
+    // updated kColumnBlock at a time, accumulating the product in a small _nc x kColumnBlock workspace.
+    Int_t nec= _ne*_nc;
+    const Double_t* B    = _tmpCC.GetMatrixArray();
+    Double_t*       dn   = _dnCidPjk.GetMatrixArray();
+    TVectorD updBlock(_nc*kColumnBlock);
+    Double_t*       upd  = updBlock.GetMatrixArray();
+    dnCidPjkMixing();
+    for (Int_t jk0= 0; jk0<nec; jk0 += kColumnBlock) {
+      Int_t w= nec-jk0 < kColumnBlock ? nec-jk0 : Int_t(kColumnBlock);
+      for (Int_t i = 0 ; i < _nc ; i++) {
+        if (_P0C[i]<=0.0) continue;  // rows not updated
+        const Double_t* Bi  = B   + i*_nc;
+        Double_t*       updi= upd + i*w;
+        for (Int_t c= 0; c<w; c++) updi[c]= 0.0;
+        for (Int_t l = 0 ; l < _nc ; l++) {
+          Double_t b= Bi[l];
+          if (b==0.0) continue;
+          const Double_t* dnl= dn + l*nec + jk0;
+          for (Int_t c= 0; c<w; c++) updi[c] += b*dnl[c];
         }
-        TMatrixD M1= _dnCidnEj;
-        M1.NormByColumn(nr,"M");
-        TMatrixD M2 (TMatrixD::kTransposed, _Mij);
-        M2.NormByColumn(_nEstj,"M");
-        M2.NormByRow(en,"M");
-        TMatrixD M3 (M2, TMatrixD::kMult, _dnCidnEj);
-        _dnCidnEj.Mult (_Mij, M3);
-        _dnCidnEj += _Mij;
-        _dnCidnEj += M1;
-#else /* OLDMULT */
-        TVectorD ksum(_ne);
-        for (Int_t j = 0 ; j < _ne ; j++) {
-          for (Int_t k = 0 ; k < _ne ; k++) {
-            Double_t sum = 0.0;
-            for (Int_t l = 0 ; l < _nc ; l++) {
-              if (_P0C[l]>0.0) sum += _efficiencyCi[l]*_Mij(l,k)*_dnCidnEj(l,j)/_P0C[l];
+      }
+      for (Int_t i = 0 ; i < _nc ; i++) {
+        if (_P0C[i]<=0.0) continue;
+        Double_t r= PbarCi[i]/_P0C[i];
+        Double_t*       dni = dn  + i*nec + jk0;
+        const Double_t* updi= upd + i*w;
+        for (Int_t c= 0; c<w; c++)
+          dni[c]= r*dni[c] - updi[c];
+      }
+    }
+  }
+#else  /* OLDERRS2 */
+  if (last)   // used to only calculate _dnCidPjk for the final iteration
+#endif
+  dnCidPjkAdd();
+}
+
+//-------------------------------------------------------------------------
+void RooUnfoldBayes::dnCidPjkAdd()
+{
+  //! Add this iteration's derivatives of the unfolding matrix to _dnCidPjk.
+  for (Int_t j = 0 ; j < _ne ; j++) {
+    if (_UjInv[j]==0.0) continue;
+    Double_t mbyu= _UjInv[j]*_nEstj[j];
+    Int_t j0= j*_nc;
+    for (Int_t i = 0 ; i < _nc ; i++) {
+      Double_t b= -mbyu * _Mij(i,j);
+      for (Int_t k = 0 ; k < _nc ; k++) _dnCidPjk(i,j0+k) += b*_P0C[k];
+      if (_efficiencyCi[i]!=0.0)
+        _dnCidPjk(i,j0+i) += (_P0C[i]*mbyu - _nbarCi[i]) / _efficiencyCi[i];
+    }
+  }
+}
+
+//-------------------------------------------------------------------------
+void RooUnfoldBayes::saveIteration (Int_t kiter, const TVectorD& PbarCi)
+{
+  //! Low-memory and sparse modes: instead of updating the error propagation matrices, save what is
+  //! needed to reconstruct them in getCovariance(): the prior, estimate, and folded prior of this iteration.
+  //! In low-memory mode, also save the nc x nc matrix that maps the previous _dnCidPjk onto the new one.
+  for (Int_t i = 0 ; i < _nc ; i++) {
+    _itP0C   (kiter,i)= _P0C[i];
+    _itNbarCi(kiter,i)= _nbarCi[i];
+  }
+  for (Int_t j = 0 ; j < _ne ; j++) _itUjInv(kiter,j)= _UjInv[j];
+  if (_sparse) _itN0C[kiter]= _N0C;
+  _itSaved= kiter+1;
+#ifndef OLDERRS2
+  if (_sparse || kiter <= 0) return;
+  dnCidPjkMixing();
+  const Double_t* B= _tmpCC.GetMatrixArray();
+  Double_t*       T= _itT.GetMatrixArray() + (kiter-1)*_nc*_nc;
+  for (Int_t i = 0 ; i < _nc ; i++) {
+    const Double_t* Bi= B + i*_nc;
+    Double_t*       Ti= T + i*_nc;
+    if (_P0C[i]<=0.0) {   // row is not updated
+      for (Int_t k = 0 ; k < _nc ; k++) Ti[k]= 0.0;
+      Ti[i]= 1.0;
+      continue;
+    }
+    for (Int_t k = 0 ; k < _nc ; k++) Ti[k]= -Bi[k];
+    Ti[i] += PbarCi[i]/_P0C[i];
+  }
+#endif
+}
+
+//-------------------------------------------------------------------------
+void RooUnfoldBayes::dnCidnEjReplay()
+{
+  //! Sparse mode: calculate the measurement error propagation matrix, _dnCidnEj, by replaying the
+  //! update of dnCidnEjUpdate() over the saved iterations, stepping through the non-zero elements of
+  //! each iteration's unfolding matrix. The columns are independent, so they are updated kColumnBlock
+  //! at a time, which only needs a small _ne x kColumnBlock workspace instead of _tmpEE.
+  const Int_t*    Mrow = _sPEjCiEffT.GetRowIndexArray();
+  const Int_t*    Mcol = _sPEjCiEffT.GetColIndexArray();
+  const Double_t* PEff = _sPEjCiEffT.GetMatrixArray();
+  const Double_t* nEstj= _nEstj.GetMatrixArray();
+  TVectorD Mk(Mrow[_nc]), M3(_ne*kColumnBlock);
+  Double_t* Mval= Mk.GetMatrixArray();
+  Double_t* M3p = M3.GetMatrixArray();
+  _dnCidnEj.ResizeTo(_nc,_ne);
+  _dnCidnEj.Zero();
+  Double_t* dn= _dnCidnEj.GetMatrixArray();
+  for (Int_t kiter = 0 ; kiter < _itSaved ; kiter++) {
+    const Double_t* P0C  = _itP0C.GetMatrixArray()    + kiter*_nc;
+    const Double_t* nbarC= _itNbarCi.GetMatrixArray() + kiter*_nc;
+    const Double_t* UjInv= _itUjInv.GetMatrixArray()  + kiter*_ne;
+    Double_t N0C= _itN0C[kiter];
+    // this iteration's unfolding matrix, as calculated by unfoldStep()
+    for (Int_t i = 0 ; i < _nc ; i++)
+      for (Int_t n = Mrow[i] ; n < Mrow[i+1] ; n++) Mval[n]= UjInv[Mcol[n]] * PEff[n] * P0C[i];
+    if (kiter <= 0) {
+      for (Int_t i = 0 ; i < _nc ; i++)
+        for (Int_t n = Mrow[i] ; n < Mrow[i+1] ; n++) dn[i*_ne+Mcol[n]]= Mval[n];
+      continue;
+    }
+    for (Int_t j0 = 0 ; j0 < _ne ; j0 += kColumnBlock) {
+      Int_t w= _ne-j0 < kColumnBlock ? _ne-j0 : Int_t(kColumnBlock);
+      for (Int_t n = 0 ; n < _ne*w ; n++) M3p[n]= 0.0;
+      for (Int_t l = 0 ; l < _nc ; l++) {
+        if (P0C[l]<=0.0) continue;
+        Double_t en= -_efficiencyCi[l]/(N0C*P0C[l]);
+        if (en==0.0) continue;
+        const Double_t* dnl= dn + l*_ne + j0;
+        for (Int_t n = Mrow[l] ; n < Mrow[l+1] ; n++) {
+          Int_t k= Mcol[n];
+          Double_t a= Mval[n]*nEstj[k]*en;
+          if (a==0.0) continue;
+          Double_t* M3k= M3p + k*w;
+          for (Int_t c = 0 ; c < w ; c++) M3k[c] += a*dnl[c];
+        }
+      }
+      for (Int_t i = 0 ; i < _nc ; i++) {
+        Double_t nr= P0C[i]>0.0 ? nbarC[i]/(N0C*P0C[i]) : 0.0;
+        Double_t* dni= dn + i*_ne + j0;
+        for (Int_t c = 0 ; c < w ; c++) dni[c] *= nr;
+        for (Int_t n = Mrow[i] ; n < Mrow[i+1] ; n++) {
+          Int_t k= Mcol[n];
+          Double_t a= Mval[n];
+          if (k>=j0 && k<j0+w) dni[k-j0] += a;
+          if (a==0.0) continue;
+          const Double_t* M3k= M3p + k*w;
+          for (Int_t c = 0 ; c < w ; c++) dni[c] += a*M3k[c];
+        }
+      }
+    }
+  }
+}
+
+//-------------------------------------------------------------------------
+void RooUnfoldBayes::getCovarianceResponseSparse (TMatrixD& cov) const
+{
+  //! Sparse mode: add the response matrix covariance, equivalent to ABAT(_dnCidPjk,Vjk), to cov.
+  //! For each effect j, the columns (j,k) of _dnCidPjk are independent, and only those with a non-zero
+  //! response error are needed. These are reconstructed kColumnBlock at a time by replaying the update of
+  //! dnCidPjkUpdate() over the saved iterations, without storing _dnCidPjk or the row mixing matrices.
+  const Int_t*    Prow = _sPEjCi.GetRowIndexArray();
+  const Int_t*    Pcol = _sPEjCi.GetColIndexArray();
+  const Double_t* Pval = _sPEjCi.GetMatrixArray();
+  const Int_t*    Mrow = _sPEjCiEffT.GetRowIndexArray();
+  const Int_t*    Mcol = _sPEjCiEffT.GetColIndexArray();
+  const Double_t* PEff = _sPEjCiEffT.GetMatrixArray();
+  const Double_t* nEstj= _nEstj.GetMatrixArray();
+  TVectorD V(_nc), D(_nc*kColumnBlock), Y(_ne*kColumnBlock);
+  Double_t* Dp= D.GetMatrixArray();
+  Double_t* Yp= Y.GetMatrixArray();
+  std::vector<Int_t> cols;
+  for (Int_t j = 0 ; j < _ne ; j++) {
+    responseVariance (j, V.GetMatrixArray());
+    cols.clear();
+    for (Int_t k = 0 ; k < _nc ; k++) if (V[k]!=0.0) cols.push_back(k);
+    for (size_t c0 = 0 ; c0 < cols.size() ; c0 += kColumnBlock) {
+      const Int_t* kc= &cols[c0];
+      Int_t w= cols.size()-c0 < size_t(kColumnBlock) ? Int_t(cols.size()-c0) : Int_t(kColumnBlock);
+      // D(i,c)= _dnCidPjk(i,j*_nc+kc[c])
+      for (Int_t n = 0 ; n < _nc*w ; n++) Dp[n]= 0.0;
+      for (Int_t kiter = 0 ; kiter < _itSaved ; kiter++) {
+        const Double_t* P0C  = _itP0C.GetMatrixArray()    + kiter*_nc;
+        const Double_t* nbarC= _itNbarCi.GetMatrixArray() + kiter*_nc;
+        const Double_t* UjInv= _itUjInv.GetMatrixArray()  + kiter*_ne;
+        if (kiter > 0) {
+          // D = diag(PbarCi/P0C) D - _Mij diag(UjInv*_nEstj/N0C) PEjCi D, leaving rows with P0C<=0 unchanged
+          Double_t nbartrue= 0.0;
+          for (Int_t i = 0 ; i < _nc ; i++) nbartrue += nbarC[i];
+          Double_t Ninv= 1.0/nbartrue, N0Cinv= 1.0/_itN0C[kiter];
+          for (Int_t e = 0 ; e < _ne ; e++) {
+            Double_t* Ye= Yp + e*w;
+            for (Int_t c = 0 ; c < w ; c++) Ye[c]= 0.0;
+            Double_t a= UjInv[e]*nEstj[e]*N0Cinv;
+            if (a==0.0) continue;
+            for (Int_t n = Prow[e] ; n < Prow[e+1] ; n++) {
+              Double_t b= a*Pval[n];
+              const Double_t* Dl= Dp + Pcol[n]*w;
+              for (Int_t c = 0 ; c < w ; c++) Ye[c] += b*Dl[c];
             }
-            ksum[k]= sum;
           }
           for (Int_t i = 0 ; i < _nc ; i++) {
-            Double_t dsum = _P0C[i]>0 ? _dnCidnEj(i,j)*_nbarCi[i]/_P0C[i] : 0.0;
-            for (Int_t k = 0 ; k < _ne ; k++) {
-              dsum -= _Mij(i,k)*_nEstj[k]*ksum[k];
+            if (P0C[i]<=0.0) continue;
+            Double_t r= nbarC[i]*Ninv/P0C[i];
+            Double_t* Di= Dp + i*w;
+            for (Int_t c = 0 ; c < w ; c++) Di[c] *= r;
+            for (Int_t n = Mrow[i] ; n < Mrow[i+1] ; n++) {
+              Int_t e= Mcol[n];
+              Double_t m= UjInv[e] * PEff[n] * P0C[i];
+              if (m==0.0) continue;
+              const Double_t* Ye= Yp + e*w;
+              for (Int_t c = 0 ; c < w ; c++) Di[c] -= m*Ye[c];
             }
-            // update dnCidnEj. Note that we can do this in-place due to the ordering of the accesses.
-            _dnCidnEj(i,j) = _Mij(i,j) + dsum/_N0C;
           }
         }
-#endif
+        // add this iteration's derivatives, as in dnCidPjkAdd()
+        if (UjInv[j]==0.0) continue;
+        Double_t mbyu= UjInv[j]*nEstj[j];
+        for (Int_t n = Prow[j] ; n < Prow[j+1] ; n++) {
+          Int_t i= Pcol[n];
+          Double_t effinv= _efficiencyCi[i] > 0.0 ? 1.0/_efficiencyCi[i] : 0.0;
+          Double_t Mij= UjInv[j] * (Pval[n]*effinv) * P0C[i];
+          Double_t b= -mbyu * Mij;
+          Double_t* Di= Dp + i*w;
+          for (Int_t c = 0 ; c < w ; c++) Di[c] += b*P0C[kc[c]];
+        }
+        for (Int_t c = 0 ; c < w ; c++) {
+          Int_t i= kc[c];
+          if (_efficiencyCi[i]!=0.0)
+            Dp[i*w+c] += (P0C[i]*mbyu - nbarC[i]) / _efficiencyCi[i];
+        }
+      }
+      for (Int_t a = 0 ; a < _nc ; a++) {
+        const Double_t* Da= Dp + a*w;
+        for (Int_t b = 0 ; b <= a ; b++) {
+          const Double_t* Db= Dp + b*w;
+          Double_t sum= 0.0;
+          for (Int_t c = 0 ; c < w ; c++) sum += Da[c]*V[kc[c]]*Db[c];
+          cov(a,b) += sum;
+          if (b!=a) cov(b,a) += sum;
+        }
       }
     }
-#endif
+  }
+}
 
-    if (_dosys) {
 #ifndef OLDERRS2
-      if (kiter > 0) {
-        TVectorD mbyu(_ne);
-        for (Int_t j = 0 ; j < _ne ; j++) {
-          mbyu[j]= _UjInv[j]*_nEstj[j]/_N0C;
-        }
-        TMatrixD A= _Mij;
-        A.NormByRow (mbyu, "M");
-        TMatrixD B(A, TMatrixD::kMult, PEjCi);
-        TMatrixD dnCidPjkUpd (B, TMatrixD::kMult, _dnCidPjk);
-        Int_t nec= _ne*_nc;
-        for (Int_t i = 0 ; i < _nc ; i++) {
-          if (_P0C[i]<=0.0) continue;  // skip loop: dnCidPjkUpd(i,jk) will also be 0 because _Mij(i,j) will be 0
-          Double_t r= PbarCi[i]/_P0C[i];
-          for (Int_t jk= 0; jk<nec; jk++)
-            _dnCidPjk(i,jk)= r*_dnCidPjk(i,jk) - dnCidPjkUpd(i,jk);
+//-------------------------------------------------------------------------
+void RooUnfoldBayes::dnCidPjkMixing()
+{
+  //! Set _tmpCC to B= _Mij diag(_UjInv*_nEstj/_N0C) PEjCi, which mixes the rows of _dnCidPjk in each iteration.
+  const Double_t* Mij  = _Mij.GetMatrixArray();
+  const Double_t* PEj0 = _PEjCi.GetMatrixArray();
+  Double_t*       B    = _tmpCC.GetMatrixArray();
+  Double_t N0Cinv= 1.0/_N0C;
+  _tmpCC.Zero();
+  for (Int_t i = 0 ; i < _nc ; i++) {
+    if (_P0C[i]<=0.0) continue;  // skip: _Mij(i,j) and so B(i,k) will be 0
+    const Double_t* Mi= Mij + i*_ne;
+    Double_t*       Bi= B   + i*_nc;
+    for (Int_t j = 0 ; j < _ne ; j++) {
+      Double_t a= Mi[j]*_UjInv[j]*_nEstj[j]*N0Cinv;
+      if (a==0.0) continue;
+      const Double_t* PEj= PEj0 + j*_nc;
+      for (Int_t k = 0 ; k < _nc ; k++) Bi[k] += a*PEj[k];
+    }
+  }
+}
+
+//-------------------------------------------------------------------------
+void RooUnfoldBayes::dnCidPjkBlock (Int_t j, TMatrixD& D, TMatrixD& tmp) const
+{
+  //! Low-memory mode: reconstruct D(i,k)= _dnCidPjk(i,j*_nc+k) for effect j by replaying the
+  //! saved iterations. D and tmp should be _nc x _nc.
+  const Double_t* PEjCiEff= _PEjCiEffT.GetMatrixArray();
+  Double_t* Dp= D.GetMatrixArray();
+  Double_t* Tp= tmp.GetMatrixArray();
+  D.Zero();
+  for (Int_t kiter = 0 ; kiter < _itSaved ; kiter++) {
+    if (kiter > 0) {
+      const Double_t* T= _itT.GetMatrixArray() + (kiter-1)*_nc*_nc;
+      tmp.Zero();
+      for (Int_t i = 0 ; i < _nc ; i++) {
+        const Double_t* Ti= T  + i*_nc;
+        Double_t*       Ni= Tp + i*_nc;
+        for (Int_t l = 0 ; l < _nc ; l++) {
+          Double_t t= Ti[l];
+          if (t==0.0) continue;
+          const Double_t* Dl= Dp + l*_nc;
+          for (Int_t k = 0 ; k < _nc ; k++) Ni[k] += t*Dl[k];
         }
       }
-#else  /* OLDERRS2 */
-      if (kiter == _niter-1)   // used to only calculate _dnCidPjk for the final iteration
-#endif
-      for (Int_t j = 0 ; j < _ne ; j++) {
-        if (_UjInv[j]==0.0) continue;
-        Double_t mbyu= _UjInv[j]*_nEstj[j];
-        Int_t j0= j*_nc;
-        for (Int_t i = 0 ; i < _nc ; i++) {
-          Double_t b= -mbyu * _Mij(i,j);
-          for (Int_t k = 0 ; k < _nc ; k++) _dnCidPjk(i,j0+k) += b*_P0C[k];
-          if (_efficiencyCi[i]!=0.0)
-            _dnCidPjk(i,j0+i) += (_P0C[i]*mbyu - _nbarCi[i]) / _efficiencyCi[i];
-        }
+      D= tmp;
+    }
+    Double_t UjInv= _itUjInv(kiter,j);
+    if (UjInv==0.0) continue;
+    const Double_t* P0C  = _itP0C.GetMatrixArray()    + kiter*_nc;
+    const Double_t* nbarC= _itNbarCi.GetMatrixArray() + kiter*_nc;
+    Double_t mbyu= UjInv*_nEstj[j];
+    for (Int_t i = 0 ; i < _nc ; i++) {
+      Double_t Mij= UjInv * PEjCiEff[i*_ne+j] * P0C[i];
+      Double_t b= -mbyu * Mij;
+      Double_t* Di= Dp + i*_nc;
+      for (Int_t k = 0 ; k < _nc ; k++) Di[k] += b*P0C[k];
+      if (_efficiencyCi[i]!=0.0)
+        Di[i] += (P0C[i]*mbyu - nbarC[i]) / _efficiencyCi[i];
+    }
+  }
+}
+
+//-------------------------------------------------------------------------
+void RooUnfoldBayes::getCovarianceLowMem (TMatrixD& cov) const
+{
+  //! Low-memory mode: add the response matrix covariance, equivalent to ABAT(_dnCidPjk,Vjk),
+  //! to cov, building _dnCidPjk one effect (nc x nc block) at a time.
+  TMatrixD D(_nc,_nc), tmp(_nc,_nc);
+  TVectorD V(_nc);
+  const Double_t* Dp= D.GetMatrixArray();
+  for (Int_t j = 0 ; j < _ne ; j++) {
+    responseVariance (j, V.GetMatrixArray());
+    dnCidPjkBlock (j, D, tmp);
+    for (Int_t a = 0 ; a < _nc ; a++) {
+      const Double_t* Da= Dp + a*_nc;
+      for (Int_t b = 0 ; b <= a ; b++) {
+        const Double_t* Db= Dp + b*_nc;
+        Double_t sum= 0.0;
+        for (Int_t k = 0 ; k < _nc ; k++) sum += Da[k]*V[k]*Db[k];
+        cov(a,b) += sum;
+        if (b!=a) cov(b,a) += sum;
       }
     }
+  }
+}
+#endif
 
-    // no need to smooth the last iteraction
-    if (_smoothit && kiter < (_niter-1)) smooth(PbarCi);
+//-------------------------------------------------------------------------
+void RooUnfoldBayes::responseVariance (Int_t j, Double_t* V) const
+{
+  //! Set V[0.._nc-1] to the squared errors of row j (effect E_j) of the response matrix
+  if (!_sparse) {
+    const TMatrixD& Eres= _res->Eresponse();
+    for (Int_t k = 0 ; k < _nc ; k++) {
+      Double_t e= Eres(j,k);
+      V[k]= e*e;
+    }
+    return;
+  }
+  const TMatrixDSparse& Eres= _res->EresponseSparse();
+  const Int_t*    Erow= Eres.GetRowIndexArray();
+  const Int_t*    Ecol= Eres.GetColIndexArray();
+  const Double_t* Eval= Eres.GetMatrixArray();
+  for (Int_t k = 0 ; k < _nc ; k++) V[k]= 0.0;
+  for (Int_t n = Erow[j] ; n < Erow[j+1] ; n++) {
+    Int_t k= Ecol[n];
+    if (k < _nc) V[k]= Eval[n]*Eval[n];
+  }
+}
 
-    // Chi2 based on Poisson errors
-    Double_t chi2 = getChi2(PbarCi, _P0C, _nbartrue);
-    if (verbose()>=1) cout << "Chi^2 of change " << chi2 << endl;
+//-------------------------------------------------------------------------
+void RooUnfoldBayes::UnfoldingMatrix (TMatrixD& m) const
+{
+  //! Copy the unfolding matrix (Mij) into m. Unlike UnfoldingMatrix(), this also works with SetSparse().
+  if (!_sparse) {
+    m.ResizeTo (_Mij.GetNrows(), _Mij.GetNcols());
+    m= _Mij;
+    return;
+  }
+  m.ResizeTo (_nc, _ne);
+  m.Zero();
+  if (_sMij.GetNrows() == 0) return;
+  const Int_t*    Mrow= _sPEjCiEffT.GetRowIndexArray();
+  const Int_t*    Mcol= _sPEjCiEffT.GetColIndexArray();
+  const Double_t* Mval= _sMij.GetMatrixArray();
+  for (Int_t i = 0 ; i < _nc ; i++)
+    for (Int_t n = Mrow[i] ; n < Mrow[i+1] ; n++) m(i,Mcol[n])= Mval[n];
+}
 
-    // and repeat
+//-------------------------------------------------------------------------
+void RooUnfoldBayes::getCovarianceMeasured (TMatrixD& cov) const
+{
+  //! Create the covariance matrix of result from that of the measured distribution
+#ifdef OLDERRS
+  TMatrixD Dprop;
+  UnfoldingMatrix (Dprop);
+#else
+  const TMatrixD& Dprop= _dnCidnEj;
+#endif
+  if (_haveCovMes) {
+    ABAT (Dprop, GetMeasuredCov(), cov);
+  } else {
+    TVectorD v= Emeasured();
+    v.Sqr();
+    ABAT (Dprop, v, cov);
+  }
+}
+
+//-------------------------------------------------------------------------
+void RooUnfoldBayes::SetCheckpoints (const std::vector<Int_t>& niters, Bool_t withCov)
+{
+  //! Save the results after each of niters iterations, as well as doing the full
+  //! GetIterations() iterations. This gives the results for many numbers of iterations
+  //! for the cost of one unfolding. If withCov, the covariance matrix due to the measured
+  //! distribution is also saved. Covariance matrices are not available with IncludeSystematics.
+  //! Checkpoints with more iterations than GetIterations() are ignored.
+  //! Use CheckpointReco(i) and CheckpointCov(i) to get the results after GetCheckpoint(i)
+  //! iterations, or UseCheckpoint(i) to make that result the current one.
+  _checkpoints= niters;
+  _ckWithCov= withCov;
+  _ckReco.clear();
+  _ckCov .clear();
+  _unfolded= _haveCov= _haveWgt= _haveErrors= _have_err_mat= _haveToys= false;
+}
+
+//-------------------------------------------------------------------------
+void RooUnfoldBayes::saveCheckpoint (Int_t i)
+{
+  //! Save current iteration's result (and covariance) as checkpoint i
+  TVectorD& reco= _ckReco[i];
+  reco.ResizeTo (_nc);
+  reco= _nbarCi;
+  reco.ResizeTo (_nt);  // drop fakes in final bin
+  if (_ckWithCov && !_dosys) {
+    TMatrixD& cov= _ckCov[i];
+#ifndef OLDERRS
+    if (_sparse) dnCidnEjReplay();   // from the iterations saved so far
+#endif
+    cov.ResizeTo (_nc, _nc);
+    getCovarianceMeasured (cov);
+    cov.ResizeTo (_nt, _nt);
+  }
+}
+
+//-------------------------------------------------------------------------
+const TVectorD& RooUnfoldBayes::CheckpointReco (Int_t i)
+{
+  //! Unfolded result after GetCheckpoint(i) iterations.
+  //! This is empty if that is more than GetIterations(), or i is not a checkpoint.
+  static const TVectorD empty;
+  if (!_unfolded) Vreco();
+  if (i<0 || i>=Int_t(_ckReco.size())) {
+    cerr << "RooUnfoldBayes checkpoint " << i << " not available" << endl;
+    return empty;
+  }
+  return _ckReco[i];
+}
+
+//-------------------------------------------------------------------------
+const TMatrixD& RooUnfoldBayes::CheckpointCov (Int_t i)
+{
+  //! Covariance matrix after GetCheckpoint(i) iterations, if this was requested with SetCheckpoints.
+  //! This is empty if it was not, or if that is more than GetIterations(), or i is not a checkpoint.
+  static const TMatrixD empty;
+  if (!_unfolded) Vreco();
+  if (i<0 || i>=Int_t(_ckCov.size())) {
+    cerr << "RooUnfoldBayes checkpoint " << i << " not available" << endl;
+    return empty;
+  }
+  return _ckCov[i];
+}
+
+//-------------------------------------------------------------------------
+Bool_t RooUnfoldBayes::UseCheckpoint (Int_t i)
+{
+  //! Replace the unfolded result (and covariance matrix, if saved) with that of checkpoint i,
+  //! so that Hreco(), Chi2(), etc. return the results after GetCheckpoint(i) iterations.
+  //! kCovToy errors are not available for checkpoints.
+  if (!_unfolded) Vreco();
+  if (i<0 || i>=Int_t(_ckReco.size()) || i>=Int_t(_ckCov.size()) || _ckReco[i].GetNrows()!=_nt) {
+    cerr << "RooUnfoldBayes checkpoint " << i << " not available" << endl;
+    return false;
+  }
+  _rec= _ckReco[i];
+  _haveErrors= _haveWgt= _have_err_mat= _haveToys= false;
+  _haveCov= (_ckCov[i].GetNrows()==_nt);
+  if (_haveCov) {
+    _cov.ResizeTo (_nt, _nt);
+    _cov= _ckCov[i];
   }
+  _ckUsed= i;
+  _ckNoCov= false;
+  return true;
 }
 
 //-------------------------------------------------------------------------
@@ -340,44 +1174,38 @@ void RooUnfoldBayes::getCovariance()
 {
   if (_dosys!=2) {
     if (verbose()>=1) cout << "Calculating covariances due to number of measured events" << endl;
-
-    //! Create the covariance matrix of result from that of the measured distribution
-    _cov.ResizeTo (_nc, _nc);
-#ifdef OLDERRS
-    const TMatrixD& Dprop= _Mij;
-#else
-    const TMatrixD& Dprop= _dnCidnEj;
+#ifndef OLDERRS
+    if (_sparse) dnCidnEjReplay();
 #endif
-    if (_haveCovMes) {
-      ABAT (Dprop, GetMeasuredCov(), _cov);
-    } else {
-      TVectorD v= Emeasured();
-      v.Sqr();
-      ABAT (Dprop, v, _cov);
-    }
+    _cov.ResizeTo (_nc, _nc);
+    getCovarianceMeasured (_cov);
   }
 
   if (_dosys) {
     if (verbose()>=1) cout << "Calculating covariance due to unfolding matrix..." << endl;
 
-    const TMatrixD& Eres= _res->Eresponse();
-    TVectorD Vjk(_ne*_nc);           // vec(Var(j,k))
-    for (Int_t j = 0 ; j < _ne ; j++) {
-      Int_t j0= j*_nc;
-      for (Int_t i = 0 ; i < _nc ; i++) {
-        Double_t e= Eres(j,i);
-        Vjk[j0+i]= e*e;
+    if (_sparse) {
+      if (_dosys==2) {
+        _cov.ResizeTo (_nc, _nc);
+        _cov.Zero();
       }
+      getCovarianceResponseSparse (_cov);
+      return;
     }
-
-    if (_dosys!=2) {
-      TMatrixD covres(_nc,_nc);
-      ABAT (_dnCidPjk, Vjk, covres);
-      _cov += covres;
-    } else {
-      _cov.ResizeTo (_nc, _nc);
-      ABAT (_dnCidPjk, Vjk, _cov);
+#ifndef OLDERRS2
+    if (_lowmem) {
+      if (_dosys==2) {
+        _cov.ResizeTo (_nc, _nc);
+        _cov.Zero();
+      }
+      getCovarianceLowMem (_cov);
+      return;
     }
+#endif
+    TVectorD Vjk(_ne*_nc);           // vec(Var(j,k))
+    for (Int_t j = 0 ; j < _ne ; j++) responseVariance (j, Vjk.GetMatrixArray()+j*_nc);
+
+    ABAT (_dnCidPjk, Vjk, _cov, _dosys!=2);
   }
 }
 
@@ -469,3 +1297,18 @@ void RooUnfoldBayes::Print(Option_t* option) const
     cout << "--------------------------------------------------------\n" << endl;
   }
 }
+
+Long64_t RooUnfoldBayes::MatrixBytes() const
+{
+  //! Memory held in the vectors and matrices of this unfolding, including the iteration workspace,
+  //! sparse, checkpoint, and low-memory mode matrices.
+  Long64_t n= RooUnfold::MatrixBytes();
+  const TVectorD* v[]= { &_nEstj, &_nCi, &_nbarCi, &_efficiencyCi, &_P0C, &_UjInv, &_sMij, &_warmP0C, &_itN0C };
+  for (size_t i= 0; i<sizeof(v)/sizeof(v[0]); i++) n += RooUnfoldTiming::Bytes (*v[i]);
+  const TMatrixDBase* m[]= { &_Nji, &_Mij, &_Vij, &_VnEstij, &_dnCidnEj, &_dnCidPjk, &_PEjCi, &_PEjCiEffT,
+                             &_tmpEE, &_tmpCC, &_sPEjCi, &_sPEjCiEffT, &_itT, &_itP0C, &_itNbarCi, &_itUjInv };
+  for (size_t i= 0; i<sizeof(m)/sizeof(m[0]); i++) n += RooUnfoldTiming::Bytes (*m[i]);
+  for (size_t i= 0; i<_ckReco.size(); i++) n += RooUnfoldTiming::Bytes (_ckReco[i]);
+  for (size_t i= 0; i<_ckCov.size();  i++) n += RooUnfoldTiming::Bytes (_ckCov[i]);
+  return n;
+}
@@ -14,8 +14,11 @@
 
 #include "RooUnfold.h"
 
+#include <vector>
+
 #include "TVectorD.h"
 #include "TMatrixD.h"
+#include "TMatrixDSparse.h"
 
 class TH1;
 class TH2;
@@ -43,12 +46,30 @@ public:
   void SetSmoothing  (Bool_t smoothit= false);
   Int_t GetIterations() const;
   Int_t GetSmoothing()  const;
+  void SetConvergence (Double_t tol= 0.0, Bool_t relative= false);  // stop iterating before GetIterations() when converged
+  Double_t GetConvergence() const;
+  Int_t GetIterationsUsed() const;
+  void SetLowMemory (Bool_t lowmem= true);  // don't store full _dnCidPjk with IncludeSystematics
+  Bool_t GetLowMemory() const;
+  void SetSparse (Bool_t sparse= true);  // store response and unfolding matrices as sparse matrices
+  Bool_t GetSparse() const;
   const TMatrixD& UnfoldingMatrix() const;
+  void UnfoldingMatrix (TMatrixD& m) const;  // copy unfolding matrix into m, also with SetSparse()
+  virtual Bool_t UnfoldBatch (const TMatrixD& meas, TMatrixD& reco, const TMatrixD* err= 0, std::vector<TMatrixD>* cov= 0);
+
+  // Save results after intermediate numbers of iterations in a single unfolding
+  void SetCheckpoints (const std::vector<Int_t>& niters, Bool_t withCov= false);
+  Int_t NCheckpoints() const;
+  Int_t GetCheckpoint (Int_t i) const;
+  const TVectorD& CheckpointReco (Int_t i);
+  const TMatrixD& CheckpointCov  (Int_t i);
+  Bool_t UseCheckpoint (Int_t i);
 
   virtual void  SetRegParm (Double_t parm);
   virtual Double_t GetRegParm() const;
   virtual void Reset();
   virtual void Print (Option_t* option= "") const;
+  virtual Long64_t MatrixBytes() const;
 
   static TMatrixD& H2M (const TH2* h, TMatrixD& m, Bool_t overflow);
 
@@ -58,9 +79,29 @@ protected:
   virtual void GetCov();
   virtual void GetSettings();
 
+  virtual void ClearUnfolding (Bool_t newResponse= kTRUE);
   void setup();
+  void setupResponse();
+  void setupResponseSparse();
   void unfold();
+  void unfoldStep();
   void getCovariance();
+  void getCovarianceMeasured (TMatrixD& cov) const;
+  void saveCheckpoint (Int_t i);
+  void dnCidnEjUpdate (Int_t kiter);
+  void dnCidnEjReplay();
+  void dnCidPjkUpdate (Int_t kiter, const TVectorD& PbarCi, Bool_t last);
+  void dnCidPjkAdd();
+  void responseVariance (Int_t j, Double_t* V) const;
+  Bool_t converged (const TVectorD& PbarCi) const;
+  Bool_t converged (const TVectorD& PbarCi, const TVectorD& P0C, Double_t nbartrue) const;
+  void saveIteration (Int_t kiter, const TVectorD& PbarCi);
+  void getCovarianceResponseSparse (TMatrixD& cov) const;
+#ifndef OLDERRS2
+  void dnCidPjkMixing();
+  void dnCidPjkBlock (Int_t j, TMatrixD& D, TMatrixD& tmp) const;
+  void getCovarianceLowMem (TMatrixD& cov) const;
+#endif
 
   void smooth(TVectorD& PbarCi) const;
   Double_t getChi2(const TVectorD& prob1,
@@ -68,6 +109,8 @@ protected:
                    Double_t nevents) const;
 
 private:
+  enum { kColumnBlock= 64 };  // columns of the error propagation matrices updated together
+
   void Init();
   void CopyData (const RooUnfoldBayes& rhs);
 
@@ -92,8 +135,38 @@ protected:
   TMatrixD _Mij;          // unfolding matrix
   TMatrixD _Vij;          // covariance matrix
   TMatrixD _VnEstij;      // covariance matrix of effects
-  TMatrixD _dnCidnEj;     // measurement error propagation matrix
-  TMatrixD _dnCidPjk;     // response error propagation matrix (stack j,k into each column)
+  TMatrixD _dnCidnEj;     // measurement error propagation matrix (sparse mode: only calculated in GetCov)
+  TMatrixD _dnCidPjk;     // response error propagation matrix (stack j,k into each column; not used in low-memory or sparse mode)
+  TMatrixD _PEjCi;        //! probability of effect E_j given cause C_i
+  TMatrixD _PEjCiEffT;    //! PEjCi divided by efficiency, transposed: (row,column)=(cause,effect)
+  TMatrixD _tmpEE;        //! workspace for _dnCidnEj update (effects x effects)
+  TMatrixD _tmpCC;        //! workspace for _dnCidPjk update (causes x causes)
+
+  Bool_t   _sparse;       //! sparse mode: use the following instead of _Nji, _PEjCi, _PEjCiEffT, and _Mij
+  TMatrixDSparse _sPEjCi;     //! sparse mode: _PEjCi
+  TMatrixDSparse _sPEjCiEffT; //! sparse mode: _PEjCiEffT
+  TVectorD _sMij;         //! sparse mode: non-zero elements of _Mij, which has the same sparsity as _sPEjCiEffT
+
+  std::vector<Int_t>    _checkpoints;  //! numbers of iterations at which to save results
+  Bool_t                _ckWithCov;    //! also save covariance matrix at checkpoints
+  Int_t                 _ckUsed;       //! checkpoint selected by UseCheckpoint(), or -1
+  Bool_t                _ckNoCov;      //! GetCov() failed because checkpoint _ckUsed has no covariance (already reported)
+  std::vector<TVectorD> _ckReco;       //! result at each checkpoint
+  std::vector<TMatrixD> _ckCov;        //! covariance matrix at each checkpoint
+
+  Double_t _convTol;      //! convergence tolerance (0 to always do _niter iterations)
+  Bool_t   _convRelative; //! convergence on maximum relative change, rather than chi^2 of change
+  Int_t    _niterUsed;    //! number of iterations done in last unfolding
+  TVectorD _warmP0C;      //! incremental mode: prior for the next unfolding (last result, normalised)
+  Double_t _warmN0C;      //! incremental mode: number of events in _warmP0C (0 if none)
+
+  Bool_t   _lowmem;       //! low-memory mode: build _dnCidPjk one effect at a time in getCovariance()
+  Int_t    _itSaved;      //! number of iterations saved in low-memory or sparse mode
+  TMatrixD _itT;          //! low-memory mode: _dnCidPjk row mixing for each iteration >0 (stacked nc x nc)
+  TMatrixD _itP0C;        //! low-memory and sparse modes: prior for each iteration
+  TMatrixD _itNbarCi;     //! low-memory and sparse modes: estimate for each iteration
+  TMatrixD _itUjInv;      //! low-memory and sparse modes: 1/(folded prior) for each iteration
+  TVectorD _itN0C;        //! sparse mode: number of events in the prior for each iteration
 
 public:
   ClassDef (RooUnfoldBayes, 1) // Bayesian Unfolding
@@ -162,10 +235,83 @@ Int_t RooUnfoldBayes::GetSmoothing()  const
   return _smoothit;
 }
 
+inline
+Int_t RooUnfoldBayes::NCheckpoints() const
+{
+  // Number of checkpoints
+  return _checkpoints.size();
+}
+
+inline
+Int_t RooUnfoldBayes::GetCheckpoint (Int_t i) const
+{
+  // Number of iterations at checkpoint i (0 if i is not a checkpoint)
+  return (i>=0 && i<Int_t(_checkpoints.size())) ? _checkpoints[i] : 0;
+}
+
+inline
+void RooUnfoldBayes::SetConvergence (Double_t tol, Bool_t relative)
+{
+  // Stop iterating when the chi^2 of change between the prior and new estimate (or, if relative,
+  // the maximum relative change in any bin) falls below tol. GetIterations() is then the maximum
+  // number of iterations. tol=0 always does GetIterations() iterations.
+  _convTol= tol;
+  _convRelative= relative;
+}
+
+inline
+Double_t RooUnfoldBayes::GetConvergence() const
+{
+  // Return convergence tolerance
+  return _convTol;
+}
+
+inline
+Int_t RooUnfoldBayes::GetIterationsUsed() const
+{
+  // Return number of iterations done in the last unfolding
+  return _niterUsed;
+}
+
+inline
+void RooUnfoldBayes::SetLowMemory (Bool_t lowmem)
+{
+  // With IncludeSystematics, don't store the response error propagation matrix, which has
+  // nc*ne*nc elements, but recalculate it in blocks of nc*nc for the covariance.
+  // This uses (niter-1)*nc*nc elements instead, at the cost of more CPU in GetCov.
+  _lowmem= lowmem;
+}
+
+inline
+Bool_t RooUnfoldBayes::GetLowMemory() const
+{
+  // Return low-memory mode setting
+  return _lowmem;
+}
+
+inline
+void RooUnfoldBayes::SetSparse (Bool_t sparse)
+{
+  // Store the response quantities and unfolding matrix as sparse matrices (non-zero elements only),
+  // using RooUnfoldResponse::EresponseSparse() for the errors. This saves memory and CPU for large
+  // response matrices with mostly local migrations. The results are the same as without SetSparse().
+  // The iterations only save their priors and estimates (O(nbins) each), from which GetCov calculates
+  // the error propagation matrices only when errors are requested. SetLowMemory() is then not needed.
+  // UnfoldingMatrix() is then empty: use UnfoldingMatrix(m).
+  _sparse= sparse;
+}
+
+inline
+Bool_t RooUnfoldBayes::GetSparse() const
+{
+  // Return sparse mode setting
+  return _sparse;
+}
+
 inline
 const TMatrixD& RooUnfoldBayes::UnfoldingMatrix() const
 {
-  // Access unfolding matrix (Mij)
+  // Access unfolding matrix (Mij). Empty with SetSparse().
   return _Mij;
 }
 
@@ -80,18 +80,70 @@ RooUnfoldBinByBin::Unfold()
     }
 
     _rec.ResizeTo(_nt);
-    _factors.ResizeTo(_nt);
+    // In incremental mode, keep the correction factors from the previous unfolding with the same response
+    Bool_t newFactors= !_incremental || _factors.GetNrows()!=_nt;
+    if (newFactors) _factors.ResizeTo(_nt);
     Int_t nb= _nm < _nt ? _nm : _nt;
     for (int i=0; i<nb; i++) {
-      Double_t train= vtrain[i]-fakes[i];
-      if (train==0.0) continue;
-      Double_t c= vtruth[i]/train;
-      _factors[i]= c;
-      _rec[i]= c * (vmeas[i]-fac*fakes[i]);
+      if (newFactors) {
+        Double_t train= vtrain[i]-fakes[i];
+        if (train==0.0) continue;
+        _factors[i]= vtruth[i]/train;
+      }
+      _rec[i]= _factors[i] * (vmeas[i]-fac*fakes[i]);
     }
     _unfolded= true;
 }
 
+void
+RooUnfoldBinByBin::ClearUnfolding (Bool_t newResponse)
+{
+    //! The correction factors only depend on the response, so are kept for the next unfolding in incremental mode
+    //! if that has not changed.
+    if (newResponse) _factors.ResizeTo(0);
+    RooUnfold::ClearUnfolding (newResponse);
+}
+
+Bool_t
+RooUnfoldBinByBin::UnfoldBatch (const TMatrixD& meas, TMatrixD& reco, const TMatrixD* err, std::vector<TMatrixD>* cov)
+{
+    //! Unfold all the columns of meas at once, with the correction factors calculated once (see RooUnfold::UnfoldBatch)
+    if (!BatchSetup (meas, reco, err, cov, cov!=0)) return kFALSE;
+    const TVectorD& vtrain= _res->Vmeasured();
+    const TVectorD& vtruth= _res->Vtruth();
+    const TVectorD& fakes=  _res->Vfakes();
+    const Double_t  train=  _res->FakeEntries() ? vtrain.Sum() : 0.0;
+    const Int_t nb= meas.GetNcols(), nf= _nm < _nt ? _nm : _nt;
+
+    TVectorD c(_nt);
+    for (int i=0; i<nf; i++) {
+      Double_t t= vtrain[i]-fakes[i];
+      if (t!=0.0) c[i]= vtruth[i]/t;
+    }
+    for (int b=0; b<nb; b++) {
+      Double_t fac= 0.0;
+      if (train!=0.0) {
+        for (int i=0; i<_nm; i++) fac += meas(i,b);
+        fac /= train;
+      }
+      for (int i=0; i<nf; i++) reco(i,b)= c[i] * (meas(i,b)-fac*fakes[i]);
+    }
+    if (!cov) return kTRUE;
+
+    const TMatrixD* covmeas= err ? 0 : &GetMeasuredCov();
+    for (int b=0; b<nb; b++) {
+      TMatrixD& v= (*cov)[b];
+      if (err) {
+        for (int i=0; i<nf; i++) v(i,i)= c[i]*c[i]*(*err)(i,b)*(*err)(i,b);
+      } else {
+        for (int i=0; i<nf; i++)
+          for (int j=0; j<nf; j++)
+            v(i,j)= c[i]*c[j]*(*covmeas)(i,j);
+      }
+    }
+    return kTRUE;
+}
+
 void
 RooUnfoldBinByBin::GetCov()
 {
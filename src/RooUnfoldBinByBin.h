@@ -33,11 +33,13 @@ public:
   RooUnfoldBinByBin (const RooUnfoldResponse* res, const TH1* meas, const char* name=0, const char* title=0);
 
   TVectorD* Impl();
+  virtual Bool_t UnfoldBatch (const TMatrixD& meas, TMatrixD& reco, const TMatrixD* err= 0, std::vector<TMatrixD>* cov= 0);
 
 protected:
   virtual void Unfold();
   virtual void GetCov();
   virtual void GetSettings();
+  virtual void ClearUnfolding (Bool_t newResponse= kTRUE);
 
 protected:
   // instance variables
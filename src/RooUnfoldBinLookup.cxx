@@ -0,0 +1,60 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Precomputed bin lookup for histogram axes.
+//
+//==============================================================================
+
+//____________________________________________________________
+/*! \class RooUnfoldBinLookup
+\brief Precomputed bin lookup for the axes of a 1, 2, or 3-dimensional histogram.</p>
+<p>Gives the same bins as TAxis::FindFixBin, but without the virtual calls and checks for labels and extendable axes.
+Uniform axes use the same arithmetic as TAxis, and variable-width axes a branch-free binary search of a table of
+the bin edges padded to a power of 2 (see RooUnfoldAxisLookup). FindBinDim&lt;N&gt; is specialised at compile time for
+N dimensions.</p>
+<p>The lookup is only valid while the histogram's binning is not changed. The histogram axes themselves are not kept,
+so it can be used by many threads at once.</p>
+ */
+/////////////////////////////////////////////////////////////
+
+#include "RooUnfoldBinLookup.h"
+
+#include "TH1.h"
+#include "TAxis.h"
+#include "TArrayD.h"
+
+ClassImp (RooUnfoldAxisLookup);
+ClassImp (RooUnfoldBinLookup);
+
+void RooUnfoldAxisLookup::Setup (const TAxis* axis)
+{
+  //! Set up lookup of bins of axis
+  _n=     axis->GetNbins();
+  _xmin=  axis->GetXmin();
+  _xmax=  axis->GetXmax();
+  _width= _xmax-_xmin;
+  _nsteps= 0;
+  _edges.Set(0);
+  const TArrayD* bins= axis->GetXbins();
+  if (bins->GetSize() == 0) return;  // uniform bins
+  Int_t size= 1;
+  while (size < _n+1) {
+    size *= 2;
+    _nsteps++;
+  }
+  _edges.Set (size);
+  for (Int_t i= 0; i<size; i++) _edges[i]= (i<=_n) ? bins->At(i) : _xmax;
+}
+
+void RooUnfoldBinLookup::Setup (const TH1* h, Int_t ndim)
+{
+  //! Set up lookup of bins in the first ndim (default all) axes of h
+  _ndim= (ndim>0 && ndim<=3) ? ndim : h->GetDimension();
+  _axis[0].Setup (h->GetXaxis());
+  _axis[1].Setup (h->GetYaxis());
+  _axis[2].Setup (h->GetZaxis());
+  _nall= 1;
+  for (Int_t d= 0; d<_ndim; d++) _nall *= _axis[d].GetNbins();
+}
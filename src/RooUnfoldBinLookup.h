@@ -0,0 +1,201 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Precomputed bin lookup for histogram axes.
+//
+//==============================================================================
+
+#ifndef ROOUNFOLDBINLOOKUP_HH
+#define ROOUNFOLDBINLOOKUP_HH
+
+#include "Rtypes.h"
+#include "TArrayD.h"
+
+class TAxis;
+class TH1;
+
+class RooUnfoldAxisLookup {
+
+public:
+
+  RooUnfoldAxisLookup (const TAxis* axis= 0);  // lookup for axis
+  virtual ~RooUnfoldAxisLookup() {}
+
+  void  Setup (const TAxis* axis);
+  Int_t GetNbins() const;
+  Int_t FindBin (Double_t x) const;  // bin number (0 for underflow, nbins+1 for overflow), as TAxis::FindFixBin
+
+private:
+
+  Int_t    _n;        // Number of bins
+  Double_t _xmin;     // Low edge of first bin
+  Double_t _xmax;     // High edge of last bin
+  Double_t _width;    // _xmax-_xmin
+  Int_t    _nsteps;   // Number of steps in the binary search of variable-width bins (0 if uniform)
+  TArrayD  _edges;    // Bin low edges followed by _xmax, padded with _xmax to a power of 2 (variable-width bins only)
+
+public:
+
+  ClassDef (RooUnfoldAxisLookup, 0) // Precomputed bin lookup for an axis
+};
+
+class RooUnfoldBinLookup {
+
+public:
+
+  RooUnfoldBinLookup (const TH1* h= 0, Int_t ndim= 0);  // lookup for the first ndim (default all) axes of h
+  virtual ~RooUnfoldBinLookup() {}
+
+  void  Setup (const TH1* h, Int_t ndim= 0);
+  Int_t GetDimension() const;
+  Int_t GetNbins() const;  // total number of bins, not counting under/overflows
+  const RooUnfoldAxisLookup& GetAxis (Int_t i) const;
+
+  // Global histogram bin of x[0..GetDimension()-1], as TH1::FindFixBin, setting index to the vector index
+  // (-1 or GetNbins() if out of range, as RooUnfoldResponse::FindBin), and inrange if the bin is not an
+  // under/overflow on any axis. FindBinDim<N> is specialised for GetDimension()==N.
+  Int_t FindBin (const Double_t* x, Int_t& index, Bool_t& inrange) const;
+  template <Int_t N> Int_t FindBinDim (const Double_t* x, Int_t& index, Bool_t& inrange) const;
+
+  // Vector index only, as RooUnfoldResponse::FindBin
+  Int_t FindIndex (Double_t x) const;
+  Int_t FindIndex (Double_t x, Double_t y) const;
+  Int_t FindIndex (Double_t x, Double_t y, Double_t z) const;
+
+private:
+
+  Int_t _ndim;                     // Number of dimensions
+  Int_t _nall;                     // Total number of bins
+  RooUnfoldAxisLookup _axis[3];    // Axis lookups
+
+public:
+
+  ClassDef (RooUnfoldBinLookup, 0) // Precomputed bin lookup for a histogram
+};
+
+// Inline method definitions
+
+inline
+RooUnfoldAxisLookup::RooUnfoldAxisLookup (const TAxis* axis)
+  : _n(0), _xmin(0.0), _xmax(0.0), _width(0.0), _nsteps(0)
+{
+  // Constructor for lookup of bins on axis
+  if (axis) Setup (axis);
+}
+
+inline
+Int_t RooUnfoldAxisLookup::GetNbins() const
+{
+  // Return number of bins
+  return _n;
+}
+
+inline
+Int_t RooUnfoldAxisLookup::FindBin (Double_t x) const
+{
+  // Return bin number containing x (0 for underflow, GetNbins()+1 for overflow).
+  // Same as TAxis::FindFixBin, including the floating-point rounding at bin edges.
+  if (x < _xmin)     return 0;
+  if (!(x < _xmax))  return _n+1;
+  if (_nsteps == 0)  return 1 + Int_t (_n*(x-_xmin)/_width);
+  // Branch-free binary search for the last edge <= x: _edges[0] <= x < _xmax
+  const Double_t* e= _edges.GetArray();
+  Int_t lo= 0;
+  for (Int_t half= _edges.GetSize()/2, s= 0; s<_nsteps; s++, half /= 2)
+    lo += (e[lo+half] <= x) ? half : 0;
+  return lo+1;
+}
+
+inline
+RooUnfoldBinLookup::RooUnfoldBinLookup (const TH1* h, Int_t ndim)
+  : _ndim(0), _nall(0)
+{
+  // Constructor for lookup of bins in the first ndim (default all) axes of h
+  if (h) Setup (h, ndim);
+}
+
+inline
+Int_t RooUnfoldBinLookup::GetDimension() const
+{
+  // Return number of dimensions (0 if not set up)
+  return _ndim;
+}
+
+inline
+Int_t RooUnfoldBinLookup::GetNbins() const
+{
+  // Return total number of bins, not counting under/overflows
+  return _nall;
+}
+
+inline
+const RooUnfoldAxisLookup& RooUnfoldBinLookup::GetAxis (Int_t i) const
+{
+  // Return lookup for axis i (0, 1, or 2 for x, y, or z)
+  return _axis[i];
+}
+
+template <Int_t N> inline
+Int_t RooUnfoldBinLookup::FindBinDim (const Double_t* x, Int_t& index, Bool_t& inrange) const
+{
+  // Global bin and vector index of x[0..N-1], for GetDimension()==N
+  Int_t bin= 0, stride= 1, istride= 1;
+  index= 0;
+  inrange= kTRUE;
+  for (Int_t d= 0; d<N; d++) {
+    const Int_t n= _axis[d].GetNbins();
+    const Int_t b= _axis[d].FindBin (x[d]);
+    bin += stride*b;
+    stride *= n+2;
+    if (b<1 || b>n) {
+      if (inrange) index= (b<1 ? -1 : _nall);
+      inrange= kFALSE;
+    } else if (inrange) {
+      index += istride*(b-1);
+      istride *= n;
+    }
+  }
+  return bin;
+}
+
+inline
+Int_t RooUnfoldBinLookup::FindBin (const Double_t* x, Int_t& index, Bool_t& inrange) const
+{
+  // Global bin and vector index of x[0..GetDimension()-1]
+  if (_ndim==1) return FindBinDim<1> (x, index, inrange);
+  if (_ndim==2) return FindBinDim<2> (x, index, inrange);
+  return               FindBinDim<3> (x, index, inrange);
+}
+
+inline
+Int_t RooUnfoldBinLookup::FindIndex (Double_t x) const
+{
+  // Vector index (0..nx-1) for bin containing x, or -1 or nx if out of range
+  return _axis[0].FindBin (x) - 1;
+}
+
+inline
+Int_t RooUnfoldBinLookup::FindIndex (Double_t x, Double_t y) const
+{
+  // Vector index (0..nx*ny-1) for bin containing (x,y), or -1 or nx*ny if out of range
+  const Double_t xy[2]= { x, y };
+  Int_t index;
+  Bool_t inrange;
+  FindBinDim<2> (xy, index, inrange);
+  return index;
+}
+
+inline
+Int_t RooUnfoldBinLookup::FindIndex (Double_t x, Double_t y, Double_t z) const
+{
+  // Vector index (0..nx*ny*nz-1) for bin containing (x,y,z), or -1 or nx*ny*nz if out of range
+  const Double_t xyz[3]= { x, y, z };
+  Int_t index;
+  Bool_t inrange;
+  FindBinDim<3> (xyz, index, inrange);
+  return index;
+}
+
+#endif
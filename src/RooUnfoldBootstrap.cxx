@@ -0,0 +1,166 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Poisson bootstrap replicas of the training histograms of a
+//      RooUnfoldResponse, filled in the same pass as the nominal.
+//
+//==============================================================================
+
+//____________________________________________________________
+/*! \class RooUnfoldBootstrap
+\brief Poisson bootstrap replicas of the measured, fakes, truth, and response histograms of a RooUnfoldResponse.</p>
+<p>Each training event is added to every replica with an integer weight drawn from a Poisson distribution with
+mean 1 (times the event weight). The weights come from a hash of the seed, the event number, and the replica number
+(see PoissonWeight), rather than a sequential random number generator, so the replicas are the same whichever
+order the events are filled in, or by whichever thread, so long as each event keeps its event number.</p>
+<p>Only the bins that are filled are stored, with the sums for all replicas of a bin kept together and found
+through a hash map of the bin numbers, so the memory needed is the number of non-empty bins times the number of
+replicas, not the full size of each histogram.</p>
+<p>Normally used through RooUnfoldResponse::SetBootstrap, which fills the replicas along with the nominal histograms
+in RooUnfoldResponse::Fill, Miss, Fake, FillN, and in RooUnfoldResponseFiller.</p>
+ */
+/////////////////////////////////////////////////////////////
+
+#include "RooUnfoldBootstrap.h"
+
+#include <iostream>
+#include <vector>
+#include <unordered_map>
+
+#include "TH1.h"
+
+using std::cerr;
+using std::endl;
+using std::vector;
+using std::unordered_map;
+
+ClassImp (RooUnfoldBootstrap);
+
+void RooUnfoldBootstrap::Setup (Int_t nrep, UInt_t seed)
+{
+  //! Set number of replicas and the seed for their event weights, and clear.
+  //! Events are numbered from 0.
+  _nrep= nrep>0 ? nrep : 0;
+  _seed= seed;
+  _next= 0;
+  _wrep.assign (_nrep, 0);
+  _zero= kTRUE;
+  Reset();
+}
+
+void RooUnfoldBootstrap::Reset()
+{
+  //! Remove all replica contents, keeping the number of replicas, seed, and event number
+  for (Int_t h= 0; h<kNhist; h++) {
+    _slot[h].clear();
+    _bin [h].clear();
+    _sum [h].clear();
+  }
+}
+
+static inline ULong64_t SplitMix64 (ULong64_t x)
+{
+  // SplitMix64 finaliser: a bijective hash with good avalanche
+  x += 0x9E3779B97F4A7C15ULL;
+  x= (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x= (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+Int_t RooUnfoldBootstrap::PoissonWeight (UInt_t seed, Long64_t event, Int_t replica)
+{
+  //! Poisson(1) weight of event in replica. This is a counter-based random number: a pure function of
+  //! seed, event, and replica, so it does not matter in which order, or in which thread, the events are filled.
+  ULong64_t x= SplitMix64 ((ULong64_t(seed) << 32) | UInt_t(replica));
+  x= SplitMix64 (x ^ ULong64_t(event));
+  const Double_t u= Double_t (x >> 11) * (1.0/9007199254740992.0);  // uniform in [0,1) from the top 53 bits
+  // Invert the Poisson(1) cumulative distribution: P(k)= exp(-1)/k!
+  Double_t p= 0.36787944117144233, c= p;
+  Int_t k= 0;
+  while (u >= c && k < 20) {
+    k++;
+    p /= k;
+    c += p;
+  }
+  return k;
+}
+
+void RooUnfoldBootstrap::BeginEvent (Long64_t event)
+{
+  //! Take the replica weights for the following AddBin calls from event, which becomes the last event filled
+  _zero= kTRUE;
+  for (Int_t r= 0; r<_nrep; r++) {
+    _wrep[r]= PoissonWeight (_seed, event, r);
+    if (_wrep[r]) _zero= kFALSE;
+  }
+  _next= event+1;
+}
+
+Int_t RooUnfoldBootstrap::Slot (Int_t h, Int_t bin)
+{
+  //! Index in _bin of bin of histogram h, adding it if not yet filled.
+  //! The index is kept in a hash map, so only the filled bins take memory.
+  std::pair<unordered_map<Int_t,Int_t>::iterator,bool> ins= _slot[h].insert (std::make_pair (bin, Int_t(_bin[h].size())));
+  if (ins.second) {
+    _bin[h].push_back (bin);
+    _sum[h].resize (_sum[h].size()+_nrep, 0.0);
+  }
+  return ins.first->second;
+}
+
+void RooUnfoldBootstrap::AddBin (Int_t h, Int_t bin, Double_t w)
+{
+  //! Add the current event (see BeginEvent), with weight w, to bin of histogram h in each replica
+  if (_zero || bin < 0) return;
+  Double_t* sum= &_sum[h][Slot(h,bin)*_nrep];
+  for (Int_t r= 0; r<_nrep; r++)
+    if (_wrep[r]) sum[r] += w*_wrep[r];
+}
+
+Bool_t RooUnfoldBootstrap::Merge (const RooUnfoldBootstrap& other)
+{
+  //! Add the replicas of another RooUnfoldBootstrap, eg. filled by another thread.
+  //! Both must have the same number of replicas and seed. The next event number is the later of the two.
+  //! Returns false, without changing the replicas, if they cannot be merged.
+  if (!SameReplicas (other)) {
+    cerr << "RooUnfoldBootstrap::Merge: cannot merge " << other._nrep << " replicas with seed " << other._seed
+         << " into " << _nrep << " replicas with seed " << _seed << endl;
+    return kFALSE;
+  }
+  for (Int_t h= 0; h<kNhist; h++) {
+    for (Int_t i= 0, n= other._bin[h].size(); i<n; i++) {
+      Double_t* sum= &_sum[h][Slot(h,other._bin[h][i])*_nrep];
+      const Double_t* osum= &other._sum[h][i*_nrep];
+      for (Int_t r= 0; r<_nrep; r++) sum[r] += osum[r];
+    }
+  }
+  if (other._next > _next) _next= other._next;
+  return kTRUE;
+}
+
+Double_t RooUnfoldBootstrap::GetBinContent (Int_t h, Int_t bin, Int_t replica) const
+{
+  //! Content of bin of histogram h in replica (0 if not filled)
+  if (replica<0 || replica>=_nrep || bin<0) return 0.0;
+  unordered_map<Int_t,Int_t>::const_iterator it= _slot[h].find (bin);
+  return it==_slot[h].end() ? 0.0 : _sum[h][it->second*_nrep+replica];
+}
+
+void RooUnfoldBootstrap::SetReplica (Int_t replica, TH1* const hist[kNhist]) const
+{
+  //! Set the filled bins of the measured, fakes, truth, and response histograms (any can be 0) to their
+  //! contents in replica. The other bins are not changed, so hist[] should be copies of the histograms
+  //! with no events other than those in the replicas. Bin errors stored with Sumw2 are not changed.
+  if (replica<0 || replica>=_nrep) {
+    cerr << "RooUnfoldBootstrap::SetReplica: no replica " << replica << " of " << _nrep << endl;
+    return;
+  }
+  for (Int_t h= 0; h<kNhist; h++) {
+    if (!hist[h]) continue;
+    const Double_t* sum= _sum[h].empty() ? 0 : &_sum[h][replica];
+    for (Int_t i= 0, n= _bin[h].size(); i<n; i++)
+      hist[h]->SetBinContent (_bin[h][i], sum[i*_nrep]);
+  }
+}
@@ -0,0 +1,126 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Poisson bootstrap replicas of the training histograms of a
+//      RooUnfoldResponse, filled in the same pass as the nominal.
+//
+//==============================================================================
+
+#ifndef ROOUNFOLDBOOTSTRAP_HH
+#define ROOUNFOLDBOOTSTRAP_HH
+
+#include "Rtypes.h"
+#include <vector>
+#include <unordered_map>
+
+class TH1;
+
+class RooUnfoldBootstrap {
+
+public:
+
+  enum { kMes, kFak, kTru, kRes, kNhist };  // Measured, fakes, truth, and response histograms (as RooUnfoldResponseFiller)
+
+  RooUnfoldBootstrap (Int_t nrep= 0, UInt_t seed= 1);  // nrep replicas with weights from seed
+  virtual ~RooUnfoldBootstrap() {}
+
+  void     Setup (Int_t nrep, UInt_t seed= 1);  // set number of replicas and seed, and clear
+  void     Reset();                             // clear replicas, keeping the number of replicas, seed, and event number
+  Int_t    GetNReplicas() const;
+  UInt_t   GetSeed() const;
+  Long64_t GetNextEvent() const;                // event number of next event
+  void     SetNextEvent (Long64_t event);
+
+  void     BeginEvent (Long64_t event);              // weights of event for the following AddBin calls
+  void     AddBin (Int_t h, Int_t bin, Double_t w);  // add event with weight w to bin of histogram h of each replica
+  Bool_t   SameReplicas (const RooUnfoldBootstrap& other) const;  // same number of replicas and seed?
+  Bool_t   Merge (const RooUnfoldBootstrap& other);  // add replicas with the same number of replicas and seed
+
+  Int_t    GetNbins (Int_t h) const;                 // number of bins of histogram h filled
+  Int_t    GetBin (Int_t h, Int_t i) const;          // histogram bin number of i'th filled bin
+  Double_t GetBinContent (Int_t h, Int_t bin, Int_t replica) const;
+  void     SetReplica (Int_t replica, TH1* const hist[kNhist]) const;  // set the filled bins of the histograms
+
+  static Int_t PoissonWeight (UInt_t seed, Long64_t event, Int_t replica);  // Poisson(1) weight of event in replica
+
+private:
+
+  Int_t   Slot (Int_t h, Int_t bin);
+
+  // instance variables
+
+  Int_t    _nrep;                        // Number of replicas
+  UInt_t   _seed;                        // Seed for the replica weights
+  Long64_t _next;                        // Event number of next event
+  std::unordered_map<Int_t,Int_t> _slot[kNhist];  // Index in _bin of each filled histogram bin
+  std::vector<Int_t>    _bin [kNhist];   // Histogram bin number of each filled bin
+  std::vector<Double_t> _sum [kNhist];   // Sums of weights of each filled bin in each replica, _sum[h][i*_nrep+r]
+  std::vector<Int_t>    _wrep;           //! Weights of the current event in each replica
+  Bool_t   _zero;                        //! All weights of the current event are 0
+
+public:
+
+  ClassDef (RooUnfoldBootstrap, 0) // Poisson bootstrap replicas of response training histograms
+};
+
+// Inline method definitions
+
+inline
+RooUnfoldBootstrap::RooUnfoldBootstrap (Int_t nrep, UInt_t seed)
+{
+  // Constructor for nrep replicas, with event weights from seed
+  Setup (nrep, seed);
+}
+
+inline
+Int_t RooUnfoldBootstrap::GetNReplicas() const
+{
+  // Return number of replicas
+  return _nrep;
+}
+
+inline
+UInt_t RooUnfoldBootstrap::GetSeed() const
+{
+  // Return seed used for the replica weights
+  return _seed;
+}
+
+inline
+Long64_t RooUnfoldBootstrap::GetNextEvent() const
+{
+  // Return event number of next event
+  return _next;
+}
+
+inline
+void RooUnfoldBootstrap::SetNextEvent (Long64_t event)
+{
+  // Set event number of next event, eg. the first event filled by a thread
+  _next= event;
+}
+
+inline
+Bool_t RooUnfoldBootstrap::SameReplicas (const RooUnfoldBootstrap& other) const
+{
+  // Return true if other has the same number of replicas and seed, so its replicas can be merged with these
+  return other._nrep == _nrep && other._seed == _seed;
+}
+
+inline
+Int_t RooUnfoldBootstrap::GetNbins (Int_t h) const
+{
+  // Return number of bins of histogram h filled in any replica
+  return _bin[h].size();
+}
+
+inline
+Int_t RooUnfoldBootstrap::GetBin (Int_t h, Int_t i) const
+{
+  // Return histogram bin number of i'th filled bin (i=0..GetNbins(h)-1) of histogram h
+  return _bin[h][i];
+}
+
+#endif
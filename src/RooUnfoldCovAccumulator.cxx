@@ -0,0 +1,118 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Single-pass mean and covariance of a set of vectors (eg. toy results).
+//
+//==============================================================================
+
+//____________________________________________________________
+/*! \class RooUnfoldCovAccumulator
+\brief Single-pass (Welford) mean and covariance matrix of a set of vectors, eg. the results of toy MC tests.</p>
+<p>Each vector is added with Add(). The running mean and the sums of products of deviations from it are updated,
+so the vectors themselves are not kept and the memory needed does not depend on how many are added.
+This is also more accurate than accumulating sums of x and x*x.</p>
+<p>Accumulators filled separately (eg. in different threads) can be combined with Merge(), giving the same
+mean and covariance (up to rounding) as if all the vectors had been added to one accumulator.
+Accumulators can also be written to a file, eg. to merge the results of toys run on different machines.</p>
+ */
+/////////////////////////////////////////////////////////////
+
+#include "RooUnfoldCovAccumulator.h"
+
+#include <iostream>
+
+using std::cerr;
+using std::endl;
+
+ClassImp (RooUnfoldCovAccumulator);
+
+void RooUnfoldCovAccumulator::Reset (Int_t n)
+{
+  //! Remove all the vectors and set vector size to n
+  _n= n;
+  _mean .ResizeTo (_n);
+  _m2   .ResizeTo (_n, _n);
+  _delta.ResizeTo (_n);
+  Reset();
+}
+
+void RooUnfoldCovAccumulator::Add (const Double_t* x)
+{
+  //! Add one vector of GetSize() elements.
+  //! Rank-1 update of the upper triangle of the sums of products of deviations.
+  if (_delta.GetNrows()!=_n) _delta.ResizeTo (_n);  // workspace is not read from files
+  _count++;
+  const Double_t f= 1.0/Double_t(_count);
+  Double_t* mean=  _mean .GetMatrixArray();
+  Double_t* delta= _delta.GetMatrixArray();
+  for (Int_t i= 0; i<_n; i++) {
+    delta[i]= x[i]-mean[i];
+    mean[i] += delta[i]*f;
+  }
+  if (_count==1) return;
+  Double_t* m2= _m2.GetMatrixArray();
+  for (Int_t i= 0; i<_n; i++) {
+    const Double_t di= delta[i];
+    if (di==0.0) continue;
+    Double_t* row= m2+Long64_t(i)*_n;
+    for (Int_t j= i; j<_n; j++) row[j] += di*(x[j]-mean[j]);
+  }
+}
+
+void RooUnfoldCovAccumulator::Merge (const RooUnfoldCovAccumulator& other)
+{
+  //! Add all the vectors of another accumulator of the same size (Chan et al. pairwise update).
+  if (other._count==0) return;
+  if (other._n != _n) {
+    cerr << "RooUnfoldCovAccumulator::Merge: cannot merge vectors of size " << other._n
+         << " with size " << _n << endl;
+    return;
+  }
+  if (_count==0) {
+    _count= other._count;
+    _mean=  other._mean;
+    _m2=    other._m2;
+    return;
+  }
+  const Double_t na= _count, nb= other._count, nab= na+nb;
+  const Double_t fb= nb/nab, fab= na*nb/nab;
+  if (_delta.GetNrows()!=_n) _delta.ResizeTo (_n);
+  Double_t* mean=  _mean .GetMatrixArray();
+  Double_t* delta= _delta.GetMatrixArray();
+  const Double_t* omean= other._mean.GetMatrixArray();
+  for (Int_t i= 0; i<_n; i++) {
+    delta[i]= omean[i]-mean[i];
+    mean[i] += delta[i]*fb;
+  }
+  Double_t* m2= _m2.GetMatrixArray();
+  const Double_t* om2= other._m2.GetMatrixArray();
+  for (Int_t i= 0; i<_n; i++) {
+    const Double_t di= delta[i]*fab;
+    Double_t*       row=  m2 +Long64_t(i)*_n;
+    const Double_t* orow= om2+Long64_t(i)*_n;
+    for (Int_t j= i; j<_n; j++) row[j] += orow[j] + di*delta[j];
+  }
+  _count += other._count;
+}
+
+void RooUnfoldCovAccumulator::GetCovariance (TMatrixD& cov, Bool_t unbiased) const
+{
+  //! Fill cov with the covariance matrix of the vectors added.
+  //! Divides by N-1 if unbiased, otherwise by N. Zero if there are too few vectors.
+  cov.ResizeTo (_n, _n);
+  Long64_t nd= unbiased ? _count-1 : _count;
+  if (nd<=0) {
+    cov.Zero();
+    return;
+  }
+  const Double_t f= 1.0/Double_t(nd);
+  const Double_t* m2= _m2.GetMatrixArray();
+  Double_t* c= cov.GetMatrixArray();
+  for (Int_t i= 0; i<_n; i++) {
+    for (Int_t j= i; j<_n; j++) {
+      c[Long64_t(i)*_n+j]= c[Long64_t(j)*_n+i]= m2[Long64_t(i)*_n+j]*f;
+    }
+  }
+}
@@ -0,0 +1,104 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Single-pass mean and covariance of a set of vectors (eg. toy results).
+//
+//==============================================================================
+
+#ifndef ROOUNFOLDCOVACCUMULATOR_HH
+#define ROOUNFOLDCOVACCUMULATOR_HH
+
+#include "Rtypes.h"
+#include "TVectorD.h"
+#include "TMatrixD.h"
+
+class RooUnfoldCovAccumulator {
+
+public:
+
+  RooUnfoldCovAccumulator (Int_t n= 0); // accumulator for vectors of size n
+  virtual ~RooUnfoldCovAccumulator() {}
+
+  void            Reset (Int_t n);                  // clear and set vector size
+  void            Reset();                          // clear
+  void            Add (const TVectorD& x);          // add one vector
+  void            Add (const Double_t* x);          // add one vector of GetSize() elements
+  void            Merge (const RooUnfoldCovAccumulator& other); // add all the vectors of another accumulator
+
+  Int_t           GetSize() const;                  // vector size
+  Long64_t        GetEntries() const;               // number of vectors added
+  const TVectorD& GetMean() const;                  // mean vector
+  void            GetCovariance (TMatrixD& cov, Bool_t unbiased= kTRUE) const;
+  TMatrixD        GetCovariance (Bool_t unbiased= kTRUE) const;
+
+private:
+
+  Int_t    _n;      // vector size
+  Long64_t _count;  // number of vectors added
+  TVectorD _mean;   // running mean
+  TMatrixD _m2;     // sum of products of deviations from the mean (upper triangle)
+  TVectorD _delta;  //! workspace
+
+public:
+  ClassDef (RooUnfoldCovAccumulator, 1) // Single-pass mean and covariance
+};
+
+// Inline method definitions
+
+inline
+RooUnfoldCovAccumulator::RooUnfoldCovAccumulator (Int_t n)
+  : _n(0), _count(0)
+{
+  // Constructor for vectors of size n
+  Reset (n);
+}
+
+inline
+void RooUnfoldCovAccumulator::Reset()
+{
+  // Remove all the vectors, keeping the size
+  _count= 0;
+  _mean.Zero();
+  _m2.Zero();
+}
+
+inline
+void RooUnfoldCovAccumulator::Add (const TVectorD& x)
+{
+  // Add one vector
+  Add (x.GetMatrixArray());
+}
+
+inline
+Int_t RooUnfoldCovAccumulator::GetSize() const
+{
+  // Return vector size
+  return _n;
+}
+
+inline
+Long64_t RooUnfoldCovAccumulator::GetEntries() const
+{
+  // Return number of vectors added
+  return _count;
+}
+
+inline
+const TVectorD& RooUnfoldCovAccumulator::GetMean() const
+{
+  // Return mean of the vectors added
+  return _mean;
+}
+
+inline
+TMatrixD RooUnfoldCovAccumulator::GetCovariance (Bool_t unbiased) const
+{
+  // Return covariance matrix of the vectors added
+  TMatrixD cov;
+  GetCovariance (cov, unbiased);
+  return cov;
+}
+
+#endif
@@ -3,7 +3,7 @@
 //      $Id$
 //
 // Description:
-//      Unfolding interface to Fortran routine, BAYES, by G. D'Agostini from
+//      Unfolding with D'Agostini's BAYES algorithm, as in his Fortran routine from
 //      http://www.roma1.infn.it/~dagos/bayes_distr.txt
 //
 // Authors: Tim Adye <T.J.Adye@rl.ac.uk>
@@ -12,7 +12,17 @@
 
 //____________________________________________________________
 /*! \class RooUnfoldDagostini
- \brief Unfolding interface to Fortran routine, BAYES, by G. D'Agostini from http://www.roma1.infn.it/~dagos/bayes_distr.txt .
+ \brief Unfolding with D'Agostini's BAYES algorithm, from http://www.roma1.infn.it/~dagos/bayes_distr.txt .
+ <p>This is a C++ implementation of the iterations and data-statistics covariance of the BAYES Fortran routine
+ (as called previously with mode=2, er_mode=20). It works directly on the RooUnfoldResponse matrix, with no limit on the
+ number of bins, and keeps its buffers in the object, so several instances can unfold at the same time
+ (eg. in parallel toys).</p>
+ <p>Fakes, if any, are treated as an extra cause. The covariance matrix uses the unfolding matrix of the last
+ iteration, with multinomial errors on the measured distribution (NIM A 362 (1995) 487).
+ For the full error propagation through the iterations, use RooUnfoldBayes.</p>
+ <p>Versions linked with the Fortran routine copied its Vc0_u matrix instead. Covariances from that version
+ may not match this one exactly. The unfolded result is the same as from RooUnfoldBayes (without smoothing)
+ for the same number of iterations, which test/RooUnfoldTestDagostini.sh checks.</p>
 */
 
 /////////////////////////////////////////////////////////////
@@ -32,27 +42,6 @@ using std::cout;
 using std::cerr;
 using std::endl;
 
-// SIZE_C and SIZE_E must agree exactly with PARAMETERs in bayes.for.
-#define SIZE_C 100
-#define SIZE_E 100
-
-extern "C" {
-  // bayes_ arguments must agree with the BAYES subroutine in bayes.for.
-  extern void bayes_ (const int* noc, const int* noe, int* nsteps, const int* mode, const int* er_mode, const int* keep, int* ier);
-  // bayesc_ must agree with the /BAYESC/ common block in bayes_c.for.
-  extern struct {
-    float pec[SIZE_C][SIZE_E], pce[SIZE_E][SIZE_C], 
-          pc[SIZE_C], ne[SIZE_E], nc[SIZE_C], 
-          nec_mc[SIZE_C][SIZE_E], nc_mc[SIZE_C], 
-          Vc[SIZE_C][SIZE_C], eff[SIZE_C], eff_0, eff_true,
-          Vc0[SIZE_C][SIZE_C], Vc1[SIZE_C][SIZE_C],
-          M_unf[SIZE_E][SIZE_C], Vc_u[SIZE_C][SIZE_C],
-          Vc0_u[SIZE_C][SIZE_C], Vpc[SIZE_C][SIZE_C],
-          Vpc0[SIZE_C][SIZE_C], Vpc1[SIZE_C][SIZE_C];
-  } bayesc_;
-}
-
-
 ClassImp (RooUnfoldDagostini);
 
 RooUnfoldDagostini::RooUnfoldDagostini (const RooUnfoldDagostini& rhs)
@@ -108,54 +97,74 @@ RooUnfoldDagostini::Assign (const RooUnfoldDagostini& rhs)
 void
 RooUnfoldDagostini::Unfold()
 {
-  Int_t nt= _nt, nm= _nm;
-  if (nt > SIZE_C) {
-    cerr << nt << " truth bins is too large - maximum is "  << SIZE_C << endl;
-    nt= SIZE_C;
-  }
-  if (nm > SIZE_E) {
-    cerr << nm << " measured bins is too large - maximum is "  << SIZE_E << endl;
-    nm= SIZE_E;
-  }
+  //! Iterate P(C_i|E_j) = P(E_j|C_i) P(C_i) / sum_l P(E_j|C_l) P(C_l), starting from the training truth
+  //! as the prior, and taking the next prior from the unfolded distribution.
+  //! The probabilities P(E_j|C_i) are read from the response matrix in place, one measured bin (row) at a time.
   if (_haveCovMes) cerr << "Warning: BAYES does not account for bin-bin correlations on measured input" << endl;
-  
+
   const TMatrixD& res= _res->Mresponse();
   const TVectorD& tru= _res->Vtruth();
   const TVectorD& meas= Vmeasured();
-  Double_t ntrue= 0;
-  for (Int_t i= 0; i < nt; i++) {
-    bayesc_.pc[i]=    tru(i);
-    bayesc_.nc_mc[i]= tru(i);
-    ntrue +=  tru(i);
-    for (Int_t j= 0; j < nm; j++)
-      bayesc_.nec_mc[i][j]= tru(i) * res(j,i);
-  }
-
-  Int_t ntf= nt;
-  if (_res->FakeEntries()) {
-    TVectorD fakes= _res->Vfakes();
+  const Double_t* pres= res.GetMatrixArray();
+  const Bool_t havefakes= _res->FakeEntries();
+  const Int_t nc= havefakes ? _nt+1 : _nt;   // number of causes, including fakes
+
+  _prior.ResizeTo (nc);
+  _eff  .ResizeTo (nc);
+  _ncause.ResizeTo (nc);
+  _denom.ResizeTo (_nm);
+  _pfake.ResizeTo (havefakes ? _nm : 0);
+
+  Double_t ntrue= tru.Sum();
+  for (Int_t i= 0; i < _nt; i++) _prior[i]= tru[i];
+  if (havefakes) {
+    const TVectorD& fakes= _res->Vfakes();
     Double_t nfakes= fakes.Sum();
     if (_verbose>=1) cout << "Add truth bin for " << nfakes << " fakes" << endl;
-    ntf++;
-    ntrue +=              nfakes;
-    bayesc_.pc[ntf-1]=    nfakes;
-    bayesc_.nc_mc[ntf-1]= nfakes;
-    for (Int_t j= 0; j < nm; j++)
-      bayesc_.nec_mc[ntf-1][j]= fakes[j];
+    ntrue +=       nfakes;
+    _prior[_nt]=   nfakes;
+    for (Int_t j= 0; j < _nm; j++) _pfake[j]= nfakes!=0.0 ? fakes[j]/nfakes : 0.0;
+  }
+  if (ntrue <= 0.0) {
+    cerr << "RooUnfoldDagostini: no training truth entries" << endl;
+    _fail= true;
+    return;
+  }
+  _prior *= 1.0/ntrue;
+
+  // Efficiency of each cause: sum_j P(E_j|C_i)
+  _eff.Zero();
+  for (Int_t j= 0; j < _nm; j++) {
+    const Double_t* r= pres + j*_nt;
+    for (Int_t i= 0; i < _nt; i++) _eff[i] += r[i];
+    if (havefakes) _eff[_nt] += _pfake[j];
   }
 
-  for (Int_t i= 0; i < ntf; i++)
-    bayesc_.pc[i] /= ntrue;
-  for (Int_t j= 0; j < nm; j++)
-    bayesc_.ne[j]= meas(j);
-
-  int mode= 2, er_mode= 20, keep= 0, ier= 0;
-  bayes_ (&ntf, &nm, &_niter, &mode, &er_mode, &keep, &ier);
-  if (ier != 0) cerr << "BAYES returned error " << ier << endl;
+  Int_t niter= _niter>0 ? _niter : 1;
+  for (Int_t it= 0; it < niter; it++) {
+    _ncause.Zero();
+    for (Int_t j= 0; j < _nm; j++) {
+      const Double_t* r= pres + j*_nt;
+      Double_t d= havefakes ? _pfake[j]*_prior[_nt] : 0.0;
+      for (Int_t i= 0; i < _nt; i++) d += r[i]*_prior[i];
+      _denom[j]= d;
+      if (d <= 0.0) continue;
+      Double_t w= meas[j]/d;
+      for (Int_t i= 0; i < _nt; i++) _ncause[i] += r[i]*w;
+      if (havefakes) _ncause[_nt] += _pfake[j]*w;
+    }
+    Double_t sum= 0.0;
+    for (Int_t i= 0; i < nc; i++) {
+      _ncause[i]= _eff[i]>0.0 ? _ncause[i]*_prior[i]/_eff[i] : 0.0;
+      sum += _ncause[i];
+    }
+    if (it == niter-1 || sum <= 0.0) break;
+    for (Int_t i= 0; i < nc; i++) _prior[i]= _ncause[i]/sum;
+  }
 
   _rec.ResizeTo (_nt);
-  for (Int_t i= 0; i < nt; i++)
-    _rec(i)= bayesc_.nc[i];
+  for (Int_t i= 0; i < _nt; i++)
+    _rec(i)= _ncause[i];
 
   _unfolded= true;
   _haveCov=  false;
@@ -164,11 +173,24 @@ RooUnfoldDagostini::Unfold()
 void
 RooUnfoldDagostini::GetCov()
 {
-  Int_t nt= _nt < SIZE_C ? _nt : SIZE_C;
-  _cov.ResizeTo(_nt,_nt);
-  for (Int_t i= 0; i < nt; i++)
-    for (Int_t j= 0; j < nt; j++)
-      _cov(i,j)= bayesc_.Vc0_u[j][i];
+  //! Covariance from the measured distribution's statistics, with the unfolding matrix
+  //! M_ij = P(C_i|E_j)/eff_i of the last iteration fixed:
+  //! V = M diag(n(E)) M^T - n(C) n(C)^T / N, for a multinomial n(E) with N events.
+  const TMatrixD& res= _res->Mresponse();
+  const TVectorD& meas= Vmeasured();
+  _munf.ResizeTo (_nt, _nm);
+  for (Int_t i= 0; i < _nt; i++) {
+    Double_t f= _eff[i]>0.0 ? _prior[i]/_eff[i] : 0.0;
+    for (Int_t j= 0; j < _nm; j++)
+      _munf(i,j)= _denom[j]>0.0 ? res(j,i)*f/_denom[j] : 0.0;
+  }
+  ABAT (_munf, meas, _cov);
+  Double_t ntot= meas.Sum();
+  if (ntot > 0.0) {
+    for (Int_t i= 0; i < _nt; i++)
+      for (Int_t j= 0; j < _nt; j++)
+        _cov(i,j) -= _rec[i]*_rec[j]/ntot;
+  }
   _haveCov= true;
 }
 
@@ -3,7 +3,7 @@
 //      $Id$
 //
 // Description:
-//      Unfolding interface to Fortran routine, BAYES, by G. D'Agostini from
+//      Unfolding with D'Agostini's BAYES algorithm, as in his Fortran routine from
 //      http://www.roma1.infn.it/~dagos/bayes_distr.txt
 //
 // Authors: Tim Adye <T.J.Adye@rl.ac.uk>
@@ -51,6 +51,12 @@ private:
 protected:
   // instance variables
   Int_t _niter;
+  TVectorD _prior;   //! prior P(C_i) used in the last iteration (fakes in the last bin)
+  TVectorD _eff;     //! efficiency of each cause
+  TVectorD _ncause;  //! unfolded number of events in each cause
+  TVectorD _denom;   //! sum_i P(E_j|C_i) P(C_i) for each measured bin in the last iteration
+  TVectorD _pfake;   //! P(E_j|fakes), if the response has fakes
+  TMatrixD _munf;    //! unfolding matrix of the last iteration
 
 public:
   ClassDef (RooUnfoldDagostini, 1) // Bayesian Unfolding
@@ -26,6 +26,9 @@ maths needed to plot these graphs. The object requires the number of toys over w
  (0 for a simple calculation, 1 or 2 for a method based on the covariance matrix, depending on the method used for calculation of errors.). </p>
 <p>On some occasions the chi squared value can be very large. This is due to the covariance matrices being near singular and thus 
 difficult to invert reliably. A warning will be displayed if this is the case. To plot the chi squared distribution use the option Draw("chi2"), to filter out the larger values use Draw("chi2","abs(chi2 < max") where max is the largest value to be included.</p> 
+<p>The toys are taken from RooUnfold::ToyEnsemble(), so they can also be run in separate jobs and merged (see RooUnfold::RunToys()
+and RooUnfold::SetToyEnsemble()), keeping RooUnfoldToyEnsemble::kErrorSums (and kChi2 if the truth is given). Only the chi^2
+is kept for each toy, so the memory used does not grow with the number of toys times the number of bins.</p>
  */
 /////////////////////////////////////////////////////////////////
 
@@ -33,18 +36,18 @@ difficult to invert reliably. A warning will be displayed if this is the case. T
 
 #include <iostream>
 #include <cmath>
-#include <vector>
 
 #include "TString.h"
 #include "TStyle.h"
 #include "TH1D.h"
-#include "TProfile.h"
+#include "TMatrixD.h"
 #include "TNtuple.h"
 #include "TAxis.h"
 
 #include "RooUnfoldResponse.h"
 #include "RooUnfold.h"
-#include "RooUnfoldResponse.h"
+#include "RooUnfoldToyEnsemble.h"
+#include "RooUnfoldNoDirectory.h"
 
 using std::cout;
 using std::cerr;
@@ -124,11 +127,11 @@ RooUnfoldErrors::CreatePlots()
 {
   //! Gets the values for plotting. Compares unfolding errors with errors calculated from toy MC.
 
-    Bool_t oldstat= TH1::AddDirectoryStatus();
-    TH1::AddDirectory (kFALSE);
-    h_err     = new TH1D ("unferr", "Unfolding errors", ntx, xlo, xhi); 
-    h_err_res = new TH1D ("toyerr", "Toy MC RMS",       ntx, xlo, xhi); 
-    TH1::AddDirectory (oldstat);
+    {
+      RooUnfoldNoDirectory nodir;
+      h_err     = new TH1D ("unferr", "Unfolding errors", ntx, xlo, xhi); 
+      h_err_res = new TH1D ("toyerr", "Toy MC RMS",       ntx, xlo, xhi); 
+    }
 
     unfold->SetNToys(toys);
     const TVectorD errunf= unfold->ErecoV(RooUnfold::kErrors);
@@ -144,53 +147,51 @@ RooUnfoldErrors::CreatePlots()
 void
 RooUnfoldErrors::CreatePlotsWithChi2()
 {
-  //! Gets the values for plotting. Uses the Runtoy method from RooUnfold to get plots to analyse for
-  //! spread and error on the unfolding. Can also give values for a chi squared plot if a truth distribution is known
+  //! Gets the values for plotting. Uses the toys from RooUnfold::ToyEnsemble to get plots to analyse for
+  //! spread and error on the unfolding. Can also give values for a chi squared plot if a truth distribution is known.
+  //! The same toys are then used for the unfolding's kCovToy covariance matrix.
+  //! The spread of each bin comes from the ensemble's running covariance, and the mean error from its sums of
+  //! the toys' errors (kErrorSums), so only the chi^2 is kept for each toy.
 
     const Double_t maxchi2=1e10;
 
-    Bool_t oldstat= TH1::AddDirectoryStatus();
-    TH1::AddDirectory (kFALSE);
-
-    h_err     = new TProfile ("unferr", "Unfolding errors", ntx, xlo, xhi); 
-    h_err_res = new TH1D     ("toyerr", "Toy MC RMS",       ntx, xlo, xhi); 
-    hchi2     = new TNtuple  ("chi2", "chi2", "chi2");
-    std::vector<TH1D*> graph_vector(ntx);
-    for (int a=0; a<ntx; a++) {
-      TString graph_name;
-      graph_name.Form("resbin%d",a);
-      graph_vector[a]= new TH1D (graph_name,graph_name, 100,0,10000);
+    {
+      RooUnfoldNoDirectory nodir;
+      h_err     = new TH1D    ("unferr", "Unfolding errors", ntx, xlo, xhi); 
+      h_err_res = new TH1D    ("toyerr", "Toy MC RMS",       ntx, xlo, xhi); 
+      hchi2     = new TNtuple ("chi2", "chi2", "chi2");
     }
     
-    TH1::AddDirectory (oldstat);
-    
     int odd_ch=0;
-    for (int k=0; k<toys;k++){  
-        RooUnfold* toy= unfold->RunToy();
-        Double_t chi2=       toy->Chi2 (hTrue);
-        const TVectorD reco= toy->Vreco();
-        const TVectorD err=  toy->ErecoV();
-        for (int i=0; i<ntx; i++) {    
-            graph_vector[i]->Fill(reco[i]);
-            h_err->Fill(h_err->GetBinCenter(i+1),err[i]);
-        } 
-        if (hTrue){
+    unfold->SetNToys(toys);
+    Int_t contents= RooUnfoldToyEnsemble::kErrorSums;
+    if (hTrue) contents |= RooUnfoldToyEnsemble::kChi2;
+    const RooUnfoldToyEnsemble& ens= unfold->ToyEnsemble (contents, hTrue);
+    const Double_t n= ens.GetEntries();
+    if (n>0.0) {
+        TMatrixD cov;
+        ens.GetMoments().GetCovariance (cov, kFALSE);
+        const TVectorD& esum=  ens.GetErrorSum();
+        const TVectorD& esum2= ens.GetErrorSum2();
+        for (int i=0; i<ntx; i++) {
+            // mean error and its uncertainty, as from a TProfile
+            Double_t emean= esum[i]/n, evar= esum2[i]/n - emean*emean;
+            h_err->SetBinContent (i+1, emean);
+            h_err->SetBinError   (i+1, evar>0.0 ? sqrt(evar/n) : 0.0);
+            Double_t spr= sqrt(cov(i,i));
+            h_err_res->SetBinContent (i+1, spr);
+            h_err_res->SetBinError   (i+1, spr/sqrt(2*n));
+        }
+    }
+    if (hTrue){
+        for (int k=0; k<ens.GetEntries(); k++){  
+            Double_t chi2= ens.GetChi2(k);
             hchi2->Fill(chi2);
-            if (fabs(chi2)>=maxchi2 && toy->verbose()>=1){
+            if (fabs(chi2)>=maxchi2 && unfold->verbose()>=1){
                 cerr<<"Large |chi^2| value: "<< chi2 << endl;
                 odd_ch++;
             }
         }
-        delete toy;
-    }
-    for (int i=0; i<ntx; i++){
-      TH1D* graph= graph_vector[i];
-        Double_t n= graph->GetEntries();
-        if (n<=0.0) continue;
-        Double_t spr= graph->GetRMS();
-        h_err_res->SetBinContent (i+1, spr);
-        h_err_res->SetBinError   (i+1, spr/sqrt(2*n));
-        delete graph;
     }
     
     if (odd_ch){
@@ -7,6 +7,8 @@
 
 #include "RooUnfoldIds.h"
 #include "RooUnfoldResponse.h"
+#include "RooUnfoldCovAccumulator.h"
+#include "RooUnfoldNoDirectory.h"
 
 #include <iostream>
 
@@ -62,21 +64,38 @@ RooUnfoldIds::Reset()
 void
 RooUnfoldIds::Destroy()
 {
-   delete _meas1d;
-   delete _train1d;
-   delete _truth1d;
-   delete _reshist;
 }
 
 //______________________________________________________________________________
 void
 RooUnfoldIds::Init()
 {
-   _meas1d = _train1d = _truth1d = 0;
-   _reshist = 0;
+   _vtrain.ResizeTo(0);
+   _vtruth.ResizeTo(0);
+   _mmig.ResizeTo(0, 0);
+   _emig.ResizeTo(0, 0);
+   _vmeas.ResizeTo(0);
+   _convTol = 0.;
+   _convRelative = kFALSE;
+   _niterUsed = 0;
    GetSettings();
 }
 
+//______________________________________________________________________________
+void
+RooUnfoldIds::ClearUnfolding(Bool_t newResponse)
+{
+   //! Drop the measured distribution. The training inputs are kept unless the response has changed.
+   _vmeas.ResizeTo(0);
+   if (newResponse) {
+      _vtrain.ResizeTo(0);
+      _vtruth.ResizeTo(0);
+      _mmig.ResizeTo(0, 0);
+      _emig.ResizeTo(0, 0);
+   }
+   RooUnfold::ClearUnfolding(newResponse);
+}
+
 //______________________________________________________________________________
 void
 RooUnfoldIds::Assign(const RooUnfoldIds &rhs)
@@ -94,12 +113,16 @@ RooUnfoldIds::CopyData(const RooUnfoldIds &rhs)
    _lambdaUmin = rhs._lambdaUmin;
    _lambdaMmin = rhs._lambdaMmin;
    _lambdaS = rhs._lambdaS;
+   _convTol = rhs._convTol;
+   _convRelative = rhs._convRelative;
 }
 
 //______________________________________________________________________________
 void
-RooUnfoldIds::Unfold()
+RooUnfoldIds::SetupInputs()
 {
+   //! Copy the measured and training distributions used by the unfolding and the toys into vectors,
+   //! padded to _nb bins, directly from the cached vectors and the response histogram.
    //! Data and MC reco/truth must have the same number of bins
    if (_res->FakeEntries()) {
       _nb = _nt+1;
@@ -108,41 +131,57 @@ RooUnfoldIds::Unfold()
       _nb = _nm > _nt ? _nm : _nt;
    }
 
-   Bool_t oldstat= TH1::AddDirectoryStatus();
-   TH1::AddDirectory (kFALSE);
-
-   _meas1d  = HistNoOverflow(_meas            , _overflow); // data
-   _train1d = HistNoOverflow(_res->Hmeasured(), _overflow); // reco
-   _truth1d = HistNoOverflow(_res->Htruth()   , _overflow); // true
-   _reshist = _res->HresponseNoOverflow();
-
-   Resize(_meas1d,  _nb);
-   Resize(_train1d, _nb);
-   Resize(_truth1d, _nb);
-   Resize(_reshist, _nb, _nb);
+   _vmeas.ResizeTo(_nm);
+   _vmeaserr.ResizeTo(_nm);
+   _vmeas    = Vmeasured(); // data
+   _vmeaserr = Emeasured();
+   _vmeas.ResizeTo(_nb);
+   _vmeaserr.ResizeTo(_nb);
+
+   // Training inputs are kept if the response has not changed
+   if (!_mmig.GetNrows()) {
+      _vtrain.ResizeTo(_nm);
+      _vtruth.ResizeTo(_nt);
+      _vtrain = _res->Vmeasured(); // reco
+      _vtruth = _res->Vtruth();    // true
+      _vtrain.ResizeTo(_nb);
+      _vtruth.ResizeTo(_nb);
+      _mmig.ResizeTo(_nm, _nt);
+      RooUnfoldResponse::H2M(_res->Hresponse(), _mmig, 0, _overflow); // number of events
+      _mmig.ResizeTo(_nb, _nb);
+
+      // Fakes are put in an extra truth bin
+      if (_res->FakeEntries()) {
+         const TVectorD& fakes = _res->Vfakes();
+         Double_t nfakes = fakes.Sum();
+         if (_verbose >= 1) std::cout << "Add truth bin for " << nfakes << " fakes" << std::endl;
+         for (Int_t i = 0; i < _nm; ++i) _mmig(i, _nt) = fakes[i];
+         _vtruth[_nt] = nfakes;
+      }
 
-   // Something about fakes here?
-   if (_res->FakeEntries()) {
-      TVectorD fakes = _res->Vfakes();
-      Double_t nfakes = fakes.Sum();
-      if (_verbose >= 1) std::cout << "Add truth bin for " << nfakes << " fakes" << std::endl;
-      for (Int_t i = 0; i < _nm; ++i) _reshist->SetBinContent(i+1, _nt+1, fakes[i]);
-      _truth1d->SetBinContent(_nt+1, nfakes);
+      _recomatch.ResizeTo(_nb);
+      _truthmatch.ResizeTo(_nb);
+      MatchedProjections(_mmig, _recomatch, _truthmatch);
    }
+}
 
-   if (_verbose >= 1) std::cout << "IDS init " << _reshist->GetNbinsX() << " x " << _reshist->GetNbinsY() << std::endl;
+//______________________________________________________________________________
+void
+RooUnfoldIds::Unfold()
+{
+   SetupInputs();
+
+   if (_verbose >= 1) std::cout << "IDS init " << _nb << " x " << _nb << std::endl;
 
    // Perform IDS unfolding
-   TH1D *rechist = dynamic_cast<TH1D*>(GetIDSUnfoldedSpectrum(_train1d, _truth1d, _reshist, _meas1d, _niter));
+   TVectorD rec(_nb);
+   _niterUsed = GetIDSUnfoldedSpectrum(_vtrain, _vtruth, _mmig, _recomatch, _truthmatch, _vmeas, _vmeaserr, _niter, rec);
 
    _rec.ResizeTo(_nt);
    for (Int_t i = 0; i < _nt; ++i) {
-     _rec[i] = rechist->GetBinContent(i+1);
+     _rec[i] = rec[i];
    }
 
-   delete rechist;
-   TH1::AddDirectory(oldstat);
-
    _unfolded = kTRUE;
    _haveCov = kFALSE;
 }
@@ -151,34 +190,29 @@ RooUnfoldIds::Unfold()
 void
 RooUnfoldIds::GetCov()
 {
-   if (!_meas1d) return;
-
-   Bool_t oldstat = TH1::AddDirectoryStatus();
-   TH1::AddDirectory(kFALSE);
+   if (!_vmeas.GetNrows()) return;
 
-   TH2D *meascov = new TH2D("meascov", "meascov", _nb, 0.0, 1.0, _nb, 0.0, 1.0);
-   const TMatrixD& cov = GetMeasuredCov();
-   for (Int_t i = 0; i < _nm; ++i)
-     for (Int_t j = 0; j < _nm; ++j)
-       meascov->SetBinContent(i+1, j+1, cov(i,j));
+   const TMatrixD* cov = &GetMeasuredCov();   // used in place if no padding is needed
+   TMatrixD meascov;
+   if (_nb != _nm) {
+      meascov.ResizeTo(_nm, _nm);
+      meascov = *cov;
+      meascov.ResizeTo(_nb, _nb);
+      cov = &meascov;
+   }
 
    // Need to fill _cov with unfolded result
-   TH2D *unfoldedCov = GetUnfoldCovMatrix(meascov, _NToys);
-   TH2D *adetCov     = GetAdetCovMatrix(_NToys);
-
+   TMatrixD unfoldedCov, adetCov;
+   GetUnfoldCov(*cov, unfoldedCov, _NToys);
+   GetAdetCov(adetCov, _NToys);
 
    _cov.ResizeTo(_nt, _nt);
    for (Int_t i = 0; i < _nt; i++) {
       for (Int_t j = 0; j < _nt; ++j) {
-         _cov(i,j) = unfoldedCov->GetBinContent(i+1, j+1) + adetCov->GetBinContent(i+1, j+1);
+         _cov(i,j) = unfoldedCov(i, j) + adetCov(i, j);
       }
    }
 
-   delete adetCov;
-   delete unfoldedCov;
-   delete meascov;
-   TH1::AddDirectory(oldstat);
-
    _haveCov = kTRUE;
 }
 
@@ -192,18 +226,51 @@ RooUnfoldIds::GetUnfoldCovMatrix(const TH2D *cov, Int_t ntoys, Int_t seed)
    //! "ntoys"  - number of pseudo experiments used for the propagation
    //! "seed"   - seed for pseudo experiments
    //! Note that this covariance matrix will contain effects of forced normalisation if spectrum is normalised to unit area.
+   if (!_vmeas.GetNrows()) SetupInputs();
+
+   TMatrixD mcov(_nb, _nb), toycov;
+   for (Int_t i = 0; i < _nb; ++i)
+      for (Int_t j = 0; j < _nb; ++j)
+         mcov(i, j) = cov->GetBinContent(i+1, j+1);
+   GetUnfoldCov(mcov, toycov, ntoys, seed);
+   return CovHist(toycov);
+}
+
+//______________________________________________________________________________
+TH2D*
+RooUnfoldIds::GetAdetCovMatrix(Int_t ntoys, Int_t seed)
+{
+   //! Determine covariance matrix of unfolded spectrum from finite statistics in
+   //! response matrix using pseudo experiments
+   //! "ntoys"  - number of pseudo experiments used for the propagation
+   //! "seed"   - seed for pseudo experiments
+   TMatrixD toycov;
+   GetAdetCov(toycov, ntoys, seed);
+   return CovHist(toycov);
+}
+
+//______________________________________________________________________________
+TH2D*
+RooUnfoldIds::CovHist(const TMatrixD& unfcov) const
+{
+   //! Make a histogram of the toy covariance matrix
+   RooUnfoldNoDirectory nodir;
+   TH2D *h = new TH2D("unfcovmat", "Toy covariance matrix", _nb, 0.0, _nb, _nb, 0.0, _nb);
+   for (Int_t j = 0; j < _nb; ++j) {
+      for (Int_t k = 0; k < _nb; ++k) {
+         h->SetBinContent(j+1, k+1, unfcov(j, k));
+      }
+   }
+   return h;
+}
 
-   _meas1d  = HistNoOverflow(_meas            , _overflow); // data
-   _train1d = HistNoOverflow(_res->Hmeasured(), _overflow); // reco
-   _truth1d = HistNoOverflow(_res->Htruth()   , _overflow); // true
-   _reshist = _res->HresponseNoOverflow();
+//______________________________________________________________________________
+void
+RooUnfoldIds::GetUnfoldCov(const TMatrixD &cov, TMatrixD &unfcov, Int_t ntoys, Int_t seed)
+{
+   //! As GetUnfoldCovMatrix, with the covariance matrices (_nb x _nb) as TMatrixD
 
-   TH1D* unfres = 0;
-   TH2D* unfcov = (TH2D*)_reshist->Clone("unfcovmat");
-   unfcov->SetTitle("Toy covariance matrix");
-   for (Int_t i = 1; i <= _nb; ++i)
-      for(Int_t j = 1; j <= _nb; ++j)
-         unfcov->SetBinContent(i, j, 0.);
+   if (!_vmeas.GetNrows()) SetupInputs();
 
    // Code for generation of toys (taken from TSVDUnfold [took from RooResult] and modified)
    // Calculate the elements of the upper-triangular matrix L that
@@ -213,149 +280,102 @@ RooUnfoldIds::GetUnfoldCovMatrix(const TH2D *cov, Int_t ntoys, Int_t seed)
    for (Int_t iPar = 0; iPar < _nb; ++iPar) {
 
       // Calculate the diagonal term first
-      L(iPar, iPar) = cov->GetBinContent(iPar+1, iPar+1);
+      L(iPar, iPar) = cov(iPar, iPar);
       for (Int_t k = 0; k < iPar; ++k) L(iPar, iPar) -= TMath::Power(L(k, iPar), 2);
       if (L(iPar, iPar) > 0.0) L(iPar, iPar) = TMath::Sqrt(L(iPar,iPar));
       else                     L(iPar, iPar) = 0.0;
 
       // ...then the off-diagonal terms
       for (Int_t jPar = iPar+1; jPar < _nb; ++jPar) {
-         L(iPar, jPar) = cov->GetBinContent(iPar+1, jPar+1);
+         L(iPar, jPar) = cov(iPar, jPar);
          for (Int_t k = 0; k < iPar; k++) L(iPar, jPar) -= L(k, iPar)*L(k, jPar);
          if (L(iPar,iPar) != 0.) L(iPar, jPar) /= L(iPar, iPar);
          else                    L(iPar, jPar) = 0;
       }
    }
 
-   // Remember it
-   TMatrixD *Lt = new TMatrixD(TMatrixD::kTransposed, L);
    TRandom3 random(seed);
 
    // Needed to build covariance matrix
-   TVectorD avgtoy(_nb);
-   TMatrixD toys(ntoys, _nb);
-   for (Int_t j = 0; j < _nb; ++j) {
-      avgtoy[j] = 0.0;
-      for (Int_t i = 0; i < ntoys; ++i) {
-         toys[i][j] = 0.0;
-      }
-   }
+   RooUnfoldCovAccumulator acc(_nb);
+   TVectorD toyres(_nb), toymeas(_nb);
 
-   // Get the mean of the toys first
-   TH1D *toyhist = (TH1D*)_meas1d->Clone("toyhisto");
+   // Run the toys, accumulating their mean and covariance. Only the measured spectrum changes between toys.
+   TVectorD g(_nb);
    for (Int_t i = 0; i < ntoys; i++) {
 
       // create a vector of unit Gaussian variables
-      TVectorD g(_nb);
       for (Int_t k = 0; k < _nb; ++k) g(k) = random.Gaus(0.,1.);
 
       // Multiply this vector by Lt to introduce the appropriate correlations
-      g *= (*Lt);
-
-      // Add the mean value offsets and store the results
-      for (Int_t j = 1; j <= _nb; ++j) {
-         toyhist->SetBinContent(j, _meas1d->GetBinContent(j) + g(j-1));
-         toyhist->SetBinError(j, _meas1d->GetBinError(j));
-      }
-
-      // Perform IDS unfolding
-      unfres = dynamic_cast<TH1D*>(GetIDSUnfoldedSpectrum(_train1d, _truth1d, _reshist, toyhist, _niter));
-
+      // and add the mean value offsets
       for (Int_t j = 0; j < _nb; ++j) {
-         toys[i][j] = unfres->GetBinContent(j+1);
-         avgtoy[j] += unfres->GetBinContent(j+1)/ntoys;
+         Double_t v = 0.0;
+         for (Int_t k = 0; k < _nb; ++k) v += g(k)*L(k, j);
+         toymeas[j] = _vmeas[j] + v;
       }
 
-      delete unfres;
-
-   }
-   delete toyhist;
-   delete Lt;
-
-   for (Int_t i = 0; i < ntoys; ++i) {
-      for (Int_t j = 0; j < _nb; ++j) {
-         for (Int_t k = 0; k < _nb; ++k) {
-            unfcov->SetBinContent(j+1, k+1, unfcov->GetBinContent(j+1, k+1) + (toys[i][j] - avgtoy[j])*(toys[i][k] - avgtoy[k])/ntoys);
-         }
-      }
+      // Perform IDS unfolding
+      GetIDSUnfoldedSpectrum(_vtrain, _vtruth, _mmig, _recomatch, _truthmatch, toymeas, _vmeaserr, _niter, toyres);
+      acc.Add(toyres);
    }
 
-   return unfcov;
+   acc.GetCovariance(unfcov, kFALSE);
 }
 
 //______________________________________________________________________________
-TH2D*
-RooUnfoldIds::GetAdetCovMatrix(Int_t ntoys, Int_t seed)
+void
+RooUnfoldIds::GetAdetCov(TMatrixD &unfcov, Int_t ntoys, Int_t seed)
 {
-   //! Determine covariance matrix of unfolded spectrum from finite statistics in
-   //! response matrix using pseudo experiments
-   //! "ntoys"  - number of pseudo experiments used for the propagation
-   //! "seed"   - seed for pseudo experiments
-
-   _meas1d  = HistNoOverflow(_meas            , _overflow); // data
-   _train1d = HistNoOverflow(_res->Hmeasured(), _overflow); // reco
-   _truth1d = HistNoOverflow(_res->Htruth()   , _overflow); // true
-   _reshist = _res->HresponseNoOverflow();
-
-   TH1D *unfres = 0;
-   TH2D *unfcov = (TH2D*)_reshist->Clone("unfcovmat");
-   unfcov->SetTitle("Toy covariance matrix");
-   for(Int_t i = 1; i <= _nb; ++i)
-      for(Int_t j = 1; j <= _nb; ++j)
-         unfcov->SetBinContent(i, j, 0.0);
+   //! As GetAdetCovMatrix, with the covariance matrix as a TMatrixD
+
+   if (!_vmeas.GetNrows()) SetupInputs();
+
+   // Errors on the migration matrix elements, with the same padding and fakes bin
+   if (!_emig.GetNrows()) {
+      const TH2* hres = _res->Hresponse();
+      _emig.ResizeTo(_nm, _nt);
+      RooUnfoldResponse::H2ME(hres, _emig, 0, _overflow);
+      _emig.ResizeTo(_nb, _nb);
+      if (_res->FakeEntries() && !hres->GetSumw2N()) {
+         for (Int_t i = 0; i < _nm; ++i) _emig(i, _nt) = TMath::Sqrt(_mmig(i, _nt));
+      }
+   }
 
    //Now the toys for the detector response matrix
    TRandom3 random(seed);
 
    // Needed to build covariance matrix
-   TVectorD avgtoy(_nb);
-   TMatrixD toys(ntoys, _nb);
-   for (Int_t j = 0; j < _nb; ++j) {
-      avgtoy[j] = 0.0;
-      for (Int_t i = 0; i < ntoys; ++i) {
-         toys[i][j] = 0.0;
-      }
-   }
+   RooUnfoldCovAccumulator acc(_nb);
+   TVectorD toyres(_nb);
+
+   // Only the transfer matrix and its projections change between toys
+   TMatrixD toymig(_mmig);
+   TVectorD recomatch(_nb), truthmatch(_nb);
 
-   TH2D *toymat = (TH2D*)_reshist->Clone("toymat");
    Double_t fluc = -1.0;
    for (Int_t i = 0; i < ntoys; ++i) {
-      for (Int_t k = 1; k <= _nb; ++k) {
-         for (Int_t m = 1; m <= _nb; ++m) {
-            if (_reshist->GetBinContent(k, m)) {
+      for (Int_t k = 0; k < _nb; ++k) {
+         for (Int_t m = 0; m < _nb; ++m) {
+            if (_mmig(k, m)) {
                // fToymat->SetBinContent(k, m, random.Poisson(fAdet->GetBinContent(k,m)));
                fluc = -1.0;
                while (fluc < 0.0) {
-                  fluc = random.Gaus(_reshist->GetBinContent(k, m), _reshist->GetBinError(k, m));
+                  fluc = random.Gaus(_mmig(k, m), _emig(k, m));
                }
-               
-               toymat->SetBinContent(k, m, fluc);
+
+               toymig(k, m) = fluc;
             }
          }
       }
+      MatchedProjections(toymig, recomatch, truthmatch);
 
       // Perform IDS unfolding
-      unfres = dynamic_cast<TH1D*>(GetIDSUnfoldedSpectrum(_train1d, _truth1d, toymat, _meas1d, _niter));
-
-      for (Int_t j = 0; j < _nb; ++j) {
-         toys[i][j] = unfres->GetBinContent(j+1);
-         avgtoy[j] += unfres->GetBinContent(j+1)/ntoys;
-      }
-
-      delete unfres;
+      GetIDSUnfoldedSpectrum(_vtrain, _vtruth, toymig, recomatch, truthmatch, _vmeas, _vmeaserr, _niter, toyres);
+      acc.Add(toyres);
    }
 
-   delete toymat;
-
-   for (Int_t i = 0; i < ntoys; ++i) {
-      for (Int_t j = 0; j < _nb; ++j) {
-         for (Int_t k = 0; k < _nb; ++k) {
-            unfcov->SetBinContent(j+1, k+1, unfcov->GetBinContent(j+1, k+1) + (toys[i][j] - avgtoy[j])*(toys[i][k] - avgtoy[k])/ntoys);
-         }
-      }
-   }
-
-   return unfcov;
+   acc.GetCovariance(unfcov, kFALSE);
 }
 
 //______________________________________________________________________________
@@ -366,51 +386,19 @@ RooUnfoldIds::GetSettings()
 }
 
 //______________________________________________________________________________
-TH1*
-RooUnfoldIds::GetIDSUnfoldedSpectrum(const TH1 *h_RecoMC, const TH1 *h_TruthMC, const TH2 *h_2DSmear, const TH1 *h_RecoData, Int_t iter)
+Int_t
+RooUnfoldIds::GetIDSUnfoldedSpectrum(const TVectorD &reco, const TVectorD &truth, const TMatrixD &migmatrix,
+                                     const TVectorD &recomatch, const TVectorD &truthmatch,
+                                     const TVectorD &data_, const TVectorD &dataerror_, Int_t iter, TVectorD &result)
 {
-   Int_t nbinsx = h_RecoData->GetNbinsX();
-   Int_t nbinsy = h_RecoData->GetNbinsY();
-   Int_t nbins  = nbinsx*nbinsy;
-
-   // Sanity checks
-   if (h_TruthMC->GetNbinsX() != nbinsx || h_TruthMC->GetNbinsY() != nbinsy ||
-       h_RecoMC->GetNbinsX()  != nbinsx || h_RecoMC->GetNbinsY()  != nbinsy ||
-       h_2DSmear->GetNbinsX() != nbins) {
-      std::cout << "Bins of input histograms don't all match, exiting IDS unfolding and returning NULL." << std::endl;
-      return NULL;
-   }
-
-   // Put inputs into vectors, and if necessary turn 2-D inputs into 1-D inputs
-   TVectorD reco(nbins), truth(nbins);
-   TVectorD data(nbins), dataerror(nbins);
-   Int_t i = 0;
-   for (Int_t by = 1; by <= nbinsy; ++by) { // loop over pt
-      for (Int_t bx = 1; bx <= nbinsx; ++bx) { // loop over gap_size, for each pt value
-         reco[i]  = h_RecoMC->GetBinContent(bx, by);
-         truth[i] = h_TruthMC->GetBinContent(bx, by);
-         data[i]  = h_RecoData->GetBinContent(bx, by);
-         if (data[i] > 0.0) {
-            dataerror[i] = h_RecoData->GetBinError(bx, by);
-         } else {
-            dataerror[i] = 1.0;
-         }
-         i++;
-      }
-   }
-
-   // Make transfer matrix and project matched MC spectra
-   TMatrixD migmatrix(nbins, nbins);
-   TVectorD recomatch(nbins);
-   TVectorD truthmatch(nbins);
+   //! IDS unfolding of the measured spectrum data_ (with errors dataerror_), using the vectors and
+   //! matrices made by SetupInputs (see also MatchedProjections).
+   //! The unfolded spectrum is written into result. Returns the number of iterations done.
+   //! Used by the toys, which only change data_ or migmatrix.
+   Int_t nbins = data_.GetNrows();
+   TVectorD data(data_), dataerror(nbins);
    for (Int_t i = 0; i < nbins; ++i) {
-      recomatch[i] = 0.0;
-      truthmatch[i] = 0.0;
-      for (Int_t j = 0; j < nbins; ++j) {
-         recomatch[i]   += h_2DSmear->GetBinContent(i+1, j+1);
-         truthmatch[i]  += h_2DSmear->GetBinContent(j+1, i+1);
-         migmatrix[i][j] = h_2DSmear->GetBinContent(i+1, j+1);
-      }
+      dataerror[i] = data[i] > 0.0 ? dataerror_[i] : 1.0;
    }
 
    // Apply matching inefficiency from reco MC to data
@@ -430,10 +418,11 @@ RooUnfoldIds::GetIDSUnfoldedSpectrum(const TH1 *h_RecoMC, const TH1 *h_TruthMC,
    // Double_t lambdaMmin = 0.0;
    // Double_t lambdaS = 0.;
 
-   TVectorD result0(nbins), result(nbins);
-   PerformIterations(data, dataerror, migmatrix, nbins,
-                     _lambdaL, iter, _lambdaUmin, _lambdaMmin, _lambdaS,
-                     &result0, &result);
+   result.ResizeTo(nbins);
+   TVectorD result0(nbins);
+   Int_t nused = PerformIterations(data, dataerror, migmatrix, nbins,
+                                   _lambdaL, iter, _lambdaUmin, _lambdaMmin, _lambdaS,
+                                   &result0, &result);
 
    // Apply matching efficiency from truth MC to unfolded matched data
    for (Int_t i = 0; i < nbins; ++i) {
@@ -443,21 +432,23 @@ RooUnfoldIds::GetIDSUnfoldedSpectrum(const TH1 *h_RecoMC, const TH1 *h_TruthMC,
          result[i] = 0.0;
       }
    }
+   return nused;
+}
 
-   // Make 1-D or 2-D histogram
-   TH1 *h_DataUnfolded = (TH1*)h_RecoData->Clone("unfolded");
-   h_DataUnfolded->SetTitle("unfolded");
-   h_DataUnfolded->Reset();
-
-   i = 0;
-   for (Int_t by = 1; by <= nbinsy; ++by) {
-      for (Int_t bx = 1; bx <= nbinsx; ++bx) {
-         h_DataUnfolded->SetBinContent(bx, by, result[i++]);
+//______________________________________________________________________________
+void
+RooUnfoldIds::MatchedProjections(const TMatrixD &migmatrix, TVectorD &recomatch, TVectorD &truthmatch)
+{
+   //! Project the transfer matrix onto the matched reco and truth MC spectra
+   Int_t n = migmatrix.GetNrows();
+   for (Int_t i = 0; i < n; ++i) {
+      recomatch[i] = 0.0;
+      truthmatch[i] = 0.0;
+      for (Int_t j = 0; j < n; ++j) {
+         recomatch[i]  += migmatrix[i][j];
+         truthmatch[i] += migmatrix[j][i];
       }
    }
-
-   // Return result
-   return h_DataUnfolded;
 }
 
 //______________________________________________________________________________
@@ -504,18 +495,14 @@ RooUnfoldIds::MCnormalizationCoeffIter(const TVectorD *vd, const TVectorD *errvd
 
 //______________________________________________________________________________
 void
-RooUnfoldIds::IdsUnfold( const TVectorD &b, const TVectorD &errb, const TMatrixD &A, const Int_t dim, const Double_t lambda, TVectorD *soustr_, TVectorD *unf)
+RooUnfoldIds::IdsUnfold( const TVectorD &b, const TVectorD &errb, const TMatrixD &A, const TVectorD &recoA, const TVectorD &trueA, const Int_t dim, const Double_t lambda, TVectorD *soustr_, TVectorD *unf)
 {
+   //! recoA and trueA are the reco and true MC projections (row and column sums) of A,
+   //! as given by MatrixSums or ModifyMatrix, so they are not recalculated here.
    //! compute the mc true and reco spectra and normalize them
-   TVectorD reco_mcN(dim), true_mcN(dim);
+   TVectorD reco_mcN(recoA), true_mcN(trueA);
    Double_t estNkd = 0., Nkd = 0. , Nmc = 0.;
    for(Int_t i=0; i<dim; i++ ){
-      reco_mcN[i] = 0.;
-      true_mcN[i] = 0.;
-      for(Int_t j=0; j<dim; j++ ){
-         reco_mcN[i] += A[i][j];
-         true_mcN[i] += A[j][i];
-      }
       if(b[i] - (*soustr_)[i] >= 0.){
          Nmc += reco_mcN[i];
          estNkd += b[i] - (*soustr_)[i];
@@ -531,28 +518,29 @@ RooUnfoldIds::IdsUnfold( const TVectorD &b, const TVectorD &errb, const TMatrixD
       (*unf)[i] = true_mcN[i] + (*soustr_)[i];
    }
 
-   // compute the prob(j|i) matrix
-   TMatrixD prob(dim, dim);
+   // Probability corrections for all bins (ef<0 where no correction is applied)
+   TVectorD ef(dim), dev(dim);
    for(Int_t i=0; i<dim; i++){
-      Double_t si = 0.;
-      for(Int_t j=0; j<dim; j++){
-         si += A[i][j];
-      }
-      for(Int_t j=0; j<dim; j++){
-         if( si!=0. )
-            prob[i][j] = A[i][j]/si;
-         else
-            prob[i][j] = 0.;
-      }
+      dev[i] = b[i]-(*soustr_)[i]-reco_mcN[i];
+      if (reco_mcN[i] != 0.0 && (b[i] - (*soustr_)[i]) > 0.0 /*&&((*b)[i]>0.)*/)
+         ef[i] = Probability( fabs(dev[i]), sqrt( pow(errb[i],2) /* + Nkd/Nmc*fabs((*reco_mcN)[i]) */ ), lambda );
+      else
+         ef[i] = -1.;
+   }
 
-      if (reco_mcN[i] != 0.0 && (b[i] - (*soustr_)[i]) > 0.0 /*&&((*b)[i]>0.)*/) {
-         Double_t ef = Probability( fabs(b[i]-(*soustr_)[i]-reco_mcN[i]), sqrt( pow(errb[i],2) /* + Nkd/Nmc*fabs((*reco_mcN)[i]) */ ), lambda );
-         for(Int_t j=0; j<dim; j++){
-            (*unf)[j] += ef * prob[i][j]*(b[i]-(*soustr_)[i]-reco_mcN[i]);
+   // apply them using the prob(j|i) matrix, A[i][j]/recoA[i]
+   for(Int_t i=0; i<dim; i++){
+      if (ef[i] >= 0.) {
+         const Double_t si = recoA[i];
+         if (si != 0.) {
+            const Double_t *Ai = A[i].GetPtr();
+            for(Int_t j=0; j<dim; j++){
+               (*unf)[j] += ef[i] * (Ai[j]/si)*dev[i];
+            }
          }
-         (*unf)[i] += (1-ef) * (b[i]-(*soustr_)[i]-reco_mcN[i]);
+         (*unf)[i] += (1-ef[i]) * dev[i];
       } else {
-         (*unf)[i] += b[i]-(*soustr_)[i]-reco_mcN[i];
+         (*unf)[i] += dev[i];
       }
    }
 
@@ -560,19 +548,33 @@ RooUnfoldIds::IdsUnfold( const TVectorD &b, const TVectorD &errb, const TMatrixD
 
 //______________________________________________________________________________
 void
-RooUnfoldIds::ComputeSoustrTrue( const TMatrixD *A, const TVectorD *unfres, const TVectorD *unfresErr, Int_t N, TVectorD *soustr_, Double_t lambdaS )
+RooUnfoldIds::MatrixSums( const TMatrixD &A, TVectorD &recoA, TVectorD &trueA )
 {
+   //! Reco and true MC projections of transfer matrix A (row and column sums)
+   const Int_t dim = A.GetNrows();
+   recoA.ResizeTo(dim);
+   trueA.ResizeTo(dim);
+   for(Int_t i=0; i<dim; i++ ){
+      recoA[i] = 0.;
+      trueA[i] = 0.;
+      for(Int_t j=0; j<dim; j++ ){
+         recoA[i] += A[i][j];
+         trueA[i] += A[j][i];
+      }
+   }
+}
 
-   TVectorD *true_mcT = new TVectorD(N), *active = new TVectorD(N);
+//______________________________________________________________________________
+void
+RooUnfoldIds::ComputeSoustrTrue( const TVectorD *true_mcT, const TVectorD *unfres, const TVectorD *unfresErr, Int_t N, TVectorD *soustr_, Double_t lambdaS )
+{
+   //! true_mcT is the true MC projection of the transfer matrix (its column sums)
+   TVectorD *active = new TVectorD(N);
    Double_t estNkd = 0., Nmc=0., NkUR=0.;
    for(Int_t j=0; j<N; j++){
 
       (*active)[j] = 1.;
 
-      (*true_mcT)[j] = 0.;
-      for(Int_t i=0; i<N; i++){
-         (*true_mcT)[j] += ((*A)[i][j]);
-      }
       if((*unfres)[j] - (*soustr_)[j] >= 0.){
          Nmc += (*true_mcT)[j];
          estNkd += (*unfres)[j] - (*soustr_)[j];
@@ -600,23 +602,19 @@ RooUnfoldIds::ComputeSoustrTrue( const TMatrixD *A, const TVectorD *unfres, cons
       estNkd = NkUR;
    }
 
-   delete true_mcT; delete active;
+   delete active;
 }
 
 //______________________________________________________________________________
 void
-RooUnfoldIds::ModifyMatrix( TMatrixD *Am, const TMatrixD *A, const TVectorD *unfres, const TVectorD *unfresErr, Int_t N, const Double_t lambdaM_, TVectorD *soustr_, const Double_t lambdaS_ )
+RooUnfoldIds::ModifyMatrix( TMatrixD *Am, TVectorD *recoAm, TVectorD *trueAm, const TMatrixD *A, const TVectorD *true_mcT, const TVectorD *unfres, const TVectorD *unfresErr, Int_t N, const Double_t lambdaM_, TVectorD *soustr_, const Double_t lambdaS_ )
 {
-   ComputeSoustrTrue( A, unfres, unfresErr, N, soustr_, lambdaS_ );
+   //! Fill Am with the modified transfer matrix and recoAm/trueAm with its projections (row and column sums),
+   //! which are accumulated while the matrix is modified. true_mcT holds the column sums of A.
+   ComputeSoustrTrue( true_mcT, unfres, unfresErr, N, soustr_, lambdaS_ );
 
-   TVectorD *true_mcT = new TVectorD(N);
    Double_t estNkd = 0., Nmc=0., NkUR=0.;
    for(Int_t j=0; j<N; j++){
-      (*true_mcT)[j] = 0.;
-      for(Int_t i=0; i<N; i++){
-         (*true_mcT)[j] += ((*A)[i][j]);
-         ((*Am)[i][j]) = ((*A)[i][j]);
-      }
       if((*unfres)[j] - (*soustr_)[j] >= 0.){
          Nmc += (*true_mcT)[j];
          estNkd += (*unfres)[j] - (*soustr_)[j];
@@ -630,36 +628,79 @@ RooUnfoldIds::ModifyMatrix( TMatrixD *Am, const TMatrixD *A, const TVectorD *unf
 
    NkUR = MCnormalizationCoeffIter( unfres, unfresErr, true_mcT, N, estNkd, Nmc, soustr_ );
 
+   for(Int_t i=0; i<N; i++) (*recoAm)[i] = 0.;
    for(Int_t j=0; j<N; j++){
-      if( (*unfres)[j] - (*soustr_)[j]>0. && (*true_mcT)[j]!=0. ){
-         Double_t ef = Probability(fabs((*unfres)[j] - (*soustr_)[j] -NkUR/Nmc*(*true_mcT)[j]), sqrt(pow((*unfresErr)[j],2) /* +pow(NkUR/Nmc,2)*fabs((*true_mcT)[j]) */ ), lambdaM_);
-         for(Int_t i=0; i<N; i++){
-            ((*Am)[i][j]) += ef * ( ((*unfres)[j] - (*soustr_)[j])*(Nmc/NkUR) - (*true_mcT)[j]) * ((*A)[i][j])/((*true_mcT)[j]);
-         }
+      Double_t ef = 0., dev = 0.;
+      const Bool_t modify = ( (*unfres)[j] - (*soustr_)[j]>0. && (*true_mcT)[j]!=0. );
+      if( modify ){
+         ef = Probability(fabs((*unfres)[j] - (*soustr_)[j] -NkUR/Nmc*(*true_mcT)[j]), sqrt(pow((*unfresErr)[j],2) /* +pow(NkUR/Nmc,2)*fabs((*true_mcT)[j]) */ ), lambdaM_);
+         dev = ((*unfres)[j] - (*soustr_)[j])*(Nmc/NkUR) - (*true_mcT)[j];
+      }
+      (*trueAm)[j] = 0.;
+      for(Int_t i=0; i<N; i++){
+         Double_t a = ((*A)[i][j]);
+         if( modify ) a += ef * dev * ((*A)[i][j])/((*true_mcT)[j]);
+         ((*Am)[i][j]) = a;
+         (*recoAm)[i] += a;
+         (*trueAm)[j] += a;
       }
    }
-
-   delete true_mcT;
 }
 
 //______________________________________________________________________________
-void
+Int_t
 RooUnfoldIds::PerformIterations(const TVectorD &data, const TVectorD &dataErr, const TMatrixD &A_, const Int_t &N_, const Double_t lambdaL_, const Int_t NstepsOptMin_, const Double_t lambdaU_, const Double_t lambdaM_, const Double_t lambdaS_, TVectorD* unfres1IDS_, TVectorD* unfres2IDS_)
 {
+   //! Returns the number of iterations done, which is less than NstepsOptMin_ if converged.
+   //! The projections of A_ are calculated once, and those of the modified matrix while it is made.
    TVectorD soustr(N_);
    for (Int_t i = 0; i < N_; i++) soustr[i] = 0.;
 
-   IdsUnfold(data, dataErr, A_, N_, lambdaL_, &soustr, unfres1IDS_); // 1 step
+   TVectorD recoA(N_), trueA(N_);
+   MatrixSums(A_, recoA, trueA);
+
+   IdsUnfold(data, dataErr, A_, recoA, trueA, N_, lambdaL_, &soustr, unfres1IDS_); // 1 step
    
    for (Int_t i = 0; i < N_; i++) (*unfres2IDS_)[i] = (*unfres1IDS_)[i];
 
    TMatrixD Am_(N_, N_);
+   TVectorD recoAm(N_), trueAm(N_);
+   TVectorD prev(N_);
    for (Int_t k = 0; k < NstepsOptMin_; k++) {
-      ModifyMatrix(&Am_, &A_, unfres2IDS_, &dataErr, N_, lambdaM_, &soustr, lambdaS_);
+      if (_convTol > 0.) prev = *unfres2IDS_;
+
+      ModifyMatrix(&Am_, &recoAm, &trueAm, &A_, &trueA, unfres2IDS_, &dataErr, N_, lambdaM_, &soustr, lambdaS_);
 
       // UNFOLDING
-      IdsUnfold(data, dataErr, Am_, N_, lambdaU_, &soustr, unfres2IDS_); // full iterations
+      IdsUnfold(data, dataErr, Am_, recoAm, trueAm, N_, lambdaU_, &soustr, unfres2IDS_); // full iterations
+
+      if (_convTol > 0. && Converged(prev, *unfres2IDS_)) {
+         if (_verbose >= 1) std::cout << "IDS converged after " << k+1 << " iterations" << std::endl;
+         return k+1;
+      }
+   }
+   return NstepsOptMin_;
+}
+
+//______________________________________________________________________________
+Bool_t
+RooUnfoldIds::Converged(const TVectorD &prev, const TVectorD &next) const
+{
+   //! Check whether the change between iterations is below the tolerance set by SetConvergence.
+   //! Uses the chi^2 of change (with Poisson errors), or the maximum relative change in any bin.
+   Double_t change = 0.;
+   for (Int_t i = 0; i < prev.GetNrows(); i++) {
+      Double_t diff = next[i] - prev[i];
+      if (_convRelative) {
+         if (prev[i] == 0.) continue;
+         Double_t rel = TMath::Abs(diff / prev[i]);
+         if (rel > change) change = rel;
+      } else {
+         Double_t sum = TMath::Abs(next[i] + prev[i]);
+         change += sum > 1. ? diff*diff/sum : diff*diff;
+      }
    }
+   return change < _convTol;
 }
 
 //______________________________________________________________________________
@@ -730,12 +771,7 @@ RooUnfoldIds::Streamer(TBuffer &R__b)
 {
    //! Stream an object of class RooUnfoldIds.
    if (R__b.IsReading()) {
-      // Don't add our histograms to the currect directory.
-      // We own them and we don't want them to disappear when the file is closed.
-      Bool_t oldstat = TH1::AddDirectoryStatus();
-      TH1::AddDirectory(kFALSE);
       RooUnfoldIds::Class()->ReadBuffer  (R__b, this);
-      TH1::AddDirectory(oldstat);
    } else {
       RooUnfoldIds::Class()->WriteBuffer (R__b, this);
    }
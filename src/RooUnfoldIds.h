@@ -12,6 +12,7 @@
 class RooUnfoldResponse;
 class TH1;
 class TH1D;
+class TH2;
 class TH2D;
 class TRandom3;
 
@@ -49,30 +50,42 @@ public:
    void SetLambdaS(Double_t lambdaS);
    Double_t GetLambdaS() const;
 
+   void SetConvergence(Double_t tol = 0., Bool_t relative = kFALSE); // stop iterating before GetNIter() when converged
+   Double_t GetConvergence() const;
+   Int_t GetIterationsUsed() const;
+
    virtual void Reset();
 
    TH2D* GetUnfoldCovMatrix(const TH2D *cov, Int_t ntoys, Int_t seed = 1);
    TH2D* GetAdetCovMatrix(Int_t ntoys, Int_t seed = 1);
+   void GetUnfoldCov(const TMatrixD &cov, TMatrixD &unfcov, Int_t ntoys, Int_t seed = 1);  // as GetUnfoldCovMatrix, without histograms
+   void GetAdetCov(TMatrixD &unfcov, Int_t ntoys, Int_t seed = 1);                        // as GetAdetCovMatrix, without histograms
 
 protected:
    void Assign(const RooUnfoldIds &rhs); // implementation of assignment operator
    virtual void Unfold();
    virtual void GetCov();
    virtual void GetSettings();
+   virtual void ClearUnfolding(Bool_t newResponse = kTRUE);
 
 private:
    void Init();
    void Destroy();
    void CopyData(const RooUnfoldIds &rhs);
 
-   TH1* GetIDSUnfoldedSpectrum(const TH1 *h_RecoMC, const TH1 *h_TruthMC, const TH2 *h_2DSmear, const TH1 *h_RecoData, Int_t iter);
+   void SetupInputs();
+   TH2D* CovHist(const TMatrixD &unfcov) const;
+   Int_t GetIDSUnfoldedSpectrum(const TVectorD &reco, const TVectorD &truth, const TMatrixD &migmatrix, const TVectorD &recomatch, const TVectorD &truthmatch, const TVectorD &data, const TVectorD &dataerror, Int_t iter, TVectorD &result);
+   static void MatchedProjections(const TMatrixD &migmatrix, TVectorD &recomatch, TVectorD &truthmatch);
    Double_t Probability(Double_t deviation, Double_t sigma, Double_t lambda);
    Double_t MCnormalizationCoeff(const TVectorD *vd, const TVectorD *errvd, const TVectorD *vRecmc, const Int_t dim, const Double_t estNknownd, const Double_t Nmc, const Double_t lambda, const TVectorD *soustr_ );
    Double_t MCnormalizationCoeffIter(const TVectorD *vd, const TVectorD *errvd, const TVectorD *vRecmc, const Int_t dim, const Double_t estNknownd, const Double_t Nmc, const TVectorD *soustr_, Double_t lambdaN = 0., Int_t NiterMax = 5, Int_t messAct = 1);
-   void IdsUnfold(const TVectorD &b, const TVectorD &errb, const TMatrixD &A, const Int_t dim, const Double_t lambda, TVectorD *soustr_, TVectorD *unf);
-   void ComputeSoustrTrue(const TMatrixD *A, const TVectorD *unfres, const TVectorD *unfresErr, Int_t N, TVectorD *soustr_, Double_t lambdaS);
-   void ModifyMatrix(TMatrixD *Am, const TMatrixD *A, const TVectorD *unfres, const TVectorD *unfresErr, Int_t N, const Double_t lambdaM_, TVectorD *soustr_, const Double_t lambdaS_);
-   void PerformIterations(const TVectorD &data, const TVectorD &dataErr, const TMatrixD &A_, const Int_t &N_, Double_t lambdaL_, Int_t NstepsOptMin_, Double_t lambdaU_, Double_t lambdaM_, Double_t lambdaS_, TVectorD* unfres1IDS_, TVectorD* unfres2IDS_);
+   void IdsUnfold(const TVectorD &b, const TVectorD &errb, const TMatrixD &A, const TVectorD &recoA, const TVectorD &trueA, const Int_t dim, const Double_t lambda, TVectorD *soustr_, TVectorD *unf);
+   static void MatrixSums(const TMatrixD &A, TVectorD &recoA, TVectorD &trueA);
+   void ComputeSoustrTrue(const TVectorD *true_mcT, const TVectorD *unfres, const TVectorD *unfresErr, Int_t N, TVectorD *soustr_, Double_t lambdaS);
+   void ModifyMatrix(TMatrixD *Am, TVectorD *recoAm, TVectorD *trueAm, const TMatrixD *A, const TVectorD *true_mcT, const TVectorD *unfres, const TVectorD *unfresErr, Int_t N, const Double_t lambdaM_, TVectorD *soustr_, const Double_t lambdaS_);
+   Int_t PerformIterations(const TVectorD &data, const TVectorD &dataErr, const TMatrixD &A_, const Int_t &N_, Double_t lambdaL_, Int_t NstepsOptMin_, Double_t lambdaU_, Double_t lambdaM_, Double_t lambdaS_, TVectorD* unfres1IDS_, TVectorD* unfres2IDS_);
+   Bool_t Converged(const TVectorD &prev, const TVectorD &next) const;
    TMatrixD* GetSqrtMatrix(const TMatrixD& covMat);
    void GenGaussRnd(TArrayD& v, const TMatrixD& sqrtMat, TRandom3& R);
 
@@ -85,11 +98,21 @@ protected:
    Double_t _lambdaMmin; // regularize Modification of folding matrix
    Double_t _lambdaS; // regularize background Subtraction
 
-   TH1D *_meas1d, *_train1d, *_truth1d;
-   TH2D *_reshist;
+   Double_t _convTol; //! convergence tolerance (0 to always do _niter iterations)
+   Bool_t _convRelative; //! convergence on maximum relative change, rather than chi^2 of change
+   Int_t _niterUsed; //! number of iterations done in last unfolding
+
+   TVectorD _vmeas;      //! Measured distribution (data)
+   TVectorD _vmeaserr;   //! Measured distribution errors
+   TVectorD _vtrain;     //! Training reco distribution
+   TVectorD _vtruth;     //! Training truth distribution, with fakes in bin _nt
+   TMatrixD _mmig;       //! Transfer matrix (number of events), with fakes in column _nt
+   TMatrixD _emig;       //! Transfer matrix errors, for the response toys
+   TVectorD _recomatch;  //! Matched reco projection of _mmig
+   TVectorD _truthmatch; //! Matched truth projection of _mmig
 
 public:
-   ClassDef(RooUnfoldIds, 1)
+   ClassDef(RooUnfoldIds, 2)
 };
 
 // Inline method definitions
@@ -216,4 +239,28 @@ Double_t RooUnfoldIds::GetLambdaS() const
    return _lambdaS;
 }
 
+inline
+void RooUnfoldIds::SetConvergence(Double_t tol, Bool_t relative)
+{
+   // Stop iterating when the chi^2 of change between iterations (or, if relative, the maximum
+   // relative change in any bin) falls below tol. GetNIter() is then the maximum number of
+   // iterations. tol=0 always does GetNIter() iterations.
+   _convTol = tol;
+   _convRelative = relative;
+}
+
+inline
+Double_t RooUnfoldIds::GetConvergence() const
+{
+   // Return convergence tolerance
+   return _convTol;
+}
+
+inline
+Int_t RooUnfoldIds::GetIterationsUsed() const
+{
+   // Return number of iterations done in the last unfolding
+   return _niterUsed;
+}
+
 #endif // IDSUnfoldingTool_RooUnfoldIds
@@ -23,12 +23,15 @@
 #include "RooUnfoldInvert.h"
 
 #include <iostream>
+#include <vector>
 
 #include "TH1.h"
 #include "TH2.h"
 #include "TVectorD.h"
 #include "TMatrixD.h"
+#include "TMatrixDSparse.h"
 #include "TDecompSVD.h"
+#include "TDecompSparse.h"
 
 #include "RooUnfoldResponse.h"
 
@@ -43,6 +46,7 @@ RooUnfoldInvert::RooUnfoldInvert (const RooUnfoldInvert& rhs)
 {
   //! Copy constructor.
   Init();
+  _sparse= rhs._sparse;
 }
 
 RooUnfoldInvert::RooUnfoldInvert (const RooUnfoldResponse* res, const TH1* meas,
@@ -66,6 +70,7 @@ RooUnfoldInvert::~RooUnfoldInvert()
 {
   delete _svd;
   delete _resinv;
+  delete _sdec;
 }
 
 void
@@ -73,6 +78,9 @@ RooUnfoldInvert::Init()
 {
   _svd= 0;
   _resinv= 0;
+  _sdec= 0;
+  _sparse= false;
+  _covVar.ResizeTo(0);
   GetSettings();
 }
 
@@ -81,6 +89,7 @@ RooUnfoldInvert::Reset()
 {
   delete _svd;
   delete _resinv;
+  delete _sdec;
   Init();
   RooUnfold::Reset();
 }
@@ -91,18 +100,40 @@ RooUnfoldInvert::Impl()
   return _svd;
 }
 
-void
-RooUnfoldInvert::Unfold()
+Bool_t
+RooUnfoldInvert::Decompose()
 {
-  if (_nt>_nm) {
-    TMatrixD resT (TMatrixD::kTransposed, _res->Mresponse());
-    _svd= new TDecompSVD (resT);
+  //! Decompose the response matrix, unless already done for a previous unfolding with the same response
+  if (UseSparse()) {
+    if (!_sdec) {   // keep decomposition from previous unfolding with the same response
+      delete _resinv; _resinv= 0;
+      delete _svd;    _svd= 0;
+      TMatrixDSparse aug;
+      Augmented (_res->MresponseSparse(), aug);
+      _sdec= new TDecompSparse (aug, _verbose>=2 ? 1 : 0);
+      if (!_sdec->Decompose()) {
+        cerr << "Warning: sparse decomposition of response matrix failed" << endl;
+      }
+    }
+  } else if (!_svd) {   // keep decomposition from previous unfolding with the same response
     delete _resinv; _resinv= 0;
-  } else
-    _svd= new TDecompSVD (_res->Mresponse());
-  if (_svd->Condition()<0){
-    cerr <<"Warning: response matrix bad condition= "<<_svd->Condition()<<endl;
+    if (_sparse && _verbose>=1) cout << "Response matrix is not square, so use the dense SVD instead of a sparse decomposition" << endl;
+    if (_nt>_nm) {
+      TMatrixD resT (TMatrixD::kTransposed, _res->Mresponse());
+      _svd= new TDecompSVD (resT);
+    } else
+      _svd= new TDecompSVD (_res->Mresponse());
+    if (_svd->Condition()<0){
+      cerr <<"Warning: response matrix bad condition= "<<_svd->Condition()<<endl;
+    }
   }
+  return UseSparse() ? (_sdec!=0) : (_svd!=0);
+}
+
+void
+RooUnfoldInvert::Unfold()
+{
+  Decompose();
 
   _rec.ResizeTo(_nm);
   _rec= Vmeasured();
@@ -117,7 +148,9 @@ RooUnfoldInvert::Unfold()
   }
 
   Bool_t ok;
-  if (_nt>_nm) {
+  if (UseSparse()) {
+    ok= SolveSparse (_rec);
+  } else if (_nt>_nm || (_incremental && InvertResponse())) {  // incremental mode: apply the cached inverse
     ok= InvertResponse();
     if (ok) _rec *= *_resinv;
   } else
@@ -133,18 +166,138 @@ RooUnfoldInvert::Unfold()
   _haveCov=  false;
 }
 
+void
+RooUnfoldInvert::ClearUnfolding (Bool_t newResponse)
+{
+  //! The response matrix decomposition and inverse only depend on the response,
+  //! so can be kept for the next unfolding if that has not changed.
+  if (newResponse) {
+    delete _svd;    _svd= 0;
+    delete _resinv; _resinv= 0;
+    delete _sdec;   _sdec= 0;
+    _covVar.ResizeTo(0);
+  }
+  RooUnfold::ClearUnfolding (newResponse);
+}
+
+Long64_t
+RooUnfoldInvert::MatrixBytes() const
+{
+  //! Memory held in the vectors and matrices of this unfolding, including the response matrix decomposition and inverse
+  Long64_t n= RooUnfold::MatrixBytes() + RooUnfoldTiming::Bytes (_covVar);
+  if (_svd)    n += (Long64_t(_nm)*_nm + Long64_t(_nt)*_nt + _nt) * sizeof(Double_t);  // U, V, and singular values
+  if (_resinv) n += RooUnfoldTiming::Bytes (*_resinv);
+  return n;
+}
+
+Bool_t
+RooUnfoldInvert::UnfoldBatch (const TMatrixD& meas, TMatrixD& reco, const TMatrixD* err, std::vector<TMatrixD>* cov)
+{
+  //! Unfold all the columns of meas at once (see RooUnfold::UnfoldBatch). After subtracting the fakes from each
+  //! column, the results are a single matrix product with the inverse of the response matrix, which is
+  //! calculated once. The covariance matrices are calculated once if err is not specified.
+  if (!BatchSetup (meas, reco, err, cov, cov!=0)) return kFALSE;
+  if (!Decompose() || !InvertResponse()) {
+    cerr << "Response matrix inversion failed" << endl;
+    return kFALSE;
+  }
+  const Int_t nb= meas.GetNcols();
+  TMatrixD y (meas);
+  if (_res->FakeEntries()) {
+    const TVectorD& fakes= _res->Vfakes();
+    const Double_t train= _res->Vmeasured().Sum();
+    for (Int_t b= 0; b<nb; b++) {
+      Double_t fac= 0.0;
+      if (train!=0.0) {
+        for (Int_t i= 0; i<_nm; i++) fac += y(i,b);
+        fac /= train;
+      }
+      for (Int_t i= 0; i<_nm; i++) y(i,b) -= fac*fakes[i];
+    }
+  }
+  reco.Mult (*_resinv, y);
+  if (!cov) return kTRUE;
+  TVectorD var, work;
+  for (Int_t b= 0; b<nb; b++) {
+    if (err) {
+      BatchVariance (*err, b, var);
+      ABAT (*_resinv, var, (*cov)[b], kFALSE, &work);
+    } else if (b==0)
+      PropagateCov ((*cov)[b], &work);
+    else
+      (*cov)[b]= (*cov)[0];
+  }
+  return kTRUE;
+}
+
 void
 RooUnfoldInvert::GetCov()
 {
     if (!InvertResponse()) return;
+    if (_incremental && UpdateCov()) {
+      _haveCov= true;
+      return;
+    }
     _cov.ResizeTo(_nt,_nt);
-    ABAT (*_resinv, GetMeasuredCov(), _cov);
+    PropagateCov (_cov);
     _haveCov= true;
+    if (!_incremental || _haveCovMes) return;
+    const TVectorD& err= Emeasured();
+    _covVar.ResizeTo(_nm);
+    for (Int_t k= 0; k<_nm; k++) _covVar[k]= err[k]*err[k];
+}
+
+void
+RooUnfoldInvert::PropagateCov (TMatrixD& cov, TVectorD* work, TMatrixD* gwork)
+{
+  //! cov = R^-1 V R^-1^T for the measurement covariance matrix V. With SetMeasuredCov, this is calculated as
+  //! (R^-1 L)(R^-1 L)^T from its Cholesky factor L, which is guaranteed positive semi-definite. Otherwise V is
+  //! diagonal and only the measurement variances are needed.
+  if (MeasuredCovLValid())
+    ABATChol (*_resinv, GetMeasuredCovL(), cov, gwork);
+  else if (_haveCovMes)
+    ABAT (*_resinv, GetMeasuredCov(), cov, kFALSE, work);
+  else {
+    TVectorD var (Emeasured());
+    var.Sqr();
+    ABAT (*_resinv, var, cov, kFALSE, work);
+  }
+}
+
+Bool_t
+RooUnfoldInvert::UpdateCov()
+{
+  //! Incremental mode: update the covariance matrix of the previous unfolding, cov = R^-1 diag(var) R^-1^T,
+  //! by a rank-1 term for each measured bin whose variance changed. This is only used with uncorrelated
+  //! measurement errors, and if fewer than half the bins changed, when it is faster than the full product.
+  if (_haveCovMes || _covVar.GetNrows()!=_nm || _cov.GetNrows()!=_nt || _cov.GetNcols()!=_nt) return false;
+  const TVectorD& err= Emeasured();
+  std::vector<Int_t> changed;
+  for (Int_t k= 0; k<_nm; k++)
+    if (err[k]*err[k] != _covVar[k]) changed.push_back(k);
+  if (2*Int_t(changed.size()) >= _nm) return false;
+  const Double_t* rinv= _resinv->GetMatrixArray();
+  Double_t*       cov=  _cov.GetMatrixArray();
+  TVectorD a(_nt);
+  for (size_t n= 0; n<changed.size(); n++) {
+    const Int_t k= changed[n];
+    const Double_t v= err[k]*err[k], d= v-_covVar[k];
+    _covVar[k]= v;
+    for (Int_t i= 0; i<_nt; i++) a[i]= rinv[Long64_t(i)*_nm+k];
+    for (Int_t i= 0; i<_nt; i++) {
+      const Double_t ai= d*a[i];
+      if (ai==0.0) continue;
+      Double_t* ci= cov+Long64_t(i)*_nt;
+      for (Int_t j= 0; j<_nt; j++) ci[j] += ai*a[j];
+    }
+  }
+  return true;
 }
 
 Bool_t
 RooUnfoldInvert::InvertResponse()
 {
+    if (UseSparse()) return InvertResponseSparse();
     if (!_svd)   return false;
     if (_resinv) return true;
     if (_nt>_nm) _resinv= new TMatrixD(_nm,_nt);
@@ -163,6 +316,67 @@ RooUnfoldInvert::InvertResponse()
     return true;
 }
 
+Bool_t
+RooUnfoldInvert::SolveSparse (TVectorD& rec)
+{
+  //! Sparse mode: replace rec (measured, with fakes subtracted) by the unfolded result, x = R^-1 rec.
+  //! This solves the augmented system [0 R; R^T 0] [y; x] = [rec; 0] (see Augmented).
+  if (!_sdec) return false;
+  TVectorD b(2*_nm);
+  for (Int_t i= 0; i<_nm; i++) b[i]= rec[i];
+  if (!_sdec->Solve (b)) return false;
+  for (Int_t i= 0; i<_nt; i++) rec[i]= b[_nm+i];
+  return true;
+}
+
+Bool_t
+RooUnfoldInvert::InvertResponseSparse()
+{
+  //! Sparse mode: fill _resinv one column (measured bin) at a time using the sparse decomposition.
+  //! The inverse is in general dense, so is only made for the covariance matrix.
+  if (!_sdec)  return false;
+  if (_resinv) return true;
+  TMatrixD* resinv= new TMatrixD(_nt,_nm);
+  TVectorD b(2*_nm);
+  for (Int_t k= 0; k<_nm; k++) {
+    b.Zero();
+    b[k]= 1.0;
+    if (!_sdec->Solve (b)) {
+      cerr << "response matrix inversion failed" << endl;
+      delete resinv;
+      return false;
+    }
+    for (Int_t i= 0; i<_nt; i++) (*resinv)(i,k)= b[_nm+i];  // column k of R^-1
+  }
+  _resinv= resinv;
+  return true;
+}
+
+void
+RooUnfoldInvert::Augmented (const TMatrixDSparse& r, TMatrixDSparse& aug)
+{
+  //! Set aug to the symmetric augmented matrix [0 R; R^T 0] of the square matrix r.
+  //! TDecompSparse only decomposes symmetric matrices. Unlike the normal equations, R^T R, the
+  //! augmented matrix has the same condition number as R (its eigenvalues are +/- the singular
+  //! values of R), so the sparse solution is as accurate as the dense SVD's.
+  const Int_t     n=    r.GetNrows();
+  const Int_t*    rows= r.GetRowIndexArray();
+  const Int_t*    cols= r.GetColIndexArray();
+  const Double_t* data= r.GetMatrixArray();
+  const Int_t     nnz=  rows[n];
+  std::vector<Int_t>    irow (2*nnz), icol (2*nnz);
+  std::vector<Double_t> val  (2*nnz);
+  Int_t m= 0;
+  for (Int_t i= 0; i<n; i++) {
+    for (Int_t k= rows[i]; k<rows[i+1]; k++) {
+      irow[m]= i;         icol[m]= n+cols[k]; val[m++]= data[k];  // R   in the upper right
+      irow[m]= n+cols[k]; icol[m]= i;         val[m++]= data[k];  // R^T in the lower left
+    }
+  }
+  aug.ResizeTo (2*n, 2*n, m);
+  if (m>0) aug.SetMatrixArray (m, &irow[0], &icol[0], &val[0]);
+}
+
 void
 RooUnfoldInvert::GetSettings(){
     _minparm=0;
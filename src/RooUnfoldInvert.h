@@ -21,6 +21,7 @@ class TH1;
 class TH1D;
 class TH2D;
 class TDecompSVD;
+class TDecompSparse;
 
 class RooUnfoldInvert : public RooUnfold {
 
@@ -36,20 +37,35 @@ public:
 
   virtual void Reset();
   TDecompSVD* Impl();
+  void SetSparse (Bool_t sparse= true);  // use sparse response matrix and decomposition
+  Bool_t GetSparse() const;
+  virtual Bool_t UnfoldBatch (const TMatrixD& meas, TMatrixD& reco, const TMatrixD* err= 0, std::vector<TMatrixD>* cov= 0);
+  virtual Long64_t MatrixBytes() const;
 
 protected:
   virtual void Unfold();
   virtual void GetCov();
   virtual void GetSettings();
+  virtual void ClearUnfolding (Bool_t newResponse= kTRUE);
 
 private:
   void Init();
+  Bool_t Decompose();
   Bool_t InvertResponse();
+  Bool_t InvertResponseSparse();
+  Bool_t SolveSparse (TVectorD& rec);
+  Bool_t UseSparse() const;
+  Bool_t UpdateCov();
+  void PropagateCov (TMatrixD& cov, TVectorD* work= 0, TMatrixD* gwork= 0);
+  static void Augmented (const TMatrixDSparse& r, TMatrixDSparse& aug);
 
 protected:
   // instance variables
   TDecompSVD* _svd;
   TMatrixD*   _resinv;
+  TDecompSparse* _sdec;  //! sparse mode: decomposition of the augmented response matrix
+  Bool_t      _sparse;   //! sparse mode
+  TVectorD    _covVar;   //! incremental mode: measurement variances used for _cov
 
 public:
   ClassDef (RooUnfoldInvert, 1)  // Unregularised unfolding
@@ -89,4 +105,29 @@ RooUnfoldInvert& RooUnfoldInvert::operator= (const RooUnfoldInvert& rhs)
   return *this;
 }
 
+inline
+void RooUnfoldInvert::SetSparse (Bool_t sparse)
+{
+  // Use RooUnfoldResponse::MresponseSparse() and a sparse decomposition (TDecompSparse) of the
+  // symmetric augmented matrix [0 R; R^T 0], instead of the SVD of the dense response matrix.
+  // This needs much less memory for large response matrices with mostly local migrations,
+  // but requires the response matrix to have full rank. Impl() is then 0.
+  // Only used for a square response matrix: otherwise the dense SVD is still used.
+  _sparse= sparse;
+}
+
+inline
+Bool_t RooUnfoldInvert::UseSparse() const
+{
+  // Use the sparse decomposition? Only for a square response matrix
+  return _sparse && _nm==_nt;
+}
+
+inline
+Bool_t RooUnfoldInvert::GetSparse() const
+{
+  // Return sparse mode setting
+  return _sparse;
+}
+
 #endif /*ROOUNFOLDINVERT_H_*/
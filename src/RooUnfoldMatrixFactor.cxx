@@ -0,0 +1,202 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Cached factorisation of a covariance matrix, for its inverse (weight
+//      matrix) and chi-squared quadratic forms.
+//
+//==============================================================================
+
+//____________________________________________________________
+/*! \class RooUnfoldMatrixFactor
+\brief Cached factorisation of a covariance matrix.</p>
+<p>Decompose() tries a Cholesky decomposition \f$V = L L^T\f$ first. This fails for a matrix that is not positive definite
+(eg. with empty bins), or is rejected if the pivots show that it is ill-conditioned (an estimated condition number above
+\f$10^{12}\f$). In those cases the SVD pseudo-inverse from RooUnfold::InvertMatrix is used instead, as before.
+The choice does not depend on the verbosity: with verbose>=1, the determinant \f$\prod_i L_{ii}^2\f$ and a condition
+number estimate \f$(\max_i L_{ii}/\min_i L_{ii})^2\f$ from the Cholesky pivots are printed, or the SVD diagnostics if
+that was used.</p>
+<p>With the Cholesky factor, \f$\chi^2 = r^T V^{-1} r = |L^{-1} r|^2\f$ is a single triangular solve, and the inverse
+is only formed if asked for. Has() checks whether a matrix is the one already decomposed, so the factorisation can be
+kept until the covariance matrix changes.</p>
+ */
+/////////////////////////////////////////////////////////////
+
+#include "RooUnfoldMatrixFactor.h"
+
+#include <cmath>
+#include <iostream>
+
+#include "TVectorD.h"
+#include "TMatrixD.h"
+
+#include "RooUnfold.h"
+
+using std::sqrt;
+using std::frexp;
+using std::ldexp;
+using std::cout;
+using std::endl;
+
+ClassImp (RooUnfoldMatrixFactor);
+
+static const Double_t cholTol= 1e-12;  // minimum pivot relative to the largest diagonal element
+
+void RooUnfoldMatrixFactor::Reset()
+{
+  //! Forget the matrix and its decomposition
+  _method= kNone;
+  _status= 0;
+  _haveInv= kFALSE;
+  _mat.ResizeTo (0, 0);
+  _L.ResizeTo (0, 0);
+  _inv.ResizeTo (0, 0);
+}
+
+Bool_t RooUnfoldMatrixFactor::Has (const TMatrixD& mat) const
+{
+  //! Returns true if mat is the matrix last decomposed (whether or not that succeeded)
+  if (_method == kNone) return kFALSE;
+  const Int_t n= _mat.GetNrows();
+  if (mat.GetNrows() != n || mat.GetNcols() != n) return kFALSE;
+  const Double_t *a= mat.GetMatrixArray(), *b= _mat.GetMatrixArray();
+  for (Int_t i= 0, nn= n*n; i<nn; i++)
+    if (a[i] != b[i]) return kFALSE;
+  return kTRUE;
+}
+
+Bool_t RooUnfoldMatrixFactor::Cholesky()
+{
+  //! Cholesky decomposition of _mat into _L. Fails if a pivot is not above cholTol times the largest diagonal
+  //! element, which is the case if _mat is not positive definite or is ill-conditioned.
+  const Int_t n= _mat.GetNrows();
+  const Double_t* a= _mat.GetMatrixArray();
+  Double_t dmax= 0.0;
+  for (Int_t i= 0; i<n; i++)
+    if (a[i*n+i] > dmax) dmax= a[i*n+i];
+  if (dmax <= 0.0) return kFALSE;
+  _L.ResizeTo (n, n);
+  _L.Zero();
+  Double_t* l= _L.GetMatrixArray();
+  for (Int_t i= 0; i<n; i++) {
+    Double_t* li= l+i*n;
+    for (Int_t j= 0; j<=i; j++) {
+      const Double_t* lj= l+j*n;
+      Double_t s= a[i*n+j];
+      for (Int_t k= 0; k<j; k++) s -= li[k]*lj[k];
+      if (j<i) {
+        li[j]= s/lj[j];
+      } else {
+        if (s <= cholTol*dmax) return kFALSE;
+        li[i]= sqrt(s);
+      }
+    }
+  }
+  return kTRUE;
+}
+
+Int_t RooUnfoldMatrixFactor::Decompose (const TMatrixD& mat, const char* name, Int_t verbose)
+{
+  //! Decompose covariance matrix mat, by Cholesky if it is positive definite and well-conditioned,
+  //! otherwise by SVD (using RooUnfold::InvertMatrix). Either way, the diagnostics are printed if verbose>=1.
+  //! Returns the status from RooUnfold::InvertMatrix: 0 if the inversion failed, 1 if OK, or 2 and 3 for warnings.
+  Reset();
+  _mat.ResizeTo (mat);
+  _mat= mat;
+  if (mat.GetNrows()==mat.GetNcols() && Cholesky()) {
+    _method= kCholesky;
+    _status= 1;
+    if (verbose>=1) PrintCholesky (name);
+    return _status;
+  }
+  _L.ResizeTo (0, 0);
+  _method= kSVD;
+  _status= RooUnfold::InvertMatrix (_mat, _inv, name, verbose);
+  _haveInv= kTRUE;
+  return _status;
+}
+
+void RooUnfoldMatrixFactor::PrintCholesky (const char* name) const
+{
+  //! Print the determinant, \f$\prod_i L_{ii}^2\f$, and an estimate of the condition number from the ratio of the
+  //! largest to smallest pivots, \f$(\max_i L_{ii}/\min_i L_{ii})^2\f$, in the style of RooUnfold::InvertMatrix.
+  //! The determinant is accumulated as mantissa and power of 2, so it does not overflow for large matrices.
+  const Int_t n= _L.GetNrows();
+  const Double_t* l= _L.GetMatrixArray();
+  Double_t d1= 1.0, d2= 0.0, lmin= 0.0, lmax= 0.0;
+  for (Int_t i= 0; i<n; i++) {
+    const Double_t p= l[i*n+i];
+    if (i==0 || p<lmin) lmin= p;
+    if (i==0 || p>lmax) lmax= p;
+    int e= 0;
+    d1= frexp (d1*p*p, &e);
+    d2 += e;
+  }
+  const Double_t cond= (lmax/lmin)*(lmax/lmin), det= ldexp (d1, Int_t(d2));
+  cout << name << " condition~"<<cond<<" (Cholesky pivots), determinant="<<det;
+  if (d2!=0.0) cout <<" ("<<d1<<"*2^"<<d2<<")";
+  cout <<endl;
+}
+
+Double_t RooUnfoldMatrixFactor::Chi2 (const TVectorD& r) const
+{
+  //! Returns \f$r^T V^{-1} r\f$ for the decomposed matrix \f$V\f$: \f$|L^{-1} r|^2\f$ by forward substitution
+  //! with the Cholesky factor, otherwise with the SVD pseudo-inverse.
+  const Int_t n= _mat.GetNrows();
+  if (_method==kNone || r.GetNrows()!=n) return 0.0;
+  const Double_t* rp= r.GetMatrixArray();
+  Double_t chi2= 0.0;
+  if (_method==kCholesky) {
+    _y.ResizeTo (n);
+    Double_t* y= _y.GetMatrixArray();
+    const Double_t* l= _L.GetMatrixArray();
+    for (Int_t i= 0; i<n; i++) {
+      const Double_t* li= l+i*n;
+      Double_t s= rp[i];
+      for (Int_t k= 0; k<i; k++) s -= li[k]*y[k];
+      y[i]= s/li[i];
+      chi2 += y[i]*y[i];
+    }
+  } else {
+    const Double_t* w= _inv.GetMatrixArray();
+    for (Int_t k= 0; k<n; k++) {
+      const Double_t* wk= w+k*n;
+      Double_t s= 0.0;
+      for (Int_t l= 0; l<n; l++) s += wk[l]*rp[l];
+      chi2 += rp[k]*s;
+    }
+  }
+  return chi2;
+}
+
+const TMatrixD& RooUnfoldMatrixFactor::GetInverse() const
+{
+  //! Returns the inverse of the decomposed matrix. From a Cholesky factor it is
+  //! \f$V^{-1} = L^{-T} L^{-1}\f$, calculated the first time it is needed.
+  if (_haveInv || _method!=kCholesky) return _inv;
+  const Int_t n= _L.GetNrows();
+  TMatrixD linv (n, n);  // L^-1, lower triangular
+  const Double_t* l= _L.GetMatrixArray();
+  Double_t* m= linv.GetMatrixArray();
+  for (Int_t j= 0; j<n; j++) {
+    m[j*n+j]= 1.0/l[j*n+j];
+    for (Int_t i= j+1; i<n; i++) {
+      const Double_t* li= l+i*n;
+      Double_t s= 0.0;
+      for (Int_t k= j; k<i; k++) s -= li[k]*m[k*n+j];
+      m[i*n+j]= s/li[i];
+    }
+  }
+  _inv.ResizeTo (n, n);
+  Double_t* w= _inv.GetMatrixArray();
+  for (Int_t i= 0; i<n; i++) {
+    for (Int_t j= 0; j<=i; j++) {
+      Double_t s= 0.0;
+      for (Int_t k= i; k<n; k++) s += m[k*n+i]*m[k*n+j];
+      w[i*n+j]= w[j*n+i]= s;
+    }
+  }
+  _haveInv= kTRUE;
+  return _inv;
+}
@@ -0,0 +1,78 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Cached factorisation of a covariance matrix, for its inverse (weight
+//      matrix) and chi-squared quadratic forms.
+//
+//==============================================================================
+
+#ifndef ROOUNFOLDMATRIXFACTOR_HH
+#define ROOUNFOLDMATRIXFACTOR_HH
+
+#include "Rtypes.h"
+#include "TVectorD.h"
+#include "TMatrixD.h"
+
+class RooUnfoldMatrixFactor {
+
+public:
+
+  enum EMethod { kNone, kCholesky, kSVD };
+
+  RooUnfoldMatrixFactor();
+  virtual ~RooUnfoldMatrixFactor() {}
+
+  Int_t    Decompose (const TMatrixD& mat, const char* name= "matrix", Int_t verbose= 1);  // status as RooUnfold::InvertMatrix
+  void     Reset();                              // forget the decomposition
+  Bool_t   Has (const TMatrixD& mat) const;      // mat is the matrix decomposed
+  Int_t    GetMethod() const;                    // kCholesky or kSVD (kNone if not decomposed)
+  Int_t    GetStatus() const;                    // return value of Decompose
+  Double_t Chi2 (const TVectorD& r) const;       // r^T mat^-1 r
+  const TMatrixD& GetInverse() const;            // mat^-1 (SVD pseudo-inverse if ill-conditioned)
+
+private:
+
+  Bool_t   Cholesky();
+  void     PrintCholesky (const char* name) const;
+
+  // instance variables
+
+  Int_t    _method;          // EMethod used
+  Int_t    _status;          // return value of Decompose
+  TMatrixD _mat;             // Matrix decomposed
+  TMatrixD _L;               // Lower triangular Cholesky factor, _mat = _L * _L^T
+  mutable TMatrixD _inv;     // Inverse (always set for SVD, computed on demand for Cholesky)
+  mutable Bool_t   _haveInv; // _inv is set
+  mutable TVectorD _y;       //! workspace
+
+public:
+
+  ClassDef (RooUnfoldMatrixFactor, 0) // Cached covariance matrix factorisation
+};
+
+// Inline method definitions
+
+inline
+RooUnfoldMatrixFactor::RooUnfoldMatrixFactor()
+{
+  // Constructor. Use Decompose() to set the matrix.
+  Reset();
+}
+
+inline
+Int_t RooUnfoldMatrixFactor::GetMethod() const
+{
+  // Return decomposition used: kCholesky, kSVD, or kNone if not decomposed
+  return _method;
+}
+
+inline
+Int_t RooUnfoldMatrixFactor::GetStatus() const
+{
+  // Return the status of the last Decompose: 0 if it failed
+  return _status;
+}
+
+#endif
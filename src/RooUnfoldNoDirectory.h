@@ -0,0 +1,84 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Scope in which new histograms are not added to the current directory,
+//      without changing the global TH1::AddDirectory setting.
+//
+//==============================================================================
+
+#ifndef ROOUNFOLDNODIRECTORY_HH
+#define ROOUNFOLDNODIRECTORY_HH
+
+#include "RVersion.h"
+#include "TDirectory.h"
+#include "TH1.h"
+
+// Histograms that RooUnfold creates for its own use (and owns) must not be added to the current
+// directory, or they would be deleted when the file is closed. Toggling TH1::AddDirectory for this
+// changes a process-wide setting, which races with other threads. Instead, for the lifetime of a
+// RooUnfoldNoDirectory object, the current directory is unset using a TDirectory::TContext, which
+// restores it afterwards (or falls back to gROOT if that directory was deleted in the meantime).
+// With ROOT::EnableThreadSafety() that is only for the current thread, so unfoldings in other
+// threads are not affected.
+//
+// ROOT 5 needs a current directory for TObject::Clone, and is not thread-safe anyway, so there the
+// TH1::AddDirectory setting is switched off for the lifetime of the object instead.
+
+class RooUnfoldNoDirectory {
+
+public:
+
+  RooUnfoldNoDirectory();   // unset current directory
+  ~RooUnfoldNoDirectory();  // restore it
+
+private:
+
+  RooUnfoldNoDirectory (const RooUnfoldNoDirectory&);             // not copyable
+  RooUnfoldNoDirectory& operator= (const RooUnfoldNoDirectory&);
+
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,0,0)
+  TDirectory::TContext _ctx;  // unsets the current directory, and restores it
+#else
+  Bool_t _addDir;             // TH1::AddDirectory setting to restore
+#endif
+};
+
+// Inline method definitions
+
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,0,0)
+
+inline
+RooUnfoldNoDirectory::RooUnfoldNoDirectory()
+  : _ctx(0)
+{
+  // Unset the current directory, so new histograms are not added to it
+}
+
+inline
+RooUnfoldNoDirectory::~RooUnfoldNoDirectory()
+{
+  // The current directory is restored by _ctx
+}
+
+#else
+
+inline
+RooUnfoldNoDirectory::RooUnfoldNoDirectory()
+  : _addDir(TH1::AddDirectoryStatus())
+{
+  // Don't add new histograms to the current directory
+  TH1::AddDirectory (kFALSE);
+}
+
+inline
+RooUnfoldNoDirectory::~RooUnfoldNoDirectory()
+{
+  // Restore the TH1::AddDirectory setting
+  TH1::AddDirectory (_addDir);
+}
+
+#endif
+
+#endif
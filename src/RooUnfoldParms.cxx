@@ -37,8 +37,12 @@ return an rms. The chi squared values are calculated using the chi2() method in
 #include "TH1D.h"
 #include "TProfile.h"
 #include "RooUnfold.h"
+#include "RooUnfoldBayes.h"
+#include "RooUnfoldSvd.h"
 #include "TRandom.h"
 #include "RooUnfoldResponse.h"
+#include "RooUnfoldNoDirectory.h"
+#include "RooUnfoldThreads.h"
 #include "TLatex.h"
 using std::cout;
 using std::cerr;
@@ -62,6 +66,9 @@ RooUnfoldParms::Init()
     hres=0;  
     hrms=0;
     _done_math=0;
+    _done_scan=0;
+    _nt=0;
+    _nthreads=unfold->NThreads();
     _maxparm=unfold->GetMaxParm();
     _minparm=unfold->GetMinParm();
     _stepsizeparm=unfold->GetStepSizeParm();
@@ -124,6 +131,7 @@ RooUnfoldParms::DoMath()
     Int_t nobins=Int_t((_maxparm-_minparm)/_stepsizeparm);
     Double_t xlo=_minparm;
     Double_t xhi=_maxparm;
+    delete hch2; delete herr; delete hres; delete hrms;  // plots from before the range was changed
     hch2=new TProfile("hch2","#chi^{2} vs regparm",nobins,xlo,xhi);
     herr=new TProfile("herr","Mean error vs regparm",nobins,xlo,xhi);
     hres=new TProfile("hres","Mean residual vs regparm",nobins,xlo,xhi);
@@ -144,54 +152,32 @@ RooUnfoldParms::DoMath()
     }
     
     else{ 
-        vector<TH1D*> graph_vector;    
-        for(Double_t a = _minparm; a<=_maxparm; a+=_stepsizeparm) {
-        TString graph_title("Residuals at k= ");
-        graph_title+=a;
-        TH1D* graph_name = new TH1D (graph_title,graph_title, 200,0,1000);
-        graph_vector.push_back(graph_name);
-        }
-        Int_t gvl=0;
+        if (!_done_scan) Scan();
         Int_t _overflow=unfold->Overflow();
-        Int_t nt = unfold->response()->GetNbinsTruth();
-        if (_overflow) nt += 2;
-    
-        for (Double_t k=_minparm;k<=_maxparm;k+=_stepsizeparm)
-        {   
-            RooUnfold* unf = unfold->Clone("unfold_toy");
-            unf->SetRegParm(k);
+        Int_t nt=_nt;
+        for (Int_t p=0; p<GetNPoints(); p++)
+        {
+            Double_t k=_parm[p];
+            const TVectorD& reco=_reco[p];
+            const TVectorD& errs=_errs[p];
             Double_t sq_err_tot=0;
-            TH1* hReco=unf->Hreco(doerror); 
-            for (Int_t i= 0; i < nt; i++)
-            {
-              sq_err_tot += RooUnfoldResponse::GetBinError (hReco, i, _overflow);
-            }
+            for (Int_t i= 0; i < nt; i++) sq_err_tot += errs[i];
             herr->Fill(k,sq_err_tot/nt);
             if (hTrue)
             {   
-                Double_t rsqt=0;    
-                Double_t res_tot=0;
                 for (int i=0;i<nt;i++){
-                    Int_t j= RooUnfoldResponse::GetBin (hReco, i, _overflow);
-                    if (hReco->GetBinContent(j)!=0.0 || (hReco->GetBinError(j)>0.0)) 
+                    if (reco[i]!=0.0 || errs[i]>0.0) 
                     {
-                        Double_t res=hReco->GetBinContent(j) - hTrue->GetBinContent(j);
-                        //cout <<"res="<<res<<endl;
-                        Double_t rsq=res*res;
-                        rsqt+=rsq;
-                        graph_vector[gvl]->Fill(res);
-                        res_tot+=res;
+                        Int_t j= RooUnfoldResponse::GetBin (hTrue, i, _overflow);
+                        Double_t res=reco[i] - hTrue->GetBinContent(j);
                         hres->Fill(k,res);
                     }
                 }
-                double chi2=unf->Chi2(hTrue,doerror);
+                Double_t chi2=_chi2[p];
                 if (chi2<=1e10){
                     hch2->Fill(k,chi2);
                 }
-                
             }
-            gvl++;
-            delete unf;
         }
         Double_t bn=_minparm;
         for (int i=0; i<hres->GetNbinsX(); i++){
@@ -199,30 +185,179 @@ RooUnfoldParms::DoMath()
             hrms->Fill(bn,spr);
             bn+=_stepsizeparm;
         }
-        for (unsigned int i=0; i<graph_vector.size(); i++){
-            delete graph_vector[i];
-        }
     }
     _done_math=true;
 }
 
+void
+RooUnfoldParms::Scan()
+{
+    //Unfolds at each regularisation parameter, filling the results table (GetNPoints(), GetParm(), GetPointReco(),
+    //GetPointErrors(), GetPointChi2()), from which the plots are made.
+    //The scan points are shared between SetNThreads() threads, each using one copy of the unfolding object
+    //for a contiguous range of points, so a method's workspace that does not depend on the regularisation
+    //parameter (eg. the RooUnfoldSvd decomposition or the TUnfold object) is kept between points.
+    //Bayes results for all numbers of iterations are obtained from a single unfolding using checkpoints.
+    _parm.clear();
+    for (Double_t k=_minparm;k<=_maxparm;k+=_stepsizeparm) _parm.push_back(k);
+    Int_t np=_parm.size();
+    _nt = unfold->response()->GetNbinsTruth();
+    if (unfold->Overflow()) _nt += 2;
+    _reco.assign (np, TVectorD(_nt));
+    _errs.assign (np, TVectorD(_nt));
+    _chi2.assign (np, -1.0);
+    _done_scan=true;
+    if (np<=0) return;
+
+    if (dynamic_cast<const RooUnfoldBayes*>(unfold) && doerror!=RooUnfold::kCovToy &&
+        !unfold->SystematicsIncluded() && _minparm>=0.5) {
+        RooUnfoldBayes* bayes= dynamic_cast<RooUnfoldBayes*>(unfold->Clone("unfold_scan"));
+        vector<Int_t> niters;
+        for (Int_t p=0; p<np; p++) niters.push_back(Int_t(_parm[p]+0.5));
+        bayes->SetIterations (niters.back());
+        bayes->SetCheckpoints (niters, doerror!=RooUnfold::kNoError);
+        for (Int_t p=0; p<np; p++) {
+            bayes->UseCheckpoint(p);
+            ScanPoint (bayes, p);
+        }
+        delete bayes;
+        return;
+    }
+
+#ifdef ROOUNFOLD_THREADS
+    Int_t nthreads= RooUnfoldThreads::NThreads (_nthreads, np);
+    // toys share the unfolding's random number generator unless they have their own random number streams
+    if (nthreads>1 && (!unfold->ThreadSafe() || (doerror==RooUnfold::kCovToy && !unfold->ToySeed()))) {
+        if (unfold->verbose()>=1) cout << unfold->ClassName() << " scan cannot run in parallel - use 1 thread" << endl;
+        nthreads= 1;
+    }
+    if (nthreads>1) {
+        // Fill lazily-cached quantities now, so the threads only read shared state.
+        unfold->response()->FillCache();
+        RooUnfoldThreads::EnableThreadSafety();
+        vector<RooUnfold*> unfs;
+        {
+            RooUnfoldNoDirectory nodir;
+            for (Int_t t= 0; t<nthreads; t++) unfs.push_back (unfold->Clone("unfold_scan"));
+        }
+        vector<std::thread> threads;
+        for (Int_t t= 0; t<nthreads; t++) {
+            Int_t first= Int_t ((Long64_t(np)* t   )/nthreads);
+            Int_t last=  Int_t ((Long64_t(np)*(t+1))/nthreads);
+            threads.push_back (std::thread (&RooUnfoldParms::ScanRange, this, unfs[t], first, last));
+        }
+        for (Int_t t= 0; t<nthreads; t++) {
+            threads[t].join();
+            delete unfs[t];
+        }
+        return;
+    }
+#endif
+    RooUnfold* unf= unfold->Clone("unfold_scan");
+    ScanRange (unf, 0, np);
+    delete unf;
+}
+
+void
+RooUnfoldParms::ScanRange(RooUnfold* unf, Int_t first, Int_t last)
+{
+    //Unfolds with unf at scan points first to last-1.
+    //Only the result is cleared for each point: SetRegParm leaves the workspace for the next unfolding.
+    for (Int_t p=first; p<last; p++) {
+        unf->SetRegParm(_parm[p]);
+        unf->RooUnfold::ClearUnfolding(kFALSE);
+        ScanPoint (unf, p);
+    }
+}
+
+void
+RooUnfoldParms::ScanPoint(RooUnfold* unf, Int_t p)
+{
+    //Stores the result, errors, and chi^2 of unf as scan point p
+    _reco[p]= unf->Vreco();
+    unf->ErecoV(_errs[p], doerror);
+    if (hTrue) _chi2[p]= unf->Chi2(hTrue,doerror);
+}
+
 void
 RooUnfoldParms::SetMinParm(double min)
 {
-    //Sets minimum parameter
+    //Sets minimum parameter The scan and plots are redone the next time they are needed.
     _minparm=min;
+    _done_scan=_done_math=false;
 }
 
 void
 RooUnfoldParms::SetMaxParm(double max)
 {
-    //Sets maximum parameter
+    //Sets maximum parameter The scan and plots are redone the next time they are needed.
     _maxparm=max;
+    _done_scan=_done_math=false;
 }
 
 void
 RooUnfoldParms::SetStepSizeParm(double size)
 {
-    //Sets step size.
+    //Sets step size. The scan and plots are redone the next time they are needed.
     _stepsizeparm=size;
+    _done_scan=_done_math=false;
+}
+
+void
+RooUnfoldParms::SetNThreads(Int_t nthreads)
+{
+    //Sets number of threads for the scan (0 = number of cores). The default is the unfolding object's NThreads().
+    _nthreads=nthreads;
+}
+
+Int_t
+RooUnfoldParms::GetNPoints()
+{
+    //Returns number of regularisation parameters scanned
+    if (!_done_scan){Scan();}
+    return _parm.size();
+}
+
+Double_t
+RooUnfoldParms::GetParm(Int_t i)
+{
+    //Returns regularisation parameter of scan point i (0 if there is no such point)
+    if (!CheckPoint(i,"GetParm")) return 0.0;
+    return _parm[i];
+}
+
+const TVectorD&
+RooUnfoldParms::GetPointReco(Int_t i)
+{
+    //Returns unfolded result at scan point i (an empty vector if there is no such point)
+    static const TVectorD none;
+    if (!CheckPoint(i,"GetPointReco")) return none;
+    return _reco[i];
+}
+
+const TVectorD&
+RooUnfoldParms::GetPointErrors(Int_t i)
+{
+    //Returns errors on the unfolded result at scan point i (an empty vector if there is no such point)
+    static const TVectorD none;
+    if (!CheckPoint(i,"GetPointErrors")) return none;
+    return _errs[i];
+}
+
+Double_t
+RooUnfoldParms::GetPointChi2(Int_t i)
+{
+    //Returns chi squared of the unfolded result at scan point i with respect to the truth distribution (-1 if not available)
+    if (!CheckPoint(i,"GetPointChi2")) return -1.0;
+    return _chi2[i];
+}
+
+Bool_t
+RooUnfoldParms::CheckPoint(Int_t i, const char* method)
+{
+    //Scans if necessary, and returns true if i is a valid scan point, otherwise prints an error
+    if (!_done_scan){Scan();}
+    if (i>=0 && i<Int_t(_parm.size())) return true;
+    cerr<<"Error: RooUnfoldParms::"<<method<<" scan point "<<i<<" out of range 0-"<<Int_t(_parm.size())-1<<endl;
+    return false;
 }
@@ -13,7 +13,9 @@
 #define ROOUNFOLDPARMS_H_
 
 #include "TNamed.h"
+#include "TVectorD.h"
 #include "RooUnfold.h"
+#include <vector>
 
 class TH1;
 class RooUnfold;
@@ -33,18 +35,35 @@ class RooUnfoldParms : public TNamed {
     void SetMinParm(double min);
     void SetMaxParm(double max);
     void SetStepSizeParm(double size);
+    void SetNThreads(Int_t nthreads);
+    Int_t GetNPoints(); // Results table: number of regularisation parameters scanned
+    Double_t GetParm(Int_t i); // Regularisation parameter of scan point i
+    const TVectorD& GetPointReco(Int_t i); // Unfolded result at scan point i
+    const TVectorD& GetPointErrors(Int_t i); // Errors at scan point i
+    Double_t GetPointChi2(Int_t i); // Chi squared at scan point i
     
     private:
     bool _done_math;
+    bool _done_scan;
     TH1* hrms; // Output plot
     TProfile* hch2; // Output plot
     TProfile* herr; // Output plot
     TProfile* hres; // Output plot
     void DoMath();
     void Init();
+    void Scan();
+    void ScanRange(RooUnfold* unf, Int_t first, Int_t last);
+    void ScanPoint(RooUnfold* unf, Int_t p);
+    Bool_t CheckPoint(Int_t i, const char* method);
     Double_t _maxparm; //Maximum parameter
     Double_t _minparm; //Minimum parameter
     Double_t _stepsizeparm; //Step size
+    Int_t _nthreads; //Number of threads for the scan
+    Int_t _nt; //Number of truth bins in the results
+    std::vector<Double_t> _parm; //! Regularisation parameter of each scan point
+    std::vector<TVectorD> _reco; //! Unfolded result of each scan point
+    std::vector<TVectorD> _errs; //! Errors of each scan point
+    std::vector<Double_t> _chi2; //! Chi squared of each scan point
 public:
     ClassDef (RooUnfoldParms, 0)  // Optimisation of unfolding regularisation parameter
 };
@@ -22,10 +22,21 @@
 /////////////////////////////////////////////////////////////
 
 #include "RooUnfoldResponse.h"
+#include "RooUnfoldResponseFiller.h"
+#include "RooUnfoldBinLookup.h"
+#include "RooUnfoldBootstrap.h"
+#include "RooUnfoldNoDirectory.h"
 
 #include <iostream>
 #include <assert.h>
 #include <cmath>
+#include <cstdio>
+#include <cstring>
+#if !defined(_WIN32)
+#define ROOUNFOLD_MMAP 1
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 #include "TClass.h"
 #include "TNamed.h"
@@ -38,8 +49,10 @@
 #include "TF3.h"
 #include "TVectorD.h"
 #include "TMatrixD.h"
+#include "TMatrixDSparse.h"
 #include "TRandom.h"
 #include "TCollection.h"
+#include "TArrayD.h"
 
 #if ROOT_VERSION_CODE >= ROOT_VERSION(5,18,0)
 #define HAVE_RooUnfoldFoldingFunction
@@ -56,7 +69,8 @@ using std::sqrt;
 class RooUnfoldFoldingFunction {
 public:
   RooUnfoldFoldingFunction (const RooUnfoldResponse* res, TF1* func, Double_t eps=1e-12, bool verbose=false)
-    : _res(res), _func(func), _eps(eps), _verbose(verbose), _fvals(_res->GetNbinsMeasured()) {
+    : _res(res), _func(func), _eps(eps), _verbose(verbose), _fvals(_res->GetNbinsMeasured()),
+      _lookup(_res->Hmeasured(), _res->GetDimensionMeasured()) {
     _ndim= dynamic_cast<TF3*>(_func) ? 3 :
            dynamic_cast<TF2*>(_func) ? 2 : 1;
     if (_ndim>=2 && eps==1e-12) eps= 0.000001;
@@ -64,11 +78,10 @@ public:
   }
 
   double operator() (double* x, double* p) const {
-    const TH1* mes= _res->Hmeasured();
     Int_t bin;
-    if      (_ndim==1) bin= RooUnfoldResponse::FindBin (mes, x[0]);
-    else if (_ndim==2) bin= RooUnfoldResponse::FindBin (mes, x[0], x[1]);
-    else               bin= RooUnfoldResponse::FindBin (mes, x[0], x[1], x[2]);
+    if      (_ndim==1) bin= _lookup.FindIndex (x[0]);
+    else if (_ndim==2) bin= _lookup.FindIndex (x[0], x[1]);
+    else               bin= _lookup.FindIndex (x[0], x[1], x[2]);
     if (bin<0 || bin>=_res->GetNbinsMeasured()) return 0.0;
     for (Int_t i=0, n=_func->GetNpar(); i<n; i++) {
       if (p[i] == _func->GetParameter(i)) continue;
@@ -141,6 +154,7 @@ private:
   Double_t _eps;
   bool _verbose;
   mutable TVectorD _fvals;
+  RooUnfoldBinLookup _lookup;
   Int_t _ndim;
 };
 #endif  
@@ -221,13 +235,38 @@ RooUnfoldResponse::Add (const RooUnfoldResponse& rhs)
   assert (_fak != 0 && rhs._fak != 0);
   assert (_tru != 0 && rhs._tru != 0);
   assert (_res != 0 && rhs._res != 0);
+  _checksum= 0;
   if (_cached) ClearCache();
+  if (_boot && !(rhs._boot && _boot->SameReplicas (*rhs._boot))) {
+    cerr << "RooUnfoldResponse::Add: " << rhs.GetName() << " does not have the same bootstrap replicas as "
+         << GetName() << ", so they are removed" << endl;
+    delete _boot; _boot= 0;
+  }
   _mes->Add (rhs._mes);
   _fak->Add (rhs._fak);
   _tru->Add (rhs._tru);
   _res->Add (rhs._res);
+  if (_boot) _boot->Merge (*rhs._boot);
 }
 
+void
+RooUnfoldResponse::Add (const RooUnfoldResponseFiller& filler)
+{
+  //! Add the events accumulated in a RooUnfoldResponseFiller, which must have been set up with the same binning
+  if (_res == 0) {
+    cerr << "RooUnfoldResponse::Add: " << GetName() << " is not set up" << endl;
+    return;
+  }
+  _checksum= 0;
+  if (_cached) ClearCache();
+  if (!filler.Publish (*this)) return;
+  if (_boot && !_boot->SameReplicas (filler._boot)) {
+    cerr << "RooUnfoldResponse::Add: RooUnfoldResponseFiller does not have the same bootstrap replicas as "
+         << GetName() << ", so they are removed" << endl;
+    delete _boot; _boot= 0;
+  }
+  if (_boot) _boot->Merge (filler._boot);
+}
 
 Long64_t RooUnfoldResponse::Merge (TCollection* others)
 {
@@ -250,6 +289,9 @@ RooUnfoldResponse::Reset()
   delete _fak;
   delete _tru;
   delete _res;
+  delete _lMes;
+  delete _lTru;
+  delete _boot;
   return Setup();
 }
 
@@ -267,8 +309,16 @@ RooUnfoldResponse::Setup()
   _res= 0;
   _vMes= _eMes= _vFak= _vTru= _eTru= 0;
   _mRes= _eRes= 0;
+  _mResS= _eResS= 0;
+  _lMes= _lTru= 0;
+  _haveSmear= false;
+  _boot= 0;
+  _map= 0;
+  _mapSize= 0;
   _nm= _nt= _mdim= _tdim= 0;
+  _checksum= 0;
   _cached= false;
+  _timing.Reset();
   return *this;
 }
 
@@ -285,8 +335,7 @@ RooUnfoldResponse::Setup (Int_t nm, Double_t mlo, Double_t mhi, Int_t nt, Double
 {
   //! set up simple 1D case
   Reset();
-  Bool_t oldstat= TH1::AddDirectoryStatus();
-  TH1::AddDirectory (kFALSE);
+  RooUnfoldNoDirectory nodir;
   _mes= new TH1D ("measured", "Measured", nm, mlo, mhi);
   _fak= new TH1D ("fakes",    "Fakes",    nm, mlo, mhi);
   _tru= new TH1D ("truth",    "Truth",    nt, tlo, thi);
@@ -295,7 +344,6 @@ RooUnfoldResponse::Setup (Int_t nm, Double_t mlo, Double_t mhi, Int_t nt, Double
   _nt= nt;
   SetNameTitleDefault ("response", "Response");
   _res= new TH2D (GetName(), GetTitle(), nm, mlo, mhi, nt, tlo, thi);
-  TH1::AddDirectory (oldstat);
   return *this;
 }
 
@@ -315,8 +363,7 @@ RooUnfoldResponse::Setup (const TH1* measured, const TH1* truth)
 {
   //! set up - measured and truth only used for shape
   Reset();
-  Bool_t oldstat= TH1::AddDirectoryStatus();
-  TH1::AddDirectory (kFALSE);
+  RooUnfoldNoDirectory nodir;
   _mes= (TH1*) measured ->Clone();
   _mes->Reset();
   _fak= (TH1*) _mes     ->Clone("fakes");
@@ -335,7 +382,6 @@ RooUnfoldResponse::Setup (const TH1* measured, const TH1* truth)
   _res= new TH2D (GetName(), GetTitle(), _nm, 0.0, Double_t(_nm), _nt, 0.0, Double_t(_nt));
   if (_mdim==1) ReplaceAxis (_res->GetXaxis(), _mes->GetXaxis());
   if (_tdim==1) ReplaceAxis (_res->GetYaxis(), _tru->GetXaxis());
-  TH1::AddDirectory (oldstat);
   return *this;
 }
 
@@ -350,8 +396,7 @@ RooUnfoldResponse::Setup (const TH1* measured, const TH1* truth, const TH2* resp
   //! "measured" and/or "truth" can be specified as 0 (1D case only) or an empty histograms (no entries) as a shortcut
   //! to indicate, respectively, no fakes and/or no inefficiency.
   Reset();
-  Bool_t oldstat= TH1::AddDirectoryStatus();
-  TH1::AddDirectory (kFALSE);
+  RooUnfoldNoDirectory nodir;
   _res= (TH2*) response->Clone();
   if (measured) {
     _mes= (TH1*) measured->Clone();
@@ -374,7 +419,6 @@ RooUnfoldResponse::Setup (const TH1* measured, const TH1* truth, const TH2* resp
     ReplaceAxis (_tru->GetXaxis(), _res->GetYaxis());
     _tdim= 1;
   }
-  TH1::AddDirectory (oldstat);
   if (_overflow && (_mdim > 1 || _tdim > 1)) {
     cerr << "UseOverflow setting ignored for multi-dimensional distributions" << endl;
     _overflow= 0;
@@ -459,6 +503,15 @@ RooUnfoldResponse::ClearCache()
   delete _eTru; _eTru= 0;
   delete _mRes; _mRes= 0;
   delete _eRes; _eRes= 0;
+  delete _mResS; _mResS= 0;
+  delete _eResS; _eResS= 0;
+  UnmapCache();
+  _haveSmear= false;
+  _smearBin .Set(0);
+  _smearElem.Set(0);
+  _smearVal .Set(0);
+  _smearErr .Set(0);
+  _smearFac .Set(0);
   _cached= false;
 }
 
@@ -468,10 +521,13 @@ RooUnfoldResponse::Fill (Double_t xr, Double_t xt, Double_t w)
   //! Fill 1D Response Matrix
   assert (_mes != 0 && _tru != 0);
   assert (_mdim==1 && _tdim==1);
+  _checksum= 0;
   if (_cached) ClearCache();
-  _mes->Fill (xr, w);
-  _tru->Fill (xt, w);
-  return _res->Fill (xr, xt, w);
+  Int_t bm= _mes->Fill (xr, w);
+  Int_t bt= _tru->Fill (xt, w);
+  Int_t br= _res->Fill (xr, xt, w);
+  if (_boot) BootstrapEvent (bm, -1, bt, br, w);
+  return br;
 }
 
 Int_t
@@ -480,11 +536,14 @@ RooUnfoldResponse::Fill (Double_t xr, Double_t yr, Double_t xt, Double_t yt, Dou
   //! Fill 2D Response Matrix
   assert (_mes != 0 && _tru != 0);
   assert (_mdim==2 && _tdim==2);
+  _checksum= 0;
   if (_cached) ClearCache();
-  ((TH2*)_mes)->Fill (xr, yr, w);
-  ((TH2*)_tru)->Fill (xt, yt, w);
-  return _res->Fill (_res->GetXaxis()->GetBinCenter (FindBin (_mes, xr, yr)+1),
-                     _res->GetYaxis()->GetBinCenter (FindBin (_tru, xt, yt)+1), w);
+  Int_t bm= ((TH2*)_mes)->Fill (xr, yr, w);
+  Int_t bt= ((TH2*)_tru)->Fill (xt, yt, w);
+  Int_t br= _res->Fill (_res->GetXaxis()->GetBinCenter (MeasuredLookup().FindIndex (xr, yr)+1),
+                        _res->GetYaxis()->GetBinCenter (TruthLookup()   .FindIndex (xt, yt)+1), w);
+  if (_boot) BootstrapEvent (bm, -1, bt, br, w);
+  return br;
 }
 
 Int_t
@@ -493,11 +552,72 @@ RooUnfoldResponse::Fill (Double_t xr, Double_t yr, Double_t zr, Double_t xt, Dou
   //! Fill 3D Response Matrix
   assert (_mes != 0 && _tru != 0);
   assert (_mdim==3 && _tdim==3);
+  _checksum= 0;
+  if (_cached) ClearCache();
+  Int_t bm= ((TH3*)_mes)->Fill (xr, yr, zr, w);
+  Int_t bt= ((TH3*)_tru)->Fill (xt, yt, zt, w);
+  Int_t br= _res->Fill (_res->GetXaxis()->GetBinCenter (MeasuredLookup().FindIndex (xr, yr, zr)+1),
+                        _res->GetYaxis()->GetBinCenter (TruthLookup()   .FindIndex (xt, yt, zt)+1), w);
+  if (_boot) BootstrapEvent (bm, -1, bt, br, w);
+  return br;
+}
+
+void
+RooUnfoldResponse::FillN (Int_t n, const Double_t* reco, const Double_t* truth, const Double_t* w, const Int_t* type)
+{
+  //! Fill n events at once.
+  //! reco and truth give the measured and truth coordinates of each event in turn
+  //! (x, (x,y), or (x,y,z) for each event, according to the dimensions of the measured and truth distributions).
+  //! w gives the event weights (all 1 if w=0).
+  //! type gives kFillMatch (as Fill), kFillMiss (as Miss: reco not used), or kFillFake (as Fake: truth not used)
+  //! for each event. If type=0, all events are kFillMatch.
+  //! reco (truth) can be 0 if all events are kFillMiss (kFillFake).
+  //! The result is the same as calling Fill, Miss, or Fake for each event, but each axis bin is looked up only
+  //! once and the weights are added to the histogram bins directly, with the histogram statistics and number
+  //! of entries updated at the end. Histogram axes are not extended (as TH1::FindFixBin).
+  //! See also RooUnfoldResponseFiller::FillParallel for filling with several threads.
+  assert (_mes != 0 && _fak != 0 && _tru != 0 && _res != 0);
+  assert (_mdim>=1 && _mdim<=3 && _tdim>=1 && _tdim<=3);
+  if (n<=0) return;
+  _checksum= 0;
   if (_cached) ClearCache();
-  ((TH3*)_mes)->Fill (xr, yr, zr, w);
-  ((TH3*)_tru)->Fill (xt, yt, zt, w);
-  return _res->Fill (_res->GetXaxis()->GetBinCenter (FindBin (_mes, xr, yr, zr)+1),
-                     _res->GetYaxis()->GetBinCenter (FindBin (_tru, xt, yt, zt)+1), w);
+
+  Bool_t weighted= kFALSE;
+  if (w) {
+    for (Int_t i= 0; i<n; i++) {
+      if (w[i] != 1.0) {
+        weighted= kTRUE;
+        break;
+      }
+    }
+  }
+
+  RooUnfoldResponseFiller filler;
+  if (filler.SetupDirect (this, weighted)) {
+    filler.FillN (n, reco, truth, w, type);
+    filler.PublishDirect();
+  } else {
+    filler.Setup (this);
+    filler.FillN (n, reco, truth, w, type);
+    filler.Publish (*this);
+  }
+  if (_boot) _boot->Merge (filler._boot);
+}
+
+const RooUnfoldBinLookup&
+RooUnfoldResponse::MeasuredLookup() const
+{
+  //! Bin lookup for the measured distribution, set up on first use
+  if (!_lMes) _lMes= new RooUnfoldBinLookup (_mes, _mdim);
+  return *_lMes;
+}
+
+const RooUnfoldBinLookup&
+RooUnfoldResponse::TruthLookup() const
+{
+  //! Bin lookup for the truth distribution, set up on first use
+  if (!_lTru) _lTru= new RooUnfoldBinLookup (_tru, _tdim);
+  return *_lTru;
 }
 
 Int_t
@@ -557,8 +677,11 @@ RooUnfoldResponse::Miss1D (Double_t xt, Double_t w)
   //! Fill missed event (not reconstructed due to detection inefficiencies) into 1D Response Matrix (with weight)
   assert (_tru != 0);
   assert (_tdim==1);
+  _checksum= 0;
   if (_cached) ClearCache();
-  return _tru->Fill (xt, w);
+  Int_t bt= _tru->Fill (xt, w);
+  if (_boot) BootstrapEvent (-1, -1, bt, -1, w);
+  return bt;
 }
 
 Int_t
@@ -567,8 +690,11 @@ RooUnfoldResponse::Miss2D (Double_t xt, Double_t yt, Double_t w)
   //! Fill missed event (not reconstructed due to detection inefficiencies) into 2D Response Matrix (with weight)
   assert (_tru != 0);
   assert (_tdim==2);
+  _checksum= 0;
   if (_cached) ClearCache();
-  return ((TH2*)_tru)->Fill (xt, yt, w);
+  Int_t bt= ((TH2*)_tru)->Fill (xt, yt, w);
+  if (_boot) BootstrapEvent (-1, -1, bt, -1, w);
+  return bt;
 }
 
 Int_t
@@ -577,8 +703,11 @@ RooUnfoldResponse::Miss (Double_t xt, Double_t yt, Double_t zt, Double_t w)
   //! Fill missed event (not reconstructed due to detection inefficiencies) into 3D Response Matrix
   assert (_tru != 0);
   assert (_tdim==3);
+  _checksum= 0;
   if (_cached) ClearCache();
-  return ((TH3*)_tru)->Fill (xt, yt, zt, w);
+  Int_t bt= ((TH3*)_tru)->Fill (xt, yt, zt, w);
+  if (_boot) BootstrapEvent (-1, -1, bt, -1, w);
+  return bt;
 }
 
 Int_t
@@ -587,9 +716,12 @@ RooUnfoldResponse::Fake1D (Double_t xr, Double_t w)
   //! Fill fake event (reconstructed event with no truth) into 1D Response Matrix (with weight)
   assert (_fak != 0 && _mes != 0);
   assert (_mdim==1);
+  _checksum= 0;
   if (_cached) ClearCache();
-         _mes->Fill (xr, w);
-  return _fak->Fill (xr, w);
+  Int_t bm= _mes->Fill (xr, w);
+  Int_t bf= _fak->Fill (xr, w);
+  if (_boot) BootstrapEvent (bm, bf, -1, -1, w);
+  return bf;
 }
 
 Int_t
@@ -598,9 +730,12 @@ RooUnfoldResponse::Fake2D (Double_t xr, Double_t yr, Double_t w)
   //! Fill fake event (reconstructed event with no truth) into 2D Response Matrix (with weight)
   assert (_mes != 0);
   assert (_mdim==2);
+  _checksum= 0;
   if (_cached) ClearCache();
-         ((TH2*)_fak)->Fill (xr, yr, w);
-  return ((TH2*)_mes)->Fill (xr, yr, w);
+  Int_t bf= ((TH2*)_fak)->Fill (xr, yr, w);
+  Int_t bm= ((TH2*)_mes)->Fill (xr, yr, w);
+  if (_boot) BootstrapEvent (bm, bf, -1, -1, w);
+  return bm;
 }
 
 Int_t
@@ -609,9 +744,12 @@ RooUnfoldResponse::Fake (Double_t xr, Double_t yr, Double_t zr, Double_t w)
   //! Fill fake event (reconstructed event with no truth) into 3D Response Matrix
   assert (_mes != 0);
   assert (_mdim==3);
+  _checksum= 0;
   if (_cached) ClearCache();
-         ((TH3*)_mes)->Fill (xr, yr, zr, w);
-  return ((TH3*)_fak)->Fill (xr, yr, zr, w);
+  Int_t bm= ((TH3*)_mes)->Fill (xr, yr, zr, w);
+  Int_t bf= ((TH3*)_fak)->Fill (xr, yr, zr, w);
+  if (_boot) BootstrapEvent (bm, bf, -1, -1, w);
+  return bf;
 }
 
 TH1D*
@@ -713,13 +851,37 @@ TMatrixD*
 RooUnfoldResponse::H2M  (const TH2* h, Int_t nx, Int_t ny, const TH1* norm, Bool_t overflow)
 {
   //! Returns Matrix of values of bins in a 2D input histogram
-  Int_t first= overflow ? 0 : 1;
   if (overflow) {
     nx += 2;
     ny += 2;
   }
   TMatrixD* m= new TMatrixD (nx, ny);
   if (!h) return m;
+  H2M (h, *m, norm, overflow);
+  return m;
+}
+
+TMatrixD*
+RooUnfoldResponse::H2ME (const TH2* h, Int_t nx, Int_t ny, const TH1* norm, Bool_t overflow)
+{
+  //! Returns matrix of bin errors for a 2D histogram.
+  if (overflow) {
+    nx += 2;
+    ny += 2;
+  }
+  TMatrixD* m= new TMatrixD (nx, ny);
+  if (!h) return m;
+  H2ME (h, *m, norm, overflow);
+  return m;
+}
+
+TMatrixD&
+RooUnfoldResponse::H2M  (const TH2* h, TMatrixD& m, const TH1* norm, Bool_t overflow)
+{
+  //! Fills existing matrix, m, with the values of bins in a 2D input histogram.
+  //! The matrix dimensions (including under/overflow bins if overflow is set) give the number of bins.
+  Int_t first= overflow ? 0 : 1;
+  Int_t nx= m.GetNrows(), ny= m.GetNcols();
   for (Int_t j= 0; j < ny; j++) {
     Double_t fac;
     if (!norm) fac= 1.0;
@@ -728,23 +890,18 @@ RooUnfoldResponse::H2M  (const TH2* h, Int_t nx, Int_t ny, const TH1* norm, Bool
       if (fac != 0.0) fac= 1.0/fac;
     }
     for (Int_t i= 0; i < nx; i++) {
-      (*m)(i,j)= h->GetBinContent(i+first,j+first) * fac;
+      m(i,j)= h->GetBinContent(i+first,j+first) * fac;
     }
   }
   return m;
 }
 
-TMatrixD*
-RooUnfoldResponse::H2ME (const TH2* h, Int_t nx, Int_t ny, const TH1* norm, Bool_t overflow)
+TMatrixD&
+RooUnfoldResponse::H2ME (const TH2* h, TMatrixD& m, const TH1* norm, Bool_t overflow)
 {
-  //! Returns matrix of bin errors for a 2D histogram.
+  //! Fills existing matrix, m, with the bin errors of a 2D histogram.
   Int_t first= overflow ? 0 : 1;
-  if (overflow) {
-    nx += 2;
-    ny += 2;
-  }
-  TMatrixD* m= new TMatrixD (nx, ny);
-  if (!h) return m;
+  Int_t nx= m.GetNrows(), ny= m.GetNcols();
   for (Int_t j= 0; j < ny; j++) {
     Double_t fac;
     if (!norm) fac= 1.0;
@@ -754,9 +911,73 @@ RooUnfoldResponse::H2ME (const TH2* h, Int_t nx, Int_t ny, const TH1* norm, Bool
     }
     for (Int_t i= 0; i < nx; i++) {
       //! Assume Poisson norm, Multinomial P(mes|tru)
-      (*m)(i,j)= h->GetBinError(i+first,j+first) * fac;
+      m(i,j)= h->GetBinError(i+first,j+first) * fac;
+    }
+  }
+  return m;
+}
+
+TMatrixDSparse*
+RooUnfoldResponse::H2MSparse  (const TH2* h, Int_t nx, Int_t ny, const TH1* norm, Bool_t overflow)
+{
+  //! Returns sparse matrix of the non-zero bins in a 2D input histogram, with the same elements as H2M.
+  //! No dense matrix is made, so this can be used for large response matrices that are mostly zero.
+  return H2MSparse (h, nx, ny, norm, overflow, kFALSE);
+}
+
+TMatrixDSparse*
+RooUnfoldResponse::H2MESparse (const TH2* h, Int_t nx, Int_t ny, const TH1* norm, Bool_t overflow)
+{
+  //! Returns sparse matrix of the non-zero bin errors of a 2D histogram, with the same elements as H2ME.
+  return H2MSparse (h, nx, ny, norm, overflow, kTRUE);
+}
+
+TMatrixDSparse*
+RooUnfoldResponse::H2MSparse  (const TH2* h, Int_t nx, Int_t ny, const TH1* norm, Bool_t overflow, Bool_t errors)
+{
+  //! Make sparse matrix of bin contents (or errors) of h, normalised as H2M. The first pass counts
+  //! the non-zero elements, so the compressed rows can be filled in place in the second.
+  if (overflow) {
+    nx += 2;
+    ny += 2;
+  }
+  TMatrixDSparse* m= new TMatrixDSparse (nx, ny);
+  if (!h) return m;
+  Int_t first= overflow ? 0 : 1, stride= h->GetNbinsX()+2;
+  TVectorD fac(ny);
+  for (Int_t j= 0; j < ny; j++) {
+    if (!norm) fac[j]= 1.0;
+    else {
+      fac[j]= GetBinContent (norm, j, overflow);
+      if (fac[j] != 0.0) fac[j]= 1.0/fac[j];
+    }
+  }
+  Int_t nnz= 0;
+  for (Int_t i= 0; i < nx; i++) {
+    for (Int_t j= 0; j < ny; j++) {
+      Int_t bin= (i+first) + stride*(j+first);
+      Double_t v= errors ? h->GetBinError(bin) : h->GetBinContent(bin);
+      if (v*fac[j] != 0.0) nnz++;
+    }
+  }
+  if (nnz == 0) return m;
+  m->SetSparseIndex (nnz);
+  Int_t*    rows= m->GetRowIndexArray();
+  Int_t*    cols= m->GetColIndexArray();
+  Double_t* data= m->GetMatrixArray();
+  Int_t n= 0;
+  for (Int_t i= 0; i < nx; i++) {
+    rows[i]= n;
+    for (Int_t j= 0; j < ny; j++) {
+      Int_t bin= (i+first) + stride*(j+first);
+      Double_t v= (errors ? h->GetBinError(bin) : h->GetBinContent(bin)) * fac[j];
+      if (v == 0.0) continue;
+      cols[n]= j;
+      data[n]= v;
+      n++;
     }
   }
+  rows[nx]= n;
   return m;
 }
 
@@ -818,9 +1039,11 @@ void RooUnfoldResponse::PrintMatrix(const TMatrixD& m, const char* name, const c
 }
 
 void
-RooUnfoldResponse::Print (Option_t* /* option */) const
+RooUnfoldResponse::Print (Option_t* option) const
 {
+  //! Print the response matrix. With option "timing", also print the time and memory of the cache rebuilds (see GetTiming).
   PrintMatrix (Mresponse(), Form("%s response matrix",GetTitle()));
+  if (TString(option).Contains("timing")) _timing.Print (cout, Form("RooUnfoldResponse::%s", GetName()));
 }
 
 
@@ -906,27 +1129,445 @@ TF1* RooUnfoldResponse::MakeFoldingFunction (TF1* func, Double_t eps, Bool_t ver
 }
 
 
-RooUnfoldResponse* RooUnfoldResponse::RunToy() const
+RooUnfoldResponse* RooUnfoldResponse::RunToy (TRandom* rnd) const
 {
   //! Returns new RooUnfoldResponse object with smeared response matrix elements for use as a toy.
+  //! The smearing uses the random number generator rnd, or gRandom if not specified.
+  if (!rnd) rnd= gRandom;
   TString name= GetName();
   name += "_toy";
   RooUnfoldResponse* res= new RooUnfoldResponse (*this);
   res->SetName(name);
-  if (!FakeEntries()) _fak->Reset();
-  TH2* hres= res->Hresponse();
+  if (!FakeEntries() && res->_fak) res->_fak->Reset();
+  SmearBins (rnd, res->Hresponse(), 0, 0);
+  return res;
+}
+
+void
+RooUnfoldResponse::RunToy (RooUnfoldResponse& toy, TRandom* rnd) const
+{
+  //! Re-smear toy, a response previously returned by RunToy(), reusing its histograms and matrices.
+  //! The smearing is applied to this object's response matrix, so the result is the same as a new
+  //! RunToy(rnd), but without copying all the histograms. Only the bins with errors are changed,
+  //! along with the corresponding elements of the toy's cached matrices.
+  if (!rnd) rnd= gRandom;
+  TH2* htoy= toy.Hresponse();
+  // Without Sumw2, the errors change with the contents
+  TMatrixD* etoy= (htoy->GetSumw2N() == 0) ? toy._eRes : 0;
+  SmearBins (rnd, htoy, toy._mRes, etoy);
+  htoy->SetEntries (Hresponse()->GetEntries());
+  toy._checksum= 0;
+  // The sparse matrices' non-zero elements may have changed, so recalculate them on next use
+  delete toy._mResS; toy._mResS= 0;
+  delete toy._eResS; toy._eResS= 0;
+}
+
+Bool_t
+RooUnfoldResponse::SetBootstrap (Int_t nrep, UInt_t seed)
+{
+  //! Fill nrep Poisson bootstrap replicas of the measured, fakes, truth, and response histograms along with the
+  //! nominal histograms, for all events filled after this call. Each event is added to each replica with a weight
+  //! drawn from a Poisson distribution with mean 1, using a counter-based random number generator (see
+  //! RooUnfoldBootstrap::PoissonWeight) seeded by seed and the event number. Events are numbered in the order they
+  //! are given to Fill, Miss, Fake, or FillN, or by their position in the arrays given to
+  //! RooUnfoldResponseFiller::FillParallel, so the replicas do not depend on the number of threads used.
+  //! The replicas are used instead of Gaussian smearing of the response for the toys of an unfolding with
+  //! IncludeSystematics (see RooUnfold::RunToy), each toy using a different replica, so at most nrep toys are run.
+  //! They are not saved when the RooUnfoldResponse is written to a file.
+  //! The replicas must start from the same (empty) histograms as the nominal, so SetBootstrap must be called
+  //! after Setup and before any events are filled. Otherwise it fails and returns false.
+  //! nrep=0 removes the replicas.
+  if (nrep>0) {
+    if (!_res) {
+      cerr << "RooUnfoldResponse::SetBootstrap: " << GetName() << " is not set up" << endl;
+      return kFALSE;
+    }
+    if (!IsEmpty (_mes) || !IsEmpty (_fak) || !IsEmpty (_tru) || !IsEmpty (_res)) {
+      cerr << "RooUnfoldResponse::SetBootstrap: " << GetName()
+           << " already has entries, which would be missing from the bootstrap replicas" << endl;
+      return kFALSE;
+    }
+  }
+  delete _boot; _boot= 0;
+  if (nrep>0) _boot= new RooUnfoldBootstrap (nrep, seed);
+  return kTRUE;
+}
+
+Bool_t
+RooUnfoldResponse::IsEmpty (const TH1* h)
+{
+  //! True if histogram h has no entries and all its bins (including under/overflows) are empty
+  if (!h) return kTRUE;
+  if (h->GetEntries() != 0.0) return kFALSE;
+  for (Int_t i= 0, n= (h->GetNbinsX()+2)*(h->GetNbinsY()+2)*(h->GetNbinsZ()+2); i<n; i++)
+    if (h->GetBinContent(i) != 0.0) return kFALSE;
+  return kTRUE;
+}
+
+Int_t
+RooUnfoldResponse::GetNReplicas() const
+{
+  //! Number of bootstrap replicas (0 if SetBootstrap was not used)
+  return _boot ? _boot->GetNReplicas() : 0;
+}
+
+void
+RooUnfoldResponse::BootstrapEvent (Int_t bmes, Int_t bfak, Int_t btru, Int_t bres, Double_t w)
+{
+  //! Add the next event to the bootstrap replicas, in the given bins (-1 if not filled) of each histogram
+  _boot->BeginEvent (_boot->GetNextEvent());
+  _boot->AddBin (RooUnfoldBootstrap::kMes, bmes, w);
+  _boot->AddBin (RooUnfoldBootstrap::kFak, bfak, w);
+  _boot->AddBin (RooUnfoldBootstrap::kTru, btru, w);
+  _boot->AddBin (RooUnfoldBootstrap::kRes, bres, w);
+}
+
+RooUnfoldResponse* RooUnfoldResponse::RunReplica (Int_t replica) const
+{
+  //! Returns new RooUnfoldResponse object with the contents of bootstrap replica (0..GetNReplicas()-1),
+  //! for use as a toy. Bins not filled by any event since SetBootstrap keep their nominal contents,
+  //! and the bin errors are those of the nominal response.
+  TString name= GetName();
+  name += "_toy";
+  RooUnfoldResponse* res= new RooUnfoldResponse (*this);
+  res->SetName(name);
+  if (!FakeEntries() && res->_fak) res->_fak->Reset();
+  RunReplica (*res, replica);
+  return res;
+}
+
+void
+RooUnfoldResponse::RunReplica (RooUnfoldResponse& toy, Int_t replica) const
+{
+  //! Set toy, a response previously returned by RunReplica() or RunToy(), to the contents of another
+  //! bootstrap replica. Only the bins filled in the replicas are changed.
+  if (!_boot || replica<0 || replica>=_boot->GetNReplicas()) {
+    cerr << "RooUnfoldResponse::RunReplica: " << GetName() << " has no bootstrap replica " << replica << endl;
+    return;
+  }
+  TH1* hist[RooUnfoldBootstrap::kNhist]= { toy._mes, toy._fak, toy._tru, toy._res };
+  Double_t nent[RooUnfoldBootstrap::kNhist];
+  for (Int_t h= 0; h<RooUnfoldBootstrap::kNhist; h++) if (hist[h]) nent[h]= hist[h]->GetEntries();
+  _boot->SetReplica (replica, hist);
+  // SetBinContent counts an entry per bin
+  for (Int_t h= 0; h<RooUnfoldBootstrap::kNhist; h++) if (hist[h]) hist[h]->SetEntries (nent[h]);
+  toy._checksum= 0;
+  toy.ClearCache();
+}
+
+void
+RooUnfoldResponse::SmearResponse (TMatrixD& m, TRandom* rnd) const
+{
+  //! Fill m with the response matrix, Mresponse(), with each element smeared by its error, as RunToy().
+  //! Uses the random number generator rnd (gRandom if not specified), giving the same result as
+  //! RunToy(rnd)->Mresponse(). Only the non-empty bins are visited, and no histograms or other
+  //! objects are made, so m can be reused for many toys.
+  if (!rnd) rnd= gRandom;
+  const TMatrixD& mres= Mresponse();
+  if (m.GetNrows() != mres.GetNrows() || m.GetNcols() != mres.GetNcols())
+    m.ResizeTo (mres.GetNrows(), mres.GetNcols());
+  m= mres;
+  SmearBins (rnd, 0, &m, 0);
+}
+
+void
+RooUnfoldResponse::SmearCache() const
+{
+  //! Fill the list of response bins with errors, which are the ones smeared by RunToy().
+  //! They are in the order of the loop over all bins (truth bins within each measured bin), so use the same random numbers.
+  if (_haveSmear) return;
+  ROOUNFOLD_TIMER (timer, _timing, kCache);
+  Int_t first= _overflow ? 0 : 1, stride= _res->GetNbinsX()+2, ncols= _nt + (_overflow ? 2 : 0);
+  Int_t nbins= 0;
+  for (Int_t i= 1; i<=_nm; i++)
+    for (Int_t j= 1; j<=_nt; j++)
+      if (_res->GetBinError (i+stride*j) > 0.0) nbins++;
+  _smearBin .Set(nbins);
+  _smearElem.Set(nbins);
+  _smearVal .Set(nbins);
+  _smearErr .Set(nbins);
+  _smearFac .Set(nbins);
+  Int_t n= 0;
   for (Int_t i= 1; i<=_nm; i++) {
     for (Int_t j= 1; j<=_nt; j++) {
-      Int_t bin= hres->GetBin (i,j);
-      Double_t e= hres->GetBinError (bin);
-      if (e>0.0) {
-        Double_t v= hres->GetBinContent(bin) + gRandom->Gaus(0.0,e);
-        if (v<0.0) v= 0.0;
-        hres->SetBinContent (bin, v);
-      }
+      Int_t bin= i+stride*j;
+      Double_t e= _res->GetBinError (bin);
+      if (!(e > 0.0)) continue;
+      Double_t fac= GetBinContent (_tru, j-first, _overflow);   // as H2M
+      if (fac != 0.0) fac= 1.0/fac;
+      _smearBin [n]= bin;
+      _smearElem[n]= (i-first)*ncols + (j-first);
+      _smearVal [n]= _res->GetBinContent (bin);
+      _smearErr [n]= e;
+      _smearFac [n]= fac;
+      n++;
     }
   }
-  return res;
+  _haveSmear= true;
+  _cached= true;
+  ROOUNFOLD_TIMER_BYTES (timer, CacheBytes());
+}
+
+void
+RooUnfoldResponse::SmearBins (TRandom* rnd, TH2* h, TMatrixD* m, TMatrixD* e) const
+{
+  //! Smear each response bin with an error, setting the result in histogram h and/or
+  //! (normalised as Mresponse()) matrix m. If e is specified, also set it to h's new bin errors.
+  SmearCache();
+  Double_t* ma= m ? m->GetMatrixArray() : 0;
+  Double_t* ea= e ? e->GetMatrixArray() : 0;
+  for (Int_t n= 0, nbins= _smearBin.GetSize(); n<nbins; n++) {
+    Double_t v= _smearVal[n] + rnd->Gaus(0.0,_smearErr[n]);
+    if (v<0.0) v= 0.0;
+    if (h)  h->SetBinContent (_smearBin[n], v);
+    if (ma) ma[_smearElem[n]]= v * _smearFac[n];
+    if (ea && h) ea[_smearElem[n]]= h->GetBinError (_smearBin[n]) * _smearFac[n];
+  }
+}
+
+void
+RooUnfoldResponse::FillCache (Bool_t sparse) const
+{
+  //! Fill all the cached vectors and matrices. The accessors fill them on first use, which is
+  //! not safe if several threads share this object, so call this before starting the threads.
+  //! If sparse, fill MresponseSparse() and EresponseSparse() instead of the dense matrices.
+  Vmeasured();
+  Emeasured();
+  Vfakes();
+  Vtruth();
+  Etruth();
+  if (sparse) {
+    MresponseSparse();
+    EresponseSparse();
+  } else {
+    Mresponse();
+    Eresponse();
+  }
+  if (_res) SmearCache();
+  if (_mes) MeasuredLookup();
+  if (_tru) TruthLookup();
+}
+
+// Start of the file written by RooUnfoldResponse::WriteCache. It is followed by the contents of
+// Vmeasured(), Emeasured(), Vfakes(), Vtruth(), Etruth(), Mresponse(), and Eresponse(), in that order.
+struct RooUnfoldCacheHeader {
+  char     magic[8];     // RooUnfoldCacheMagic
+  Int_t    nm, nt;       // Measured and truth vector sizes
+  Int_t    overflow;     // UseOverflow setting
+  Int_t    pad;          // Keep the Double_t's aligned
+  Double_t one;          // 1.0, to check the floating-point format and byte order
+  Double_t stats[4][3];  // Entries, sum of weights, and sum of weights*x of the measured, fakes, truth, and response histograms
+  ULong64_t checksum;    // Hash of the bin contents and errors of the same histograms
+};
+static const char RooUnfoldCacheMagic[8]= { 'R', 'U', 'C', 'A', 'C', 'H', 'E', '2' };
+
+static inline ULong64_t CacheMix (ULong64_t x, Double_t v)
+{
+  // Add the bits of v to the hash x (SplitMix64 finaliser)
+  ULong64_t b;
+  memcpy (&b, &v, sizeof(b));
+  x ^= b + 0x9E3779B97F4A7C15ULL;
+  x= (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x= (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+ULong64_t
+RooUnfoldResponse::CacheChecksum() const
+{
+  //! Hash of the bin contents (including under/overflows) and sums of weights squared of the measured, fakes,
+  //! truth, and response histograms, used to check that a cache file matches them. Unlike CacheStats, this
+  //! changes when weight only moves between bins, eg. in a systematic variation. It takes a single pass over
+  //! the bins, reading the histograms' arrays directly where possible. The result is kept in _checksum when
+  //! the response is written to a file or a cache file, so ReadCache does not have to recalculate it.
+  const TH1* hist[4]= { _mes, _fak, _tru, _res };
+  ULong64_t x= 0;
+  for (Int_t h= 0; h<4; h++) {
+    const TH1* hh= hist[h];
+    if (!hh) {
+      x= CacheMix (x, -1.0);
+      continue;
+    }
+    const Int_t n= (hh->GetNbinsX()+2) * (hh->GetNbinsY()+2) * (hh->GetNbinsZ()+2);
+    const TArrayD* a= dynamic_cast<const TArrayD*>(hh);
+    const Double_t* w=  (a && a->GetSize()==n) ? a->GetArray() : 0;
+    const Double_t* w2= (hh->GetSumw2N()==n)   ? hh->GetSumw2()->GetArray() : 0;
+    x= CacheMix (x, Double_t(n));
+    x= CacheMix (x, w2 ? 1.0 : 0.0);
+    for (Int_t i= 0; i<n; i++) {
+      x= CacheMix (x, w ? w[i] : hh->GetBinContent(i));
+      if (w2) x= CacheMix (x, w2[i]);
+    }
+  }
+  return x;
+}
+
+void
+RooUnfoldResponse::CacheStats (Double_t stats[4][3]) const
+{
+  //! Summary of the histograms used to check that a cache file matches them. Uses the stored histogram
+  //! statistics, so does not need to loop over the bins.
+  const TH1* hist[4]= { _mes, _fak, _tru, _res };
+  for (Int_t h= 0; h<4; h++) {
+    Double_t s[TH1::kNstat];
+    for (Int_t i= 0; i<TH1::kNstat; i++) s[i]= 0.0;
+    if (hist[h]) hist[h]->GetStats (s);
+    stats[h][0]= hist[h] ? hist[h]->GetEntries() : 0.0;
+    stats[h][1]= s[0];
+    stats[h][2]= s[2];
+  }
+}
+
+Bool_t
+RooUnfoldResponse::WriteCache (const char* filename) const
+{
+  //! Write the cached vectors and matrices (Vmeasured, Emeasured, Vfakes, Vtruth, Etruth, Mresponse, and Eresponse)
+  //! to filename as flat arrays of doubles, for use with ReadCache. The file is only valid for this response's
+  //! histograms (which should be saved as usual), and on machines with the same floating-point format.
+  if (!_res) {
+    cerr << "RooUnfoldResponse::WriteCache: " << GetName() << " is not set up" << endl;
+    return kFALSE;
+  }
+  FillCache();
+  RooUnfoldCacheHeader hdr;
+  memset (&hdr, 0, sizeof(hdr));
+  memcpy (hdr.magic, RooUnfoldCacheMagic, sizeof(hdr.magic));
+  hdr.nm= _vMes->GetNrows();
+  hdr.nt= _vTru->GetNrows();
+  hdr.overflow= _overflow;
+  hdr.one= 1.0;
+  CacheStats (hdr.stats);
+  hdr.checksum= _checksum= CacheChecksum();
+  FILE* f= fopen (filename, "wb");
+  if (!f) {
+    cerr << "RooUnfoldResponse::WriteCache: cannot create " << filename << endl;
+    return kFALSE;
+  }
+  const TVectorD* v[5]= { _vMes, _eMes, _vFak, _vTru, _eTru };
+  const TMatrixD* m[2]= { _mRes, _eRes };
+  Bool_t ok= (fwrite (&hdr, sizeof(hdr), 1, f) == 1);
+  for (Int_t i= 0; ok && i<5; i++)
+    ok= (fwrite (v[i]->GetMatrixArray(), sizeof(Double_t), v[i]->GetNrows(),    f) == size_t(v[i]->GetNrows()));
+  for (Int_t i= 0; ok && i<2; i++)
+    ok= (fwrite (m[i]->GetMatrixArray(), sizeof(Double_t), m[i]->GetNoElements(), f) == size_t(m[i]->GetNoElements()));
+  if (fclose (f) != 0) ok= kFALSE;
+  if (!ok) cerr << "RooUnfoldResponse::WriteCache: error writing " << filename << endl;
+  return ok;
+}
+
+Bool_t
+RooUnfoldResponse::ReadCache (const char* filename, Bool_t map, Bool_t verify)
+{
+  //! Use the vectors and matrices written by WriteCache(filename) as this response's cache, so they do not
+  //! have to be built from the histograms on first use. The file must have been written from the same
+  //! histograms, which is checked with their sizes, entries, sums of weights, and a checksum of all their bins.
+  //! The checksum is taken from when this response was read from a ROOT file (or written with WriteCache), so
+  //! this check does not need to loop over the bins. It is only recalculated, taking a pass over all the bins,
+  //! if the histograms were filled since then, or if verify is set (eg. if they were changed directly).
+  //! If map (and supported on this platform), the file is memory-mapped, so it is only read as it is used,
+  //! and processes on the same machine using the same file share one copy. Otherwise the file is read into
+  //! memory. As with the other caches, they are dropped (and the file unmapped) if the response is changed.
+  if (!_res) {
+    cerr << "RooUnfoldResponse::ReadCache: " << GetName() << " is not set up" << endl;
+    return kFALSE;
+  }
+  ClearCache();
+  ROOUNFOLD_TIMER (timer, _timing, kCache);
+  FILE* f= fopen (filename, "rb");
+  if (!f) {
+    cerr << "RooUnfoldResponse::ReadCache: cannot open " << filename << endl;
+    return kFALSE;
+  }
+  RooUnfoldCacheHeader hdr, want;
+  memset (&want, 0, sizeof(want));
+  CacheStats (want.stats);
+  const Int_t nm= _nm + (_overflow ? 2 : 0), nt= _nt + (_overflow ? 2 : 0);
+  if (fread (&hdr, sizeof(hdr), 1, f) != 1 || memcmp (hdr.magic, RooUnfoldCacheMagic, sizeof(hdr.magic)) != 0 || hdr.one != 1.0) {
+    cerr << "RooUnfoldResponse::ReadCache: " << filename << " is not a RooUnfoldResponse cache file" << endl;
+    fclose (f);
+    return kFALSE;
+  }
+  if (hdr.nm != nm || hdr.nt != nt || hdr.overflow != _overflow || memcmp (hdr.stats, want.stats, sizeof(hdr.stats)) != 0 ||
+      hdr.checksum != ((verify || !_checksum) ? CacheChecksum() : _checksum)) {
+    cerr << "RooUnfoldResponse::ReadCache: " << filename << " was not written from " << GetName() << endl;
+    fclose (f);
+    return kFALSE;
+  }
+
+  TVectorD** v[5]= { &_vMes, &_eMes, &_vFak, &_vTru, &_eTru };
+  const Int_t nv[5]= { nm, nm, nm, nt, nt };
+  TMatrixD** m[2]= { &_mRes, &_eRes };
+  Double_t* data= 0;
+#ifdef ROOUNFOLD_MMAP
+  const Long64_t size= sizeof(hdr) + Long64_t(3*nm + 2*nt + 2*Long64_t(nm)*nt) * Long64_t(sizeof(Double_t));
+  struct stat st;
+  if (map && fstat (fileno(f), &st) == 0 && Long64_t(st.st_size) >= size) {
+    // A private mapping shares the pages between processes, but is never written back to the file
+    void* p= mmap (0, size_t(size), PROT_READ|PROT_WRITE, MAP_PRIVATE, fileno(f), 0);
+    if (p != MAP_FAILED) {
+      _map= (Char_t*) p;
+      _mapSize= size;
+      data= (Double_t*) (_map + sizeof(hdr));
+    }
+  }
+#endif
+  Bool_t ok= kTRUE;
+  for (Int_t i= 0; i<5; i++) {
+    *v[i]= new TVectorD();
+    if (data) {
+      (*v[i])->Use (nv[i], data);
+      data += nv[i];
+    } else {
+      (*v[i])->ResizeTo (nv[i]);
+      if (ok) ok= (fread ((*v[i])->GetMatrixArray(), sizeof(Double_t), nv[i], f) == size_t(nv[i]));
+    }
+  }
+  for (Int_t i= 0; i<2; i++) {
+    *m[i]= new TMatrixD();
+    if (data) {
+      (*m[i])->Use (nm, nt, data);
+      data += Long64_t(nm)*nt;
+    } else {
+      (*m[i])->ResizeTo (nm, nt);
+      if (ok) ok= (fread ((*m[i])->GetMatrixArray(), sizeof(Double_t), (*m[i])->GetNoElements(), f) == size_t((*m[i])->GetNoElements()));
+    }
+  }
+  fclose (f);
+  _cached= true;
+  if (!ok) {
+    cerr << "RooUnfoldResponse::ReadCache: error reading " << filename << endl;
+    ClearCache();
+  }
+  ROOUNFOLD_TIMER_BYTES (timer, CacheBytes());
+  return ok;
+}
+
+Long64_t
+RooUnfoldResponse::CacheBytes() const
+{
+  //! Memory held in the cached vectors and matrices, including a memory-mapped cache file
+  Long64_t n= 0;
+  const TVectorD* v[]= { _vMes, _eMes, _vFak, _vTru, _eTru };
+  for (size_t i= 0; i<sizeof(v)/sizeof(v[0]); i++)
+    if (v[i] && !_map) n += RooUnfoldTiming::Bytes (*v[i]);
+  const TMatrixDBase* m[]= { _mRes, _eRes, _mResS, _eResS };
+  for (size_t i= 0; i<sizeof(m)/sizeof(m[0]); i++)
+    if (m[i] && (!_map || i>=2)) n += RooUnfoldTiming::Bytes (*m[i]);
+  n += _mapSize;
+  n += Long64_t(_smearBin.GetSize() + _smearElem.GetSize()) * sizeof(Int_t)
+     + Long64_t(_smearVal.GetSize() + _smearErr.GetSize() + _smearFac.GetSize()) * sizeof(Double_t);
+  return n;
+}
+
+void
+RooUnfoldResponse::UnmapCache()
+{
+  //! Unmap the cache file used by ReadCache. The matrices and vectors using it must already have been deleted.
+#ifdef ROOUNFOLD_MMAP
+  if (_map) munmap (_map, size_t(_mapSize));
+#endif
+  _map= 0;
+  _mapSize= 0;
 }
 
 void
@@ -972,13 +1613,19 @@ void
 RooUnfoldResponse::Streamer (TBuffer &R__b)
 {
   if (R__b.IsReading()) {
-    // Don't add our histograms to the currect directory.
-    // We own them and we don't want them to disappear when the file is closed.
-    Bool_t oldstat= TH1::AddDirectoryStatus();
-    TH1::AddDirectory (kFALSE);
+    delete _lMes; _lMes= 0;
+    delete _lTru; _lTru= 0;
+    delete _boot; _boot= 0;
+    _haveSmear= false;
     RooUnfoldResponse::Class()->ReadBuffer  (R__b, this);
-    TH1::AddDirectory (oldstat);
+    // Don't leave our histograms in the currect directory.
+    // We own them and we don't want them to disappear when the file is closed.
+    if (_mes) _mes->SetDirectory (0);
+    if (_fak) _fak->SetDirectory (0);
+    if (_tru) _tru->SetDirectory (0);
+    if (_res) _res->SetDirectory (0);
   } else {
+    _checksum= CacheChecksum();   // for ReadCache after reading back
     RooUnfoldResponse::Class()->WriteBuffer (R__b, this);
   }
 }
@@ -15,16 +15,23 @@
 #include "TNamed.h"
 #include "TMatrixD.h"
 #include "TH1.h"
+#include "RooUnfoldTiming.h"
 #if ROOT_VERSION_CODE >= ROOT_VERSION(5,0,0)
 #include "TVectorDfwd.h"
+#include "TMatrixDSparsefwd.h"
 #else
 class TVectorD;
+class TMatrixDSparse;
 #endif
 class TF1;
 class TH2;
 class TH2D;
 class TAxis;
 class TCollection;
+class TRandom;
+class RooUnfoldResponseFiller;
+class RooUnfoldBinLookup;
+class RooUnfoldBootstrap;
 
 #ifdef PrintMatrix
 // TMVA in ROOT 6.14/00 added a debugging macro called PrintMatrix in TMVA/DNN/Architectures/Cpu/CpuMatrix.h.
@@ -40,6 +47,12 @@ class RooUnfoldResponse : public TNamed {
 
 public:
 
+  enum FillType {        // Type of each event given to FillN:
+    kFillMatch,          //   measured and truth (as Fill)
+    kFillMiss,           //   truth only, not measured (as Miss)
+    kFillFake            //   measured only, no truth (as Fake)
+  };
+
   // Standard methods
 
   RooUnfoldResponse(); // default constructor
@@ -81,7 +94,10 @@ public:
           Int_t Fake (Double_t xr, Double_t yr, Double_t w);  // Fill fake event into 2D (with weight) or 3D Response Matrix
   virtual Int_t Fake (Double_t xr, Double_t yr, Double_t zr, Double_t w);  // Fill fake event into 3D Response Matrix
 
+  virtual void FillN (Int_t n, const Double_t* reco, const Double_t* truth, const Double_t* w= 0, const Int_t* type= 0);  // Fill n events at once
+
   virtual void Add (const RooUnfoldResponse& rhs);
+          void Add (const RooUnfoldResponseFiller& filler);  // add events accumulated separately, eg. in another thread
   virtual Long64_t Merge (TCollection* others);
 
   // Accessors
@@ -108,6 +124,8 @@ public:
   const TVectorD& Etruth()            const;   // Truth distribution errors as a TVectorD
   const TMatrixD& Mresponse()         const;   // Response matrix as a TMatrixD: (row,column)=(measured,truth)
   const TMatrixD& Eresponse()         const;   // Response matrix errors as a TMatrixD: (row,column)=(measured,truth)
+  const TMatrixDSparse& MresponseSparse() const; // Response matrix as a TMatrixDSparse, storing only non-zero elements
+  const TMatrixDSparse& EresponseSparse() const; // Response matrix errors as a TMatrixDSparse, storing only non-zero elements
 
   Double_t operator() (Int_t r, Int_t t) const;// Response matrix element (measured,truth)
 
@@ -121,6 +139,10 @@ public:
   static TVectorD* H2VE (const TH1*  h, Int_t nb, Bool_t overflow= kFALSE);
   static TMatrixD* H2M  (const TH2*  h, Int_t nx, Int_t ny, const TH1* norm= 0, Bool_t overflow= kFALSE);
   static TMatrixD* H2ME (const TH2*  h, Int_t nx, Int_t ny, const TH1* norm= 0, Bool_t overflow= kFALSE);
+  static TMatrixD& H2M  (const TH2*  h, TMatrixD& m, const TH1* norm= 0, Bool_t overflow= kFALSE);  // fill existing matrix
+  static TMatrixD& H2ME (const TH2*  h, TMatrixD& m, const TH1* norm= 0, Bool_t overflow= kFALSE);  // fill existing matrix
+  static TMatrixDSparse* H2MSparse  (const TH2* h, Int_t nx, Int_t ny, const TH1* norm= 0, Bool_t overflow= kFALSE);  // non-zero bins only
+  static TMatrixDSparse* H2MESparse (const TH2* h, Int_t nx, Int_t ny, const TH1* norm= 0, Bool_t overflow= kFALSE);  // non-zero errors only
   static void      V2H  (const TVectorD& v, TH1* h, Int_t nb, Bool_t overflow= kFALSE);
   static Int_t   FindBin(const TH1*  h, Double_t x);  // return vector index for bin containing (x)
   static Int_t   FindBin(const TH1*  h, Double_t x, Double_t y);  // return vector index for bin containing (x,y)
@@ -133,7 +155,20 @@ public:
   TH1* ApplyToTruth (const TH1* truth= 0, const char* name= "AppliedResponse") const; // If argument is 0, applies itself to its own truth
   TF1* MakeFoldingFunction (TF1* func, Double_t eps=1e-12, Bool_t verbose=false) const;
 
-  RooUnfoldResponse* RunToy() const;
+  RooUnfoldResponse* RunToy (TRandom* rnd= 0) const;
+  void               RunToy (RooUnfoldResponse& toy, TRandom* rnd= 0) const;  // re-smear toy previously returned by RunToy()
+  void SmearResponse (TMatrixD& m, TRandom* rnd= 0) const;  // fill m with Mresponse() smeared as RunToy(), without copying the histograms
+  Bool_t SetBootstrap (Int_t nrep, UInt_t seed= 1);  // fill nrep Poisson bootstrap replicas with events filled after Setup
+  Int_t GetNReplicas() const;                      // number of bootstrap replicas
+  const RooUnfoldBootstrap* Bootstrap() const;     // bootstrap replicas (0 if none)
+  RooUnfoldResponse* RunReplica (Int_t replica) const;
+  void               RunReplica (RooUnfoldResponse& toy, Int_t replica) const;  // set toy previously returned by RunReplica() or RunToy() to another replica
+  void FillCache (Bool_t sparse= kFALSE) const;  // Fill all cached vectors and matrices (eg. before sharing between threads)
+  Bool_t WriteCache (const char* filename) const;        // write cached vectors and matrices to a flat binary file
+  Bool_t ReadCache  (const char* filename, Bool_t map= kTRUE, Bool_t verify= kFALSE);  // use cached vectors and matrices from a WriteCache file
+  Long64_t CacheBytes() const;                   // memory held in the cached vectors and matrices
+  const RooUnfoldTiming& GetTiming() const;      // time and memory of the cache rebuilds (RooUnfoldTiming::kCache)
+  void ResetTiming();
 
 private:
 
@@ -146,7 +181,18 @@ private:
   virtual Int_t Fake1D (Double_t xr, Double_t w= 1.0);  // Fill fake event into 1D Response Matrix (with weight)
   virtual Int_t Fake2D (Double_t xr, Double_t yr, Double_t w= 1.0);  // Fill fake event into 2D Response Matrix (with weight)
 
+  void SmearCache() const;
+  void CacheStats (Double_t stats[4][3]) const;
+  ULong64_t CacheChecksum() const;
+  void UnmapCache();
+  void BootstrapEvent (Int_t bmes, Int_t bfak, Int_t btru, Int_t bres, Double_t w);
+  void SmearBins (TRandom* rnd, TH2* h, TMatrixD* m, TMatrixD* e) const;
+  const RooUnfoldBinLookup& MeasuredLookup() const;
+  const RooUnfoldBinLookup& TruthLookup() const;
+
+  static TMatrixDSparse* H2MSparse (const TH2* h, Int_t nx, Int_t ny, const TH1* norm, Bool_t overflow, Bool_t errors);
   static Int_t GetBinDim (const TH1* h, Int_t i);
+  static Bool_t IsEmpty (const TH1* h);
   static void ReplaceAxis(TAxis* axis, const TAxis* source);
 
   // instance variables
@@ -160,6 +206,7 @@ private:
   TH1*  _tru;      // Truth    histogram
   TH2*  _res;      // Response histogram
   Int_t _overflow; // Use histogram under/overflows if 1
+  mutable ULong64_t _checksum; // CacheChecksum() when last written or cached, 0 if the histograms were changed since
 
   mutable TVectorD* _vMes;   //! Cached measured vector
   mutable TVectorD* _eMes;   //! Cached measured error
@@ -168,11 +215,25 @@ private:
   mutable TVectorD* _eTru;   //! Cached truth    error
   mutable TMatrixD* _mRes;   //! Cached response matrix
   mutable TMatrixD* _eRes;   //! Cached response error
+  mutable TMatrixDSparse* _mResS; //! Cached sparse response matrix
+  mutable TMatrixDSparse* _eResS; //! Cached sparse response error
   mutable Bool_t    _cached; //! We are using cached vectors/matrices
+  mutable RooUnfoldBinLookup* _lMes; //! Cached measured bin lookup
+  mutable RooUnfoldBinLookup* _lTru; //! Cached truth    bin lookup
+  mutable Bool_t    _haveSmear; //! The following are filled
+  mutable TArrayI   _smearBin;  //! Response bins with non-zero errors, which are smeared by RunToy
+  mutable TArrayI   _smearElem; //! Index of each of these bins in the Mresponse() matrix array
+  mutable TArrayD   _smearVal;  //! Content of each bin
+  mutable TArrayD   _smearErr;  //! Error of each bin
+  mutable TArrayD   _smearFac;  //! Mresponse() normalisation (1/truth) of each bin
+  RooUnfoldBootstrap* _boot;    //! Bootstrap replicas (not saved)
+  Char_t*  _map;                //! Memory-mapped cache file (see ReadCache)
+  Long64_t _mapSize;            //! Size of _map
+  mutable RooUnfoldTiming _timing; //! Time and memory of the cache rebuilds
 
 public:
 
-  ClassDef (RooUnfoldResponse, 1) // Respose Matrix
+  ClassDef (RooUnfoldResponse, 2) // Respose Matrix
 };
 
 // Inline method definitions
@@ -346,7 +407,11 @@ inline
 const TMatrixD& RooUnfoldResponse::Mresponse() const
 {
   // Response matrix as a TMatrixD: (row,column)=(measured,truth)
-  if (!_mRes) _cached= (_mRes= H2M  (_res, _nm, _nt, _tru, _overflow)); 
+  if (!_mRes) {
+    ROOUNFOLD_TIMER (timer, _timing, kCache);
+    _cached= (_mRes= H2M  (_res, _nm, _nt, _tru, _overflow));
+    ROOUNFOLD_TIMER_BYTES (timer, CacheBytes());
+  }
   return *_mRes;
 }
 
@@ -354,10 +419,54 @@ inline
 const TMatrixD& RooUnfoldResponse::Eresponse() const
 {
   // Response matrix errors as a TMatrixD: (row,column)=(measured,truth)
-  if (!_eRes) _cached= (_eRes= H2ME (_res, _nm, _nt, _tru, _overflow)); 
+  if (!_eRes) {
+    ROOUNFOLD_TIMER (timer, _timing, kCache);
+    _cached= (_eRes= H2ME (_res, _nm, _nt, _tru, _overflow));
+    ROOUNFOLD_TIMER_BYTES (timer, CacheBytes());
+  }
   return *_eRes;
 }
 
+inline
+const TMatrixDSparse& RooUnfoldResponse::MresponseSparse() const
+{
+  // Response matrix as a TMatrixDSparse: (row,column)=(measured,truth).
+  // Same elements as Mresponse(), but without storing the zeros.
+  if (!_mResS) {
+    ROOUNFOLD_TIMER (timer, _timing, kCache);
+    _cached= (_mResS= H2MSparse  (_res, _nm, _nt, _tru, _overflow));
+    ROOUNFOLD_TIMER_BYTES (timer, CacheBytes());
+  }
+  return *_mResS;
+}
+
+inline
+const TMatrixDSparse& RooUnfoldResponse::EresponseSparse() const
+{
+  // Response matrix errors as a TMatrixDSparse: (row,column)=(measured,truth).
+  // Same elements as Eresponse(), but without storing the zeros.
+  if (!_eResS) {
+    ROOUNFOLD_TIMER (timer, _timing, kCache);
+    _cached= (_eResS= H2MESparse (_res, _nm, _nt, _tru, _overflow));
+    ROOUNFOLD_TIMER_BYTES (timer, CacheBytes());
+  }
+  return *_eResS;
+}
+
+inline
+const RooUnfoldTiming& RooUnfoldResponse::GetTiming() const
+{
+  // Return time and memory of the rebuilds of the response matrix cache (RooUnfoldTiming::kCache).
+  // The matrices are built on first use, and again after the response is changed.
+  return _timing;
+}
+
+inline
+void RooUnfoldResponse::ResetTiming()
+{
+  // Forget the timing of previous cache rebuilds
+  _timing.Reset();
+}
 
 inline
 Double_t RooUnfoldResponse::operator() (Int_t r, Int_t t) const
@@ -461,4 +570,11 @@ Int_t RooUnfoldResponse::FindBin (const TH1* h, Double_t x)
   return h->GetXaxis()->FindBin(x) - 1;
 }
 
+inline
+const RooUnfoldBootstrap* RooUnfoldResponse::Bootstrap() const
+{
+  // Return bootstrap replicas, or 0 if SetBootstrap was not used
+  return _boot;
+}
+
 #endif
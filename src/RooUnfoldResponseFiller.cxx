@@ -0,0 +1,444 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Lightweight accumulator of training events for a RooUnfoldResponse,
+//      eg. one per thread, merged at the end.
+//
+//==============================================================================
+
+//____________________________________________________________
+/*! \class RooUnfoldResponseFiller
+\brief Accumulates training events for a RooUnfoldResponse in flat bin arrays, without any histogram objects.</p>
+<p>A RooUnfoldResponseFiller is set up with the binning of a RooUnfoldResponse, which is only read, and filled using
+Fill, Miss, Fake, or FillN, the same way as the RooUnfoldResponse. The events are added to the RooUnfoldResponse
+with RooUnfoldResponse::Add(filler). Each filler can be used by only one thread at a time, but separate fillers
+for the same RooUnfoldResponse can be filled in parallel, eg. one per slot of ROOT's RDataFrame:</p>
+<pre>
+  std::vector&lt;RooUnfoldResponseFiller&gt; fillers (df.GetNSlots(), RooUnfoldResponseFiller(&amp;response));
+  df.ForeachSlot ([&amp;](unsigned int slot, double xr, double xt) { fillers[slot].Fill (xr, xt); }, {"xr", "xt"});
+  RooUnfoldResponseFiller::Reduce (fillers);
+  response.Add (fillers[0]);
+</pre>
+<p>Reduce() merges the fillers pairwise in a tree, with the merges at each level done in parallel.
+FillParallel() fills a RooUnfoldResponse from arrays of events, sharing them between threads in this way.</p>
+ */
+/////////////////////////////////////////////////////////////
+
+#include "RooUnfoldResponseFiller.h"
+
+#include <iostream>
+#include <vector>
+
+#include "TH1.h"
+#include "TH2.h"
+#include "TAxis.h"
+#include "TArrayD.h"
+#include "RooUnfoldResponse.h"
+#include "RooUnfoldThreads.h"
+
+using std::cerr;
+using std::endl;
+using std::vector;
+
+ClassImp (RooUnfoldResponseFiller);
+
+void RooUnfoldResponseFiller::Init()
+{
+  for (Int_t s= 0; s<2; s++) {
+    _ndim[s]= _nres[s]= 0;
+    _raxis[s]= 0;
+    _ownAxis[s]= kFALSE;
+  }
+  for (Int_t h= 0; h<kNhist; h++) {
+    _ncell[h]= 0;
+    _w[h]= _w2[h]= 0;
+    _hist[h]= 0;
+  }
+  _statOverflows= TH1::GetStatOverflows();
+  _boot.Setup (0);
+  Reset();
+}
+
+void RooUnfoldResponseFiller::Reset()
+{
+  //! Remove all accumulated events, keeping the binning
+  for (Int_t h= 0; h<kNhist; h++) {
+    _sum [h].Reset();
+    _sum2[h].Reset();
+    for (Int_t i= 0; i<TH1::kNstat; i++) _stats[h][i]= 0.0;
+    _nent[h]= 0;
+  }
+  _weighted= kFALSE;
+  _boot.Reset();
+}
+
+void RooUnfoldResponseFiller::CopyData (const RooUnfoldResponseFiller& rhs)
+{
+  //! Copy binning and accumulated events from another filler
+  for (Int_t s= 0; s<2; s++) {
+    _ndim[s]=    rhs._ndim[s];
+    _lookup[s]=  rhs._lookup[s];
+    _rlookup[s]= rhs._rlookup[s];
+    _nres[s]=    rhs._nres[s];
+    _raxis[s]=   rhs._raxis[s];
+    _ownAxis[s]= rhs._ownAxis[s];
+  }
+  for (Int_t h= 0; h<kNhist; h++) {
+    _ncell[h]= rhs._ncell[h];
+    _sum  [h]= rhs._sum [h];
+    _sum2 [h]= rhs._sum2[h];
+    _w    [h]= _sum [h].GetArray();
+    _w2   [h]= _sum2[h].GetArray();
+    _hist [h]= 0;
+    for (Int_t i= 0; i<TH1::kNstat; i++) _stats[h][i]= rhs._stats[h][i];
+    _nent [h]= rhs._nent[h];
+  }
+  _weighted=      rhs._weighted;
+  _statOverflows= rhs._statOverflows;
+  _boot=          rhs._boot;
+}
+
+Bool_t RooUnfoldResponseFiller::SetupBinning (const RooUnfoldResponse* res)
+{
+  //! Take binning from res, which must already be set up
+  const TH1* hist[2]= { res->Hmeasured(), res->Htruth() };
+  const TH2* hres= res->Hresponse();
+  if (!hist[0] || !hist[1] || !hres || !res->Hfakes()) {
+    cerr << "RooUnfoldResponseFiller: RooUnfoldResponse " << res->GetName() << " is not set up" << endl;
+    Init();
+    return kFALSE;
+  }
+  _ndim[0]= res->GetDimensionMeasured();
+  _ndim[1]= res->GetDimensionTruth();
+  _raxis[0]= hres->GetXaxis();
+  _raxis[1]= hres->GetYaxis();
+  for (Int_t s= 0; s<2; s++) {
+    _lookup[s].Setup (hist[s], _ndim[s]);
+    _nres[s]= _raxis[s]->GetNbins();
+    // In 1D, the response histogram is filled with the coordinates themselves. Its axes are usually those of the
+    // measured and truth histograms, so the bin lookup can be shared, but not necessarily if it was set up from an
+    // existing response.
+    _ownAxis[s]= (_ndim[s]==1 && !SameBinning (_raxis[s], hist[s]->GetXaxis()));
+    if (_ownAxis[s]) _rlookup[s].Setup (_raxis[s]);
+  }
+  _ncell[kMes]= Ncells (hist[0],        _ndim[0]);
+  _ncell[kFak]= Ncells (res->Hfakes(),  _ndim[0]);
+  _ncell[kTru]= Ncells (hist[1],        _ndim[1]);
+  _ncell[kRes]= (_nres[0]+2)*(_nres[1]+2);
+  _statOverflows= TH1::GetStatOverflows();
+  // Bootstrap replicas continue the event numbering of res
+  if (const RooUnfoldBootstrap* boot= res->Bootstrap()) {
+    _boot.Setup (boot->GetNReplicas(), boot->GetSeed());
+    _boot.SetNextEvent (boot->GetNextEvent());
+  } else
+    _boot.Setup (0);
+  return kTRUE;
+}
+
+void RooUnfoldResponseFiller::Setup (const RooUnfoldResponse* res)
+{
+  //! Set up for events with the binning of res, and clear
+  if (!SetupBinning (res)) return;
+  for (Int_t h= 0; h<kNhist; h++) {
+    _sum [h].Set (_ncell[h]);
+    _sum2[h].Set (_ncell[h]);
+    _w   [h]= _sum [h].GetArray();
+    _w2  [h]= _sum2[h].GetArray();
+    _hist[h]= 0;
+  }
+  Reset();
+}
+
+Bool_t RooUnfoldResponseFiller::SetupDirect (RooUnfoldResponse* res, Bool_t weighted)
+{
+  //! Set up to add the weights directly to the bins of the histograms of res (used by RooUnfoldResponse::FillN).
+  //! weighted specifies whether any weight is not 1, in which case sums of weights squared are stored,
+  //! as TH1::Fill. Returns kFALSE if the histograms do not store their bins in a TArrayD (eg. TH1F).
+  if (!SetupBinning (res)) return kFALSE;
+  TH1* hist[kNhist]= { res->Hmeasured(), res->Hfakes(), res->Htruth(), res->Hresponse() };
+  for (Int_t h= 0; h<kNhist; h++) {
+    TArrayD* a= dynamic_cast<TArrayD*>(hist[h]);
+    if (!a || a->GetSize() != _ncell[h]) return kFALSE;
+  }
+  for (Int_t h= 0; h<kNhist; h++) {
+    if (weighted && hist[h]->GetSumw2N()==0 && !hist[h]->TestBit(TH1::kIsNotW)) hist[h]->Sumw2();
+    _w   [h]= dynamic_cast<TArrayD*>(hist[h])->GetArray();
+    _w2  [h]= hist[h]->GetSumw2N() ? hist[h]->GetSumw2()->GetArray() : 0;
+    _hist[h]= hist[h];
+    hist[h]->GetStats (_stats[h]);
+    _nent[h]= 0;
+  }
+  _weighted= weighted;
+  return kTRUE;
+}
+
+Int_t RooUnfoldResponseFiller::Ncells (const TH1* h, Int_t ndim)
+{
+  //! Number of bins, including under/overflows, in an ndim-dimensional histogram
+  Int_t n= h->GetNbinsX()+2;
+  if (ndim>=2) n *= h->GetNbinsY()+2;
+  if (ndim>=3) n *= h->GetNbinsZ()+2;
+  return n;
+}
+
+Bool_t RooUnfoldResponseFiller::SameBinning (const TAxis* a, const TAxis* b)
+{
+  //! True if the two axes have the same bin edges
+  if (a->GetNbins() != b->GetNbins() || a->GetXmin() != b->GetXmin() || a->GetXmax() != b->GetXmax()) return kFALSE;
+  const TArrayD *ea= a->GetXbins(), *eb= b->GetXbins();
+  if (ea->GetSize() != eb->GetSize()) return kFALSE;
+  for (Int_t i= 0; i<ea->GetSize(); i++)
+    if (ea->At(i) != eb->At(i)) return kFALSE;
+  return kTRUE;
+}
+
+template <Int_t N> inline
+void RooUnfoldResponseFiller::Add (Int_t h, Int_t bin, Bool_t inrange, Double_t w, const Double_t* x)
+{
+  //! Add weight w to a bin of N-dimensional histogram h, and to its statistics at coordinates x, as TH1::Fill
+  _w[h][bin] += w;
+  if (_w2[h]) _w2[h][bin] += w*w;
+  _nent[h]++;
+  if (_boot.GetNReplicas()) _boot.AddBin (h, bin, w);
+  if (!inrange && !_statOverflows) return;
+  Double_t* s= _stats[h];
+  s[0] += w;
+  s[1] += w*w;
+  s[2] += w*x[0];
+  s[3] += w*x[0]*x[0];
+  if (N<2) return;
+  s[4] += w*x[1];
+  s[5] += w*x[1]*x[1];
+  s[6] += w*x[0]*x[1];
+  if (N<3) return;
+  s[7] += w*x[2];
+  s[8] += w*x[2]*x[2];
+  s[9] += w*x[0]*x[2];
+  s[10]+= w*x[1]*x[2];
+}
+
+template <Int_t MD, Int_t TD> inline
+void RooUnfoldResponseFiller::AddEventDim (const Double_t* reco, const Double_t* truth, Double_t w, Int_t type)
+{
+  //! Add one event of type RooUnfoldResponse::kFillMatch, kFillMiss, or kFillFake,
+  //! with MD measured and TD truth dimensions
+  if (w != 1.0) _weighted= kTRUE;
+  if (_boot.GetNReplicas()) _boot.BeginEvent (_boot.GetNextEvent());
+  Int_t im= 0, it= 0, bm= 0, bt= 0;
+  Bool_t inrm= kFALSE, inrt= kFALSE;
+  if (type != RooUnfoldResponse::kFillMiss) bm= _lookup[0].FindBinDim<MD> (reco,  im, inrm);
+  if (type != RooUnfoldResponse::kFillFake) bt= _lookup[1].FindBinDim<TD> (truth, it, inrt);
+  if (type == RooUnfoldResponse::kFillMiss) {
+    Add<TD> (kTru, bt, inrt, w, truth);
+    return;
+  }
+  Add<MD> (kMes, bm, inrm, w, reco);
+  if (type == RooUnfoldResponse::kFillFake) {
+    Add<MD> (kFak, bm, inrm, w, reco);
+    return;
+  }
+  Add<TD> (kTru, bt, inrt, w, truth);
+
+  // Response bin and coordinates as used by RooUnfoldResponse::Fill
+  Double_t xy[2];
+  Int_t rx, ry;
+  if (MD==1) {
+    xy[0]= reco[0];
+    rx= _ownAxis[0] ? _rlookup[0].FindBin (xy[0]) : bm;
+  } else {
+    rx= im+1;
+    xy[0]= _raxis[0]->GetBinCenter (rx);
+  }
+  if (TD==1) {
+    xy[1]= truth[0];
+    ry= _ownAxis[1] ? _rlookup[1].FindBin (xy[1]) : bt;
+  } else {
+    ry= it+1;
+    xy[1]= _raxis[1]->GetBinCenter (ry);
+  }
+  Add<2> (kRes, rx + (_nres[0]+2)*ry, (rx>=1 && rx<=_nres[0] && ry>=1 && ry<=_nres[1]), w, xy);
+}
+
+template <Int_t MD, Int_t TD>
+void RooUnfoldResponseFiller::FillRangeDim (Long64_t first, Long64_t last, const Double_t* reco, const Double_t* truth,
+                                            const Double_t* w, const Int_t* type)
+{
+  //! Fill events first..last-1 of the arrays, with MD measured and TD truth dimensions
+  for (Long64_t i= first; i<last; i++) {
+    const Int_t t= type ? type[i] : Int_t(RooUnfoldResponse::kFillMatch);
+    AddEventDim<MD,TD> (t != RooUnfoldResponse::kFillMiss ? reco  + i*MD : 0,
+                        t != RooUnfoldResponse::kFillFake ? truth + i*TD : 0,
+                        w ? w[i] : 1.0, t);
+  }
+}
+
+// Call FUNC<MD,TD>ARGS for the measured and truth dimensions
+#define ROOUNFOLD_DIM_SWITCH(FUNC,ARGS) \
+  switch (3*_ndim[0]+_ndim[1]-4) { \
+    case 0: FUNC<1,1> ARGS; break; \
+    case 1: FUNC<1,2> ARGS; break; \
+    case 2: FUNC<1,3> ARGS; break; \
+    case 3: FUNC<2,1> ARGS; break; \
+    case 4: FUNC<2,2> ARGS; break; \
+    case 5: FUNC<2,3> ARGS; break; \
+    case 6: FUNC<3,1> ARGS; break; \
+    case 7: FUNC<3,2> ARGS; break; \
+    case 8: FUNC<3,3> ARGS; break; \
+  }
+
+void RooUnfoldResponseFiller::AddEvent (const Double_t* reco, const Double_t* truth, Double_t w, Int_t type)
+{
+  //! Add one event of type RooUnfoldResponse::kFillMatch, kFillMiss, or kFillFake
+  if (_ncell[kRes]==0) return;
+  ROOUNFOLD_DIM_SWITCH (AddEventDim, (reco, truth, w, type))
+}
+
+void RooUnfoldResponseFiller::FillRange (Long64_t first, Long64_t last, const Double_t* reco, const Double_t* truth,
+                                         const Double_t* w, const Int_t* type)
+{
+  //! Fill events first..last-1 of the arrays, as FillN
+  if (_ncell[kRes]==0) return;
+  ROOUNFOLD_DIM_SWITCH (FillRangeDim, (first, last, reco, truth, w, type))
+}
+
+void RooUnfoldResponseFiller::FillN (Int_t n, const Double_t* reco, const Double_t* truth, const Double_t* w, const Int_t* type)
+{
+  //! Fill n events at once. See RooUnfoldResponse::FillN for the arguments.
+  FillRange (0, n, reco, truth, w, type);
+}
+
+void RooUnfoldResponseFiller::Merge (const RooUnfoldResponseFiller& other)
+{
+  //! Add the events of another filler with the same binning
+  if (other.GetEntries()==0) return;
+  for (Int_t h= 0; h<kNhist; h++) {
+    if (other._ncell[h] != _ncell[h]) {
+      cerr << "RooUnfoldResponseFiller::Merge: cannot merge fillers with different binning" << endl;
+      return;
+    }
+  }
+  for (Int_t h= 0; h<kNhist; h++) {
+    Double_t *w= _w[h], *w2= _w2[h];
+    const Double_t *ow= other._w[h], *ow2= other._w2[h];
+    for (Int_t i= 0, n= _ncell[h]; i<n; i++) w[i] += ow[i];
+    if (w2 && ow2)
+      for (Int_t i= 0, n= _ncell[h]; i<n; i++) w2[i] += ow2[i];
+    for (Int_t i= 0; i<TH1::kNstat; i++) _stats[h][i] += other._stats[h][i];
+    _nent[h] += other._nent[h];
+  }
+  if (other._weighted) _weighted= kTRUE;
+  _boot.Merge (other._boot);
+}
+
+Bool_t RooUnfoldResponseFiller::Publish (RooUnfoldResponse& res) const
+{
+  //! Add the accumulated events to the histograms of res (see RooUnfoldResponse::Add).
+  //! Returns false, without changing res, if the histograms of res have different binning.
+  TH1* hist[kNhist]= { res.Hmeasured(), res.Hfakes(), res.Htruth(), res.Hresponse() };
+  const Int_t ndim[kNhist]= { _ndim[0], _ndim[0], _ndim[1], 2 };
+  for (Int_t h= 0; h<kNhist; h++) {
+    if (!hist[h] || Ncells (hist[h], ndim[h]) != _ncell[h] || (h<kRes && hist[h]->GetDimension() != ndim[h])) {
+      cerr << "RooUnfoldResponse::Add: RooUnfoldResponseFiller has different binning from " << res.GetName() << endl;
+      return kFALSE;
+    }
+  }
+  for (Int_t h= 0; h<kNhist; h++) {
+    if (_nent[h]==0) continue;
+    TH1* hh= hist[h];
+    Double_t stats[TH1::kNstat];
+    hh->GetStats (stats);
+    // As TH1::Fill, store sum of weights squared if any weight is not 1
+    if (_weighted && hh->GetSumw2N()==0 && !hh->TestBit(TH1::kIsNotW)) hh->Sumw2();
+    TArrayD* a= dynamic_cast<TArrayD*>(hh);
+    Double_t* w= (a && a->GetSize()==_ncell[h]) ? a->GetArray() : 0;
+    Double_t* w2= hh->GetSumw2N() ? hh->GetSumw2()->GetArray() : 0;
+    const Double_t *sum= _w[h], *sum2= _w2[h];
+    for (Int_t i= 0, n= _ncell[h]; i<n; i++) {
+      if (sum[i]==0.0 && sum2[i]==0.0) continue;
+      if (w) w[i] += sum[i];
+      else   hh->AddBinContent (i, sum[i]);
+      if (w2) w2[i] += sum2[i];
+    }
+    for (Int_t i= 0; i<TH1::kNstat; i++) stats[i] += _stats[h][i];
+    hh->PutStats (stats);
+    hh->SetEntries (hh->GetEntries() + Double_t(_nent[h]));
+  }
+  return kTRUE;
+}
+
+void RooUnfoldResponseFiller::PublishDirect()
+{
+  //! Store the statistics and number of entries in the histograms used with SetupDirect
+  for (Int_t h= 0; h<kNhist; h++) {
+    if (!_hist[h] || _nent[h]==0) continue;
+    _hist[h]->PutStats (_stats[h]);
+    _hist[h]->SetEntries (_hist[h]->GetEntries() + Double_t(_nent[h]));
+  }
+}
+
+void RooUnfoldResponseFiller::MergeRange (vector<RooUnfoldResponseFiller>* fillers, Int_t first, Int_t last, Int_t step)
+{
+  //! Merge pairs first..last-1 of one level of the Reduce tree
+  for (Int_t p= first; p<last; p++) {
+    Int_t i= 2*step*p;
+    (*fillers)[i].Merge ((*fillers)[i+step]);
+  }
+}
+
+void RooUnfoldResponseFiller::Reduce (vector<RooUnfoldResponseFiller>& fillers, Int_t nthreads)
+{
+  //! Merge all the fillers into fillers[0], pairwise in a tree.
+  //! Up to nthreads merges at each level of the tree are done in parallel (all available cores if nthreads=0).
+  Int_t n= fillers.size();
+  for (Int_t step= 1; step<n; step *= 2) {
+    Int_t npairs= (n+step-1)/(2*step);  // number of i=0,2*step,4*step... with i+step<n
+#ifdef ROOUNFOLD_THREADS
+    Int_t nt= RooUnfoldThreads::NThreads (nthreads, npairs);
+    if (nt>1) {
+      vector<std::thread> threads;
+      for (Int_t t= 0; t<nt; t++)
+        threads.push_back (std::thread (&RooUnfoldResponseFiller::MergeRange, &fillers,
+                                        (npairs* t   )/nt, (npairs*(t+1))/nt, step));
+      for (Int_t t= 0; t<nt; t++) threads[t].join();
+      continue;
+    }
+#endif
+    MergeRange (&fillers, 0, npairs, step);
+  }
+}
+
+void RooUnfoldResponseFiller::FillParallel (RooUnfoldResponse& res, Long64_t n, const Double_t* reco, const Double_t* truth,
+                                            const Double_t* w, const Int_t* type, Int_t nthreads)
+{
+  //! Fill n events into res, as RooUnfoldResponse::FillN, sharing them between nthreads threads (all available cores
+  //! if nthreads=0). Each thread fills its own RooUnfoldResponseFiller, which are merged with Reduce() and added to res.
+  //! The result is the same as RooUnfoldResponse::FillN (up to rounding in the sums of weights).
+  if (n<=0) return;
+#ifdef ROOUNFOLD_THREADS
+  nthreads= RooUnfoldThreads::NThreads (nthreads, n);
+  if (nthreads>1) {
+    vector<RooUnfoldResponseFiller> fillers (nthreads, RooUnfoldResponseFiller(&res));
+    vector<std::thread> threads;
+    const Long64_t event0= fillers[0]._boot.GetNextEvent();
+    for (Int_t t= 0; t<nthreads; t++) {
+      Long64_t first= (n* t   )/nthreads;
+      Long64_t last=  (n*(t+1))/nthreads;
+      fillers[t].SetEventNumber (event0+first);  // bootstrap weights as if filled in one pass
+      threads.push_back (std::thread (&RooUnfoldResponseFiller::FillRange, &fillers[t], first, last, reco, truth, w, type));
+    }
+    for (Int_t t= 0; t<nthreads; t++) threads[t].join();
+    Reduce (fillers, nthreads);
+    res.Add (fillers[0]);
+    return;
+  }
+#endif
+  const Int_t mdim= res.GetDimensionMeasured(), tdim= res.GetDimensionTruth();
+  const Long64_t chunk= kMaxInt;
+  for (Long64_t first= 0; first<n; first += chunk) {
+    Int_t nf= Int_t (n-first < chunk ? n-first : chunk);
+    res.FillN (nf, reco ? reco + first*mdim : 0, truth ? truth + first*tdim : 0,
+               w ? w + first : 0, type ? type + first : 0);
+  }
+}
@@ -0,0 +1,186 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Lightweight accumulator of training events for a RooUnfoldResponse,
+//      eg. one per thread, merged at the end.
+//
+//==============================================================================
+
+#ifndef ROOUNFOLDRESPONSEFILLER_HH
+#define ROOUNFOLDRESPONSEFILLER_HH
+
+#include "Rtypes.h"
+#include "TArrayD.h"
+#include "TH1.h"
+#include "RooUnfoldResponse.h"
+#include "RooUnfoldBinLookup.h"
+#include "RooUnfoldBootstrap.h"
+#include <vector>
+
+class TAxis;
+
+class RooUnfoldResponseFiller {
+
+public:
+
+  RooUnfoldResponseFiller (const RooUnfoldResponse* res= 0); // accumulator with the binning of res
+  RooUnfoldResponseFiller (const RooUnfoldResponseFiller& rhs); // copy constructor
+  virtual ~RooUnfoldResponseFiller() {}
+  RooUnfoldResponseFiller& operator= (const RooUnfoldResponseFiller& rhs); // assignment operator
+
+  void     Setup (const RooUnfoldResponse* res);  // set binning from res and clear
+  void     Reset();                               // clear accumulated events
+
+  // Fill with training data: reco and truth are arrays of GetDimensionMeasured() and GetDimensionTruth() coordinates
+
+  void     Fill (const Double_t* reco, const Double_t* truth, Double_t w= 1.0);  // as RooUnfoldResponse::Fill
+  void     Miss (const Double_t* truth, Double_t w= 1.0);                        // as RooUnfoldResponse::Miss
+  void     Fake (const Double_t* reco,  Double_t w= 1.0);                        // as RooUnfoldResponse::Fake
+  void     Fill (Double_t xr, Double_t xt, Double_t w= 1.0);                     // 1D Fill
+  void     Miss (Double_t xt, Double_t w= 1.0);                                  // 1D Miss
+  void     Fake (Double_t xr, Double_t w= 1.0);                                  // 1D Fake
+  void     FillN (Int_t n, const Double_t* reco, const Double_t* truth, const Double_t* w= 0, const Int_t* type= 0);  // as RooUnfoldResponse::FillN
+
+  void     Merge (const RooUnfoldResponseFiller& other);  // add events of another accumulator with the same binning
+  Long64_t GetEntries() const;                            // number of events accumulated
+  void     SetEventNumber (Long64_t event);               // bootstrap event number of the next event
+
+  static void Reduce (std::vector<RooUnfoldResponseFiller>& fillers, Int_t nthreads= 0);  // merge all into fillers[0]
+  static void FillParallel (RooUnfoldResponse& res, Long64_t n, const Double_t* reco, const Double_t* truth,
+                            const Double_t* w= 0, const Int_t* type= 0, Int_t nthreads= 0);  // fill res using nthreads
+
+private:
+
+  enum { kMes, kFak, kTru, kRes, kNhist };  // same as RooUnfoldBootstrap
+
+  void   Init();
+  void   CopyData (const RooUnfoldResponseFiller& rhs);
+  Bool_t SetupBinning (const RooUnfoldResponse* res);
+  Bool_t SetupDirect (RooUnfoldResponse* res, Bool_t weighted);  // add directly to the histograms of res
+  Bool_t Publish (RooUnfoldResponse& res) const;  // add to histograms of res (false if the binning differs)
+  void   PublishDirect();                         // store statistics in histograms used with SetupDirect
+  template <Int_t N> void Add (Int_t h, Int_t bin, Bool_t inrange, Double_t w, const Double_t* x);
+  template <Int_t MD, Int_t TD> void AddEventDim (const Double_t* reco, const Double_t* truth, Double_t w, Int_t type);
+  template <Int_t MD, Int_t TD> void FillRangeDim (Long64_t first, Long64_t last, const Double_t* reco, const Double_t* truth,
+                                                   const Double_t* w, const Int_t* type);
+  void   AddEvent (const Double_t* reco, const Double_t* truth, Double_t w, Int_t type);
+  void   FillRange (Long64_t first, Long64_t last, const Double_t* reco, const Double_t* truth,
+                    const Double_t* w, const Int_t* type);
+  static void MergeRange (std::vector<RooUnfoldResponseFiller>* fillers, Int_t first, Int_t last, Int_t step);
+  static Int_t Ncells (const TH1* h, Int_t ndim);
+  static Bool_t SameBinning (const TAxis* a, const TAxis* b);
+
+  // instance variables
+
+  Int_t        _ndim[2];        // Number of measured and truth dimensions
+  RooUnfoldBinLookup  _lookup[2];   // Measured and truth bin lookup
+  RooUnfoldAxisLookup _rlookup[2];  // Response histogram axes bin lookup
+  const TAxis* _raxis[2];       //! Response histogram axes (not owned)
+  Bool_t       _ownAxis[2];     // 1D response histogram axis has different binning from measured or truth
+  Int_t        _nres[2];        // Number of response bins in measured and truth
+  Int_t        _ncell[kNhist];  // Number of bins (with under/overflows) in measured, fakes, truth, and response histograms
+  TArrayD      _sum  [kNhist];  // Sum of weights in each bin
+  TArrayD      _sum2 [kNhist];  // Sum of weights squared in each bin
+  Double_t*    _w    [kNhist];  //! Where to add the weights (_sum or histogram bins)
+  Double_t*    _w2   [kNhist];  //! Where to add the weights squared (_sum2, histogram errors, or 0)
+  TH1*         _hist [kNhist];  //! Histograms used with SetupDirect
+  Double_t     _stats[kNhist][TH1::kNstat];  // Sums of weights and coordinates for the histogram statistics
+  Long64_t     _nent [kNhist];  // Number of entries in each histogram
+  Bool_t       _weighted;       // A weight was not 1
+  Bool_t       _statOverflows;  // Include under/overflows in the statistics (TH1::GetStatOverflows)
+  RooUnfoldBootstrap _boot;     // Bootstrap replicas, if the RooUnfoldResponse has them
+
+  friend class RooUnfoldResponse;
+
+public:
+
+  ClassDef (RooUnfoldResponseFiller, 0) // Accumulator of training events for a RooUnfoldResponse
+};
+
+// Inline method definitions
+
+inline
+RooUnfoldResponseFiller::RooUnfoldResponseFiller (const RooUnfoldResponse* res)
+{
+  // Constructor for events with the binning of res (which is not modified). Use Setup() if res=0.
+  Init();
+  if (res) Setup (res);
+}
+
+inline
+RooUnfoldResponseFiller::RooUnfoldResponseFiller (const RooUnfoldResponseFiller& rhs)
+{
+  // Copy constructor
+  Init();
+  CopyData (rhs);
+}
+
+inline
+RooUnfoldResponseFiller& RooUnfoldResponseFiller::operator= (const RooUnfoldResponseFiller& rhs)
+{
+  // Assignment operator
+  if (this != &rhs) CopyData (rhs);
+  return *this;
+}
+
+inline
+void RooUnfoldResponseFiller::Fill (const Double_t* reco, const Double_t* truth, Double_t w)
+{
+  // Fill measured and truth event
+  AddEvent (reco, truth, w, RooUnfoldResponse::kFillMatch);
+}
+
+inline
+void RooUnfoldResponseFiller::Miss (const Double_t* truth, Double_t w)
+{
+  // Fill missed event (truth only)
+  AddEvent (0, truth, w, RooUnfoldResponse::kFillMiss);
+}
+
+inline
+void RooUnfoldResponseFiller::Fake (const Double_t* reco, Double_t w)
+{
+  // Fill fake event (measured only)
+  AddEvent (reco, 0, w, RooUnfoldResponse::kFillFake);
+}
+
+inline
+void RooUnfoldResponseFiller::Fill (Double_t xr, Double_t xt, Double_t w)
+{
+  // Fill 1D measured and truth event
+  AddEvent (&xr, &xt, w, RooUnfoldResponse::kFillMatch);
+}
+
+inline
+void RooUnfoldResponseFiller::Miss (Double_t xt, Double_t w)
+{
+  // Fill 1D missed event
+  AddEvent (0, &xt, w, RooUnfoldResponse::kFillMiss);
+}
+
+inline
+void RooUnfoldResponseFiller::Fake (Double_t xr, Double_t w)
+{
+  // Fill 1D fake event
+  AddEvent (&xr, 0, w, RooUnfoldResponse::kFillFake);
+}
+
+inline
+Long64_t RooUnfoldResponseFiller::GetEntries() const
+{
+  // Return number of events accumulated
+  return _nent[kTru] + _nent[kFak];
+}
+
+inline
+void RooUnfoldResponseFiller::SetEventNumber (Long64_t event)
+{
+  // Set the event number of the next event, which determines its bootstrap weights (see
+  // RooUnfoldResponse::SetBootstrap). Events are numbered consecutively from the
+  // RooUnfoldResponse's next event when the filler is set up.
+  _boot.SetNextEvent (event);
+}
+
+#endif
@@ -34,6 +34,7 @@
 #include "TMatrixD.h"
 
 #include "RooUnfoldResponse.h"
+#include "RooUnfoldNoDirectory.h"
 
 #if (defined(HAVE_TSVDUNFOLD) && !HAVE_TSVDUNFOLD) && ROOT_VERSION_CODE < ROOT_VERSION(5,34,0)
 #define TSVDUNFOLD_LEAK 1
@@ -106,6 +107,9 @@ RooUnfoldSvd::Init()
   _svd= 0;
   _meas1d= _train1d= _truth1d= 0;
   _reshist= _meascov= 0;
+  _vtruth.ResizeTo(0);
+  _mres  .ResizeTo(0,0);
+  _eres  .ResizeTo(0,0);
   GetSettings();
 }
 
@@ -146,36 +150,95 @@ RooUnfoldSvd::Unfold()
     return;
   }
 
-  Bool_t oldstat= TH1::AddDirectoryStatus();
-  TH1::AddDirectory (kFALSE);
-  _meas1d=  HistNoOverflow (_meas,             _overflow);
-  _train1d= HistNoOverflow (_res->Hmeasured(), _overflow);
-  _truth1d= HistNoOverflow (_res->Htruth(),    _overflow);
-  _reshist= _res->HresponseNoOverflow();
-  Resize (_meas1d,  _nb);
-  Resize (_train1d, _nb);
-  Resize (_truth1d, _nb);
-  Resize (_reshist, _nb, _nb);
-
-  // Subtract fakes from measured distribution
-  if (_res->FakeEntries()) {
-    TVectorD fakes= _res->Vfakes();
-    Double_t fac= _res->Vmeasured().Sum();
-    if (fac!=0.0) fac=  Vmeasured().Sum() / fac;
-    if (_verbose>=1) cout << "Subtract " << fac*fakes.Sum() << " fakes from measured distribution" << endl;
-    for (Int_t i= 1; i<=_nm; i++)
-      _meas1d->SetBinContent (i, _meas1d->GetBinContent(i)-(fac*fakes[i-1]));
+#if !defined(HAVE_TSVDUNFOLD) || HAVE_TSVDUNFOLD
+  if (!_svd) {   // TSVDUnfold object is kept if only kreg has changed
+    // Pass the inputs to TSVDUnfold as vectors and matrices, padded to _nb bins, without making histograms
+    if (!_mres.GetNrows()) {   // training matrices are kept if the response has not changed
+      _vtruth.ResizeTo (_nt);
+      _vtruth= _res->Vtruth();
+      _vtruth.ResizeTo (_nb);
+      _mres.ResizeTo (_nm, _nt);
+      RooUnfoldResponse::H2M (_res->Hresponse(), _mres, 0, _overflow);  // number of events, not probabilities
+      _mres.ResizeTo (_nb, _nb);
+    }
+
+    _vmeas.ResizeTo (_nm);
+    _vmeas= Vmeasured();
+
+    // Subtract fakes from measured distribution
+    if (_res->FakeEntries()) {
+      const TVectorD& fakes= _res->Vfakes();
+      Double_t fac= _res->Vmeasured().Sum();
+      if (fac!=0.0) fac=  Vmeasured().Sum() / fac;
+      if (_verbose>=1) cout << "Subtract " << fac*fakes.Sum() << " fakes from measured distribution" << endl;
+      for (Int_t i= 0; i<_nm; i++)
+        _vmeas[i] -= fac*fakes[i];
+    }
+    _vmeas.ResizeTo (_nb);
+
+    const TMatrixD* cov= &GetMeasuredCov();   // used in place if no padding is needed
+    if (_nb != _nm) {
+      _mcov.ResizeTo (_nm, _nm);
+      _mcov= *cov;
+      _mcov.ResizeTo (_nb, _nb);
+      cov= &_mcov;
+    }
+
+    if (_verbose>=1) cout << "SVD init " << _nb << " x " << _nb << " bins, kreg=" << _kreg << endl;
+    _svd= new TSVDUnfold (_vmeas, *cov, _vtruth, _mres);
+  } else if (_verbose>=1) {
+    cout << "SVD reuse decomposition with kreg=" << _kreg << endl;
   }
 
-  _meascov= new TH2D ("meascov", "meascov", _nb, 0.0, 1.0, _nb, 0.0, 1.0);
-  const TMatrixD& cov= GetMeasuredCov();
-  for (Int_t i= 0; i<_nm; i++)
-    for (Int_t j= 0; j<_nm; j++)
-      _meascov->SetBinContent (i+1, j+1, cov(i,j));
+  const TVectorD& rec= _svd->UnfoldV (_kreg);
 
-  if (_verbose>=1) cout << "SVD init " << _reshist->GetNbinsX() << " x " << _reshist->GetNbinsY()
-                        << " bins, kreg=" << _kreg << endl;
-  _svd= new TSVDUnfold (_meas1d, _meascov, _train1d, _truth1d, _reshist);
+  _rec.ResizeTo (_nt);
+  for (Int_t i= 0; i<_nt; i++) {
+    _rec[i]= rec[i];
+  }
+
+  if (_verbose>=2) {
+    TVectorD train (_res->Vmeasured());
+    train.ResizeTo (_nb);
+    PrintTable (cout, _vtruth, train, _vmeas, rec, _nb, _nb);
+    RooUnfoldResponse::PrintMatrix(_mres,"TSVDUnfold response matrix");
+  }
+#else
+  RooUnfoldNoDirectory nodir;
+  if (!_svd) {   // TSVDUnfold object is kept if only kreg has changed
+    _meas1d=  HistNoOverflow (_meas,             _overflow);
+    Resize (_meas1d,  _nb);
+    if (!_reshist) {   // training histograms are kept if the response has not changed
+      _train1d= HistNoOverflow (_res->Hmeasured(), _overflow);
+      _truth1d= HistNoOverflow (_res->Htruth(),    _overflow);
+      _reshist= _res->HresponseNoOverflow();
+      Resize (_train1d, _nb);
+      Resize (_truth1d, _nb);
+      Resize (_reshist, _nb, _nb);
+    }
+
+    // Subtract fakes from measured distribution
+    if (_res->FakeEntries()) {
+      TVectorD fakes= _res->Vfakes();
+      Double_t fac= _res->Vmeasured().Sum();
+      if (fac!=0.0) fac=  Vmeasured().Sum() / fac;
+      if (_verbose>=1) cout << "Subtract " << fac*fakes.Sum() << " fakes from measured distribution" << endl;
+      for (Int_t i= 1; i<=_nm; i++)
+        _meas1d->SetBinContent (i, _meas1d->GetBinContent(i)-(fac*fakes[i-1]));
+    }
+
+    _meascov= new TH2D ("meascov", "meascov", _nb, 0.0, 1.0, _nb, 0.0, 1.0);
+    const TMatrixD& cov= GetMeasuredCov();
+    for (Int_t i= 0; i<_nm; i++)
+      for (Int_t j= 0; j<_nm; j++)
+        _meascov->SetBinContent (i+1, j+1, cov(i,j));
+
+    if (_verbose>=1) cout << "SVD init " << _reshist->GetNbinsX() << " x " << _reshist->GetNbinsY()
+                          << " bins, kreg=" << _kreg << endl;
+    _svd= new TSVDUnfold (_meas1d, _meascov, _train1d, _truth1d, _reshist);
+  } else if (_verbose>=1) {
+    cout << "SVD reuse decomposition with kreg=" << _kreg << endl;
+  }
 
   TH1D* rechist= _svd->Unfold (_kreg);
 
@@ -192,18 +255,67 @@ RooUnfoldSvd::Unfold()
   }
 
   delete rechist;
-  TH1::AddDirectory (oldstat);
+#endif
 
   _unfolded= true;
   _haveCov=  false;
 }
 
+void
+RooUnfoldSvd::ClearUnfolding (Bool_t newResponse)
+{
+  //! Drop the TSVDUnfold object and measured distribution.
+  //! The training inputs are only rebuilt if the response matrix has changed.
+  delete _svd;    _svd= 0;
+  delete _meas1d; _meas1d= 0;
+#ifdef TSVDUNFOLD_LEAK
+  delete _meascov;
+#endif
+  _meascov= 0;
+  if (newResponse) {
+    delete _train1d; _train1d= 0;
+    delete _truth1d; _truth1d= 0;
+    delete _reshist; _reshist= 0;
+    _vtruth.ResizeTo(0);
+    _mres  .ResizeTo(0,0);
+    _eres  .ResizeTo(0,0);
+  }
+  RooUnfold::ClearUnfolding (newResponse);
+}
+
 void
 RooUnfoldSvd::GetCov()
 {
   if (!_svd) return;
-  Bool_t oldstat= TH1::AddDirectoryStatus();
-  TH1::AddDirectory (kFALSE);
+
+#if !defined(HAVE_TSVDUNFOLD) || HAVE_TSVDUNFOLD
+  //Get the covariance matrix for statistical uncertainties on the measured distribution
+  const TMatrixD* unfoldedCov= (_dosys!=2) ? &_svd->GetXtauMatrix() : 0;
+  //Get the covariance matrix for statistical uncertainties on the response matrix
+  //Uses Poisson or Gaussian-distributed toys, depending on response matrix histogram's Sumw2 setting.
+  TMatrixD adetCov;
+  if (_dosys) {
+    Bool_t gaus= _res->Hresponse()->GetSumw2N();
+    if (gaus && !_eres.GetNrows()) {
+      _eres.ResizeTo (_nm, _nt);
+      RooUnfoldResponse::H2ME (_res->Hresponse(), _eres, 0, _overflow);
+      _eres.ResizeTo (_nb, _nb);
+    }
+    _svd->SetNThreads (NThreads());
+    _svd->GetAdetCov (adetCov, _NToys, 1, gaus ? &_eres : 0);
+  }
+
+  _cov.ResizeTo (_nt, _nt);
+  for (Int_t i= 0; i<_nt; i++) {
+    for (Int_t j= 0; j<_nt; j++) {
+      Double_t v  = 0;
+      if (unfoldedCov && unfoldedCov->GetNrows()) v  = (*unfoldedCov)(i,j);
+      if (adetCov.GetNrows())                     v += adetCov(i,j);
+      _cov(i,j)= v;
+    }
+  }
+#else
+  RooUnfoldNoDirectory nodir;
 
   TH2D *unfoldedCov= 0, *adetCov= 0;
   //Get the covariance matrix for statistical uncertainties on the measured distribution
@@ -226,7 +338,7 @@ RooUnfoldSvd::GetCov()
 #ifdef TSVDUNFOLD_LEAK
   delete unfoldedCov;
 #endif
-  TH1::AddDirectory (oldstat);
+#endif
 
   _haveCov= true;
 }
@@ -236,10 +348,20 @@ void RooUnfoldSvd::GetWgt()
   //! Get weight matrix
   if (_dosys) RooUnfold::GetWgt();   // can't add sys errors to weight, so calculate weight from covariance
   if (!_svd) return;
-  Bool_t oldstat= TH1::AddDirectoryStatus();
-  TH1::AddDirectory (kFALSE);
 
   //Get the covariance matrix for statistical uncertainties on the measured distribution
+#if !defined(HAVE_TSVDUNFOLD) || HAVE_TSVDUNFOLD
+  const TMatrixD& unfoldedWgt= _svd->GetXinvMatrix();
+  if (!unfoldedWgt.GetNrows()) return;
+
+  _wgt.ResizeTo (_nt, _nt);
+  for (Int_t i= 0; i<_nt; i++) {
+    for (Int_t j= 0; j<_nt; j++) {
+      _wgt(i,j)= unfoldedWgt(i,j);
+    }
+  }
+#else
+  RooUnfoldNoDirectory nodir;
   TH2D* unfoldedWgt= _svd->GetXinv();
 
   _wgt.ResizeTo (_nt, _nt);
@@ -252,7 +374,7 @@ void RooUnfoldSvd::GetWgt()
 #ifdef TSVDUNFOLD_LEAK
   delete unfoldedWgt;
 #endif
-  TH1::AddDirectory (oldstat);
+#endif
 
   _haveWgt= true;
 }
@@ -268,12 +390,14 @@ void RooUnfoldSvd::Streamer (TBuffer &R__b)
 {
   //! Stream an object of class RooUnfoldSvd.
   if (R__b.IsReading()) {
-    // Don't add our histograms to the currect directory.
-    // We own them and we don't want them to disappear when the file is closed.
-    Bool_t oldstat= TH1::AddDirectoryStatus();
-    TH1::AddDirectory (kFALSE);
     RooUnfoldSvd::Class()->ReadBuffer  (R__b, this);
-    TH1::AddDirectory (oldstat);
+    // Don't leave our histograms in the currect directory.
+    // We own them and we don't want them to disappear when the file is closed.
+    if (_meas1d)  _meas1d ->SetDirectory (0);
+    if (_train1d) _train1d->SetDirectory (0);
+    if (_truth1d) _truth1d->SetDirectory (0);
+    if (_reshist) _reshist->SetDirectory (0);
+    if (_meascov) _meascov->SetDirectory (0);
   } else {
     RooUnfoldSvd::Class()->WriteBuffer (R__b, this);
   }
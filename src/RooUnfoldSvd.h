@@ -62,6 +62,7 @@ protected:
   virtual void GetCov();
   virtual void GetWgt();
   virtual void GetSettings();
+  virtual void ClearUnfolding (Bool_t newResponse= kTRUE);
 
 private:
   void Init();
@@ -74,9 +75,16 @@ protected:
   Int_t _kreg;
   Int_t _nb;
 
-  TH1D *_meas1d, *_train1d, *_truth1d;
+  TH1D *_meas1d, *_train1d, *_truth1d;   // only used with ROOT's TSVDUnfold
   TH2D *_reshist, *_meascov;
 
+  // Inputs for the local TSVDUnfold, which uses them in place
+  TVectorD _vmeas;   //! Measured distribution, with fakes subtracted
+  TVectorD _vtruth;  //! Truth distribution
+  TMatrixD _mres;    //! Response matrix (number of events)
+  TMatrixD _eres;    //! Response matrix errors, for Gaussian toys
+  TMatrixD _mcov;    //! Measured covariance matrix, if padded
+
 public:
   ClassDef (RooUnfoldSvd, 1) // SVD Unfolding (interface to TSVDUnfold)
 };
@@ -125,7 +133,9 @@ RooUnfoldSvd::~RooUnfoldSvd()
 inline
 void RooUnfoldSvd::SetKterm (Int_t kreg)
 {
-  // Set regularisation parameter
+  // Set regularisation parameter. If already unfolded, the TSVDUnfold
+  // decomposition is kept, so unfolding again with the new kreg is cheap.
+  if (kreg != _kreg && _unfolded) RooUnfold::ClearUnfolding (kFALSE);
   _kreg= kreg;
 }
 
@@ -27,7 +27,10 @@ if v15 of TUnfold is used. ROOT versions 5.26 or below use v13 and so should be
 #include "RooUnfoldTUnfold.h"
 
 #include <iostream>
+#include <cmath>
+#include <vector>
 
+#include "TROOT.h"
 #include "TH1.h"
 #include "TH2.h"
 #include "TVectorD.h"
@@ -41,10 +44,16 @@ if v15 of TUnfold is used. ROOT versions 5.26 or below use v13 and so should be
 #include "TSpline.h"
 
 #include "RooUnfoldResponse.h"
+#include "RooUnfoldNoDirectory.h"
+#include "RooUnfoldThreads.h"
 
 using std::cout;
 using std::cerr;
 using std::endl;
+using std::vector;
+using std::pow;
+using std::log10;
+using std::sqrt;
 
 ClassImp (RooUnfoldTUnfold);
 
@@ -115,6 +124,10 @@ RooUnfoldTUnfold::CopyData (const RooUnfoldTUnfold& rhs)
   tau_set=rhs.tau_set;
   _tau=rhs._tau;
   _reg_method=rhs._reg_method;
+  _nScan=rhs._nScan;
+  _tauMin=rhs._tauMin;
+  _tauMax=rhs._tauMax;
+  _nRefine=rhs._nRefine;
   _lCurve  = (rhs._lCurve  ? dynamic_cast<TGraph*> (rhs._lCurve ->Clone()) : 0);
   _logTauX = (rhs._logTauX ? dynamic_cast<TSpline*>(rhs._logTauX->Clone()) : 0);
   _logTauY = (rhs._logTauY ? dynamic_cast<TSpline*>(rhs._logTauY->Clone()) : 0);
@@ -130,6 +143,9 @@ RooUnfoldTUnfold::Init()
   _lCurve = 0;
   _logTauX = 0;
   _logTauY = 0;
+  _nScan= 30;
+  _tauMin= _tauMax= 0.0;
+  _nRefine= 0;
   GetSettings();
 }
 
@@ -168,63 +184,41 @@ RooUnfoldTUnfold::Unfold()
   if (_nm<_nt)     cerr << "Warning: fewer measured bins than truth bins. TUnfold may not work correctly." << endl;
   if (_haveCovMes) cerr << "Warning: TUnfold does not account for bin-bin correlations on measured input"    << endl;
 
-  Bool_t oldstat= TH1::AddDirectoryStatus();
-  TH1::AddDirectory (kFALSE);
-  TH1D* meas= HistNoOverflow (_meas, _overflow);
-  TH2D* Hres=_res->HresponseNoOverflow();
-  TH1::AddDirectory (oldstat);
-
-  // Add inefficiencies to measured overflow bin
-  TVectorD tru= _res->Vtruth();
-  for (Int_t j= 1; j<=_nt; j++) {
-    Double_t ntru= 0.0;
-    for (Int_t i= 1; i<=_nm; i++) {
-      ntru += Hres->GetBinContent(i,j);
-    }
-    Hres->SetBinContent (_nm+1, j, tru[j-1]-ntru);
+  // Fill the measured histogram directly from the cached vectors, subtracting fakes
+  const TVectorD& vmeas= Vmeasured();
+  const TVectorD& emeas= Emeasured();
+  Bool_t s= _meas->GetSumw2N();
+  TH1D* meas;
+  {
+    RooUnfoldNoDirectory nodir;
+    meas= new TH1D (_meas->GetName(), _meas->GetTitle(), _nm, 0.0, _nm);
   }
+  if (s) meas->Sumw2();
 
-  // Subtract fakes from measured distribution
+  Double_t fac= 0.0;
+  const TVectorD* fakes= 0;
   if (_res->FakeEntries()) {
-    TVectorD fakes= _res->Vfakes();
-    Double_t fac= _res->Vmeasured().Sum();
-    if (fac!=0.0) fac=  Vmeasured().Sum() / fac;
-    if (_verbose>=1) cout << "Subtract " << fac*fakes.Sum() << " fakes from measured distribution" << endl;
-    for (Int_t i= 1; i<=_nm; i++)
-      meas->SetBinContent (i, meas->GetBinContent(i)-(fac*fakes[i-1]));
+    fakes= &_res->Vfakes();
+    fac= _res->Vmeasured().Sum();
+    if (fac!=0.0) fac=  vmeas.Sum() / fac;
+    if (_verbose>=1) cout << "Subtract " << fac*fakes->Sum() << " fakes from measured distribution" << endl;
+  }
+  for (Int_t i= 0; i<_nm; i++) {
+    Double_t v= vmeas[i];
+    if (fakes) v -= fac*(*fakes)[i];
+           meas->SetBinContent (i+1, v);
+    if (s) meas->SetBinError   (i+1, emeas[i]);
   }
 
-  Int_t ndim= _meas->GetDimension();
-  TUnfold::ERegMode reg= _reg_method;
-  if (ndim == 2 || ndim == 3) reg= TUnfold::kRegModeNone;  // set explicitly
-
+  // The TUnfold object only depends on the response, so is kept for the next measurement,
+  // unless systematic errors are now needed and it is not a TUnfoldSys.
 #ifndef NOTUNFOLDSYS
-  if (_dosys)
-    _unf= new TUnfoldSys(Hres,TUnfold::kHistMapOutputVert,reg);
-  else
-#endif
-    _unf= new TUnfold(Hres,TUnfold::kHistMapOutputVert,reg);
-
-  if        (ndim == 2) {
-    Int_t nx= _meas->GetNbinsX(), ny= _meas->GetNbinsY();
-    _unf->RegularizeBins2D (0, 1, nx, nx, ny, _reg_method);
-  } else if (ndim == 3) {
-    Int_t nx= _meas->GetNbinsX(), ny= _meas->GetNbinsY(), nz= _meas->GetNbinsZ(), nxy= nx*ny;
-    for (Int_t i= 0; i<nx; i++) {
-      _unf->RegularizeBins2D (    i, nx, ny, nxy, nz, _reg_method);
-    }
-    for (Int_t i= 0; i<ny; i++) {
-      _unf->RegularizeBins2D ( nx*i,  1, nx, nxy, nz, _reg_method);
-    }
-    for (Int_t i= 0; i<nz; i++) {
-      _unf->RegularizeBins2D (nxy*i,  1, nx,  nx, ny, _reg_method);
-    }
+  if (_unf && _dosys && !dynamic_cast<TUnfoldSys*>(_unf)) {
+    delete _unf; _unf= 0;
   }
+#endif
+  if (!_unf) SetupTUnfold();
 
-  Int_t nScan=30;
-  // use automatic L-curve scan: start with taumin=taumax=0.0
-  Double_t tauMin=0.0;
-  Double_t tauMax=0.0;
   // this method scans the parameter tau and finds the kink in the L curve
   // finally, the unfolding is done for the best choice of tau
 #if ROOT_VERSION_CODE >= ROOT_VERSION(5,23,0)  /* TUnfold v6 (included in ROOT 5.22) didn't have setInput return value */
@@ -240,7 +234,11 @@ RooUnfoldTUnfold::Unfold()
     delete _lCurve;  _lCurve  = 0;
     delete _logTauX; _logTauX = 0;
     delete _logTauY; _logTauY = 0;
-    Int_t bestPoint = _unf->ScanLcurve(nScan,tauMin,tauMax,&_lCurve,&_logTauX,&_logTauY);
+    Int_t bestPoint;
+    if (_nRefine>0 || NThreads()!=1)
+      bestPoint = ScanLcurveParallel (meas);
+    else  // automatic range unless set with SetLcurveScan
+      bestPoint = _unf->ScanLcurve(_nScan,_tauMin,_tauMax,&_lCurve,&_logTauX,&_logTauY);
     _tau=_unf->GetTau();  // save value, even if we don't use it unless tau_set
     cout <<"Lcurve scan chose tau= "<<_tau<<endl<<" at point "<<bestPoint<<endl;
   }
@@ -263,11 +261,231 @@ RooUnfoldTUnfold::Unfold()
   }
 
   delete meas;
-  delete Hres;
   _unfolded= true;
   _haveCov=  false;
 }
 
+void
+RooUnfoldTUnfold::SetupTUnfold()
+{
+  //! Creates the TUnfold object from the response matrix
+  _unf= CreateTUnfold();
+}
+
+TUnfold*
+RooUnfoldTUnfold::CreateTUnfold() const
+{
+  //! Returns a new TUnfold (or TUnfoldSys) object for the response matrix
+  //! The response histogram body is copied in a single pass, adding inefficiencies to the measured overflow bin.
+  const TH2* h= _res->Hresponse();
+  Int_t first= _overflow ? 0 : 1, s= h->GetSumw2N();
+  TH2D* Hres;
+  {
+    RooUnfoldNoDirectory nodir;
+    Hres= new TH2D (h->GetName(), h->GetTitle(), _nm, 0.0, _nm, _nt, 0.0, _nt);
+  }
+  if (s) Hres->Sumw2();
+
+  const TVectorD& tru= _res->Vtruth();
+  for (Int_t j= 0; j<_nt; j++) {
+    Double_t ntru= 0.0;
+    for (Int_t i= 0; i<_nm; i++) {
+      Double_t v= h->GetBinContent (i+first, j+first);
+      ntru += v;
+             Hres->SetBinContent (i+1, j+1, v);
+      if (s) Hres->SetBinError   (i+1, j+1, h->GetBinError (i+first, j+first));
+    }
+           Hres->SetBinContent (_nm+1, j+1, tru[j]-ntru);
+    if (s && !_overflow) Hres->SetBinError (_nm+1, j+1, h->GetBinError (_nm+1, j+1));
+  }
+
+  Int_t ndim= _meas->GetDimension();
+  TUnfold::ERegMode reg= _reg_method;
+  if (ndim == 2 || ndim == 3) reg= TUnfold::kRegModeNone;  // set explicitly
+
+  TUnfold* unf;
+#ifndef NOTUNFOLDSYS
+  if (_dosys)
+    unf= new TUnfoldSys(Hres,TUnfold::kHistMapOutputVert,reg);
+  else
+#endif
+    unf= new TUnfold(Hres,TUnfold::kHistMapOutputVert,reg);
+
+  if        (ndim == 2) {
+    Int_t nx= _meas->GetNbinsX(), ny= _meas->GetNbinsY();
+    unf->RegularizeBins2D (0, 1, nx, nx, ny, _reg_method);
+  } else if (ndim == 3) {
+    Int_t nx= _meas->GetNbinsX(), ny= _meas->GetNbinsY(), nz= _meas->GetNbinsZ(), nxy= nx*ny;
+    for (Int_t i= 0; i<nx; i++) {
+      unf->RegularizeBins2D (    i, nx, ny, nxy, nz, _reg_method);
+    }
+    for (Int_t i= 0; i<ny; i++) {
+      unf->RegularizeBins2D ( nx*i,  1, nx, nxy, nz, _reg_method);
+    }
+    for (Int_t i= 0; i<nz; i++) {
+      unf->RegularizeBins2D (nxy*i,  1, nx,  nx, ny, _reg_method);
+    }
+  }
+  delete Hres;
+  return unf;
+}
+
+static void LcurvePoints (TUnfold* unf, const vector<Double_t>* t, vector<Double_t>* x, vector<Double_t>* y,
+                          Int_t first, Int_t last)
+{
+  // Unfold with tau=10^t[i] for i=first..last-1, storing the L-curve coordinates in x[i] and y[i]
+  for (Int_t i= first; i<last; i++) {
+    unf->DoUnfold (pow (10.0, (*t)[i]));
+    (*x)[i]= unf->GetLcurveX();
+    (*y)[i]= unf->GetLcurveY();
+  }
+}
+
+static Bool_t LcurveFinite (Double_t v)
+{
+  return v==v && fabs(v)<1e300;
+}
+
+void
+RooUnfoldTUnfold::LcurveRange (Double_t& logTauMin, Double_t& logTauMax)
+{
+  //! Range of log10(tau) for the L-curve scan, if not set with SetLcurveScan. As in TUnfold::ScanLcurve,
+  //! the maximum tau is estimated from the unregularised fit, and the minimum is where the fit's chi^2
+  //! is within 1% of the unregularised value (looking up to 10 decades below the maximum).
+  _unf->DoUnfold (0.0);
+  Double_t chi2a0= _unf->GetChi2A();
+  Int_t ndf= _unf->GetNdf();
+  logTauMax= 0.5*(log10 (chi2a0+3.0*sqrt(ndf+1.0)) - _unf->GetLcurveY());
+  if (ndf<=0 || !LcurveFinite (logTauMax)) {
+    cerr << "RooUnfoldTUnfold: cannot determine L-curve scan range - use tau=1e-6 to 1" << endl;
+    logTauMin= -6.0;
+    logTauMax=  0.0;
+    return;
+  }
+  logTauMin= logTauMax;
+  for (Int_t i= 0; i<10; i++) {
+    logTauMin -= 1.0;
+    _unf->DoUnfold (pow (10.0, logTauMin));
+    if (_unf->GetChi2A() - chi2a0 < 0.01*(chi2a0>1.0 ? chi2a0 : 1.0)) break;
+  }
+}
+
+Int_t
+RooUnfoldTUnfold::LcurveKink (const vector<Double_t>& t, const vector<Double_t>& x, const vector<Double_t>& y)
+{
+  //! Returns the point of maximum curvature of the L-curve (x(t),y(t)), using three-point derivatives
+  //! with respect to t=log10(tau), which need not be equally spaced.
+  Int_t n= t.size(), best= n/2;
+  Double_t cmax= 0.0;
+  Bool_t found= kFALSE;
+  for (Int_t i= 1; i<n-1; i++) {
+    Double_t h1= t[i]-t[i-1], h2= t[i+1]-t[i];
+    if (h1<=0.0 || h2<=0.0) continue;
+    Double_t a= -h2/(h1*(h1+h2)), b= (h2-h1)/(h1*h2), c= h1/(h2*(h1+h2));
+    Double_t dx= a*x[i-1] + b*x[i] + c*x[i+1];
+    Double_t dy= a*y[i-1] + b*y[i] + c*y[i+1];
+    Double_t ddx= 2.0*(x[i-1]/(h1*(h1+h2)) - x[i]/(h1*h2) + x[i+1]/(h2*(h1+h2)));
+    Double_t ddy= 2.0*(y[i-1]/(h1*(h1+h2)) - y[i]/(h1*h2) + y[i+1]/(h2*(h1+h2)));
+    Double_t d2= dx*dx+dy*dy;
+    if (d2<=0.0) continue;
+    Double_t curv= (dx*ddy - ddx*dy) / (d2*sqrt(d2));
+    if (!LcurveFinite (curv)) continue;
+    if (!found || curv>cmax) {
+      cmax= curv;
+      best= i;
+      found= kTRUE;
+    }
+  }
+  return best;
+}
+
+Int_t
+RooUnfoldTUnfold::ScanLcurveParallel (const TH1* meas)
+{
+  //! L-curve scan of SetLcurveScan nscan points, with the points shared between NThreads() threads,
+  //! each with its own TUnfold object for the same response and input. The kink is the point of maximum
+  //! curvature. With nrefine>0, each refinement scans another nscan points between the kink's neighbours.
+  //! Sets _lCurve, _logTauX, and _logTauY as TUnfold::ScanLcurve, and finishes with _unf unfolded at the kink.
+  //! Returns the index of the kink in _lCurve.
+  Int_t nscan= _nScan>3 ? _nScan : 3;
+  Double_t logTauMin, logTauMax;
+  if (_tauMin>0.0 && _tauMax>_tauMin) {
+    logTauMin= log10 (_tauMin);
+    logTauMax= log10 (_tauMax);
+  } else
+    LcurveRange (logTauMin, logTauMax);
+
+  Int_t nthreads= RooUnfoldThreads::NThreads (NThreads(), nscan);
+  vector<TUnfold*> unfs (nthreads, _unf);
+  if (nthreads>1) RooUnfoldThreads::EnableThreadSafety();
+  for (Int_t t= 1; t<nthreads; t++) {
+    unfs[t]= CreateTUnfold();
+    unfs[t]->SetInput (meas);
+  }
+
+  vector<Double_t> t, x, y;  // all points, in increasing t
+  vector<Double_t> tn(nscan), xn(nscan), yn(nscan);  // new points
+  for (Int_t i= 0; i<nscan; i++) tn[i]= logTauMin + (logTauMax-logTauMin)*i/(nscan-1);
+  Int_t best= -1;
+  for (Int_t r= 0; r<=_nRefine; r++) {
+#ifdef ROOUNFOLD_THREADS
+    if (nthreads>1) {
+      vector<std::thread> threads;
+      for (Int_t k= 0; k<nthreads; k++) {
+        Int_t first= (nscan* k   )/nthreads;
+        Int_t last=  (nscan*(k+1))/nthreads;
+        threads.push_back (std::thread (LcurvePoints, unfs[k], &tn, &xn, &yn, first, last));
+      }
+      for (Int_t k= 0; k<nthreads; k++) threads[k].join();
+    } else
+#endif
+    LcurvePoints (_unf, &tn, &xn, &yn, 0, nscan);
+
+    // merge new points, which all lie between t[best-1] and t[best+1]
+    Int_t at= best<0 ? 0 : best;
+    vector<Double_t> tm, xm, ym;
+    tm.insert (tm.end(), t.begin(), t.begin()+at);
+    xm.insert (xm.end(), x.begin(), x.begin()+at);
+    ym.insert (ym.end(), y.begin(), y.begin()+at);
+    for (Int_t i= 0; i<nscan; i++) {
+      if (at<Int_t(t.size()) && t[at]<tn[i]) {
+        tm.push_back (t[at]); xm.push_back (x[at]); ym.push_back (y[at]);
+        at++;
+      }
+      tm.push_back (tn[i]); xm.push_back (xn[i]); ym.push_back (yn[i]);
+    }
+    tm.insert (tm.end(), t.begin()+at, t.end());
+    xm.insert (xm.end(), x.begin()+at, x.end());
+    ym.insert (ym.end(), y.begin()+at, y.end());
+    t.swap (tm); x.swap (xm); y.swap (ym);
+
+    best= LcurveKink (t, x, y);
+    if (r==_nRefine || best<=0 || best>=Int_t(t.size())-1) break;
+    Double_t lo= t[best-1], hi= t[best+1];
+    for (Int_t i= 0; i<nscan; i++) tn[i]= lo + (hi-lo)*(i+1)/(nscan+1);
+    if (_verbose>=1) cout << "Refine L-curve scan between tau= " << pow(10.0,lo) << " and " << pow(10.0,hi) << endl;
+  }
+  for (Int_t k= 1; k<nthreads; k++) delete unfs[k];
+
+  Int_t n= t.size();
+  _lCurve=  new TGraph (n, &x[0], &y[0]);
+  _logTauX= new TSpline3 ("log(chi**2)%log(tau)",   &t[0], &x[0], n);
+  _logTauY= new TSpline3 ("log(reg.cond)%log(tau)", &t[0], &y[0], n);
+  _unf->DoUnfold (pow (10.0, t[best]));
+  return best;
+}
+
+void
+RooUnfoldTUnfold::ClearUnfolding (Bool_t newResponse)
+{
+  //! The TUnfold object is only recreated if the response matrix has changed.
+  //! Otherwise the next unfolding just provides it with the new input.
+  if (newResponse) {
+    delete _unf; _unf= 0;
+  }
+  RooUnfold::ClearUnfolding (newResponse);
+}
+
 void
 RooUnfoldTUnfold::GetCov()
 {
@@ -303,6 +521,20 @@ RooUnfoldTUnfold::FixTau(Double_t tau)
   tau_set=true;
 }
 
+void
+RooUnfoldTUnfold::SetLcurveScan (Int_t nscan, Double_t tauMin, Double_t tauMax, Int_t nrefine)
+{
+  //! Settings for the L-curve scan used to choose tau, unless it was fixed with FixTau.
+  //! nscan points are scanned between tauMin and tauMax (found automatically unless 0 < tauMin < tauMax).
+  //! With nrefine>0, the scan is refined nrefine times, each with another nscan points between the neighbours
+  //! of the kink. The points are shared between NThreads() threads (each with its own TUnfold object).
+  //! With the defaults and NThreads()==1, TUnfold::ScanLcurve is used.
+  _nScan= nscan;
+  _tauMin= tauMin;
+  _tauMax= tauMax;
+  _nRefine= nrefine>0 ? nrefine : 0;
+}
+
 void
 RooUnfoldTUnfold::SetRegMethod(TUnfold::ERegMode regmethod)
 {
@@ -316,6 +548,9 @@ RooUnfoldTUnfold::SetRegMethod(TUnfold::ERegMode regmethod)
       TUnfold::kRegModeDerivative   minimize the 1st derivative of (x-x0)
       TUnfold::kRegModeCurvature    minimize the 2nd derivative of (x-x0)
    */
+  if (regmethod != _reg_method) {
+    delete _unf; _unf= 0;  // the kept TUnfold object has the old regularisation
+  }
   _reg_method=regmethod;
 }
 
@@ -42,6 +42,7 @@ public:
   TUnfold* Impl();
   void FixTau(Double_t tau);
   void OptimiseTau();
+  void SetLcurveScan (Int_t nscan= 30, Double_t tauMin= 0.0, Double_t tauMax= 0.0, Int_t nrefine= 0);  // L-curve scan settings
   virtual void SetRegParm(Double_t parm);
   Double_t GetTau() const;
   const TGraph*  GetLCurve()  const;
@@ -57,6 +58,12 @@ protected:
   virtual void Unfold();
   virtual void GetCov();
   virtual void GetSettings();
+  virtual void ClearUnfolding (Bool_t newResponse= kTRUE);
+  void SetupTUnfold();
+  TUnfold* CreateTUnfold() const;
+  Int_t ScanLcurveParallel (const TH1* meas);
+  void LcurveRange (Double_t& logTauMin, Double_t& logTauMax);
+  static Int_t LcurveKink (const std::vector<Double_t>& t, const std::vector<Double_t>& x, const std::vector<Double_t>& y);
   void Assign   (const RooUnfoldTUnfold& rhs); // implementation of assignment operator
   void CopyData (const RooUnfoldTUnfold& rhs);
 
@@ -68,10 +75,14 @@ private:
   TSpline* _logTauX;
   TSpline* _logTauY;
   TGraph*  _lCurve;
+  Int_t    _nScan;    // Number of L-curve scan points
+  Double_t _tauMin;   // Minimum tau of L-curve scan (automatic unless 0 < _tauMin < _tauMax)
+  Double_t _tauMax;   // Maximum tau of L-curve scan
+  Int_t    _nRefine;  // Number of L-curve scan refinements around the kink
 
 public:
 
-  ClassDef (RooUnfoldTUnfold, 1)   // Interface to TUnfold
+  ClassDef (RooUnfoldTUnfold, 2)   // Interface to TUnfold
 };
 
 // Inline method definitions
@@ -0,0 +1,74 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Common settings for running toys, scans, and response filling in
+//      parallel threads. For use inside RooUnfold only.
+//
+//==============================================================================
+
+#ifndef ROOUNFOLDTHREADS_HH
+#define ROOUNFOLDTHREADS_HH
+
+#include "Rtypes.h"
+#include "RVersion.h"
+
+// Threads need C++11. They can be disabled by compiling with -DNOTHREADS (make NOTHREADS=1, or cmake -DNOTHREADS=ON),
+// in which case everything runs in the calling thread and the number of threads asked for is ignored.
+#if !defined(NOTHREADS) && __cplusplus >= 201103L
+#define ROOUNFOLD_THREADS 1
+#include <thread>
+#include <functional>
+#include "TROOT.h"
+#endif
+
+namespace RooUnfoldThreads {
+
+  Int_t NThreads (Int_t nthreads, Long64_t nwork);  // number of threads to use for nwork items
+  void  EnableThreadSafety();                       // allow ROOT to be used in several threads
+  UInt_t ToyStreamSeed (UInt_t seed, Int_t itoy);   // seed for the random number stream of toy itoy
+
+}
+
+// Inline function definitions
+
+inline
+Int_t RooUnfoldThreads::NThreads (Int_t nthreads, Long64_t nwork)
+{
+  // Number of threads to share nwork items between: nthreads, or all available cores if nthreads<=0,
+  // but not more than nwork. Always 1 if threads are not available.
+#ifdef ROOUNFOLD_THREADS
+  if (nthreads<=0) nthreads= std::thread::hardware_concurrency();
+  if (nthreads>nwork) nthreads= Int_t(nwork);
+  return nthreads<1 ? 1 : nthreads;
+#else
+  return 1;
+#endif
+}
+
+inline
+void RooUnfoldThreads::EnableThreadSafety()
+{
+  // Call before starting threads that use ROOT (needs ROOT 6.06 or later)
+#if defined(ROOUNFOLD_THREADS) && ROOT_VERSION_CODE >= ROOT_VERSION(6,6,0)
+  ROOT::EnableThreadSafety();
+#endif
+}
+
+inline
+UInt_t RooUnfoldThreads::ToyStreamSeed (UInt_t seed, Int_t itoy)
+{
+  // Seed for the random number stream of toy number itoy, so each toy is the same whichever thread runs it.
+  // Mixes the bits of seed and itoy, so neighbouring toys get unrelated seeds.
+  // Never returns 0, which TRandom3::SetSeed would replace with a random seed.
+  UInt_t s= seed + 0x9E3779B9U * UInt_t(itoy+1);
+  s ^= s >> 16;
+  s *= 0x85EBCA6BU;
+  s ^= s >> 13;
+  s *= 0xC2B2AE35U;
+  s ^= s >> 16;
+  return s ? s : 1;
+}
+
+#endif
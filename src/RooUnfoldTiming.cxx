@@ -0,0 +1,111 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Time and matrix memory used by each phase of an unfolding
+//      (RooUnfold) or response matrix cache rebuild (RooUnfoldResponse),
+//      per call and in aggregate. Compile with -DNOTIMING to remove the
+//      instrumentation.
+//
+//==============================================================================
+
+//____________________________________________________________
+/*! \class RooUnfoldTiming
+\brief Time and matrix memory used by each phase of an unfolding, returned by RooUnfold::GetTiming()
+and RooUnfoldResponse::GetTiming().</p>
+<p>For each Phase, the number of calls, the total elapsed and CPU times, the elapsed time of the
+slowest call, and the largest memory held in vectors and matrices at the end of a call are kept.
+Per-toy figures are the totals divided by the number of calls of kToy. Toys run in
+parallel threads are timed in each thread and added, so their total elapsed time can exceed the elapsed
+time of the ensemble (kToys). CPU times are those of the whole process, so include other threads.</p>
+<p>Each phase is timed with a RooUnfoldTimer (a TStopwatch) in the enclosing scope, so the overhead is a few clock reads per call,
+which is small compared to the matrix operations timed.
+Compiling RooUnfold with -DNOTIMING removes the instrumentation completely: nothing is recorded, and all the counts stay zero.</p>
+ */
+/////////////////////////////////////////////////////////////
+
+#include "RooUnfoldTiming.h"
+
+#include <iostream>
+#include <iomanip>
+
+using std::endl;
+using std::setw;
+
+ClassImp (RooUnfoldTiming);
+
+RooUnfoldTiming::RooUnfoldTiming()
+{
+  //! Constructor with no calls recorded
+  Reset();
+}
+
+void RooUnfoldTiming::Reset()
+{
+  //! Forget all calls
+  for (Int_t i= 0; i<kNPhases; i++) {
+    _calls[i]= _peak[i]= 0;
+    _real[i]= _cpu[i]= _maxReal[i]= 0.0;
+  }
+}
+
+void RooUnfoldTiming::Add (Int_t phase, Double_t real, Double_t cpu, Long64_t bytes)
+{
+  //! Add one call of phase, which took real seconds elapsed and cpu seconds CPU time,
+  //! and after which bytes were held in vectors and matrices.
+  if (phase<0 || phase>=kNPhases) return;
+  _calls[phase]++;
+  _real[phase] += real;
+  _cpu[phase]  += cpu;
+  if (real  > _maxReal[phase]) _maxReal[phase]= real;
+  if (bytes > _peak[phase])    _peak[phase]=    bytes;
+}
+
+void RooUnfoldTiming::Merge (const RooUnfoldTiming& other)
+{
+  //! Add all the calls recorded in other, eg. by another thread
+  for (Int_t i= 0; i<kNPhases; i++) {
+    _calls[i] += other._calls[i];
+    _real[i]  += other._real[i];
+    _cpu[i]   += other._cpu[i];
+    if (other._maxReal[i] > _maxReal[i]) _maxReal[i]= other._maxReal[i];
+    if (other._peak[i]    > _peak[i])    _peak[i]=    other._peak[i];
+  }
+}
+
+Bool_t RooUnfoldTiming::IsEmpty() const
+{
+  //! Were no calls recorded?
+  for (Int_t i= 0; i<kNPhases; i++)
+    if (_calls[i]) return false;
+  return true;
+}
+
+const char* RooUnfoldTiming::PhaseName (Int_t phase)
+{
+  //! Name of phase, as printed by Print()
+  static const char* const names[kNPhases]= { "Unfold", "GetErrors", "GetCov", "GetWgt", "GetErrMat",
+                                              "ToyEnsemble", "toy", "RunToy", "cache" };
+  if (phase<0 || phase>=kNPhases) return "?";
+  return names[phase];
+}
+
+void RooUnfoldTiming::Print (std::ostream& o, const char* title) const
+{
+  //! Print the calls, total and mean times, slowest call, and peak matrix memory of each phase that was called
+  if (IsEmpty()) return;
+  if (title) o << title << " timing:" << endl;
+  o << "       phase      calls   real (s)    cpu (s)  real/call   max real  peak (MB)" << endl;
+  std::ios_base::fmtflags oldflags= o.flags();
+  std::streamsize oldprecision= o.precision (4);
+  for (Int_t i= 0; i<kNPhases; i++) {
+    if (!_calls[i]) continue;
+    o << setw(12) << PhaseName(i) << " " << setw(10) << _calls[i]
+      << " " << setw(10) << _real[i] << " " << setw(10) << _cpu[i]
+      << " " << setw(10) << _real[i]/_calls[i] << " " << setw(10) << _maxReal[i]
+      << " " << setw(10) << _peak[i]/1048576.0 << endl;
+  }
+  o.precision (oldprecision);
+  o.flags (oldflags);
+}
@@ -0,0 +1,190 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Time and matrix memory used by each phase of an unfolding
+//      (RooUnfold) or response matrix cache rebuild (RooUnfoldResponse),
+//      per call and in aggregate. Compile with -DNOTIMING to remove the
+//      instrumentation.
+//
+//==============================================================================
+
+#ifndef ROOUNFOLDTIMING_HH
+#define ROOUNFOLDTIMING_HH
+
+#include "Rtypes.h"
+#include "TStopwatch.h"
+#include "TVectorD.h"
+#include "TMatrixDBase.h"
+#include <iosfwd>
+
+#ifndef NOTIMING
+#define ROOUNFOLD_TIMING 1
+#endif
+
+// Time the rest of the enclosing scope as phase (a RooUnfoldTiming::Phase, without the class name)
+// in the RooUnfoldTiming object timing. With -DNOTIMING these expand to nothing, so their arguments are not evaluated.
+#ifdef ROOUNFOLD_TIMING
+#define ROOUNFOLD_TIMER(timer,timing,phase) RooUnfoldTimer timer (timing, RooUnfoldTiming::phase)
+#define ROOUNFOLD_TIMER_BYTES(timer,bytes)  timer.SetBytes (bytes)
+#else
+#define ROOUNFOLD_TIMER(timer,timing,phase)
+#define ROOUNFOLD_TIMER_BYTES(timer,bytes)
+#endif
+
+class RooUnfoldTiming {
+
+public:
+
+  enum Phase {     // Instrumented phases:
+    kUnfold,       //   RooUnfold::Unfold()
+    kErrors,       //   RooUnfold::GetErrors()
+    kCov,          //   RooUnfold::GetCov()
+    kWgt,          //   RooUnfold::GetWgt()
+    kErrMat,       //   RooUnfold::GetErrMat(), including its toys
+    kToys,         //   each ensemble of toys (RooUnfold::ToyEnsemble(), RooUnfold::RunToys())
+    kToy,          //   each toy: RunToy(), unfolding, and errors (summed over threads)
+    kRunToy,       //   RooUnfold::RunToy(): copy and smear the inputs
+    kCache,        //   RooUnfoldResponse cached vector or matrix rebuild
+    kNPhases
+  };
+
+  RooUnfoldTiming();
+  virtual ~RooUnfoldTiming() {}
+
+  void     Reset();                                      // forget all calls
+  void     Add (Int_t phase, Double_t real, Double_t cpu, Long64_t bytes= 0);  // add one call
+  void     Merge (const RooUnfoldTiming& other);         // add all the calls of another object
+
+  Long64_t GetCalls       (Int_t phase) const;  // number of calls
+  Double_t GetRealTime    (Int_t phase) const;  // total elapsed time (s)
+  Double_t GetCpuTime     (Int_t phase) const;  // total CPU time (s)
+  Double_t GetMaxRealTime (Int_t phase) const;  // elapsed time of the slowest call (s)
+  Long64_t GetPeakBytes   (Int_t phase) const;  // largest memory in vectors and matrices after a call
+  Bool_t   IsEmpty() const;                     // no calls recorded?
+  void     Print (std::ostream& o, const char* title= 0) const;  // table of the phases that were called
+
+  static Bool_t      Enabled();                 // compiled with the instrumentation?
+  static const char* PhaseName (Int_t phase);
+  static Long64_t    Bytes (const TVectorD& v);      // memory used by the elements of v
+  static Long64_t    Bytes (const TMatrixDBase& m);  // memory used by the elements of m (dense or sparse)
+
+private:
+
+  Long64_t _calls[kNPhases];    // number of calls
+  Double_t _real[kNPhases];     // total elapsed time
+  Double_t _cpu[kNPhases];      // total CPU time
+  Double_t _maxReal[kNPhases];  // slowest call
+  Long64_t _peak[kNPhases];     // largest memory after a call
+
+public:
+  ClassDef (RooUnfoldTiming, 1) // Time and matrix memory used by each unfolding phase
+};
+
+// Scoped timer: adds the time from construction to destruction as one call of a phase.
+
+class RooUnfoldTimer {
+
+public:
+
+  RooUnfoldTimer (RooUnfoldTiming& timing, Int_t phase);  // start timing
+  ~RooUnfoldTimer();                                      // add the call
+  void SetBytes (Long64_t bytes);                         // memory to record for this call
+
+private:
+
+  RooUnfoldTimer (const RooUnfoldTimer&);                 // not copyable
+  RooUnfoldTimer& operator= (const RooUnfoldTimer&);
+
+  RooUnfoldTiming& _timing;
+  Int_t            _phase;
+  Long64_t         _bytes;
+  TStopwatch       _sw;
+};
+
+// Inline method definitions
+
+inline
+Long64_t RooUnfoldTiming::GetCalls (Int_t phase) const
+{
+  // Return number of calls of phase
+  return _calls[phase];
+}
+
+inline
+Double_t RooUnfoldTiming::GetRealTime (Int_t phase) const
+{
+  // Return total elapsed time of phase in seconds
+  return _real[phase];
+}
+
+inline
+Double_t RooUnfoldTiming::GetCpuTime (Int_t phase) const
+{
+  // Return total CPU time of phase in seconds
+  return _cpu[phase];
+}
+
+inline
+Double_t RooUnfoldTiming::GetMaxRealTime (Int_t phase) const
+{
+  // Return elapsed time of the slowest call of phase in seconds
+  return _maxReal[phase];
+}
+
+inline
+Long64_t RooUnfoldTiming::GetPeakBytes (Int_t phase) const
+{
+  // Return the largest memory (bytes) held in vectors and matrices at the end of a call of phase
+  return _peak[phase];
+}
+
+inline
+Bool_t RooUnfoldTiming::Enabled()
+{
+  // Was the instrumentation compiled in? If not (-DNOTIMING), nothing is recorded.
+#ifdef ROOUNFOLD_TIMING
+  return true;
+#else
+  return false;
+#endif
+}
+
+inline
+Long64_t RooUnfoldTiming::Bytes (const TVectorD& v)
+{
+  // Return memory used by the elements of v
+  return Long64_t(v.GetNoElements()) * sizeof(Double_t);
+}
+
+inline
+Long64_t RooUnfoldTiming::Bytes (const TMatrixDBase& m)
+{
+  // Return memory used by the elements of m. For a sparse matrix, these are the non-zero elements.
+  return Long64_t(m.GetNoElements()) * sizeof(Double_t);
+}
+
+inline
+RooUnfoldTimer::RooUnfoldTimer (RooUnfoldTiming& timing, Int_t phase)
+  : _timing(timing), _phase(phase), _bytes(0)
+{
+  // Start timing phase (the TStopwatch starts on construction)
+}
+
+inline
+RooUnfoldTimer::~RooUnfoldTimer()
+{
+  // Add the elapsed time as one call of the phase
+  _sw.Stop();
+  _timing.Add (_phase, _sw.RealTime(), _sw.CpuTime(), _bytes);
+}
+
+inline
+void RooUnfoldTimer::SetBytes (Long64_t bytes)
+{
+  // Set memory held in vectors and matrices by this call, for RooUnfoldTiming::GetPeakBytes
+  _bytes= bytes;
+}
+
+#endif
@@ -0,0 +1,214 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Results of an ensemble of toy MC unfoldings, shared by the
+//      toy-based covariance, RooUnfoldErrors, and RooUnfoldParms.
+//      Partial ensembles (ranges of toys) can be saved and merged.
+//
+//==============================================================================
+
+//____________________________________________________________
+/*! \class RooUnfoldToyEnsemble
+\brief Results of an ensemble of toy MC unfoldings, generated once by RooUnfold::ToyEnsemble() and
+kept with the RooUnfold object.</p>
+<p>The running mean and covariance of the unfolded vectors (RooUnfoldCovAccumulator) are always kept.
+This is all that is needed for the kCovToy covariance matrix, and its memory does not depend on the number of toys.
+Optionally (see Contents), the unfolded vector, errors, and chi^2 of each toy are also kept.
+RooUnfoldErrors only needs the sums of the errors (kErrorSums) and the chi^2 of each toy, so its memory does not
+grow with the number of toys times the number of bins.</p>
+<p>The ensemble is identified by the number of toys, the toy seed, and what was kept, so a later request for
+the same or fewer contents is satisfied without generating the toys again.</p>
+<p>Ensembles generated separately for consecutive ranges of toys (eg. in different threads, or with RooUnfold::RunToys()
+in different jobs, which requires RooUnfold::SetToySeed()) can be combined with Merge(). Partial ensembles can be written to
+ROOT files and merged with hadd or TFileMerger, in any order. The merged ensemble is used with RooUnfold::SetToyEnsemble().</p>
+<p>The mean and covariance are bit-identical however the toys were split, without keeping the unfolded vectors. They are
+accumulated in fixed blocks of kBlockSize toys (toys 0-99, 100-199, ...), each starting from zero, and the blocks are
+combined pairwise (RooUnfoldCovAccumulator::Merge) in block order. An ensemble starting at toy 0 combines each block as it
+is completed. Otherwise, it keeps the moments of each of its complete blocks, and the unfolded vectors of its toys before
+the first block boundary, so that merging can continue the previous ensemble's last block. Splitting on multiples of
+kBlockSize avoids keeping any vectors.</p>
+ */
+/////////////////////////////////////////////////////////////
+
+#include "RooUnfoldToyEnsemble.h"
+
+#include <iostream>
+#include <algorithm>
+
+#include "TCollection.h"
+
+using std::cerr;
+using std::endl;
+
+ClassImp (RooUnfoldToyEnsemble);
+
+void RooUnfoldToyEnsemble::Setup (Int_t n, Int_t ntoys, UInt_t seed, Int_t contents, const TH1* hTrue, Int_t chi2Error, Int_t first)
+{
+  //! Forget all toys, and set up for ntoys toys of size n, starting with toy number first, with the specified seed and Contents flags.
+  //! hTrue and chi2Error are the truth histogram and RooUnfold::ErrorTreatment used for the chi^2 (kChi2).
+  _first=     first;
+  _ntoys=     ntoys;
+  _seed=      seed;
+  _contents=  contents;
+  _hTrue=     (contents & kChi2) ? hTrue     : 0;
+  _chi2Error= (contents & kChi2) ? chi2Error : 0;
+  _entries=   0;
+  std::vector<TVectorD>().swap (_head);
+  std::vector<RooUnfoldCovAccumulator>().swap (_blocks);
+  _tail.Reset (n);
+  _moments.Reset (n);
+  _haveMoments= kTRUE;
+  _timing.Reset();
+  std::vector<TVectorD>().swap (_reco);
+  std::vector<TVectorD>().swap (_err);
+  std::vector<Double_t>().swap (_chi2);
+  if (_contents & kVectors) _reco.reserve (_ntoys);
+  if (_contents & kErrors)  _err .reserve (_ntoys);
+  if (_contents & kChi2)    _chi2.reserve (_ntoys);
+  const Int_t nerr= (_contents & (kErrors|kErrorSums)) ? n : 0;
+  _errSum .ResizeTo (nerr);
+  _errSum2.ResizeTo (nerr);
+  _errSum .Zero();
+  _errSum2.Zero();
+}
+
+void RooUnfoldToyEnsemble::Clear (Option_t*)
+{
+  //! Forget all toys and release their memory
+  Setup (GetSize(), 0, 0);
+}
+
+void RooUnfoldToyEnsemble::Add (const TVectorD& reco, const TVectorD* err, Double_t chi2)
+{
+  //! Add the results of the next toy. err and chi2 are only used with kErrors or kErrorSums, and kChi2.
+  AddMoments (reco);
+  if (_contents & kVectors) _reco.push_back (reco);
+  if (_contents & kErrors)  _err .push_back (err ? *err : TVectorD(GetSize()));
+  if (_contents & kChi2)    _chi2.push_back (chi2);
+  if ((_contents & (kErrors|kErrorSums)) && err) {
+    const Int_t n= _errSum.GetNrows();
+    const Double_t* e= err->GetMatrixArray();
+    Double_t *s= _errSum.GetMatrixArray(), *s2= _errSum2.GetMatrixArray();
+    for (Int_t i= 0; i<n; i++) {
+      s [i] += e[i];
+      s2[i] += e[i]*e[i];
+    }
+  }
+}
+
+void RooUnfoldToyEnsemble::AddMoments (const TVectorD& reco)
+{
+  //! Add the unfolded vector of the next toy to the moments of its block, or keep it if the
+  //! ensemble does not start on a block boundary and it comes before the first one.
+  if (_first+_entries < HeadEnd())
+    _head.push_back (reco);
+  else {
+    _tail.Add (reco);
+    if (_tail.GetEntries() == kBlockSize) {
+      AddBlock (_tail);
+      _tail.Reset();
+    }
+  }
+  _entries++;
+  _haveMoments= kFALSE;
+}
+
+void RooUnfoldToyEnsemble::AddBlock (const RooUnfoldCovAccumulator& block)
+{
+  //! Add the moments of the next complete block. Starting at toy 0, the blocks are combined in order straight away.
+  if (_first==0 && !_blocks.empty())
+    _blocks.front().Merge (block);
+  else
+    _blocks.push_back (block);
+}
+
+const RooUnfoldCovAccumulator& RooUnfoldToyEnsemble::GetMoments() const
+{
+  //! Return running mean and covariance of the unfolded vectors: the toys before the first block boundary,
+  //! the blocks, and the toys after the last boundary, combined in that order.
+  if (_haveMoments) return _moments;
+  _moments.Reset (GetSize());
+  if (!_head.empty()) {
+    RooUnfoldCovAccumulator head (GetSize());
+    for (size_t k= 0; k<_head.size(); k++) head.Add (_head[k]);
+    _moments.Merge (head);
+  }
+  for (size_t b= 0; b<_blocks.size(); b++) _moments.Merge (_blocks[b]);
+  _moments.Merge (_tail);
+  _haveMoments= kTRUE;
+  return _moments;
+}
+
+void RooUnfoldToyEnsemble::Merge (const RooUnfoldToyEnsemble& other)
+{
+  //! Append the toys of another ensemble with the same setup, starting with the toy after our last,
+  //! eg. the next range of toys filled in another thread or job.
+  if (other.GetEntries()==0) return;
+  if (GetEntries()==0 && _ntoys==0)  // not set up yet: take the setup of other
+    Setup (other.GetSize(), 0, other._seed, other._contents, other._hTrue, other._chi2Error, other._first);
+  if (other._contents != _contents || other.GetSize() != GetSize() || other._seed != _seed) {
+    cerr << "RooUnfoldToyEnsemble::Merge: cannot merge ensembles with different setups" << endl;
+    return;
+  }
+  if (other._first != _first+GetEntries()) {
+    cerr << "RooUnfoldToyEnsemble::Merge: toys " << other._first << "-" << other._first+other.GetEntries()-1
+         << " do not follow toys " << _first << "-" << _first+GetEntries()-1 << endl;
+    return;
+  }
+  // Continue our last block with other's toys before its first block boundary, after which we are on a boundary too.
+  for (size_t k= 0; k<other._head.size(); k++) AddMoments (other._head[k]);
+  for (size_t b= 0; b<other._blocks.size(); b++) AddBlock (other._blocks[b]);
+  _tail.Merge (other._tail);
+  _entries += other._entries - Int_t(other._head.size());
+  _haveMoments= kFALSE;
+  if (other._first+other._ntoys > _first+_ntoys) _ntoys= other._first+other._ntoys-_first;
+  _reco.insert (_reco.end(), other._reco.begin(), other._reco.end());
+  _err .insert (_err .end(), other._err .begin(), other._err .end());
+  _chi2.insert (_chi2.end(), other._chi2.begin(), other._chi2.end());
+  _errSum  += other._errSum;
+  _errSum2 += other._errSum2;
+  _timing.Merge (other._timing);
+}
+
+static bool FirstToyLess (const RooUnfoldToyEnsemble* a, const RooUnfoldToyEnsemble* b)
+{
+  return a->GetFirst() < b->GetFirst();
+}
+
+Long64_t RooUnfoldToyEnsemble::Merge (TCollection* others)
+{
+  //! Merge this and all RooUnfoldToyEnsemble objects in the collection, which together should cover a
+  //! consecutive range of toys, in toy order. This allows merging with hadd and TFileMerger.
+  RooUnfoldToyEnsemble self (*this);
+  std::vector<const RooUnfoldToyEnsemble*> parts (1, &self);
+  for (TIter it= others; TObject* o= it();) {
+    if (const RooUnfoldToyEnsemble* other= dynamic_cast<const RooUnfoldToyEnsemble*>(o))
+      parts.push_back (other);
+  }
+  std::stable_sort (parts.begin(), parts.end(), FirstToyLess);
+  Setup (GetSize(), 0, _seed, _contents, _hTrue, _chi2Error, parts.front()->_first);
+  for (size_t i= 0; i<parts.size(); i++) Merge (*parts[i]);
+  return GetEntries();
+}
+
+Bool_t RooUnfoldToyEnsemble::Has (Int_t ntoys, UInt_t seed, Int_t contents, const TH1* hTrue, Int_t chi2Error) const
+{
+  //! Does this ensemble hold ntoys toys generated with seed, keeping at least the specified contents?
+  if (_ntoys<=0 || _first != 0 || ntoys != _ntoys || GetEntries() != _ntoys || seed != _seed) return false;
+  Int_t have= _contents;
+  if (have & kErrors) have |= kErrorSums;  // the sums are kept with the errors
+  if (contents & ~have) return false;
+  if ((contents & kChi2) && (hTrue != _hTrue || chi2Error != _chi2Error)) return false;
+  return true;
+}
+
+Long64_t RooUnfoldToyEnsemble::GetBytes() const
+{
+  //! Memory held in the means, covariances, and toy vectors
+  Long64_t n= Long64_t(_blocks.size()+2) * GetSize() * (GetSize()+2) * sizeof(Double_t);  // as RooUnfoldCovAccumulator
+  n += Long64_t(_head.size() + _reco.size() + _err.size()) * GetSize() * sizeof(Double_t);
+  n += Long64_t(_chi2.size() + 2*_errSum.GetNrows()) * sizeof(Double_t);
+  return n;
+}
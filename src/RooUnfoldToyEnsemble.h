@@ -0,0 +1,246 @@
+//=====================================================================-*-C++-*-
+// File and Version Information:
+//      $Id$
+//
+// Description:
+//      Results of an ensemble of toy MC unfoldings, shared by the
+//      toy-based covariance, RooUnfoldErrors, and RooUnfoldParms.
+//      Partial ensembles (ranges of toys) can be saved and merged.
+//
+//==============================================================================
+
+#ifndef ROOUNFOLDTOYENSEMBLE_HH
+#define ROOUNFOLDTOYENSEMBLE_HH
+
+#include "TNamed.h"
+#include "TVectorD.h"
+#include "TMatrixD.h"
+#include "RooUnfoldCovAccumulator.h"
+#include "RooUnfoldTiming.h"
+#include <vector>
+
+class TH1;
+class TCollection;
+
+class RooUnfoldToyEnsemble : public TNamed {
+
+public:
+
+  enum Contents {  // what is kept for each toy, in addition to the running mean and covariance
+    kMoments= 0,   // only the mean and covariance
+    kVectors= 1,   // each toy's unfolded vector
+    kErrors=  2,   // each toy's errors (RooUnfold::ErecoV(RooUnfold::kErrors))
+    kChi2=    4,   // each toy's chi^2 wrt a truth histogram
+    kErrorSums= 8  // only the sums of the toys' errors and their squares (also kept with kErrors)
+  };
+
+  enum { kBlockSize= 100 };  // number of toys in each block of the running mean and covariance
+
+  RooUnfoldToyEnsemble (Int_t n= 0, const char* name= "toys", const char* title= "Toy MC results"); // empty ensemble of vectors of size n
+  virtual ~RooUnfoldToyEnsemble() {}
+
+  void            Setup (Int_t n, Int_t ntoys, UInt_t seed, Int_t contents= kMoments,
+                         const TH1* hTrue= 0, Int_t chi2Error= 0, Int_t first= 0);  // clear and set what is to be generated
+  virtual void    Clear (Option_t* opt= "");                        // forget all toys
+  void            Add (const TVectorD& reco, const TVectorD* err= 0, Double_t chi2= 0.0);  // add the next toy
+  void            Merge (const RooUnfoldToyEnsemble& other);        // append the toys of another ensemble
+  virtual Long64_t Merge (TCollection* others);                     // merge all, in toy order (for hadd)
+  Bool_t          Has (Int_t ntoys, UInt_t seed, Int_t contents= kMoments,
+                       const TH1* hTrue= 0, Int_t chi2Error= 0) const;  // were these toys generated?
+
+  Int_t           GetSize() const;      // vector size
+  Int_t           GetFirst() const;     // number of the first toy
+  Int_t           GetNToys() const;     // number of toys requested
+  Int_t           GetEntries() const;   // number of toys added
+  UInt_t          GetSeed() const;      // toy seed used (0 = GetRandom())
+  Int_t           GetContents() const;  // Contents flags
+  const TH1*      GetTruth() const;     // truth histogram for chi^2 (not owned)
+  Int_t           GetChi2Error() const; // RooUnfold::ErrorTreatment used for chi^2
+  void            SetTruth (const TH1* hTrue);  // truth histogram used for chi^2, which is not saved in files
+
+  const RooUnfoldCovAccumulator& GetMoments() const;  // running mean and covariance
+  const TVectorD& GetMean() const;                    // mean unfolded vector
+  void            GetCovariance (TMatrixD& cov) const;
+  const TVectorD& GetReco   (Int_t k) const;  // unfolded vector of toy k (kVectors)
+  const TVectorD& GetErrors (Int_t k) const;  // errors of toy k (kErrors)
+  Double_t        GetChi2   (Int_t k) const;  // chi^2 of toy k (kChi2)
+  const TVectorD& GetErrorSum()  const;       // sum of the toys' errors (kErrors or kErrorSums)
+  const TVectorD& GetErrorSum2() const;       // sum of the toys' squared errors (kErrors or kErrorSums)
+  Long64_t        GetBytes() const;           // memory held in the vectors and matrices
+  const RooUnfoldTiming& GetTiming() const;   // time of each toy (not saved in files)
+  RooUnfoldTiming&       Timing();
+
+private:
+
+  void        AddMoments (const TVectorD& reco);                  // add a toy to the blocks
+  void        AddBlock (const RooUnfoldCovAccumulator& block);    // add a complete block
+  Int_t       HeadEnd() const;                                    // first toy number on a block boundary
+
+  Int_t       _first;      // number of the first toy
+  Int_t       _ntoys;      // number of toys requested
+  UInt_t      _seed;       // toy seed
+  Int_t       _contents;   // Contents flags
+  const TH1*  _hTrue;      //! truth histogram for chi^2 (not owned)
+  Int_t       _chi2Error;  // error treatment for chi^2
+  Int_t       _entries;    // number of toys added
+  std::vector<TVectorD>   _head;     // unfolded vectors of the toys before the first block boundary
+  std::vector<RooUnfoldCovAccumulator> _blocks;  // moments of each complete block (starting at toy 0: of all of them)
+  RooUnfoldCovAccumulator _tail;     // moments of the toys after the last block boundary
+  mutable RooUnfoldCovAccumulator _moments;  //! running mean and covariance of all the unfolded vectors
+  mutable Bool_t          _haveMoments;      //! _moments is up to date
+  std::vector<TVectorD>   _reco;     // unfolded vector of each toy
+  std::vector<TVectorD>   _err;      // errors of each toy
+  std::vector<Double_t>   _chi2;     // chi^2 of each toy
+  TVectorD                _errSum;   // sum of the toys' errors
+  TVectorD                _errSum2;  // sum of the toys' squared errors
+  RooUnfoldTiming         _timing;   //! time of each toy
+
+public:
+  ClassDef (RooUnfoldToyEnsemble, 3) // Results of an ensemble of toy MC unfoldings
+};
+
+// Inline method definitions
+
+inline
+RooUnfoldToyEnsemble::RooUnfoldToyEnsemble (Int_t n, const char* name, const char* title)
+  : TNamed (name, title), _first(0), _ntoys(0), _seed(0), _contents(kMoments), _hTrue(0), _chi2Error(0), _entries(0),
+    _tail(n), _moments(n), _haveMoments(kFALSE)
+{
+  // Constructor for an empty ensemble of vectors of size n
+}
+
+inline
+Int_t RooUnfoldToyEnsemble::HeadEnd() const
+{
+  // Number of the first toy on a block boundary, at or after the first toy
+  return ((_first+kBlockSize-1)/kBlockSize)*kBlockSize;
+}
+
+inline
+Int_t RooUnfoldToyEnsemble::GetSize() const
+{
+  // Return vector size
+  return _tail.GetSize();
+}
+
+inline
+Int_t RooUnfoldToyEnsemble::GetFirst() const
+{
+  // Return number of the first toy: the ensemble holds toys GetFirst() to GetFirst()+GetEntries()-1
+  return _first;
+}
+
+inline
+Int_t RooUnfoldToyEnsemble::GetNToys() const
+{
+  // Return number of toys requested in Setup(), or covered by merged ensembles
+  return _ntoys;
+}
+
+inline
+Int_t RooUnfoldToyEnsemble::GetEntries() const
+{
+  // Return number of toys added
+  return _entries;
+}
+
+inline
+UInt_t RooUnfoldToyEnsemble::GetSeed() const
+{
+  // Return toy seed (see RooUnfold::SetToySeed)
+  return _seed;
+}
+
+inline
+Int_t RooUnfoldToyEnsemble::GetContents() const
+{
+  // Return Contents flags: what is kept for each toy
+  return _contents;
+}
+
+inline
+const TH1* RooUnfoldToyEnsemble::GetTruth() const
+{
+  // Return truth histogram used for the chi^2 (kChi2)
+  return _hTrue;
+}
+
+inline
+Int_t RooUnfoldToyEnsemble::GetChi2Error() const
+{
+  // Return RooUnfold::ErrorTreatment used for the chi^2 (kChi2)
+  return _chi2Error;
+}
+
+inline
+void RooUnfoldToyEnsemble::SetTruth (const TH1* hTrue)
+{
+  // Set the truth histogram used for the chi^2 (kChi2), eg. after reading the ensemble from a file.
+  // It is only used to check that a later chi^2 request is for the same histogram.
+  _hTrue= hTrue;
+}
+
+inline
+const TVectorD& RooUnfoldToyEnsemble::GetMean() const
+{
+  // Return mean of the unfolded vectors
+  return GetMoments().GetMean();
+}
+
+inline
+void RooUnfoldToyEnsemble::GetCovariance (TMatrixD& cov) const
+{
+  // Get covariance matrix of the unfolded vectors
+  GetMoments().GetCovariance (cov);
+}
+
+inline
+const TVectorD& RooUnfoldToyEnsemble::GetReco (Int_t k) const
+{
+  // Return unfolded vector of toy k. Only available with kVectors.
+  return _reco[k];
+}
+
+inline
+const TVectorD& RooUnfoldToyEnsemble::GetErrors (Int_t k) const
+{
+  // Return errors of toy k. Only available with kErrors.
+  return _err[k];
+}
+
+inline
+Double_t RooUnfoldToyEnsemble::GetChi2 (Int_t k) const
+{
+  // Return chi^2 of toy k. Only available with kChi2.
+  return _chi2[k];
+}
+
+inline
+const TVectorD& RooUnfoldToyEnsemble::GetErrorSum() const
+{
+  // Return sum over the toys of each bin's error. Only available with kErrors or kErrorSums.
+  return _errSum;
+}
+
+inline
+const TVectorD& RooUnfoldToyEnsemble::GetErrorSum2() const
+{
+  // Return sum over the toys of each bin's squared error. Only available with kErrors or kErrorSums.
+  return _errSum2;
+}
+
+inline
+const RooUnfoldTiming& RooUnfoldToyEnsemble::GetTiming() const
+{
+  // Return time of each toy and its RunToy() (RooUnfoldTiming::kToy and kRunToy) filled by RooUnfold
+  return _timing;
+}
+
+inline
+RooUnfoldTiming& RooUnfoldToyEnsemble::Timing()
+{
+  // Return time of each toy, for RooUnfold to fill
+  return _timing;
+}
+
+#endif
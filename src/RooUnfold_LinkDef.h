@@ -9,16 +9,22 @@
 #pragma link C++ class RooUnfoldSvd-;
 #pragma link C++ class RooUnfoldBinByBin+;
 #pragma link C++ class RooUnfoldResponse-;
+#pragma link C++ class RooUnfoldResponseFiller+;
+#pragma link C++ class RooUnfoldBootstrap+;
+#pragma link C++ class RooUnfoldAxisLookup+;
+#pragma link C++ class RooUnfoldBinLookup+;
 #pragma link C++ class RooUnfoldErrors+;
 #pragma link C++ class RooUnfoldParms+;
 #pragma link C++ class RooUnfoldInvert+;
 #ifndef NOTUNFOLD
 #pragma link C++ class RooUnfoldTUnfold+;
 #endif
-#ifdef HAVE_DAGOSTINI
 #pragma link C++ class RooUnfoldDagostini+;
-#endif
 #pragma link C++ class RooUnfoldIds-;
+#pragma link C++ class RooUnfoldCovAccumulator+;
+#pragma link C++ class RooUnfoldToyEnsemble+;
+#pragma link C++ class RooUnfoldTiming+;
+#pragma link C++ class RooUnfoldMatrixFactor+;
 #if !defined(HAVE_TSVDUNFOLD) || HAVE_TSVDUNFOLD
 #pragma link C++ class TSVDUnfold_130729+;
 #endif
@@ -51,6 +51,8 @@ TH1D* unfresult = tsvdunf->Unfold( kreg );
 </pre>
 where <tt>kreg</tt> determines the regularisation of the unfolding. In general, overregularisation (too small <tt>kreg</tt>) will bias the unfolded spectrum towards the Monte Carlo input, while underregularisation (too large <tt>kreg</tt>) will lead to large fluctuations in the unfolded spectrum. The optimal regularisation can be determined following guidelines in <a href="http://arXiv.org/abs/hep-ph/9509307">Nucl. Instrum. Meth. A372, 469 (1996) [hep-ph/9509307]</a> using the distribution of the <tt>|d_i|</tt> that can be obtained by <tt>tsvdunf->GetD()</tt> and/or using pseudo-experiments.
 <p>
+The inputs can also be given as vectors and matrices, <tt>new TSVDUnfold( vbdat, mBcov, vxini, mAdet )</tt>, which are used in place, without making any histograms. The unfolded spectrum is then obtained with <tt>UnfoldV( kreg )</tt>, and the covariance matrices with <tt>GetXtauMatrix()</tt>, <tt>GetXinvMatrix()</tt>, <tt>GetUnfoldCov</tt>, and <tt>GetAdetCov</tt>.
+<p>
 Covariance matrices on the measured spectrum (for either the total uncertainties or individual sources of uncertainties) can be propagated to covariance matrices using the <tt>GetUnfoldCovMatrix</tt> method, which uses pseudo experiments for the propagation. In addition, <tt>GetAdetCovMatrix</tt> allows for the propagation of the statistical uncertainties on the response matrix using pseudo experiments. The covariance matrix corresponding to <tt>Bcov</tt> is also computed as described in <a href="http://arXiv.org/abs/hep-ph/9509307">Nucl. Instrum. Meth. A372, 469 (1996) [hep-ph/9509307]</a> and can be obtained from <tt>tsvdunf->GetXtau()</tt> and its (regularisation independent) inverse from  <tt>tsvdunf->GetXinv()</tt>. The distribution of singular values can be retrieved using <tt>tsvdunf->GetSV()</tt>.
 <p>
 See also the tutorial for a toy example.
@@ -59,8 +61,12 @@ See also the tutorial for a toy example.
 
 
 #include <iostream>
+#include <vector>
 
 #include "TSVDUnfold_local.h"
+#include "RooUnfoldCovAccumulator.h"
+#include "RooUnfoldThreads.h"
+#include "TROOT.h"
 #include "TH1D.h"
 #include "TH2D.h"
 #include "TDecompSVD.h"
@@ -86,10 +92,15 @@ TSVDUnfold::TSVDUnfold( const TH1D *bdat, const TH1D *bini, const TH1D *xini, co
     fBini       (bini),
     fXini       (xini),
     fAdet       (Adet),
-    fToyhisto   (NULL),
-    fToymat     (NULL),
-    fToyMode    (kFALSE),
-    fMatToyMode (kFALSE)
+    fVbdat      (&fHbdat),
+    fMBcov      (&fHBcov),
+    fVxini      (&fHxini),
+    fMAdet      (&fHAdet),
+    fDecomp     (NULL),
+    fScale      (1.0),
+    fHaveXtau   (kFALSE),
+    fHaveXinv   (kFALSE),
+    fNThreads   (1)
 {
   //! Alternative constructor
   //! User provides data and MC test spectra, as well as detector response matrix, diagonal covariance matrix of measured spectrum built from the uncertainties on measured spectrum
@@ -138,10 +149,15 @@ TSVDUnfold::TSVDUnfold( const TH1D *bdat, TH2D* Bcov, const TH1D *bini, const TH
      fBini       (bini),
      fXini       (xini),
      fAdet       (Adet), 
-     fToyhisto   (NULL),
-     fToymat     (NULL),
-     fToyMode    (kFALSE),
-     fMatToyMode (kFALSE) 
+     fVbdat      (&fHbdat),
+     fMBcov      (&fHBcov),
+     fVxini      (&fHxini),
+     fMAdet      (&fHAdet),
+     fDecomp     (NULL),
+     fScale      (1.0),
+     fHaveXtau   (kFALSE),
+     fHaveXinv   (kFALSE),
+     fNThreads   (1)
 {
    //! Default constructor
    // Initialisation of TSVDUnfold
@@ -168,6 +184,53 @@ TSVDUnfold::TSVDUnfold( const TH1D *bdat, TH2D* Bcov, const TH1D *bini, const TH
    fDdim = 2; // This is the derivative used to compute the curvature matrix
 }
 
+//_______________________________________________________________________
+TSVDUnfold::TSVDUnfold( const TVectorD& bdat, const TMatrixD& Bcov, const TVectorD& xini, const TMatrixD& Adet )
+   : TObject     (),
+     fNdim       (0),
+     fDdim       (2),
+     fNormalize  (kFALSE),
+     fKReg       (-1),
+     fDHist      (NULL),
+     fSVHist     (NULL),
+     fXtau       (NULL),
+     fXinv       (NULL),
+     fBdat       (NULL),
+     fBcov       (NULL),
+     fBini       (NULL),
+     fXini       (NULL),
+     fAdet       (NULL),
+     fVbdat      (&bdat),
+     fMBcov      (&Bcov),
+     fVxini      (&xini),
+     fMAdet      (&Adet),
+     fDecomp     (NULL),
+     fScale      (1.0),
+     fHaveXtau   (kFALSE),
+     fHaveXinv   (kFALSE),
+     fNThreads   (1)
+{
+   //! Constructor with the inputs as vectors and matrices, which are used without copying or
+   //! making any histograms. The output histograms are only made if requested.
+   if (bdat.GetNrows() != xini.GetNrows() ||
+       bdat.GetNrows() != Bcov.GetNrows() ||
+       bdat.GetNrows() != Bcov.GetNcols() ||
+       bdat.GetNrows() != Adet.GetNrows() ||
+       bdat.GetNrows() != Adet.GetNcols()) {
+      TString msg = "All vectors and matrices must have equal dimension.\n";
+      msg += Form( "  Found: dim(bdat)=%i\n",    bdat.GetNrows() );
+      msg += Form( "  Found: dim(Bcov)=%i,%i\n", Bcov.GetNrows(), Bcov.GetNcols() );
+      msg += Form( "  Found: dim(xini)=%i\n",    xini.GetNrows() );
+      msg += Form( "  Found: dim(Adet)=%i,%i\n", Adet.GetNrows(), Adet.GetNcols() );
+      msg += "Please start again!";
+
+      Fatal( "Init", msg, "%s" );
+   }
+
+   fNdim = bdat.GetNrows();
+   fDdim = 2; // This is the derivative used to compute the curvature matrix
+}
+
 //_______________________________________________________________________
 TSVDUnfold::TSVDUnfold( const TSVDUnfold& other )
    : TObject     ( other ),
@@ -175,37 +238,41 @@ TSVDUnfold::TSVDUnfold( const TSVDUnfold& other )
      fDdim       (other.fDdim),
      fNormalize  (other.fNormalize),
      fKReg       (other.fKReg),
-     fDHist      (other.fDHist),
-     fSVHist     (other.fSVHist),
-     fXtau       (other.fXtau),
-     fXinv       (other.fXinv),
+     fDHist      (NULL),
+     fSVHist     (NULL),
+     fXtau       (NULL),
+     fXinv       (NULL),
      fBdat       (other.fBdat),
      fBcov       (other.fBcov),
      fBini       (other.fBini),
      fXini       (other.fXini),
      fAdet       (other.fAdet),
-     fToyhisto   (other.fToyhisto),
-     fToymat     (other.fToymat),
-     fToyMode    (other.fToyMode),
-     fMatToyMode (other.fMatToyMode) 
+     fVbdat      (other.fBdat ? &fHbdat : other.fVbdat),
+     fMBcov      (other.fBdat ? &fHBcov : other.fMBcov),
+     fVxini      (other.fBdat ? &fHxini : other.fVxini),
+     fMAdet      (other.fBdat ? &fHAdet : other.fMAdet),
+     fHbdat      (other.fHbdat),
+     fHBcov      (other.fHBcov),
+     fHxini      (other.fHxini),
+     fHAdet      (other.fHAdet),
+     fVx         (other.fVx),
+     fVd         (other.fVd),
+     fXtauM      (other.fXtauM),
+     fXinvM      (other.fXinvM),
+     fDecomp     (other.fDecomp ? new Decomposition(*other.fDecomp) : NULL),
+     fZ          (other.fZ),
+     fScale      (other.fScale),
+     fHaveXtau   (other.fHaveXtau),
+     fHaveXinv   (other.fHaveXinv),
+     fNThreads   (other.fNThreads)
 {
-   //! Copy constructor
+   //! Copy constructor. The output histograms are made again when requested.
 }
 
 //_______________________________________________________________________
 TSVDUnfold::~TSVDUnfold()
 {
    //! Destructor
-   if(fToyhisto){
-      delete fToyhisto;
-      fToyhisto = 0;
-   }
-   
-   if(fToymat){
-      delete fToymat;
-      fToymat = 0;
-   }
-
    if(fDHist){
       delete fDHist;
       fDHist = 0;
@@ -230,125 +297,177 @@ TSVDUnfold::~TSVDUnfold()
       delete fBcov;
       fBcov = 0;
    }
+
+   delete fDecomp;
+   fDecomp = 0;
 }
 
 //_______________________________________________________________________
-TH1D* TSVDUnfold::Unfold( Int_t kreg )
+void TSVDUnfold::LoadInputs( )
 {
-   //! Perform the unfolding with regularisation parameter kreg
-   fKReg = kreg;
-   
-   // Make the histos
-   if (!fToyMode && !fMatToyMode) InitHistos( );
-
-   // Create vectors and matrices
-   TVectorD vb(fNdim), vbini(fNdim), vxini(fNdim), vberr(fNdim);
-   TMatrixD mB(fNdim, fNdim), mA(fNdim, fNdim), mCurv(fNdim, fNdim), mC(fNdim, fNdim);
-
-   Double_t eps = 1e-12;
-   Double_t sreg;
-
-   // Copy histogams entries into vector
-   if (fToyMode) { H2V( fToyhisto, vb ); H2Verr( fToyhisto, vberr ); }
-   else          { H2V( fBdat,     vb ); H2Verr( fBdat,     vberr ); }
+   //! With the histogram constructors, copy the input histograms into the vectors and matrices used
+   //! for the unfolding. The measured distribution is copied each time, the others only until the
+   //! decomposition has been done.
+   if (!fBdat) return;
+   fHbdat.ResizeTo(fNdim);
+   H2V( fBdat, fHbdat );
+   if (fDecomp) return;
+   fHBcov.ResizeTo(fNdim, fNdim);
+   fHxini.ResizeTo(fNdim);
+   fHAdet.ResizeTo(fNdim, fNdim);
+   H2M( fBcov, fHBcov );
+   H2V( fXini, fHxini );
+   H2M( fAdet, fHAdet );
+}
 
-   H2M( fBcov, mB);
-   H2V( fBini, vbini );
-   H2V( fXini, vxini );
-   if (fMatToyMode) H2M( fToymat, mA );
-   else        H2M( fAdet,   mA );
+//_______________________________________________________________________
+void TSVDUnfold::InitDecomposition( )
+{
+   //! Load the inputs and, if not already done, decompose the detector response matrix
+   LoadInputs();
+   if (fDecomp) return;
+   fDecomp = new Decomposition;
+   Decompose( *fMAdet, *fDecomp );
+}
 
-   // Fill and invert the second derivative matrix
-   FillCurvatureMatrix( mCurv, mC );
+//_______________________________________________________________________
+TH1D* TSVDUnfold::Unfold( Int_t kreg )
+{
+   //! Perform the unfolding with regularisation parameter kreg
+   //! The decomposition of the detector response matrix does not depend on kreg, so it is only
+   //! done on the first call.
+   const TVectorD& vx = UnfoldV( kreg );
+
+   TH1D* h;
+   if (fBdat) {
+      h = (TH1D*)fBdat->Clone("unfoldingresult");
+      for(int i=1; i<=fNdim; i++){
+         h->SetBinContent(i,0.);
+         h->SetBinError(i,0.);
+      }
+   } else {
+      h = new TH1D( "unfoldingresult", "", fNdim, 0, fNdim );
+   }
+   V2H( vx, *h );
 
-   // Inversion of mC by help of SVD
-   TDecompSVD CSVD(mC);
-   TMatrixD CUort = CSVD.GetU();
-   TMatrixD CVort = CSVD.GetV();
-   TVectorD CSV   = CSVD.GetSig();
+   return h;
+}
 
-   TMatrixD CSVM(fNdim, fNdim);
-   for (Int_t i=0; i<fNdim; i++) CSVM(i,i) = 1/CSV(i);
+//_______________________________________________________________________
+const TVectorD& TSVDUnfold::UnfoldV( Int_t kreg )
+{
+   //! Perform the unfolding with regularisation parameter kreg, returning the unfolded distribution.
+   //! No histograms are made: the distributions of d and of the singular values, and the covariance
+   //! matrices, are only converted to histograms by GetD(), GetSV(), GetXtau(), and GetXinv().
+   fKReg = kreg;
 
-   CUort.Transpose( CUort );
-   TMatrixD mCinv = (CVort*CSVM)*CUort;
+   InitDecomposition();
+   const Decomposition* dec = fDecomp;
+
+   // Rescaling, rotation and damping for kreg
+   fVx.ResizeTo(fNdim);
+   fVd.ResizeTo(fNdim);
+   TVectorD vdz(fNdim), vw(fNdim);
+   Double_t scale = Solve( *dec, *fVbdat, GetKReg(), fVx, fVd, vdz, vw );
+
+   // The regularised covariance matrix is only calculated when requested with GetXtau()
+   fZ.ResizeTo(fNdim, fNdim);
+   fZ.Zero();
+   for (Int_t i=0; i<fNdim; i++) fZ(i,i) = vdz(i)*vdz(i);
+   fScale = scale;
+   fHaveXtau = kFALSE;
+   fHaveXinv = kFALSE;
+   
+   // Get Curvature and also chi2 in case of MC unfolding
+   Info( "Unfold", "Unfolding param: %i",GetKReg() );
+   Info( "Unfold", "Curvature of weight distribution: %f", GetCurvature( vw, dec->mCurv ) );
 
-   //Rescale using the data covariance matrix
-   TDecompSVD BSVD( mB );
-   TMatrixD QT = BSVD.GetU();
-   QT.Transpose(QT);
-   TVectorD B2SV = BSVD.GetSig();
-   TVectorD BSV(B2SV);
+   return fVx;
+}
 
-   for(int i=0; i<fNdim; i++){
-     BSV(i) = TMath::Sqrt(B2SV(i));
+//_______________________________________________________________________
+void TSVDUnfold::Decompose( const TMatrixD& mAdet, Decomposition& dec, const Decomposition* base ) const
+{
+   //! Regularisation-independent part of the unfolding for detector response matrix mAdet:
+   //! rescaling with the data covariance matrix and singular value decomposition of A*C^-1.
+   //! If base is given, its parts that do not depend on mAdet are copied rather than recalculated,
+   //! and the inverse covariance matrix is not calculated (as needed for toy response matrices).
+   if (base) {
+      dec.mCinv.ResizeTo(fNdim, fNdim);  dec.mCinv = base->mCinv;
+      dec.QT   .ResizeTo(fNdim, fNdim);  dec.QT    = base->QT;
+      dec.BSV  .ResizeTo(fNdim);         dec.BSV   = base->BSV;
+      dec.vxini.ResizeTo(fNdim);         dec.vxini = base->vxini;
+   } else {
+      const TMatrixD& mB = *fMBcov;
+      TMatrixD mC(fNdim, fNdim);
+      dec.mCurv.ResizeTo(fNdim, fNdim);
+      dec.vxini.ResizeTo(fNdim);
+      dec.vxini = *fVxini;
+
+      // Fill and invert the second derivative matrix
+      FillCurvatureMatrix( dec.mCurv, mC );
+
+      // Inversion of mC by help of SVD
+      TDecompSVD CSVD(mC);
+      TMatrixD CUort = CSVD.GetU();
+      TMatrixD CVort = CSVD.GetV();
+      TVectorD CSV   = CSVD.GetSig();
+
+      TMatrixD CSVM(fNdim, fNdim);
+      for (Int_t i=0; i<fNdim; i++) CSVM(i,i) = 1/CSV(i);
+
+      CUort.Transpose( CUort );
+      dec.mCinv.ResizeTo(fNdim, fNdim);
+      dec.mCinv = (CVort*CSVM)*CUort;
+
+      //Rescale using the data covariance matrix
+      TDecompSVD BSVD( mB );
+      dec.QT.ResizeTo(fNdim, fNdim);
+      dec.QT = BSVD.GetU();
+      dec.QT.Transpose(dec.QT);
+      TVectorD B2SV = BSVD.GetSig();
+      dec.BSV.ResizeTo(fNdim);
+      for(int i=0; i<fNdim; i++){
+        dec.BSV(i) = TMath::Sqrt(B2SV(i));
+      }
    }
-   TMatrixD mAtmp(fNdim,fNdim);
-   TVectorD vbtmp(fNdim);
-   mAtmp *= 0;
-   vbtmp *= 0;
+   const TMatrixD& mCinv = dec.mCinv;
+   const TMatrixD& QT    = dec.QT;
+   const TVectorD& BSV   = dec.BSV;
+   const TVectorD& vxini = dec.vxini;
+
+   TMatrixD& mA = dec.mA;
+   mA.ResizeTo(fNdim, fNdim);
+   mA *= 0;
    for(int i=0; i<fNdim; i++){
      for(int j=0; j<fNdim; j++){
-       if(BSV(i)){
-  	 vbtmp(i) += QT(i,j)*vb(j)/BSV(i);
-       }
        for(int m=0; m<fNdim; m++){
  	 if(BSV(i)){
- 	   mAtmp(i,j) += QT(i,m)*mA(m,j)/BSV(i);
+ 	   mA(i,j) += QT(i,m)*mAdet(m,j)/BSV(i);
  	 }
        }
      }
    }
-   mA = mAtmp;
-   vb = vbtmp;
 
    // Singular value decomposition and matrix operations
    TDecompSVD ASVD( mA*mCinv );
-   TMatrixD Uort = ASVD.GetU();
+   dec.UortT.ResizeTo(fNdim, fNdim);
+   dec.VortT.ResizeTo(fNdim, fNdim);
+   dec.ASV.ResizeTo(fNdim);
+   dec.Vreg.ResizeTo(fNdim, fNdim);
+   dec.UortT = ASVD.GetU();
+   dec.UortT.Transpose(dec.UortT);
    TMatrixD Vort = ASVD.GetV();
-   TVectorD ASV  = ASVD.GetSig();
-
-   if (!fToyMode && !fMatToyMode) {
-      V2H(ASV, *fSVHist);
-   }
-
-   TMatrixD Vreg = mCinv*Vort;
-
-   Uort.Transpose(Uort);
-   TVectorD vd    = Uort*vb;
-
-   if (!fToyMode && !fMatToyMode) {
-      V2H(vd, *fDHist);
-   }
-
-   // Damping coefficient
-   Int_t k = GetKReg()-1; 
+   dec.ASV   = ASVD.GetSig();
+   dec.Vreg  = mCinv*Vort;
+   dec.VortT.Transpose(Vort);
 
-   TVectorD vx(fNdim); // Return variable
-
-   // Damping factors
-   TVectorD vdz(fNdim);
-   TMatrixD Z(fNdim, fNdim);
-   for (Int_t i=0; i<fNdim; i++) {
-     if (ASV(i)<ASV(0)*eps) sreg = ASV(0)*eps;
-     else                   sreg = ASV(i);
-     vdz(i) = sreg/(sreg*sreg + ASV(k)*ASV(k));
-     Z(i,i) = vdz(i)*vdz(i);
-   }
-   TVectorD vz = CompProd( vd, vdz );
-   
-   TMatrixD VortT(Vort);
-   VortT.Transpose(VortT);
-   TMatrixD W = mCinv*Vort*Z*VortT*mCinv;
-
-   TMatrixD Xtau(fNdim, fNdim);
-   TMatrixD Xinv(fNdim, fNdim);
-   Xtau *= 0;
+   if (base) return;
+   TMatrixD& Xinv = dec.Xinv;
+   Xinv.ResizeTo(fNdim, fNdim);
    Xinv *= 0;
    for (Int_t i=0; i<fNdim; i++) {
      for (Int_t j=0; j<fNdim; j++) {
-       Xtau(i,j) =  vxini(i) * vxini(j) * W(i,j);
-
        double a=0;
        for (Int_t m=0; m<fNdim; m++) {
          a += mA(m,i)*mA(m,j);
@@ -357,41 +476,87 @@ TH1D* TSVDUnfold::Unfold( Int_t kreg )
          Xinv(i,j) = a/vxini(i)/vxini(j);
      }
    }
+}
+
+//_______________________________________________________________________
+Double_t TSVDUnfold::Solve( const Decomposition& dec, const TVectorD& vb, Int_t kreg,
+                            TVectorD& vx, TVectorD& vd, TVectorD& vdz, TVectorD& vw ) const
+{
+   //! Regularisation-dependent part of the unfolding of measured distribution vb.
+   //! Fills vx with the unfolded distribution, vd with the rotated data, vdz with the
+   //! damping factors and vw with the weights, and returns the normalisation of vx
+   //! (1 unless SetNormalize is used). Only the arguments are modified and no memory is
+   //! allocated, so this can be used for the pseudo experiments in several threads.
+   const Int_t n = fNdim;
+   const TVectorD& ASV = dec.ASV;
+   Double_t eps = 1e-12;
+   Double_t sreg;
+
+   // Rescale using the data covariance matrix (using vx as workspace)
+   for(int i=0; i<n; i++){
+     Double_t v = 0;
+     if(dec.BSV(i)){
+       for(int j=0; j<n; j++){
+         v += dec.QT(i,j)*vb(j)/dec.BSV(i);
+       }
+     }
+     vx(i) = v;
+   }
+
+   // Rotate into the singular vector basis
+   for(int i=0; i<n; i++){
+     Double_t v = 0;
+     for(int j=0; j<n; j++) v += dec.UortT(i,j)*vx(j);
+     vd(i) = v;
+   }
+
+   // Damping factors
+   Int_t k = kreg-1;
+   for (Int_t i=0; i<n; i++) {
+     if (ASV(i)<ASV(0)*eps) sreg = ASV(0)*eps;
+     else                   sreg = ASV(i);
+     vdz(i) = sreg/(sreg*sreg + ASV(k)*ASV(k));
+     vx(i)  = vd(i)*vdz(i);
+   }
 
    // Compute the weights
-   TVectorD vw = Vreg*vz;
+   for(int i=0; i<n; i++){
+     Double_t v = 0;
+     for(int j=0; j<n; j++) v += dec.Vreg(i,j)*vx(j);
+     vw(i) = v;
+   }
 
    // Rescale by xini
-   vx = CompProd( vw, vxini );
-   
+   for (Int_t i=0; i<n; i++) vx(i) = vw(i) * dec.vxini(i);
+
+   Double_t scale = 1.0;
    if(fNormalize){ // Scale result to unit area
-     Double_t scale = vx.Sum();
-     if (scale > 0){
+     Double_t sum = vx.Sum();
+     if (sum > 0){
+       scale = sum;
        vx *= 1.0/scale;
-       Xtau *= 1./scale/scale;
-       Xinv *= scale*scale;
      }
    }
+   return scale;
+}
 
-   if (!fToyMode && !fMatToyMode) {
-      M2H(Xtau, *fXtau);
-      M2H(Xinv, *fXinv);
-   }
-   
-   // Get Curvature and also chi2 in case of MC unfolding
-   if (!fToyMode && !fMatToyMode) {
-     Info( "Unfold", "Unfolding param: %i",k+1 );
-     Info( "Unfold", "Curvature of weight distribution: %f", GetCurvature( vw, mCurv ) );
-   }
+//_______________________________________________________________________
+void TSVDUnfold::ComputeXtau( ) const
+{
+   //! Fill fXtauM with the regularised covariance matrix for the damping factors of the last unfolding
+   if (fHaveXtau || !fDecomp || fZ.GetNrows() != fNdim) return;
+   const Decomposition& dec = *fDecomp;
+   TMatrixD W = dec.Vreg*fZ*dec.VortT*dec.mCinv;
 
-   TH1D* h = (TH1D*)fBdat->Clone("unfoldingresult");
-   for(int i=1; i<=fNdim; i++){
-      h->SetBinContent(i,0.);
-      h->SetBinError(i,0.);
+   fXtauM.ResizeTo(fNdim, fNdim);
+   for (Int_t i=0; i<fNdim; i++) {
+     for (Int_t j=0; j<fNdim; j++) {
+       fXtauM(i,j) =  dec.vxini(i) * dec.vxini(j) * W(i,j);
+     }
    }
-   V2H( vx, *h );
+   if (fScale != 1.0) fXtauM *= 1./fScale/fScale;
 
-   return h;
+   fHaveXtau = kTRUE;
 }
 
 //_______________________________________________________________________
@@ -403,103 +568,52 @@ TH2D* TSVDUnfold::GetUnfoldCovMatrix( const TH2D* cov, Int_t ntoys, Int_t seed )
    //! "ntoys"  - number of pseudo experiments used for the propagation
    //! "seed"   - seed for pseudo experiments
    //! Note that this covariance matrix will contain effects of forced normalisation if spectrum is normalised to unit area. 
+   TMatrixD mcov(fNdim, fNdim), toycov;
+   H2M( cov, mcov );
+   GetUnfoldCov( mcov, toycov, ntoys, seed );
+
+   TH2D* unfcov = NewHist2D("unfcovmat", "Toy covariance matrix");
+   M2H( toycov, *unfcov );
+   return unfcov;
+}
+
+//_______________________________________________________________________
+void TSVDUnfold::GetUnfoldCov( const TMatrixD& cov, TMatrixD& unfcov, Int_t ntoys, Int_t seed )
+{
+   //! As GetUnfoldCovMatrix, with the covariance matrices as TMatrixD
+   InitDecomposition();
+
+   ToySetup ts;
+   ts.matToys = kFALSE;
+   ts.ntoys   = ntoys;
+   ts.poisson = kFALSE;
+   ts.vb.ResizeTo(fNdim);
+   ts.vb = *fVbdat;
 
-   fToyMode = true;
-   TH1D* unfres = 0;
-   TH2D* unfcov = (TH2D*)fAdet->Clone("unfcovmat");
-   unfcov->SetTitle("Toy covariance matrix");
-   for(int i=1; i<=fNdim; i++)
-      for(int j=1; j<=fNdim; j++)
-         unfcov->SetBinContent(i,j,0.);
-  
    // Code for generation of toys (taken from RooResult and modified)
    // Calculate the elements of the upper-triangular matrix L that
    // gives Lt*L = C, where Lt is the transpose of L (the "square-root method")  
-   TMatrixD L(fNdim,fNdim); L *= 0;
+   TMatrixD& L = ts.L;
+   L.ResizeTo(fNdim,fNdim); L *= 0;
 
    for (Int_t iPar= 0; iPar < fNdim; iPar++) {
 
       // Calculate the diagonal term first
-      L(iPar,iPar) = cov->GetBinContent(iPar+1,iPar+1);
+      L(iPar,iPar) = cov(iPar,iPar);
       for (Int_t k=0; k<iPar; k++) L(iPar,iPar) -= TMath::Power( L(k,iPar), 2 );
       if (L(iPar,iPar) > 0.0) L(iPar,iPar) = TMath::Sqrt(L(iPar,iPar));
       else                    L(iPar,iPar) = 0.0;
 
       // ...then the off-diagonal terms
       for (Int_t jPar=iPar+1; jPar<fNdim; jPar++) {
-         L(iPar,jPar) = cov->GetBinContent(iPar+1,jPar+1);
+         L(iPar,jPar) = cov(iPar,jPar);
          for (Int_t k=0; k<iPar; k++) L(iPar,jPar) -= L(k,iPar)*L(k,jPar);
          if (L(iPar,iPar)!=0.) L(iPar,jPar) /= L(iPar,iPar);
          else                  L(iPar,jPar) = 0;
       }
    }
 
-   // Remember it
-   TMatrixD *Lt = new TMatrixD(TMatrixD::kTransposed,L);
-   TRandom3 random(seed);
-
-   fToyhisto = (TH1D*)fBdat->Clone("toyhisto");
-   TH1D *toymean = (TH1D*)fBdat->Clone("toymean");
-   for (Int_t j=1; j<=fNdim; j++) toymean->SetBinContent(j,0.);
-
-   // Get the mean of the toys first
-   for (int i=1; i<=ntoys; i++) {
-
-      // create a vector of unit Gaussian variables
-      TVectorD g(fNdim);
-      for (Int_t k= 0; k < fNdim; k++) g(k) = random.Gaus(0.,1.);
-
-      // Multiply this vector by Lt to introduce the appropriate correlations
-      g *= (*Lt);
-
-      // Add the mean value offsets and store the results
-      for (int j=1; j<=fNdim; j++) {
-         fToyhisto->SetBinContent(j,fBdat->GetBinContent(j)+g(j-1));
-         fToyhisto->SetBinError(j,fBdat->GetBinError(j));
-      }
-
-      unfres = Unfold(GetKReg());
-
-      for (Int_t j=1; j<=fNdim; j++) {
-         toymean->SetBinContent(j, toymean->GetBinContent(j) + unfres->GetBinContent(j)/ntoys);
-      }
-      delete unfres;
-      unfres = 0;
-   }
-
-   // Reset the random seed
-   random.SetSeed(seed);
-
-   //Now the toys for the covariance matrix
-   for (int i=1; i<=ntoys; i++) {
-
-      // Create a vector of unit Gaussian variables
-      TVectorD g(fNdim);
-      for (Int_t k= 0; k < fNdim; k++) g(k) = random.Gaus(0.,1.);
-
-      // Multiply this vector by Lt to introduce the appropriate correlations
-      g *= (*Lt);
-
-      // Add the mean value offsets and store the results
-      for (int j=1; j<=fNdim; j++) {
-         fToyhisto->SetBinContent( j, fBdat->GetBinContent(j)+g(j-1) );
-         fToyhisto->SetBinError  ( j, fBdat->GetBinError(j) );
-      }
-      unfres = Unfold(GetKReg());
-
-      for (Int_t j=1; j<=fNdim; j++) {
-         for (Int_t k=1; k<=fNdim; k++) {
-            unfcov->SetBinContent(j,k,unfcov->GetBinContent(j,k) + ( (unfres->GetBinContent(j) - toymean->GetBinContent(j))* (unfres->GetBinContent(k) - toymean->GetBinContent(k))/(ntoys-1)) );
-         }
-      }
-      delete unfres;
-      unfres = 0;
-   }
-   delete Lt;
-   delete toymean;
-   fToyMode = kFALSE;
-   
-   return unfcov;
+   CovToys( ts, seed, unfcov );
 }
 
 //_______________________________________________________________________
@@ -519,85 +633,150 @@ TH2D* TSVDUnfold::GetAdetCovMatrix( Int_t ntoys, Int_t seed, const TH2D* uncmat
       Fatal( "GetAdetCovMatrix", msg, "%s" );
     }
 
+   TMatrixD mAerr, toycov;
+   if (uncmat) {
+      mAerr.ResizeTo(fNdim,fNdim);
+      H2M( uncmat, mAerr );
+   } else if (fAdet && fAdet->GetSumw2N()) {
+      mAerr.ResizeTo(fNdim,fNdim);
+      for (Int_t k=0; k<fNdim; k++)
+         for (Int_t m=0; m<fNdim; m++)
+            mAerr(k,m) = fAdet->GetBinError(k+1,m+1);
+   }
+   GetAdetCov( toycov, ntoys, seed, mAerr.GetNrows() ? &mAerr : 0 );
 
-   fMatToyMode = true;
-   TH1D* unfres = 0;
-   TH2D* unfcov = (TH2D*)fAdet->Clone("unfcovmat");
-   unfcov->SetTitle("Toy covariance matrix");
-   for(int i=1; i<=fNdim; i++)
-      for(int j=1; j<=fNdim; j++)
-         unfcov->SetBinContent(i,j,0.);
-
-   //Now the toys for the detector response matrix
-   TRandom3 random(seed);
-
-   fToymat = (TH2D*)fAdet->Clone("toymat");
-   TH1D *toymean = (TH1D*)fXini->Clone("toymean");
-   for (Int_t j=1; j<=fNdim; j++) toymean->SetBinContent(j,0.);
-
-   for (int i=1; i<=ntoys; i++) {    
-      for (Int_t k=1; k<=fNdim; k++) {
-         for (Int_t m=1; m<=fNdim; m++) {
-	   if (fAdet->GetBinContent(k,m)){
-	     if(uncmat)
-	       fToymat->SetBinContent(k, m, fAdet->GetBinContent(k,m)+random.Gaus(0.,uncmat->GetBinContent(k,m)));
-	     else if(fAdet->GetSumw2N())
-	       fToymat->SetBinContent(k, m, fAdet->GetBinContent(k,m)+random.Gaus(0.,fAdet->GetBinError(k,m)));
-	     else 
-	       fToymat->SetBinContent(k, m, random.Poisson(fAdet->GetBinContent(k,m)));
-	   }
-         }
-      }
+   TH2D* unfcov = NewHist2D("unfcovmat", "Toy covariance matrix");
+   M2H( toycov, *unfcov );
+   return unfcov;
+}
 
-      unfres = Unfold(GetKReg());
+//_______________________________________________________________________
+void TSVDUnfold::GetAdetCov( TMatrixD& unfcov, Int_t ntoys, Int_t seed, const TMatrixD* uncmat )
+{
+   //! As GetAdetCovMatrix, with the covariance matrix as a TMatrixD.
+   //! "uncmat" - uncertainties on the detector response matrix elements for Gaussian smearing,
+   //!            otherwise Poisson variations on Adet are used
+   if (uncmat && (uncmat->GetNrows() != fNdim || uncmat->GetNcols() != fNdim)) {
+      TString msg = "Uncertainty matrix must have the same dimension as all other matrices.\n";
+      msg += Form( "  Found: dim(uncmat)=%i,%i\n", uncmat->GetNrows(), uncmat->GetNcols() );
+      msg += Form( "  Found: dim(Adet)=%i,%i\n", fNdim, fNdim );
+      msg += "Please start again!";
+      Fatal( "GetAdetCov", msg, "%s" );
+   }
+   InitDecomposition();
+
+   ToySetup ts;
+   ts.matToys = kTRUE;
+   ts.ntoys   = ntoys;
+   ts.vb.ResizeTo(fNdim);
+   ts.vb = *fVbdat;
+   ts.mA.ResizeTo(fNdim,fNdim);
+   ts.mA = *fMAdet;
+   ts.poisson = !uncmat;
+   ts.mAerr.ResizeTo(fNdim,fNdim);
+   if (uncmat) ts.mAerr = *uncmat;
+
+   CovToys( ts, seed, unfcov );
+}
 
-      for (Int_t j=1; j<=fNdim; j++) {
-         toymean->SetBinContent(j, toymean->GetBinContent(j) + unfres->GetBinContent(j)/ntoys);
+//_______________________________________________________________________
+void TSVDUnfold::CovToys( const ToySetup& ts, Int_t seed, TMatrixD& unfcov )
+{
+   //! Covariance matrix of the unfolded spectrum from the pseudo experiments described by ts.
+   //! The toys are unfolded directly on vectors and matrices, using the cached decomposition of
+   //! the detector response matrix, and their mean and covariance are accumulated in a single pass.
+   //! Each toy has its own random number stream, which only depends on seed and the toy number
+   //! (see RooUnfoldThreads::ToyStreamSeed), so the toys can be shared between several threads (SetNThreads)
+   //! without changing the result.
+   InitDecomposition();
+
+   Int_t ntoys = ts.ntoys;
+   RooUnfoldCovAccumulator acc(fNdim);
+
+   Int_t nthreads = RooUnfoldThreads::NThreads( fNThreads, ntoys );
+   if (nthreads<=1) {
+      ToySums( ts, 0, ntoys, UInt_t(seed), acc );
+   }
+#ifdef ROOUNFOLD_THREADS
+   else {
+      RooUnfoldThreads::EnableThreadSafety();
+      std::vector<RooUnfoldCovAccumulator> accs (nthreads, RooUnfoldCovAccumulator(fNdim));
+      std::vector<std::thread> threads;
+      for (Int_t t=0; t<nthreads; t++) {
+         Int_t first = Int_t ((Long64_t(ntoys)* t   )/nthreads);
+         Int_t last  = Int_t ((Long64_t(ntoys)*(t+1))/nthreads);
+         threads.push_back (std::thread (&TSVDUnfold::ToySums, this, std::cref(ts), first, last,
+                                         UInt_t(seed), std::ref(accs[t])));
       }
-      delete unfres;
-      unfres = 0;
-   }
-
-   // Reset the random seed
-   random.SetSeed(seed);
-
-   for (int i=1; i<=ntoys; i++) {
-      for (Int_t k=1; k<=fNdim; k++) {
-         for (Int_t m=1; m<=fNdim; m++) {
-	   if (fAdet->GetBinContent(k,m)){
-	     if(uncmat)
-	       fToymat->SetBinContent(k, m, fAdet->GetBinContent(k,m)+random.Gaus(0.,uncmat->GetBinContent(k,m)));
-	     else if(fAdet->GetSumw2N())
-	       fToymat->SetBinContent(k, m, fAdet->GetBinContent(k,m)+random.Gaus(0.,fAdet->GetBinError(k,m)));
-	     else 
-	       fToymat->SetBinContent(k, m, random.Poisson(fAdet->GetBinContent(k,m)));
-	   }
-         }
+      for (Int_t t=0; t<nthreads; t++) {
+         threads[t].join();
+         acc.Merge(accs[t]);
       }
+   }
+#endif
 
-      unfres = Unfold(GetKReg());
+   acc.GetCovariance(unfcov);
+}
 
-      for (Int_t j=1; j<=fNdim; j++) {
-         for (Int_t k=1; k<=fNdim; k++) {
-            unfcov->SetBinContent(j,k,unfcov->GetBinContent(j,k) + ( (unfres->GetBinContent(j) - toymean->GetBinContent(j))*(unfres->GetBinContent(k) - toymean->GetBinContent(k))/(ntoys-1)) );
+//_______________________________________________________________________
+void TSVDUnfold::ToySums( const ToySetup& ts, Int_t first, Int_t last, UInt_t seed,
+                          RooUnfoldCovAccumulator& acc ) const
+{
+   //! Unfold pseudo experiments first..last-1 with the last regularisation parameter,
+   //! adding the unfolded spectra to acc.
+   //! Toy number i uses its own random number stream, which depends only on seed and i.
+   //! Only reads the shared members, so several threads can run this at the same time.
+   const Int_t n = fNdim;
+   TRandom3 toyrnd;
+   TRandom3* rnd = &toyrnd;
+   TVectorD vb(ts.vb), g(n), vx(n), vd(n), vdz(n), vw(n);
+   TMatrixD mA;
+   Decomposition toydec;
+   const Decomposition* dec = fDecomp;
+   if (ts.matToys) {
+      mA.ResizeTo(n,n);
+      mA = ts.mA;
+      dec = &toydec;
+   }
+
+   for (Int_t itoy=first; itoy<last; itoy++) {
+      toyrnd.SetSeed( RooUnfoldThreads::ToyStreamSeed( seed, itoy ) );
+
+      if (ts.matToys) {
+         // Vary the detector response matrix
+         for (Int_t k=0; k<n; k++) {
+            for (Int_t m=0; m<n; m++) {
+               Double_t a = ts.mA(k,m);
+               if (a) {
+                  if (ts.poisson) mA(k,m) = rnd->Poisson(a);
+                  else            mA(k,m) = a + rnd->Gaus(0.,ts.mAerr(k,m));
+               }
+            }
+         }
+         Decompose( mA, toydec, fDecomp );
+      } else {
+         // Create a vector of unit Gaussian variables, multiply it by Lt to
+         // introduce the appropriate correlations, and add the measured values
+         for (Int_t k=0; k<n; k++) g(k) = rnd->Gaus(0.,1.);
+         for (Int_t i=0; i<n; i++) {
+            Double_t v = 0;
+            for (Int_t k=0; k<n; k++) v += g(k)*ts.L(k,i);
+            vb(i) = ts.vb(i) + v;
          }
       }
-      delete unfres;
-      unfres = 0;
+
+      Solve( *dec, vb, fKReg, vx, vd, vdz, vw );
+      acc.Add(vx);
    }
-   delete toymean;
-   fMatToyMode = kFALSE;
-   
-   return unfcov;
 }
 
 //_______________________________________________________________________
 TH1D* TSVDUnfold::GetD() const 
 { 
    //! Returns d vector (for choosing appropriate regularisation)
-   for (int i=1; i<=fDHist->GetNbinsX(); i++) {
-      if (fDHist->GetBinContent(i)<0.) fDHist->SetBinContent(i, TMath::Abs(fDHist->GetBinContent(i))); 
-   }
+   if (fVd.GetNrows() != fNdim) return NULL;
+   InitHistos();
+   for (int i=0; i<fNdim; i++) fDHist->SetBinContent(i+1, TMath::Abs(fVd(i)));
    return fDHist; 
 }
 
@@ -605,6 +784,9 @@ TH1D* TSVDUnfold::GetD() const
 TH1D* TSVDUnfold::GetSV() const 
 { 
    //! Returns singular values vector
+   if (!fDecomp) return NULL;
+   InitHistos();
+   V2H(fDecomp->ASV, *fSVHist);
    return fSVHist; 
 }
 
@@ -613,6 +795,10 @@ TH2D* TSVDUnfold::GetXtau() const
 { 
    //! Returns the computed regularized covariance matrix corresponding to total uncertainties on measured spectrum as passed in the constructor.
   //! Note that this covariance matrix will not contain the effects of forced normalization if spectrum is normalized to unit area.
+   ComputeXtau();
+   if (!fHaveXtau) return NULL;
+   InitHistos();
+   M2H(fXtauM, *fXtau);
    return fXtau; 
 }
 
@@ -620,6 +806,10 @@ TH2D* TSVDUnfold::GetXtau() const
 TH2D* TSVDUnfold::GetXinv() const 
 { 
    //! Returns the computed inverse of the covariance matrix
+   const TMatrixD& Xinv = GetXinvMatrix();
+   if (!fHaveXinv) return NULL;
+   InitHistos();
+   M2H(Xinv, *fXinv);
    return fXinv; 
 }
 
@@ -627,9 +817,34 @@ TH2D* TSVDUnfold::GetXinv() const
 TH2D* TSVDUnfold::GetBCov() const 
 { 
    //! Returns the covariance matrix
+   if (!fBcov) {
+      fBcov = NewHist2D("bcov", "Covariance matrix of measured distribution");
+      M2H(*fMBcov, *fBcov);
+   }
    return fBcov; 
 }
 
+//_______________________________________________________________________
+const TMatrixD& TSVDUnfold::GetXtauMatrix() const
+{
+   //! Returns the computed regularized covariance matrix (empty before the first unfolding)
+   ComputeXtau();
+   return fXtauM;
+}
+
+//_______________________________________________________________________
+const TMatrixD& TSVDUnfold::GetXinvMatrix() const
+{
+   //! Returns the computed inverse of the covariance matrix (empty before the first unfolding)
+   if (!fHaveXinv && fDecomp && fZ.GetNrows() == fNdim) {
+      fXinvM.ResizeTo(fNdim, fNdim);
+      fXinvM = fDecomp->Xinv;
+      if (fScale != 1.0) fXinvM *= fScale*fScale;
+      fHaveXinv = kTRUE;
+   }
+   return fXinvM;
+}
+
 //_______________________________________________________________________
 void TSVDUnfold::H2V( const TH1D* histo, TVectorD& vec )
 {
@@ -809,8 +1024,10 @@ void TSVDUnfold::FillCurvatureMatrix( TMatrixD& tCurv, TMatrixD& tC ) const
 }
 
 //_______________________________________________________________________
-void TSVDUnfold::InitHistos( )
+void TSVDUnfold::InitHistos( ) const
 {
+   //! Make the output histograms. They are kept and refilled when requested again.
+   if (fDHist) return;
 
    fDHist = new TH1D( "dd", "d vector after orthogonal transformation", fNdim, 0, fNdim );  
    fDHist->Sumw2();
@@ -818,15 +1035,28 @@ void TSVDUnfold::InitHistos( )
    fSVHist = new TH1D( "sv", "Singular values of AC^-1", fNdim, 0, fNdim );  
    fSVHist->Sumw2();
 
-   fXtau = (TH2D*)fAdet->Clone("Xtau");
-   fXtau->SetTitle("Regularized covariance matrix");  
+   fXtau = NewHist2D("Xtau", "Regularized covariance matrix");
    fXtau->Sumw2();
 
-   fXinv = (TH2D*)fAdet->Clone("Xinv");
-   fXinv->SetTitle("Inverse covariance matrix");  
+   fXinv = NewHist2D("Xinv", "Inverse covariance matrix");
    fXinv->Sumw2();
 }
 
+//_______________________________________________________________________
+TH2D* TSVDUnfold::NewHist2D( const char* name, const char* title ) const
+{
+   //! Make an empty n x n histogram, with the binning of Adet if that was given
+   TH2D* h;
+   if (fAdet) {
+      h = (TH2D*)fAdet->Clone(name);
+      h->Reset();
+      h->SetTitle(title);
+   } else {
+      h = new TH2D( name, title, fNdim, 0, fNdim, fNdim, 0, fNdim );
+   }
+   return h;
+}
+
 //_______________________________________________________________________
 void TSVDUnfold::RegularisedSymMatInvert( TMatrixDSym& mat, Double_t eps )
 {
@@ -887,11 +1117,12 @@ Double_t TSVDUnfold::ComputeChiSquared( const TH1D& truspec, const TH1D& unfspec
    UInt_t n = truspec.GetNbinsX();
 
    // compute chi2
+   const TMatrixD& Xinv = GetXinvMatrix();
    Double_t chi2 = 0;
    for (UInt_t i=0; i<n; i++) {
       for (UInt_t j=0; j<n; j++) {
          chi2 += ( (truspec.GetBinContent( i+1 )-unfspec.GetBinContent( i+1 )) *
-                   (truspec.GetBinContent( j+1 )-unfspec.GetBinContent( j+1 )) * fXinv->GetBinContent(i+1,j+1) );
+                   (truspec.GetBinContent( j+1 )-unfspec.GetBinContent( j+1 )) * Xinv(i,j) );
       }
    }
 
@@ -54,6 +54,7 @@
 
 class TH1D;
 class TH2D;
+class RooUnfoldCovAccumulator;
 
 class TSVDUnfold : public TObject {
 
@@ -68,6 +69,10 @@ public:
    // "Adet" - detector response matrix (number of events)
    TSVDUnfold( const TH1D* bdat, const TH1D* bini, const TH1D* xini, const TH2D* Adet );
    TSVDUnfold( const TH1D* bdat, TH2D* Bcov, const TH1D* bini, const TH1D* xini, const TH2D* Adet );
+   // As above, with the inputs as vectors and matrices, which are used in place (not copied),
+   // so they must be kept unchanged while this object is used. Adet(i,j) is the number of events
+   // with reconstructed bin i and true bin j. bini is not needed.
+   TSVDUnfold( const TVectorD& bdat, const TMatrixD& Bcov, const TVectorD& xini, const TMatrixD& Adet );
    TSVDUnfold( const TSVDUnfold& other );
 
    // Destructor
@@ -79,8 +84,14 @@ public:
 
    // Do the unfolding
    // "kreg"   - number of singular values used (regularisation)
+   // The kreg-independent decomposition is done on the first call and kept,
+   // so that further calls with another kreg only apply the damping factors.
+   // The input histograms must therefore not be changed after the first call.
    TH1D*    Unfold       ( Int_t kreg );
 
+   // As Unfold, returning the unfolded distribution as a vector, which is kept until the next call
+   const TVectorD& UnfoldV ( Int_t kreg );
+
    // Determine for given input error matrix covariance matrix of unfolded 
    // spectrum from toy simulation
    // "cov"    - covariance matrix on the measured spectrum, to be propagated
@@ -95,6 +106,17 @@ public:
    // "uncmat" - matrix containing the uncertainty on the detector matrix elements if different from purely statistical without any weights
    TH2D*    GetAdetCovMatrix( Int_t ntoys, Int_t seed=1, const TH2D* uncmat=0 );
 
+   // As GetUnfoldCovMatrix and GetAdetCovMatrix, filling the matrix unfcov.
+   // Without uncmat, GetAdetCov uses Poisson variations on Adet.
+   void     GetUnfoldCov ( const TMatrixD& cov, TMatrixD& unfcov, Int_t ntoys, Int_t seed = 1 );
+   void     GetAdetCov   ( TMatrixD& unfcov, Int_t ntoys, Int_t seed = 1, const TMatrixD* uncmat = 0 );
+
+   // Number of threads used for the pseudo experiments (0 = all cores).
+   // Each pseudo experiment has its own random number stream, derived from the seed, so the
+   // covariance matrices are the same whatever the number of threads.
+   void     SetNThreads ( Int_t nthreads ) { fNThreads = nthreads; }
+   Int_t    GetNThreads () const { return fNThreads; }
+
    // Regularisation parameter
    Int_t    GetKReg() const { return fKReg; }
 
@@ -113,6 +135,10 @@ public:
    //Obtain the covariance matrix on the data
    TH2D*    GetBCov() const;
 
+   // As GetXtau and GetXinv, without making a histogram
+   const TMatrixD& GetXtauMatrix() const;
+   const TMatrixD& GetXinvMatrix() const;
+
    // Helper functions
    Double_t ComputeChiSquared( const TH1D& truspec, const TH1D& unfspec );
 
@@ -122,7 +148,43 @@ private:
    void            FillCurvatureMatrix( TMatrixD& tCurv, TMatrixD& tC ) const;
    static Double_t GetCurvature       ( const TVectorD& vec, const TMatrixD& curv );
 
-   void            InitHistos  ( );
+   void            InitHistos  ( ) const;
+   TH2D*           NewHist2D   ( const char* name, const char* title ) const;
+   void            LoadInputs  ( );
+   void            InitDecomposition ( );
+
+   // Regularisation-independent part of the unfolding
+   struct Decomposition {
+      TMatrixD mCurv;        // Curvature matrix
+      TMatrixD mCinv;        // Inverse of the second derivative matrix
+      TMatrixD QT;           // Rotation diagonalising the data covariance matrix
+      TVectorD BSV;          // Square roots of the data covariance eigenvalues
+      TMatrixD mA;           // Rescaled detector response matrix
+      TMatrixD UortT;        // Transposed left singular vectors of A*C^-1
+      TMatrixD VortT;        // Transposed right singular vectors of A*C^-1
+      TVectorD ASV;          // Singular values of A*C^-1
+      TMatrixD Vreg;         // C^-1*V
+      TVectorD vxini;        // Truth MC distribution
+      TMatrixD Xinv;         // Inverse covariance matrix (before normalisation)
+   };
+   void            Decompose   ( const TMatrixD& mA, Decomposition& dec, const Decomposition* base = 0 ) const;
+   Double_t        Solve       ( const Decomposition& dec, const TVectorD& vb, Int_t kreg,
+                                 TVectorD& vx, TVectorD& vd, TVectorD& vdz, TVectorD& vw ) const;
+   void            ComputeXtau ( ) const;
+
+   // Inputs of the pseudo experiments for the covariance matrices
+   struct ToySetup {
+      Bool_t   matToys;      // Vary the detector response matrix, otherwise the measured distribution
+      Int_t    ntoys;        // Number of pseudo experiments
+      TVectorD vb;           // Measured distribution
+      TMatrixD L;            // Square root of the covariance matrix to be propagated
+      TMatrixD mA;           // Detector response matrix
+      TMatrixD mAerr;        // Uncertainties on the detector response matrix elements
+      Bool_t   poisson;      // Poisson variations on the detector response matrix
+   };
+   void            CovToys     ( const ToySetup& ts, Int_t seed, TMatrixD& unfcov );
+   void            ToySums     ( const ToySetup& ts, Int_t first, Int_t last, UInt_t seed,
+                                 RooUnfoldCovAccumulator& acc ) const;
 
    // Helper functions
    static void     H2V      ( const TH1D* histo, TVectorD& vec   );
@@ -141,23 +203,41 @@ private:
    Int_t       fDdim;        //! Derivative for curvature matrix
    Bool_t      fNormalize;   //! Normalize unfolded spectrum to 1
    Int_t       fKReg;        //! Regularisation parameter
-   TH1D*       fDHist;       //! Distribution of d (for checking regularization)
-   TH1D*       fSVHist;      //! Distribution of singular values
-   TH2D*       fXtau;        //! Computed regularized covariance matrix
-   TH2D*       fXinv;        //! Computed inverse of covariance matrix
+   mutable TH1D* fDHist;     //! Distribution of d (for checking regularization)
+   mutable TH1D* fSVHist;    //! Distribution of singular values
+   mutable TH2D* fXtau;      //! Computed regularized covariance matrix
+   mutable TH2D* fXinv;      //! Computed inverse of covariance matrix
 
-   // Input histos
+   // Input histos (0 if the vectors and matrices were given)
    const TH1D* fBdat;        // measured distribution (data)
-   TH2D* fBcov;        // covariance matrix of measured distribution (data)
+   mutable TH2D* fBcov;      // covariance matrix of measured distribution (data)
    const TH1D* fBini;        // reconstructed distribution (MC)
    const TH1D* fXini;        // truth distribution (MC)
    const TH2D* fAdet;        // Detector response matrix
 
-   // Evaluation of covariance matrices
-   TH1D*       fToyhisto;    //! Toy MC histogram
-   TH2D*       fToymat;      //! Toy MC detector response matrix
-   Bool_t      fToyMode;     //! Internal switch for covariance matrix propagation
-   Bool_t      fMatToyMode;  //! Internal switch for evaluation of statistical uncertainties from response matrix
+   // Inputs used for the unfolding: either the caller's vectors and matrices, or our copies of the input histos
+   const TVectorD* fVbdat;   //! measured distribution (data)
+   const TMatrixD* fMBcov;   //! covariance matrix of measured distribution (data)
+   const TVectorD* fVxini;   //! truth distribution (MC)
+   const TMatrixD* fMAdet;   //! Detector response matrix
+   TVectorD    fHbdat;       //! Copy of fBdat
+   TMatrixD    fHBcov;       //! Copy of fBcov
+   TVectorD    fHxini;       //! Copy of fXini
+   TMatrixD    fHAdet;       //! Copy of fAdet
+
+   // Results of the last unfolding
+   TVectorD    fVx;          //! Unfolded distribution
+   TVectorD    fVd;          //! d vector
+   mutable TMatrixD fXtauM;  //! Regularized covariance matrix, if fHaveXtau
+   mutable TMatrixD fXinvM;  //! Inverse of covariance matrix, if fHaveXinv
+
+   // Cached decomposition and damping factors for the regularised covariance matrix
+   Decomposition* fDecomp;   //! Decomposition of the detector response matrix
+   TMatrixD    fZ;           //! Squared damping factors of the last unfolding
+   Double_t    fScale;       //! Normalisation of the last unfolding
+   mutable Bool_t fHaveXtau; //! fXtauM is up to date with the last unfolding
+   mutable Bool_t fHaveXinv; //! fXinvM is up to date with the last unfolding
+   Int_t       fNThreads;    //! Number of threads for the pseudo experiments
 
    
    ClassDef( TSVDUnfold, 0 ) // Data unfolding using Singular Value Decomposition (hep-ph/9509307)   
@@ -0,0 +1,16 @@
+#!/bin/bash
+# UnfoldBatch must give the same results and covariance matrices as unfolding each measurement separately
+# (see RooUnfoldTestHarness::CheckBatch), for the methods with their own UnfoldBatch (Bayes, bin-by-bin,
+# invert) and for the default implementation (SVD). Bayes is also checked in incremental mode, where each
+# measurement is an update starting from the previous result.
+status=0
+i=0
+for args in "method=1" "method=2" "method=3" "method=5" "method=5 bincorr=0.3" "method=1 incremental=1"; do
+  i=$((i+1))
+  outfile=RooUnfoldTestBatch$i.ref
+  RooUnfoldTest $args batch=1 draw=0 name=RooUnfoldTestBatch$i > $outfile
+  bash ref/cleanup.sh $outfile
+  grep "^UnfoldBatch" $outfile
+  grep -q "^UnfoldBatch matches Unfold" $outfile || status=1
+done
+exit $status
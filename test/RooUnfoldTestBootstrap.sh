@@ -0,0 +1,21 @@
+#!/bin/bash
+# Toys using bootstrap replicas of the response (nboot, with dosys=1) must be reproducible: running again,
+# or filling the response with RooUnfoldResponseFiller::FillParallel in 4 threads and running the toys in
+# 4 threads, must give the same output, apart from the first line, which echoes the parameters.
+# Asking for more toys than replicas must only run as many toys as replicas, giving the same output again.
+outfile=RooUnfoldTestBootstrap.ref
+args="doerror=3 dosys=1 ntoys=100 toyseed=4357 nboot=100 bootseed=7 verbose=0 draw=0"
+RooUnfoldTest $args name=RooUnfoldTestBootstrap > $outfile
+bash ref/cleanup.sh $outfile
+RooUnfoldTest $args name=RooUnfoldTestBootstrapRerun > RooUnfoldTestBootstrapRerun.ref
+bash ref/cleanup.sh RooUnfoldTestBootstrapRerun.ref
+RooUnfoldTest $args fillmode=2 nthreads=4 name=RooUnfoldTestBootstrap4 > RooUnfoldTestBootstrap4.ref
+bash ref/cleanup.sh RooUnfoldTestBootstrap4.ref
+RooUnfoldTest $args ntoys=150 name=RooUnfoldTestBootstrapMore > RooUnfoldTestBootstrapMore.ref
+bash ref/cleanup.sh RooUnfoldTestBootstrapMore.ref
+status=0
+for other in RooUnfoldTestBootstrapRerun.ref RooUnfoldTestBootstrap4.ref RooUnfoldTestBootstrapMore.ref; do
+  diff <(tail -n +2 $outfile) <(tail -n +2 $other) || status=1
+  bash ref/comparetables.sh $outfile $other || status=1
+done
+exit $status
@@ -0,0 +1,23 @@
+#!/bin/bash
+# RooUnfoldDagostini (method=6) against RooUnfoldBayes (method=1), which implement the same iterations
+# from the same prior: the unfolded results must agree to the printed precision.
+# If ref/RooUnfoldTestDagostini.ref exists, the full output is also compared with it.
+outfile=RooUnfoldTestDagostini.ref
+RooUnfoldTest method=6 > $outfile
+bash ref/cleanup.sh $outfile
+RooUnfoldTest method=1 > RooUnfoldTestDagostini-bayes.ref
+bash ref/cleanup.sh RooUnfoldTestDagostini-bayes.ref
+status=0
+# bin number and unfolded output of each row of the results table
+awk '$1 ~ /^[0-9]+$/ && NF>=8 {print $1, $6}' $outfile > RooUnfoldTestDagostini.reco
+awk '$1 ~ /^[0-9]+$/ && NF>=8 {print $1, $6}' RooUnfoldTestDagostini-bayes.ref > RooUnfoldTestDagostini-bayes.reco
+if [ ! -s RooUnfoldTestDagostini.reco ]; then
+  echo "no results table in $outfile"
+  status=1
+fi
+paste -d' ' RooUnfoldTestDagostini.reco RooUnfoldTestDagostini-bayes.reco |
+  awk '{d=$2-$4; if ($1!=$3 || d>0.11 || d<-0.11) {print "bin " $1 ": Dagostini " $2 ", Bayes " $4; bad=1}} END {exit bad}' || status=1
+if [ -f ref/$outfile ]; then
+  diff $outfile ref/$outfile || status=1
+fi
+exit $status
@@ -0,0 +1,20 @@
+#!/bin/bash
+# Filling the response with RooUnfoldResponse::FillN (fillmode=1) or RooUnfoldResponseFiller::FillParallel
+# (fillmode=2, in 4 threads) must give the same results as Fill/Miss/Fake (fillmode=0): apart from the first
+# line, which echoes the parameters, the outputs must be the same.
+# If ref/RooUnfoldTestFill.ref exists, the fillmode=0 output is also compared with it.
+outfile=RooUnfoldTestFill.ref
+args="addfakes=1 draw=0"
+RooUnfoldTest $args fillmode=0 name=RooUnfoldTestFill > $outfile
+bash ref/cleanup.sh $outfile
+status=0
+for mode in 1 2; do
+  RooUnfoldTest $args fillmode=$mode nthreads=4 name=RooUnfoldTestFill$mode > RooUnfoldTestFill$mode.ref
+  bash ref/cleanup.sh RooUnfoldTestFill$mode.ref
+  diff <(tail -n +2 $outfile) <(tail -n +2 RooUnfoldTestFill$mode.ref) || status=1
+  bash ref/comparetables.sh $outfile RooUnfoldTestFill$mode.ref || status=1
+done
+if [ -f ref/$outfile ]; then
+  diff $outfile ref/$outfile || status=1
+fi
+exit $status
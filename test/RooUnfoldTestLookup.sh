@@ -0,0 +1,12 @@
+#!/bin/bash
+# RooUnfoldBinLookup must find the same bins as TAxis::FindFixBin and TH1::FindFixBin on the measured
+# binning of the 1D and 2D tests, including at bin edges and for NaN and +/-inf (see RooUnfoldTestHarness::CheckLookup).
+status=0
+for test in RooUnfoldTest RooUnfoldTest2D; do
+  outfile=${test}Lookup.ref
+  $test lookup=1 draw=0 name=${test}Lookup > $outfile
+  bash ref/cleanup.sh $outfile
+  grep "^RooUnfoldBinLookup:" $outfile
+  grep -q "^RooUnfoldBinLookup: [0-9]* values checked, 0 differ" $outfile || status=1
+done
+exit $status
@@ -0,0 +1,15 @@
+#!/bin/bash
+# RooUnfoldBayes (method=1) and RooUnfoldInvert (method=5) with SetSparse (sparse=1) must give the same
+# unfolded results and errors as with dense matrices, to the printed precision.
+# Bayes is also checked with the response matrix errors (dosys=1), which sparse mode calculates differently.
+status=0
+for opts in "method=1" "method=1 dosys=1" "method=5"; do
+  name=$(echo "$opts" | tr -d ' =')
+  outfile=RooUnfoldTestSparse$name.ref
+  RooUnfoldTest $opts sparse=0 draw=0 name=RooUnfoldTestDense$name  > RooUnfoldTestDense$name.ref
+  RooUnfoldTest $opts sparse=1 draw=0 name=RooUnfoldTestSparse$name > $outfile
+  bash ref/cleanup.sh RooUnfoldTestDense$name.ref
+  bash ref/cleanup.sh $outfile
+  bash ref/comparetables.sh RooUnfoldTestDense$name.ref $outfile 0.11 || status=1
+done
+exit $status
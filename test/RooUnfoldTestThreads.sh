@@ -0,0 +1,17 @@
+#!/bin/bash
+# Toy errors (doerror=3) with a fixed toy seed must not depend on the number of threads: apart from
+# the first line, which echoes the parameters, the output with nthreads=4 must be the same as with nthreads=1.
+# If ref/RooUnfoldTestThreads.ref exists, the full output is also compared with it.
+outfile=RooUnfoldTestThreads.ref
+args="doerror=3 ntoys=200 toyseed=4357 verbose=0 draw=0"
+RooUnfoldTest $args nthreads=1 name=RooUnfoldTestThreads > $outfile
+bash ref/cleanup.sh $outfile
+RooUnfoldTest $args nthreads=4 name=RooUnfoldTestThreads4 > RooUnfoldTestThreads4.ref
+bash ref/cleanup.sh RooUnfoldTestThreads4.ref
+status=0
+diff <(tail -n +2 $outfile) <(tail -n +2 RooUnfoldTestThreads4.ref) || status=1
+bash ref/comparetables.sh $outfile RooUnfoldTestThreads4.ref || status=1
+if [ -f ref/$outfile ]; then
+  diff $outfile ref/$outfile || status=1
+fi
+exit $status